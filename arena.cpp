@@ -0,0 +1,62 @@
+#include <cstdint>
+#include <cstdlib>
+#include "arena.hpp"
+
+namespace br {
+
+	namespace {
+
+		constexpr std::size_t first_block = 16 * 1024;
+
+		constexpr std::size_t largest_block = 1024 * 1024;
+
+		auto align_up(std::uintptr_t address, std::size_t alignment) noexcept -> std::uintptr_t {
+			return (address + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1);
+		}
+
+	} // namespace
+
+	Arena::Arena() noexcept
+		: m_head(nullptr), m_cursor(nullptr), m_limit(nullptr), m_next_size(first_block),
+		m_objects(0), m_arrays(0), m_elements(0), m_used(0), m_reserved(0), m_blocks(0) {
+	}
+
+	Arena::~Arena() noexcept {
+		while (m_head != nullptr) {
+			auto next = m_head->next;
+			std::free(m_head);
+			m_head = next;
+		}
+	}
+
+	auto Arena::allocate(std::size_t size, std::size_t alignment) -> void * {
+		auto start = align_up(reinterpret_cast<std::uintptr_t>(m_cursor), alignment);
+		if (m_cursor == nullptr || start + size > reinterpret_cast<std::uintptr_t>(m_limit)) {
+			m_grow(size, alignment);
+			start = align_up(reinterpret_cast<std::uintptr_t>(m_cursor), alignment);
+		}
+		auto result = reinterpret_cast<char *>(start);
+		m_used += result + size - m_cursor;
+		m_cursor = result + size;
+		return result;
+	}
+
+	void Arena::m_grow(std::size_t size, std::size_t alignment) {
+		auto needed = sizeof(Block) + alignment + size;
+		auto block_size = m_next_size < needed ? needed : m_next_size;
+		auto block = static_cast<Block *>(std::malloc(block_size));
+		if (block == nullptr) {
+			throw std::bad_alloc();
+		}
+		block->next = m_head;
+		m_head = block;
+		m_cursor = reinterpret_cast<char *>(block + 1);
+		m_limit = reinterpret_cast<char *>(block) + block_size;
+		m_reserved += block_size;
+		++m_blocks;
+		if (m_next_size < largest_block) {
+			m_next_size *= 2;
+		}
+	}
+
+} // namespace br
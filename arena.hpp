@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace br {
+
+	template< typename T >
+	class List;
+
+	/// Fixed-size sequence stored contiguously in an Arena.
+	template< typename T >
+	class Array {
+	public:
+		Array() noexcept : m_data(nullptr), m_size(0) {
+		}
+
+		Array(T * data, std::size_t size) noexcept : m_data(data), m_size(size) {
+		}
+
+		auto begin() const noexcept -> T const * {
+			return m_data;
+		}
+
+		auto end() const noexcept -> T const * {
+			return m_data + m_size;
+		}
+
+		auto begin() noexcept -> T * {
+			return m_data;
+		}
+
+		auto end() noexcept -> T * {
+			return m_data + m_size;
+		}
+
+		auto size() const noexcept -> std::size_t {
+			return m_size;
+		}
+
+		auto empty() const noexcept -> bool {
+			return m_size == 0;
+		}
+
+		auto front() const noexcept -> T const & {
+			return m_data[0];
+		}
+
+		auto back() const noexcept -> T const & {
+			return m_data[m_size - 1];
+		}
+
+		auto operator[](std::size_t index) const noexcept -> T const & {
+			return m_data[index];
+		}
+
+		auto operator[](std::size_t index) noexcept -> T & {
+			return m_data[index];
+		}
+
+	private:
+		T * m_data;
+		std::size_t m_size;
+	}; // class Array
+
+	/** \brief Bump allocator owning a syntax tree.
+	 **
+	 ** Memory is carved out of geometrically growing blocks and released all at once when the arena
+	 ** is destroyed. Destructors of objects made here never run, so they must only own memory that
+	 ** lives in the same arena (or nothing at all).
+	 */
+	class Arena {
+	public:
+		Arena() noexcept;
+
+		Arena(Arena const &) = delete;
+
+		auto operator=(Arena const &) -> Arena & = delete;
+
+		~Arena() noexcept;
+
+		auto allocate(std::size_t size, std::size_t alignment) -> void *;
+
+		template< typename T, typename ... TArgs >
+		auto make(TArgs && ... args) -> T * {
+			++m_objects;
+			return new(allocate(sizeof(T), alignof(T))) T(std::forward<TArgs>(args)...);
+		}
+
+		/// Copy the elements of \a list into one contiguous array.
+		template< typename T >
+		auto array(List<T> const & list) -> Array<T>;
+
+		/// Copy \a size elements starting at \a data into the arena.
+		template< typename T >
+		auto array(T const * data, std::size_t size) -> Array<T>;
+
+		/// Objects made with make().
+		auto objects() const noexcept -> std::size_t {
+			return m_objects;
+		}
+
+		/// Arrays made with array(), and their total number of elements.
+		auto arrays() const noexcept -> std::size_t {
+			return m_arrays;
+		}
+
+		auto elements() const noexcept -> std::size_t {
+			return m_elements;
+		}
+
+		/// Bytes handed out, including alignment padding.
+		auto used() const noexcept -> std::size_t {
+			return m_used;
+		}
+
+		/// Bytes obtained from the heap, and in how many blocks.
+		auto reserved() const noexcept -> std::size_t {
+			return m_reserved;
+		}
+
+		auto blocks() const noexcept -> std::size_t {
+			return m_blocks;
+		}
+
+	private:
+		struct Block {
+			Block * next;
+		};
+
+		void m_grow(std::size_t size, std::size_t alignment);
+
+		Block * m_head;
+		char * m_cursor;
+		char * m_limit;
+		std::size_t m_next_size;
+		std::size_t m_objects, m_arrays, m_elements;
+		std::size_t m_used, m_reserved, m_blocks;
+	}; // class Arena
+
+	/// Singly-linked list built in an Arena while its final length is unknown, e.g. during parsing.
+	template< typename T >
+	class List {
+	public:
+		struct Link {
+			T value;
+			Link * next;
+		};
+
+		List() noexcept : m_head(nullptr), m_tail(nullptr), m_size(0) {
+		}
+
+		void push_back(Arena & arena, T const & value) {
+			auto link = new(arena.allocate(sizeof(Link), alignof(Link))) Link{value, nullptr};
+			if (m_tail != nullptr) {
+				m_tail->next = link;
+			} else {
+				m_head = link;
+			}
+			m_tail = link;
+			++m_size;
+		}
+
+		auto head() const noexcept -> Link const * {
+			return m_head;
+		}
+
+		auto size() const noexcept -> std::size_t {
+			return m_size;
+		}
+
+	private:
+		Link * m_head;
+		Link * m_tail;
+		std::size_t m_size;
+	}; // class List
+
+	template< typename T >
+	auto Arena::array(List<T> const & list) -> Array<T> {
+		if (list.size() == 0) {
+			return Array<T>();
+		}
+		auto data = static_cast<T *>(allocate(sizeof(T) * list.size(), alignof(T)));
+		auto cursor = data;
+		for (auto link = list.head(); link != nullptr; link = link->next) {
+			new(cursor++) T(link->value);
+		}
+		++m_arrays;
+		m_elements += list.size();
+		return Array<T>(data, list.size());
+	}
+
+	template< typename T >
+	auto Arena::array(T const * data, std::size_t size) -> Array<T> {
+		if (size == 0) {
+			return Array<T>();
+		}
+		auto copy = static_cast<T *>(allocate(sizeof(T) * size, alignof(T)));
+		for (std::size_t i = 0; i < size; ++i) {
+			new(copy + i) T(data[i]);
+		}
+		++m_arrays;
+		m_elements += size;
+		return Array<T>(copy, size);
+	}
+
+} // namespace br
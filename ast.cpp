@@ -1,62 +1,235 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
 #include "ast.hpp"
+#include "batch.hpp"
+#include "builtin.hpp"
+#include "context.hpp"
+#include "jit.hpp"
+#include "parallel.hpp"
 
 namespace br {
 
+	auto spelling(UnaryOperator op) noexcept -> char const * {
+		static char const * const spellings[] = {"!", "+", "-"};
+		return spellings[static_cast<std::size_t>(op)];
+	}
+
+	auto spelling(BinaryOperator op) noexcept -> char const * {
+		static char const * const spellings[] = {"||", "&&", "==", "!=", "<", ">", "<=", ">=", "+", "-", "*", "/", "%", "**"};
+		return spellings[static_cast<std::size_t>(op)];
+	}
+
+	Visitor::~Visitor() noexcept {
+	}
+
+	Walker::~Walker() noexcept {
+	}
+
+	void Walker::visit(Variable const & node) {
+	}
+
+	void Walker::visit(Constant const & node) {
+	}
+
+	void Walker::visit(Numeric const & node) {
+	}
+
+	void Walker::visit(Boolean const & node) {
+	}
+
+	void Walker::visit(Vector const & node) {
+		node.x().accept(*this);
+		node.y().accept(*this);
+	}
+
+	void Walker::visit(FunctionCall const & node) {
+		node.func().accept(*this);
+		for (auto const & arg : node.args()) {
+			arg->accept(*this);
+		}
+	}
+
+	void Walker::visit(ArrayAccess const & node) {
+		node.var().accept(*this);
+		node.index().accept(*this);
+	}
+
+	void Walker::visit(UnaryOperation const & node) {
+		node.rhs().accept(*this);
+	}
+
+	void Walker::visit(BinaryOperation const & node) {
+		node.lhs().accept(*this);
+		node.rhs().accept(*this);
+	}
+
+	void Walker::visit(EmptyStatement const & node) {
+	}
+
+	void Walker::visit(CompoundStatement const & node) {
+		for (auto const & statement : node.stmts()) {
+			statement->accept(*this);
+		}
+	}
+
+	void Walker::visit(Program const & node) {
+		for (auto const & statement : node.stmts()) {
+			statement->accept(*this);
+		}
+	}
+
+	void Walker::visit(ConditionalStatement const & node) {
+		node.cond().accept(*this);
+		node.when_true().accept(*this);
+		node.when_false().accept(*this);
+	}
+
+	void Walker::visit(WhileStatement const & node) {
+		node.cond().accept(*this);
+		node.body().accept(*this);
+	}
+
+	void Walker::visit(UntilStatement const & node) {
+		node.cond().accept(*this);
+		node.body().accept(*this);
+	}
+
+	void Walker::visit(ForStatement const & node) {
+		node.from().accept(*this);
+		node.to().accept(*this);
+		node.step().accept(*this);
+		node.body().accept(*this);
+	}
+
+	void Walker::visit(AssignStatement const & node) {
+		node.expr().accept(*this);
+	}
+
+	void Walker::visit(ExpressionStatement const & node) {
+		node.expr().accept(*this);
+	}
+
+	namespace {
+
+		class Assigned : public Walker {
+		public:
+			std::vector<std::uint32_t> slots;
+
+			using Walker::visit;
+
+			virtual void visit(ForStatement const & node) override {
+				slots.push_back(node.slot());
+				Walker::visit(node);
+			}
+
+			virtual void visit(AssignStatement const & node) override {
+				slots.push_back(node.slot());
+				Walker::visit(node);
+			}
+		};
+
+	} // namespace
+
+	auto assigned_slots(Statement const & statement) -> std::vector<std::uint32_t> {
+		Assigned assigned;
+		statement.accept(assigned);
+		return std::move(assigned.slots);
+	}
+
+	Rewriter::~Rewriter() noexcept {
+	}
+
 	Node::~Node() noexcept {
 	}
 
 	Expression::~Expression() noexcept {
 	}
 
+	void Expression::invoke(Context & context) const {
+		evaluate(context);
+	}
+
 	Variable::~Variable() noexcept {
 	}
 
-	void Variable::invoke() const {
-		// TODO: m_id;
+	auto Variable::evaluate(Context & context) const -> Value {
+		return context.lookup(*m_symbol);
 	}
 
 	void Variable::print(std::ostream & ostream, std::size_t indent) const {
-		ostream << std::string(indent, '\t') << "<Variable>: " << m_id << std::endl;
+		ostream << std::string(indent, '\t') << "<Variable>: " << *m_id << std::endl;
+	}
+
+	void Variable::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void Variable::rewrite(Rewriter & rewriter) {
 	}
 
 	Constant::~Constant() noexcept {
 	}
 
-	void Constant::invoke() const {
-		// TODO: m_id;
+	auto Constant::evaluate(Context & context) const -> Value {
+		return *m_value;
 	}
 
 	void Constant::print(std::ostream & ostream, std::size_t indent) const {
-		ostream << std::string(indent, '\t') << "<Constant>: " << m_id << std::endl;
+		ostream << std::string(indent, '\t') << "<Constant>: " << *m_id << std::endl;
+	}
+
+	void Constant::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void Constant::rewrite(Rewriter & rewriter) {
 	}
 
 	Numeric::~Numeric() noexcept {
 	}
 
-	void Numeric::invoke() const {
-		// TODO: m_value;
+	auto Numeric::evaluate(Context & context) const -> Value {
+		return m_value;
 	}
 
 	void Numeric::print(std::ostream & ostream, std::size_t indent) const {
 		ostream << std::string(indent, '\t') << "<Numeric>: " << m_value << std::endl;
 	}
 
+	void Numeric::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void Numeric::rewrite(Rewriter & rewriter) {
+	}
+
 	Boolean::~Boolean() noexcept {
 	}
 
-	void Boolean::invoke() const {
-		// TODO: m_value;
+	auto Boolean::evaluate(Context & context) const -> Value {
+		return m_value;
 	}
 
 	void Boolean::print(std::ostream & ostream, std::size_t indent) const {
 		ostream << std::string(indent, '\t') << "<Boolean>: " << std::boolalpha << m_value << std::endl;
 	}
 
+	void Boolean::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void Boolean::rewrite(Rewriter & rewriter) {
+	}
+
 	Vector::~Vector() noexcept {
 	}
 
-	void Vector::invoke() const {
-		// TODO: (m_x, m_y);
+	auto Vector::evaluate(Context & context) const -> Value {
+		auto x = expect_number(m_x->evaluate(context), "vector x");
+		auto y = expect_number(m_y->evaluate(context), "vector y");
+		return Value(x, y);
 	}
 
 	void Vector::print(std::ostream & ostream, std::size_t indent) const {
@@ -65,26 +238,53 @@ namespace br {
 		m_y->print(ostream, indent + 1);
 	}
 
+	void Vector::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void Vector::rewrite(Rewriter & rewriter) {
+		m_x = rewriter.rewrite(m_x);
+		m_y = rewriter.rewrite(m_y);
+	}
+
 	FunctionCall::~FunctionCall() noexcept {
 	}
 
-	void FunctionCall::invoke() const {
-		// TODO: m_id(m_args);
+	auto FunctionCall::evaluate(Context & context) const -> Value {
+		auto builtin = expect_function(m_func->evaluate(context), m_args.size());
+		Value arguments[max_arity];
+		auto argument = arguments;
+		for (auto const & arg : m_args) {
+			*argument++ = arg->evaluate(context);
+		}
+		return builtin->callback(context, arguments);
 	}
 
 	void FunctionCall::print(std::ostream & ostream, std::size_t indent) const {
 		ostream << std::string(indent, '\t') << "<FunctionCall>: " << std::endl;
 		m_func->print(ostream, indent + 1);
-		for (auto const & arg : *m_args) {
+		for (auto const & arg : m_args) {
 			arg->print(ostream, indent + 1);
 		}
 	}
 
+	void FunctionCall::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void FunctionCall::rewrite(Rewriter & rewriter) {
+		m_func = rewriter.rewrite(m_func);
+		for (auto & arg : m_args) {
+			arg = rewriter.rewrite(arg);
+		}
+	}
+
 	ArrayAccess::~ArrayAccess() noexcept {
 	}
 
-	void ArrayAccess::invoke() const {
-		// TODO: m_var(m_indes);
+	auto ArrayAccess::evaluate(Context & context) const -> Value {
+		auto var = m_var->evaluate(context);
+		return br::index(var, m_index->evaluate(context));
 	}
 
 	void ArrayAccess::print(std::ostream & ostream, std::size_t indent) const {
@@ -93,81 +293,184 @@ namespace br {
 		m_index->print(ostream, indent + 1);
 	}
 
+	void ArrayAccess::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void ArrayAccess::rewrite(Rewriter & rewriter) {
+		m_var = rewriter.rewrite(m_var);
+		m_index = rewriter.rewrite(m_index);
+	}
+
 	UnaryOperation::~UnaryOperation() noexcept {
 	}
 
-	void UnaryOperation::invoke() const {
-		// TODO: m_op m_arg;
+	auto UnaryOperation::evaluate(Context & context) const -> Value {
+		auto rhs = m_rhs->evaluate(context);
+		switch (m_op) {
+			case UnaryOperator::Not:
+				return logical_not(rhs);
+			case UnaryOperator::Plus:
+				return promote(rhs);
+			case UnaryOperator::Minus:
+				return negate(rhs);
+		}
+		throw RuntimeError("unknown unary operator");
 	}
 
 	void UnaryOperation::print(std::ostream & ostream, std::size_t indent) const {
-		ostream << std::string(indent, '\t') << "<UnaryOperation>: @" << m_op << std::endl;
+		ostream << std::string(indent, '\t') << "<UnaryOperation>: @" << spelling(m_op) << std::endl;
 		m_rhs->print(ostream, indent + 1);
 	}
 
+	void UnaryOperation::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void UnaryOperation::rewrite(Rewriter & rewriter) {
+		m_rhs = rewriter.rewrite(m_rhs);
+	}
+
 	BinaryOperation::~BinaryOperation() noexcept {
 	}
 
-	void BinaryOperation::invoke() const {
-		// TODO: m_lhs m_op m_rhs
+	auto BinaryOperation::evaluate(Context & context) const -> Value {
+		auto lhs = m_lhs->evaluate(context);
+		if (m_op == BinaryOperator::And) {
+			return expect_boolean(lhs, "left operand of '&&'") && expect_boolean(m_rhs->evaluate(context), "right operand of '&&'");
+		}
+		if (m_op == BinaryOperator::Or) {
+			return expect_boolean(lhs, "left operand of '||'") || expect_boolean(m_rhs->evaluate(context), "right operand of '||'");
+		}
+		auto rhs = m_rhs->evaluate(context);
+		switch (m_op) {
+			case BinaryOperator::Or:
+			case BinaryOperator::And:
+				break;
+			case BinaryOperator::Equal:
+				return equal(lhs, rhs);
+			case BinaryOperator::NotEqual:
+				return !equal(lhs, rhs);
+			case BinaryOperator::Less:
+				return less(lhs, rhs);
+			case BinaryOperator::Greater:
+				return greater(lhs, rhs);
+			case BinaryOperator::LessEqual:
+				return less_equal(lhs, rhs);
+			case BinaryOperator::GreaterEqual:
+				return greater_equal(lhs, rhs);
+			case BinaryOperator::Add:
+				return add(lhs, rhs);
+			case BinaryOperator::Subtract:
+				return subtract(lhs, rhs);
+			case BinaryOperator::Multiply:
+				return multiply(lhs, rhs);
+			case BinaryOperator::Divide:
+				return divide(lhs, rhs);
+			case BinaryOperator::Modulo:
+				return modulo(lhs, rhs);
+			case BinaryOperator::Power:
+				return power(lhs, rhs);
+		}
+		throw RuntimeError("unknown binary operator");
 	}
 
 	void BinaryOperation::print(std::ostream & ostream, std::size_t indent) const {
-		ostream << std::string(indent, '\t') << "<BinaryOperation>: $" << m_op << std::endl;
+		ostream << std::string(indent, '\t') << "<BinaryOperation>: $" << spelling(m_op) << std::endl;
 		m_lhs->print(ostream, indent + 1);
 		m_rhs->print(ostream, indent + 1);
 	}
 
+	void BinaryOperation::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void BinaryOperation::rewrite(Rewriter & rewriter) {
+		m_lhs = rewriter.rewrite(m_lhs);
+		m_rhs = rewriter.rewrite(m_rhs);
+	}
+
 	Statement::~Statement() noexcept {
 	}
 
 	EmptyStatement::~EmptyStatement() noexcept {
 	}
 
-	void EmptyStatement::invoke() const {
+	void EmptyStatement::invoke(Context & context) const {
 	}
 
 	void EmptyStatement::print(std::ostream & ostream, std::size_t indent) const {
 		ostream << std::string(indent, '\t') << "<EmptyStatement>" << std::endl;
 	}
 
+	void EmptyStatement::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void EmptyStatement::rewrite(Rewriter & rewriter) {
+	}
+
 	CompoundStatement::~CompoundStatement() noexcept {
 	}
 
-	void CompoundStatement::invoke() const {
-		for (auto const & statement : *m_stmts) {
-			statement->invoke();
+	void CompoundStatement::invoke(Context & context) const {
+		for (auto const & statement : m_stmts) {
+			statement->invoke(context);
 		}
 	}
 
 	void CompoundStatement::print(std::ostream & ostream, std::size_t indent) const {
 		ostream << std::string(indent, '\t') << "<CompoundStatement>" << std::endl;
-		for (auto const & statement : *m_stmts) {
+		for (auto const & statement : m_stmts) {
 			statement->print(ostream, indent + 1);
 		}
 	}
 
+	void CompoundStatement::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void CompoundStatement::rewrite(Rewriter & rewriter) {
+		for (auto & statement : m_stmts) {
+			statement = rewriter.rewrite(statement);
+		}
+	}
+
 	Program::~Program() noexcept {
 	}
 
-	void Program::invoke() const {
-		for (auto const & statement : *m_stmts) {
-			statement->invoke();
+	void Program::invoke(Context & context) const {
+		for (auto const & statement : m_stmts) {
+			statement->invoke(context);
 		}
 	}
 
 	void Program::print(std::ostream & ostream, std::size_t indent) const {
 		ostream << std::string(indent, '\t') << "<Program>" << std::endl;
-		for (auto const & statement : *m_stmts) {
+		for (auto const & statement : m_stmts) {
 			statement->print(ostream, indent + 1);
 		}
 	}
 
+	void Program::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void Program::rewrite(Rewriter & rewriter) {
+		for (auto & statement : m_stmts) {
+			statement = rewriter.rewrite(statement);
+		}
+	}
+
 	ConditionalStatement::~ConditionalStatement() noexcept {
 	}
 
-	void ConditionalStatement::invoke() const {
-		// TODO: if (m_cond) { m_when_true } else { m_when_false }
+	void ConditionalStatement::invoke(Context & context) const {
+		if (expect_boolean(m_cond->evaluate(context), "condition")) {
+			m_when_true->invoke(context);
+		} else {
+			m_when_false->invoke(context);
+		}
 	}
 
 	void ConditionalStatement::print(std::ostream & ostream, std::size_t indent) const {
@@ -177,11 +480,23 @@ namespace br {
 		m_when_false->print(ostream, indent + 1);
 	}
 
+	void ConditionalStatement::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void ConditionalStatement::rewrite(Rewriter & rewriter) {
+		m_cond = rewriter.rewrite(m_cond);
+		m_when_true = rewriter.rewrite(m_when_true);
+		m_when_false = rewriter.rewrite(m_when_false);
+	}
+
 	WhileStatement::~WhileStatement() noexcept {
 	}
 
-	void WhileStatement::invoke() const {
-		// TODO: while (m_cond) { m_body }
+	void WhileStatement::invoke(Context & context) const {
+		while (expect_boolean(m_cond->evaluate(context), "condition")) {
+			m_body->invoke(context);
+		}
 	}
 
 	void WhileStatement::print(std::ostream & ostream, std::size_t indent) const {
@@ -190,11 +505,22 @@ namespace br {
 		m_body->print(ostream, indent + 1);
 	}
 
+	void WhileStatement::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void WhileStatement::rewrite(Rewriter & rewriter) {
+		m_cond = rewriter.rewrite(m_cond);
+		m_body = rewriter.rewrite(m_body);
+	}
+
 	UntilStatement::~UntilStatement() noexcept {
 	}
 
-	void UntilStatement::invoke() const {
-		// TODO: until (m_cond) { m_body }
+	void UntilStatement::invoke(Context & context) const {
+		while (!expect_boolean(m_cond->evaluate(context), "condition")) {
+			m_body->invoke(context);
+		}
 	}
 
 	void UntilStatement::print(std::ostream & ostream, std::size_t indent) const {
@@ -203,38 +529,124 @@ namespace br {
 		m_body->print(ostream, indent + 1);
 	}
 
+	void UntilStatement::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void UntilStatement::rewrite(Rewriter & rewriter) {
+		m_cond = rewriter.rewrite(m_cond);
+		m_body = rewriter.rewrite(m_body);
+	}
+
 	ForStatement::~ForStatement() noexcept {
 	}
 
-	void ForStatement::invoke() const {
-		// TODO
+	void ForStatement::invoke(Context & context) const {
+		auto from = expect_number(m_from->evaluate(context), "for-from");
+		auto to = expect_number(m_to->evaluate(context), "for-to");
+		auto step = expect_number(m_step->evaluate(context), "for-step");
+		if (!(step != 0)) {
+			throw RuntimeError("for-step must be non-zero");
+		}
+		if (context.sampler() != nullptr && context.sampler()->execute(*this, from, to, step, context)) {
+			return;
+		}
+		if (context.batch() && execute_batch(*this, from, to, step, context)) {
+			return;
+		}
+		if (context.parallel() != nullptr && context.parallel()->execute(*this, from, to, step, context)) {
+			return;
+		}
+		if (context.jit() != nullptr && context.jit()->execute(*this, from, to, step, context)) {
+			return;
+		}
+		auto count = trip_count(from, to, step);
+		auto exact = exact_steps(from, step, count);
+		auto value = from;
+		for (std::uint64_t i = 1; i <= count; ++i) {
+			context.assign(m_slot, value);
+			m_body->invoke(context);
+			value = exact ? value + step : from + static_cast<double>(i) * step;
+		}
+	}
+
+	auto ForStatement::trip_count(double from, double to, double step) noexcept -> std::uint64_t {
+		if (!in_range(from, to, step)) {
+			return 0;
+		}
+		auto estimate = std::floor((to - from) / step);
+		if (!(estimate < 4503599627370496.0)) {
+			return std::numeric_limits<std::uint64_t>::max();
+		}
+		// The estimate is rounded, so it may be off by one either way.
+		auto count = static_cast<std::uint64_t>(std::max(estimate, 0.0)) + 1;
+		while (count > 1 && !in_range(from + static_cast<double>(count - 1) * step, to, step)) {
+			--count;
+		}
+		while (in_range(from + static_cast<double>(count) * step, to, step)) {
+			++count;
+		}
+		return count;
+	}
+
+	auto ForStatement::exact_steps(double from, double step, std::uint64_t count) noexcept -> bool {
+		// Half of 2^53, to leave room for the rounding of the bound itself.
+		auto const limit = 4503599627370496.0;
+		auto bound = std::fabs(from) + static_cast<double>(count) * std::fabs(step);
+		for (int k = 0; k <= 64 && std::ldexp(bound, k) < limit; ++k) {
+			auto x = std::ldexp(from, k);
+			auto y = std::ldexp(step, k);
+			if (std::trunc(x) == x && std::trunc(y) == y) {
+				return true;
+			}
+		}
+		return false;
 	}
 
 	void ForStatement::print(std::ostream & ostream, std::size_t indent) const {
-		ostream << std::string(indent, '\t') << "<ForStatement>: " << m_id << std::endl;
+		ostream << std::string(indent, '\t') << "<ForStatement>: " << *m_id << std::endl;
 		m_from->print(ostream, indent + 1);
 		m_to->print(ostream, indent + 1);
 		m_step->print(ostream, indent + 1);
 		m_body->print(ostream, indent + 1);
 	}
 
+	void ForStatement::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void ForStatement::rewrite(Rewriter & rewriter) {
+		m_from = rewriter.rewrite(m_from);
+		m_to = rewriter.rewrite(m_to);
+		m_step = rewriter.rewrite(m_step);
+		m_body = rewriter.rewrite(m_body);
+	}
+
 	AssignStatement::~AssignStatement() noexcept {
 	}
 
-	void AssignStatement::invoke() const {
-		// TODO: m_id = m_expr
+	void AssignStatement::invoke(Context & context) const {
+		context.assign(m_slot, m_expr->evaluate(context));
 	}
 
 	void AssignStatement::print(std::ostream & ostream, std::size_t indent) const {
-		ostream << std::string(indent, '\t') << "<AssignStatement>: " << m_id << std::endl;
+		ostream << std::string(indent, '\t') << "<AssignStatement>: " << *m_id << std::endl;
 		m_expr->print(ostream, indent + 1);
 	}
 
+	void AssignStatement::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void AssignStatement::rewrite(Rewriter & rewriter) {
+		m_expr = rewriter.rewrite(m_expr);
+	}
+
 	ExpressionStatement::~ExpressionStatement() noexcept {
 	}
 
-	void ExpressionStatement::invoke() const {
-		// TODO: m_expr
+	void ExpressionStatement::invoke(Context & context) const {
+		m_expr->evaluate(context);
 	}
 
 	void ExpressionStatement::print(std::ostream & ostream, std::size_t indent) const {
@@ -242,4 +654,12 @@ namespace br {
 		m_expr->print(ostream, indent + 1);
 	}
 
+	void ExpressionStatement::accept(Visitor & visitor) const {
+		visitor.visit(*this);
+	}
+
+	void ExpressionStatement::rewrite(Rewriter & rewriter) {
+		m_expr = rewriter.rewrite(m_expr);
+	}
+
 } // namespace br
\ No newline at end of file
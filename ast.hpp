@@ -1,59 +1,285 @@
 #pragma once
 
-#include <list>
+#include <cstdint>
 #include <memory>
 #include <ostream>
 #include <string>
-#include <boost/type_erasure/any.hpp>
+#include <unordered_set>
+#include <vector>
+#include "arena.hpp"
+#include "location.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
 
 namespace br {
 
+	class Context;
+
+	class Variable;
+	class Constant;
+	class Numeric;
+	class Boolean;
+	class Vector;
+	class FunctionCall;
+	class ArrayAccess;
+	class UnaryOperation;
+	class BinaryOperation;
+	class EmptyStatement;
+	class CompoundStatement;
+	class Program;
+	class ConditionalStatement;
+	class WhileStatement;
+	class UntilStatement;
+	class ForStatement;
+	class AssignStatement;
+	class ExpressionStatement;
+
+	/// Double dispatch over the concrete node types.
+	class Visitor {
+	public:
+		virtual ~Visitor() noexcept;
+
+		virtual void visit(Variable const & node) = 0;
+
+		virtual void visit(Constant const & node) = 0;
+
+		virtual void visit(Numeric const & node) = 0;
+
+		virtual void visit(Boolean const & node) = 0;
+
+		virtual void visit(Vector const & node) = 0;
+
+		virtual void visit(FunctionCall const & node) = 0;
+
+		virtual void visit(ArrayAccess const & node) = 0;
+
+		virtual void visit(UnaryOperation const & node) = 0;
+
+		virtual void visit(BinaryOperation const & node) = 0;
+
+		virtual void visit(EmptyStatement const & node) = 0;
+
+		virtual void visit(CompoundStatement const & node) = 0;
+
+		virtual void visit(Program const & node) = 0;
+
+		virtual void visit(ConditionalStatement const & node) = 0;
+
+		virtual void visit(WhileStatement const & node) = 0;
+
+		virtual void visit(UntilStatement const & node) = 0;
+
+		virtual void visit(ForStatement const & node) = 0;
+
+		virtual void visit(AssignStatement const & node) = 0;
+
+		virtual void visit(ExpressionStatement const & node) = 0;
+	};
+
+	/// Visitor that walks every child in evaluation order; override the nodes of interest.
+	class Walker : public Visitor {
+	public:
+		virtual ~Walker() noexcept;
+
+		virtual void visit(Variable const & node) override;
+
+		virtual void visit(Constant const & node) override;
+
+		virtual void visit(Numeric const & node) override;
+
+		virtual void visit(Boolean const & node) override;
+
+		virtual void visit(Vector const & node) override;
+
+		virtual void visit(FunctionCall const & node) override;
+
+		virtual void visit(ArrayAccess const & node) override;
+
+		virtual void visit(UnaryOperation const & node) override;
+
+		virtual void visit(BinaryOperation const & node) override;
+
+		virtual void visit(EmptyStatement const & node) override;
+
+		virtual void visit(CompoundStatement const & node) override;
+
+		virtual void visit(Program const & node) override;
+
+		virtual void visit(ConditionalStatement const & node) override;
+
+		virtual void visit(WhileStatement const & node) override;
+
+		virtual void visit(UntilStatement const & node) override;
+
+		virtual void visit(ForStatement const & node) override;
+
+		virtual void visit(AssignStatement const & node) override;
+
+		virtual void visit(ExpressionStatement const & node) override;
+	};
+
+	class Expression;
+	class Statement;
+
+	/// The slots \a statement may assign, including in nested statements and as loop variables, in walking order.
+	auto assigned_slots(Statement const & statement) -> std::vector<std::uint32_t>;
+
+	/// Replaces nodes of a tree; see Node::rewrite().
+	class Rewriter {
+	public:
+		virtual ~Rewriter() noexcept;
+
+		/// \return the node to put in place of \a node, possibly \a node itself
+		virtual auto rewrite(Expression * node) -> Expression * = 0;
+
+		virtual auto rewrite(Statement * node) -> Statement * = 0;
+	};
+
+	/// Source region of a node, as byte offsets into the file of its program.
+	struct Span {
+		constexpr Span() noexcept : begin(0), end(0) {
+		}
+
+		Span(Location const & location) noexcept : begin(location.begin.offset), end(location.end.offset) {
+		}
+
+		auto location(std::uint32_t file) const noexcept -> Location {
+			return Location(Position(file, begin), Position(file, end));
+		}
+
+		std::uint32_t begin, end;
+	};
+
+	enum class UnaryOperator : std::uint8_t {
+		Not,
+		Plus,
+		Minus,
+	};
+
+	enum class BinaryOperator : std::uint8_t {
+		Or,
+		And,
+		Equal,
+		NotEqual,
+		Less,
+		Greater,
+		LessEqual,
+		GreaterEqual,
+		Add,
+		Subtract,
+		Multiply,
+		Divide,
+		Modulo,
+		Power,
+	};
+
+	/// How an operator is written in the source, e.g. "**".
+	auto spelling(UnaryOperator op) noexcept -> char const *;
+
+	auto spelling(BinaryOperator op) noexcept -> char const *;
+
 	class Node {
 	public:
 		virtual ~Node() noexcept;
 
-		virtual void invoke() const = 0;
+		auto span() const noexcept -> Span {
+			return m_span;
+		}
+
+		void span(Span span) noexcept {
+			m_span = span;
+		}
+
+		virtual void invoke(Context & context) const = 0;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const = 0;
+
+		virtual void accept(Visitor & visitor) const = 0;
+
+		/// Replace each direct child with what \a rewriter returns for it.
+		virtual void rewrite(Rewriter & rewriter) = 0;
+
+	private:
+		Span m_span;
 	};
 
 	class Expression : public Node {
 	public:
 		virtual ~Expression() noexcept;
+
+		virtual void invoke(Context & context) const override final;
+
+		virtual auto evaluate(Context & context) const -> Value = 0;
 	};
 
 	class Variable : public Expression {
 	public:
 		Variable(
-			std::string const & id
-		) noexcept : m_id(id) {
+			std::string const * id
+		) noexcept : m_id(id), m_symbol(nullptr) {
 		}
 
 		virtual ~Variable() noexcept;
 
-		virtual void invoke() const override;
+		virtual auto evaluate(Context & context) const -> Value override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto id() const noexcept -> std::string const & {
+			return *m_id;
+		}
+
+		/// What the name refers to; nullptr until bind() runs.
+		auto symbol() const noexcept -> Symbol const * {
+			return m_symbol;
+		}
+
+		void bind(Symbol const * symbol) noexcept {
+			m_symbol = symbol;
+		}
+
 	private:
-		std::string m_id;
+		std::string const * m_id;
+		Symbol const * m_symbol;
 	};
 
 	class Constant : public Expression {
 	public:
 		Constant(
-				std::string const & id
-		) noexcept : m_id(id) {
+			std::string const * id
+		) noexcept : m_id(id), m_value(nullptr) {
 		}
 
 		virtual ~Constant() noexcept;
 
-		virtual void invoke() const override;
+		virtual auto evaluate(Context & context) const -> Value override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto id() const noexcept -> std::string const & {
+			return *m_id;
+		}
+
+		/// The value of the constant; nullptr until bind() runs.
+		auto value() const noexcept -> Value const * {
+			return m_value;
+		}
+
+		void bind(Value const * value) noexcept {
+			m_value = value;
+		}
+
 	private:
-		std::string m_id;
+		std::string const * m_id;
+		Value const * m_value;
 	};
 
 	class Numeric : public Expression {
@@ -65,10 +291,18 @@ namespace br {
 
 		virtual ~Numeric() noexcept;
 
-		virtual void invoke() const override;
+		virtual auto evaluate(Context & context) const -> Value override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto value() const noexcept -> double {
+			return m_value;
+		}
+
 	private:
 		double m_value;
 	};
@@ -82,10 +316,18 @@ namespace br {
 
 		virtual ~Boolean() noexcept;
 
-		virtual void invoke() const override;
+		virtual auto evaluate(Context & context) const -> Value override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto value() const noexcept -> bool {
+			return m_value;
+		}
+
 	private:
 		bool m_value;
 	};
@@ -93,97 +335,161 @@ namespace br {
 	class Vector : public Expression {
 	public:
 		Vector(
-			std::shared_ptr<Expression> const & x,
-			std::shared_ptr<Expression> const & y
+			Expression * x,
+			Expression * y
 		) noexcept : m_x(x), m_y(y) {
 		}
 
 		virtual ~Vector() noexcept;
 
-		virtual void invoke() const override;
+		virtual auto evaluate(Context & context) const -> Value override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto x() const noexcept -> Expression const & {
+			return *m_x;
+		}
+
+		auto y() const noexcept -> Expression const & {
+			return *m_y;
+		}
+
 	private:
-		std::shared_ptr<Expression> m_x, m_y;
+		Expression * m_x, * m_y;
 	};
 
 	class FunctionCall : public Expression {
 	public:
 		FunctionCall(
-			std::shared_ptr<Expression> func,
-			std::shared_ptr< std::list< std::shared_ptr<Expression> > > args
+			Expression * func,
+			Array<Expression *> args
 		) noexcept : m_func(func), m_args(args) {
 		}
 
 		virtual ~FunctionCall() noexcept;
 
-		virtual void invoke() const override;
+		virtual auto evaluate(Context & context) const -> Value override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto func() const noexcept -> Expression const & {
+			return *m_func;
+		}
+
+		auto args() const noexcept -> Array<Expression *> const & {
+			return m_args;
+		}
+
 	private:
-		std::shared_ptr<Expression> m_func;
-		std::shared_ptr< std::list< std::shared_ptr<Expression> > > m_args;
+		Expression * m_func;
+		Array<Expression *> m_args;
 	};
 
 	class ArrayAccess : public Expression {
 	public:
 		ArrayAccess(
-			std::shared_ptr<Expression> var,
-			std::shared_ptr<Expression> index
+			Expression * var,
+			Expression * index
 		) noexcept : m_var(var), m_index(index) {
 		}
 
 		virtual ~ArrayAccess() noexcept;
 
-		virtual void invoke() const override;
+		virtual auto evaluate(Context & context) const -> Value override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto var() const noexcept -> Expression const & {
+			return *m_var;
+		}
+
+		auto index() const noexcept -> Expression const & {
+			return *m_index;
+		}
+
 	private:
-		std::shared_ptr<Expression> m_var;
-		std::shared_ptr<Expression> m_index;
+		Expression * m_var;
+		Expression * m_index;
 	};
 
 	class UnaryOperation : public Expression {
 	public:
 		UnaryOperation(
-			std::string const & op,
-			std::shared_ptr<Expression> rhs
+			UnaryOperator op,
+			Expression * rhs
 		) noexcept : m_op(op), m_rhs(rhs) {
 		}
 
 		virtual ~UnaryOperation() noexcept;
 
-		virtual void invoke() const override;
+		virtual auto evaluate(Context & context) const -> Value override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto op() const noexcept -> UnaryOperator {
+			return m_op;
+		}
+
+		auto rhs() const noexcept -> Expression const & {
+			return *m_rhs;
+		}
+
 	private:
-		std::string m_op;
-		std::shared_ptr<Expression> m_rhs;
+		UnaryOperator m_op;
+		Expression * m_rhs;
 	};
 
 	class BinaryOperation : public Expression {
 	public:
 		BinaryOperation(
-			std::string const & op,
-			std::shared_ptr<Expression> lhs,
-			std::shared_ptr<Expression> rhs
+			BinaryOperator op,
+			Expression * lhs,
+			Expression * rhs
 		) noexcept : m_op(op), m_lhs(lhs), m_rhs(rhs) {
 		}
 
 		virtual ~BinaryOperation() noexcept;
 
-		virtual void invoke() const override;
+		virtual auto evaluate(Context & context) const -> Value override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto op() const noexcept -> BinaryOperator {
+			return m_op;
+		}
+
+		auto lhs() const noexcept -> Expression const & {
+			return *m_lhs;
+		}
+
+		auto rhs() const noexcept -> Expression const & {
+			return *m_rhs;
+		}
+
 	private:
-		std::string m_op;
-		std::shared_ptr<Expression> m_lhs;
-		std::shared_ptr<Expression> m_rhs;
+		BinaryOperator m_op;
+		Expression * m_lhs;
+		Expression * m_rhs;
 	};
 
 	class Statement : public Node {
@@ -195,158 +501,385 @@ namespace br {
 	public:
 		virtual ~EmptyStatement() noexcept;
 
-		virtual void invoke() const override;
+		virtual void invoke(Context & context) const override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
+
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
 	};
 
 	class CompoundStatement : public Statement {
 	public:
 		CompoundStatement(
-			std::shared_ptr< std::list< std::shared_ptr<Statement> > > stmts
+			Array<Statement *> stmts
 		) : m_stmts(stmts) {
 		}
 
 		virtual ~CompoundStatement() noexcept;
 
-		virtual void invoke() const override;
+		virtual void invoke(Context & context) const override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto stmts() const noexcept -> Array<Statement *> const & {
+			return m_stmts;
+		}
+
+		void stmts(Array<Statement *> stmts) noexcept {
+			m_stmts = stmts;
+		}
+
 	private:
-		std::shared_ptr< std::list< std::shared_ptr<Statement> > > m_stmts;
+		Array<Statement *> m_stmts;
 	};
 
+	/** \brief Root of a syntax tree, and owner of all of its nodes.
+	 **
+	 ** Every other node, child sequence and identifier of the tree lives in the program's arena and
+	 ** identifier pool, and is released with it in one go.
+	 */
 	class Program : public Statement {
 	public:
-		Program(
-			std::shared_ptr< std::list< std::shared_ptr<Statement> > > stmts
-		) : m_stmts(stmts) {
+		Program() noexcept : m_file(0) {
 		}
 
+		Program(Program const &) = delete;
+
+		auto operator=(Program const &) -> Program & = delete;
+
 		virtual ~Program() noexcept;
 
-		virtual void invoke() const override;
+		virtual void invoke(Context & context) const override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto stmts() const noexcept -> Array<Statement *> const & {
+			return m_stmts;
+		}
+
+		void stmts(Array<Statement *> stmts) noexcept {
+			m_stmts = stmts;
+		}
+
+		auto arena() const noexcept -> Arena const & {
+			return m_arena;
+		}
+
+		auto arena() noexcept -> Arena & {
+			return m_arena;
+		}
+
+		/// Allocate a node of the tree, covering \a span of the source.
+		template< typename T, typename ... TArgs >
+		auto make(Span span, TArgs && ... args) -> T * {
+			auto node = m_arena.make<T>(std::forward<TArgs>(args)...);
+			node->span(span);
+			return node;
+		}
+
+		template< typename T >
+		auto array(List<T> const & list) -> Array<T> {
+			return m_arena.array(list);
+		}
+
+		template< typename T >
+		auto array(T const * data, std::size_t size) -> Array<T> {
+			return m_arena.array(data, size);
+		}
+
+		/// The pooled copy of an identifier; equal strings share one copy, so they compare equal by address.
+		auto name(std::string const & id) -> std::string const * {
+			return &*m_names.insert(id).first;
+		}
+
+		auto names() const noexcept -> std::size_t {
+			return m_names.size();
+		}
+
+		/// Names of the variables by frame slot, set by bind(); the first special_slots are always there.
+		auto slots() const noexcept -> Array<std::string const *> const & {
+			return m_slots;
+		}
+
+		void slots(Array<std::string const *> slots) noexcept {
+			m_slots = slots;
+		}
+
+		/// The files the program was parsed from, to resolve the spans of its nodes.
+		auto sources() const noexcept -> SourceMap const & {
+			return m_sources;
+		}
+
+		auto sources() noexcept -> SourceMap & {
+			return m_sources;
+		}
+
+		/// Id in sources() of the file the nodes of the program are in.
+		auto file() const noexcept -> std::uint32_t {
+			return m_file;
+		}
+
+		void file(std::uint32_t file) noexcept {
+			m_file = file;
+		}
+
+		auto location(Span span) const noexcept -> Location {
+			return span.location(m_file);
+		}
+
 	private:
-		std::shared_ptr< std::list< std::shared_ptr<Statement> > > m_stmts;
+		Arena m_arena;
+		std::unordered_set<std::string> m_names;
+		Array<Statement *> m_stmts;
+		Array<std::string const *> m_slots;
+		SourceMap m_sources;
+		std::uint32_t m_file;
 	};
 
 	class ConditionalStatement : public Statement {
 	public:
 		ConditionalStatement(
-			std::shared_ptr<Expression> const & cond,
-			std::shared_ptr<Statement> when_true,
-			std::shared_ptr<Statement> when_false
+			Expression * cond,
+			Statement * when_true,
+			Statement * when_false
 		) : m_cond(cond), m_when_true(when_true), m_when_false(when_false) {
 		}
 
 		virtual ~ConditionalStatement() noexcept;
 
-		virtual void invoke() const override;
+		virtual void invoke(Context & context) const override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto cond() const noexcept -> Expression const & {
+			return *m_cond;
+		}
+
+		auto when_true() const noexcept -> Statement const & {
+			return *m_when_true;
+		}
+
+		auto when_false() const noexcept -> Statement const & {
+			return *m_when_false;
+		}
+
 	private:
-		std::shared_ptr<Expression> m_cond;
-		std::shared_ptr<Statement> m_when_true, m_when_false;
+		Expression * m_cond;
+		Statement * m_when_true, * m_when_false;
 	};
 
 	class WhileStatement : public Statement {
 	public:
 		WhileStatement(
-			std::shared_ptr<Expression> cond,
-			std::shared_ptr<Statement> body
+			Expression * cond,
+			Statement * body
 		) : m_cond(cond), m_body(body) {
 		}
 
 		virtual ~WhileStatement() noexcept;
 
-		virtual void invoke() const override;
+		virtual void invoke(Context & context) const override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto cond() const noexcept -> Expression const & {
+			return *m_cond;
+		}
+
+		auto body() const noexcept -> Statement const & {
+			return *m_body;
+		}
+
 	private:
-		std::shared_ptr<Expression> m_cond;
-		std::shared_ptr<Statement> m_body;
+		Expression * m_cond;
+		Statement * m_body;
 	};
 
 	class UntilStatement : public Statement {
 	public:
 		UntilStatement(
-			std::shared_ptr<Expression> cond,
-			std::shared_ptr<Statement> body
+			Expression * cond,
+			Statement * body
 		) : m_cond(cond), m_body(body) {
 		}
 
 		virtual ~UntilStatement() noexcept;
 
-		virtual void invoke() const override;
+		virtual void invoke(Context & context) const override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto cond() const noexcept -> Expression const & {
+			return *m_cond;
+		}
+
+		auto body() const noexcept -> Statement const & {
+			return *m_body;
+		}
+
 	private:
-		std::shared_ptr<Expression> m_cond;
-		std::shared_ptr<Statement> m_body;
+		Expression * m_cond;
+		Statement * m_body;
 	};
 
 	class ForStatement : public Statement {
 	public:
 		ForStatement(
-			std::string const & id,
-			std::shared_ptr<Expression> from,
-			std::shared_ptr<Expression> to,
-			std::shared_ptr<Expression> step,
-			std::shared_ptr<Statement> body
-		) : m_id(id), m_from(from), m_to(to), m_step(step), m_body(body) {
+			std::string const * id,
+			Expression * from,
+			Expression * to,
+			Expression * step,
+			Statement * body
+		) : m_id(id), m_slot(no_slot), m_from(from), m_to(to), m_step(step), m_body(body) {
 		}
 
 		virtual ~ForStatement() noexcept;
 
-		virtual void invoke() const override;
+		virtual void invoke(Context & context) const override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto id() const noexcept -> std::string const & {
+			return *m_id;
+		}
+
+		/// Frame slot of the loop variable; no_slot until bind() runs.
+		auto slot() const noexcept -> std::uint32_t {
+			return m_slot;
+		}
+
+		void bind(std::uint32_t slot) noexcept {
+			m_slot = slot;
+		}
+
+		/// Whether the loop goes on with \a value, given its bound and step.
+		static auto in_range(double value, double to, double step) noexcept -> bool {
+			return step > 0 ? value <= to : value >= to;
+		}
+
+		/// The number of values `from + i * step` in range; the largest count for a loop that never ends.
+		static auto trip_count(double from, double to, double step) noexcept -> std::uint64_t;
+
+		/** \brief Whether the values of a loop can be accumulated, `value += step`.
+		 **
+		 ** That is when \a from, \a step and every one of the first \a count values are integral multiples of
+		 ** a common power of two small enough for all of them to be exact; the sums then equal `from + i * step`
+		 ** bit for bit. Otherwise each value must be computed as such, since accumulating would drift by up to
+		 ** half an ulp of the value per iteration.
+		 */
+		static auto exact_steps(double from, double step, std::uint64_t count) noexcept -> bool;
+
+		auto from() const noexcept -> Expression const & {
+			return *m_from;
+		}
+
+		auto to() const noexcept -> Expression const & {
+			return *m_to;
+		}
+
+		auto step() const noexcept -> Expression const & {
+			return *m_step;
+		}
+
+		auto body() const noexcept -> Statement const & {
+			return *m_body;
+		}
+
 	private:
-		std::string m_id;
-		std::shared_ptr<Expression> m_from, m_to, m_step;
-		std::shared_ptr<Statement> m_body;
+		std::string const * m_id;
+		std::uint32_t m_slot;
+		Expression * m_from, * m_to, * m_step;
+		Statement * m_body;
 	};
 
 	class AssignStatement : public Statement {
 	public:
 		AssignStatement(
-			std::string const & id,
-			std::shared_ptr<Expression> expr
-		) : m_id(id), m_expr(expr) {
+			std::string const * id,
+			Expression * expr
+		) : m_id(id), m_slot(no_slot), m_expr(expr) {
 		}
 
 		virtual ~AssignStatement() noexcept;
 
-		virtual void invoke() const override;
+		virtual void invoke(Context & context) const override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto id() const noexcept -> std::string const & {
+			return *m_id;
+		}
+
+		/// Frame slot of the assigned variable; no_slot until bind() runs.
+		auto slot() const noexcept -> std::uint32_t {
+			return m_slot;
+		}
+
+		void bind(std::uint32_t slot) noexcept {
+			m_slot = slot;
+		}
+
+		auto expr() const noexcept -> Expression const & {
+			return *m_expr;
+		}
+
 	private:
-		std::string m_id;
-		std::shared_ptr<Expression> m_expr;
+		std::string const * m_id;
+		std::uint32_t m_slot;
+		Expression * m_expr;
 	};
 
 	class ExpressionStatement : public Statement {
 	public:
-		ExpressionStatement(std::shared_ptr<Expression> const & expr) : m_expr(expr) {
+		ExpressionStatement(Expression * expr) : m_expr(expr) {
 		}
 
 		virtual ~ExpressionStatement() noexcept;
 
-		virtual void invoke() const override;
+		virtual void invoke(Context & context) const override;
 
 		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
 
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto expr() const noexcept -> Expression const & {
+			return *m_expr;
+		}
+
 	private:
-		std::shared_ptr<Expression> m_expr;
+		Expression * m_expr;
 	};
 
 
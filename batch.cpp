@@ -0,0 +1,665 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "batch.hpp"
+#include "builtin.hpp"
+#include "context.hpp"
+#include "flat.hpp"
+#include "random.hpp"
+#include "simd.hpp"
+
+namespace br {
+
+	namespace {
+
+		/// Number of iterations evaluated together.
+		constexpr std::size_t block = 256;
+
+		constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+		struct Op {
+			enum class Kind : std::uint8_t {
+				Parameter,
+				Invariant,
+				/// The lhs-th random number read by an iteration.
+				Random,
+				Add,
+				Subtract,
+				Multiply,
+				Divide,
+				Modulo,
+				Power,
+				Negate,
+				Unary,
+				Binary,
+			};
+
+			Kind kind;
+			std::size_t lhs, rhs;
+			Expression const * invariant;
+			Builtin::Unary unary;
+			Builtin::Binary binary;
+		};
+
+		struct Draw {
+			std::size_t x, y;
+		};
+
+		/// A variable assigned in the body, and the op of its latest value.
+		struct Local {
+			std::uint32_t slot;
+			std::size_t op;
+		};
+
+		auto modulo(double lhs, double rhs) -> double {
+			return std::fmod(lhs, rhs);
+		}
+
+		auto power(double lhs, double rhs) -> double {
+			return std::pow(lhs, rhs);
+		}
+
+		/// Resolve the callee of a call to the built-in it names, if the name is not shadowed.
+		auto resolve(Expression const & func, std::uint32_t slot, Context const & context) -> Builtin const * {
+			auto variable = dynamic_cast<Variable const *>(&func);
+			if (variable == nullptr) {
+				return nullptr;
+			}
+			auto symbol = variable->symbol();
+			if (symbol->slot != no_slot && (symbol->slot == slot || context.variable(symbol->slot) != nullptr)) {
+				return nullptr;
+			}
+			return symbol->builtin;
+		}
+
+		/// Whether an expression reads a variable that changes from one iteration to the next, and whether
+		/// evaluating it has no side effects.
+		class Purity : public Walker {
+		public:
+			Purity(std::uint32_t slot, std::vector<std::uint32_t> const & assigned, Context const & context)
+				: m_slot(slot), m_assigned(assigned), m_context(context), m_rand(find_builtin("rand")) {
+			}
+
+			bool varying = false;
+
+			bool pure = true;
+
+			using Walker::visit;
+
+			virtual void visit(Variable const & node) override {
+				auto symbol = node.symbol();
+				if (symbol->slot == m_slot || std::find(m_assigned.begin(), m_assigned.end(), symbol->slot) != m_assigned.end()) {
+					varying = true;
+				} else if (m_context.variable(symbol->slot) == nullptr) {
+					auto builtin = symbol->builtin;
+					if (builtin == m_rand) {
+						// Takes the next number of a stream, so differs from one iteration to the next.
+						varying = true;
+					} else {
+						pure = pure && (builtin == nullptr || builtin->kind != Builtin::Kind::Property);
+					}
+				}
+			}
+
+			virtual void visit(FunctionCall const & node) override {
+				auto builtin = resolve(node.func(), m_slot, m_context);
+				if (builtin == nullptr || !builtin->pure) {
+					pure = false;
+				}
+				for (auto const & arg : node.args()) {
+					arg->accept(*this);
+				}
+			}
+
+		private:
+			std::uint32_t m_slot;
+			std::vector<std::uint32_t> const & m_assigned;
+			Context const & m_context;
+			Builtin const * m_rand;
+		};
+
+		/// Lower the body of a loop to a sequence of array operations.
+		class Lowering : public Visitor {
+		public:
+			Lowering(std::uint32_t slot, Context const & context) : m_slot(slot), m_context(context) {
+			}
+
+			auto ops() const noexcept -> std::vector<Op> const & {
+				return m_ops;
+			}
+
+			auto draws() const noexcept -> std::vector<Draw> const & {
+				return m_draws;
+			}
+
+			auto parameter() const noexcept -> std::size_t {
+				return m_parameter;
+			}
+
+			/// The number of random numbers an iteration reads.
+			auto randoms() const noexcept -> std::size_t {
+				return m_randoms;
+			}
+
+			/// The variables assigned by the body, with the ops of their values at the end of an iteration.
+			auto locals() const noexcept -> std::vector<Local> const & {
+				return m_locals;
+			}
+
+			auto body(Statement const & body) -> bool {
+				auto compound = dynamic_cast<CompoundStatement const *>(&body);
+				if (compound == nullptr) {
+					return false;
+				}
+				m_assigned = assigned_slots(*compound);
+				for (auto slot : m_assigned) {
+					if (slot == m_slot || Context::is_special(slot)) {
+						return false;
+					}
+				}
+				auto draw = find_builtin("draw");
+				for (auto const & statement : compound->stmts()) {
+					if (dynamic_cast<EmptyStatement const *>(statement) != nullptr) {
+						continue;
+					}
+					auto assign = dynamic_cast<AssignStatement const *>(statement);
+					if (assign != nullptr) {
+						auto value = lower(source(assign->expr()));
+						if (m_failed) {
+							return false;
+						}
+						define(assign->slot(), value);
+						continue;
+					}
+					auto expression = dynamic_cast<ExpressionStatement const *>(statement);
+					auto call = expression != nullptr ? dynamic_cast<FunctionCall const *>(&source(expression->expr())) : nullptr;
+					if (call == nullptr || resolve(call->func(), m_slot, m_context) != draw || call->args().size() != 2) {
+						return false;
+					}
+					auto x = lower(*call->args().front());
+					auto y = lower(*call->args().back());
+					if (m_failed) {
+						return false;
+					}
+					m_draws.push_back(Draw{x, y});
+				}
+				return true;
+			}
+
+			virtual void visit(Variable const & node) override {
+				auto slot = node.symbol()->slot;
+				if (slot != m_slot) {
+					// Only defined if assigned earlier in the iteration; otherwise it is the previous one's.
+					auto local = find(slot);
+					if (local != nullptr) {
+						m_result = local->op;
+					} else if (m_context.variable(slot) == nullptr && node.symbol()->builtin == find_builtin("rand")) {
+						m_result = push(Op{Op::Kind::Random, m_randoms++, none, nullptr, nullptr, nullptr});
+					} else {
+						fail();
+					}
+					return;
+				}
+				if (m_parameter == none) {
+					m_parameter = push(Op{Op::Kind::Parameter, none, none, nullptr, nullptr, nullptr});
+				}
+				m_result = m_parameter;
+			}
+
+			virtual void visit(Constant const & node) override {
+				fail();
+			}
+
+			virtual void visit(Numeric const & node) override {
+				fail();
+			}
+
+			virtual void visit(Boolean const & node) override {
+				fail();
+			}
+
+			virtual void visit(Vector const & node) override {
+				fail();
+			}
+
+			virtual void visit(FunctionCall const & node) override {
+				auto builtin = resolve(node.func(), m_slot, m_context);
+				auto count = node.args().size();
+				if (builtin != nullptr && builtin->unary != nullptr && count == 1) {
+					auto rhs = lower(*node.args().front());
+					m_result = push(Op{Op::Kind::Unary, none, rhs, nullptr, builtin->unary, nullptr});
+				} else if (builtin != nullptr && builtin->binary != nullptr && count == 2) {
+					auto lhs = lower(*node.args().front());
+					auto rhs = lower(*node.args().back());
+					m_result = push(Op{Op::Kind::Binary, lhs, rhs, nullptr, nullptr, builtin->binary});
+				} else {
+					fail();
+				}
+			}
+
+			virtual void visit(ArrayAccess const & node) override {
+				fail();
+			}
+
+			virtual void visit(UnaryOperation const & node) override {
+				switch (node.op()) {
+					case UnaryOperator::Plus:
+						m_result = lower(node.rhs());
+						break;
+					case UnaryOperator::Minus: {
+						auto rhs = lower(node.rhs());
+						m_result = push(Op{Op::Kind::Negate, none, rhs, nullptr, nullptr, nullptr});
+						break;
+					}
+					case UnaryOperator::Not:
+						fail();
+						break;
+				}
+			}
+
+			virtual void visit(BinaryOperation const & node) override {
+				Op::Kind kind;
+				switch (node.op()) {
+					case BinaryOperator::Add:
+						kind = Op::Kind::Add;
+						break;
+					case BinaryOperator::Subtract:
+						kind = Op::Kind::Subtract;
+						break;
+					case BinaryOperator::Multiply:
+						kind = Op::Kind::Multiply;
+						break;
+					case BinaryOperator::Divide:
+						kind = Op::Kind::Divide;
+						break;
+					case BinaryOperator::Modulo:
+						kind = Op::Kind::Modulo;
+						break;
+					case BinaryOperator::Power:
+						kind = Op::Kind::Power;
+						break;
+					default:
+						fail();
+						return;
+				}
+				auto lhs = lower(node.lhs());
+				auto rhs = lower(node.rhs());
+				m_result = push(Op{kind, lhs, rhs, nullptr, nullptr, nullptr});
+			}
+
+			virtual void visit(EmptyStatement const & node) override {
+				fail();
+			}
+
+			virtual void visit(CompoundStatement const & node) override {
+				fail();
+			}
+
+			virtual void visit(Program const & node) override {
+				fail();
+			}
+
+			virtual void visit(ConditionalStatement const & node) override {
+				fail();
+			}
+
+			virtual void visit(WhileStatement const & node) override {
+				fail();
+			}
+
+			virtual void visit(UntilStatement const & node) override {
+				fail();
+			}
+
+			virtual void visit(ForStatement const & node) override {
+				fail();
+			}
+
+			virtual void visit(AssignStatement const & node) override {
+				fail();
+			}
+
+			virtual void visit(ExpressionStatement const & node) override {
+				fail();
+			}
+
+		private:
+			/// Lower one numeric expression; sub-trees that do not read the loop variable are evaluated once.
+			auto lower(Expression const & expr) -> std::size_t {
+				if (m_failed) {
+					return none;
+				}
+				Purity purity(m_slot, m_assigned, m_context);
+				expr.accept(purity);
+				if (!purity.pure) {
+					fail();
+					return none;
+				}
+				if (!purity.varying) {
+					return push(Op{Op::Kind::Invariant, none, none, &expr, nullptr, nullptr});
+				}
+				m_result = none;
+				expr.accept(*this);
+				return m_result;
+			}
+
+			auto push(Op const & op) -> std::size_t {
+				m_ops.push_back(op);
+				return m_ops.size() - 1;
+			}
+
+			void fail() {
+				m_failed = true;
+				m_result = none;
+			}
+
+			auto find(std::uint32_t slot) -> Local * {
+				for (auto & local : m_locals) {
+					if (local.slot == slot) {
+						return &local;
+					}
+				}
+				return nullptr;
+			}
+
+			void define(std::uint32_t slot, std::size_t op) {
+				auto local = find(slot);
+				if (local != nullptr) {
+					local->op = op;
+				} else {
+					m_locals.push_back(Local{slot, op});
+				}
+			}
+
+			std::uint32_t m_slot;
+			Context const & m_context;
+			std::vector<std::uint32_t> m_assigned;
+			std::vector<Local> m_locals;
+			std::vector<Op> m_ops;
+			std::vector<Draw> m_draws;
+			std::size_t m_parameter = none;
+			std::size_t m_randoms = 0;
+			std::size_t m_result = none;
+			bool m_failed = false;
+		};
+
+		/// A lowered body with a lane of block values for each op, evaluated for up to a block of loop values at once.
+		class Kernel {
+		public:
+			explicit Kernel(Lowering const & lowering) : m_lowering(lowering), m_lanes((lowering.ops().size() + 1) * block) {
+			}
+
+			auto lane(std::size_t op) noexcept -> double * {
+				return m_lanes.data() + op * block;
+			}
+
+			/// The loop values to evaluate at; a spare lane if the body does not read the loop variable.
+			auto values() noexcept -> double * {
+				return m_lowering.parameter() != none ? lane(m_lowering.parameter()) : lane(m_lowering.ops().size());
+			}
+
+			/// Evaluate the invariants. \return false if one fails or is not a number
+			auto prepare(Context & context) -> bool {
+				auto const & ops = m_lowering.ops();
+				for (std::size_t k = 0; k < ops.size(); ++k) {
+					if (ops[k].kind != Op::Kind::Invariant) {
+						continue;
+					}
+					Value value;
+					try {
+						value = ops[k].invariant->evaluate(context);
+					} catch (RuntimeError const &) {
+						return false;
+					}
+					if (!value.is_number()) {
+						return false;
+					}
+					simd::fill(lane(k), value.as_number(), block);
+				}
+				return true;
+			}
+
+			/// Evaluate the ops for the first \a count values(), of iterations whose random numbers start at \a random.
+			void run(Context const & context, std::uint64_t random, std::size_t count) {
+				auto const & ops = m_lowering.ops();
+				std::uint64_t randoms = m_lowering.randoms();
+				for (std::size_t k = 0; k < ops.size(); ++k) {
+					auto const & op = ops[k];
+					auto out = lane(k);
+					switch (op.kind) {
+						case Op::Kind::Parameter:
+						case Op::Kind::Invariant:
+							break;
+						case Op::Kind::Random:
+							uniform(out, context.seed(), random + op.lhs, randoms, count);
+							break;
+						case Op::Kind::Add:
+							simd::add(out, lane(op.lhs), lane(op.rhs), count);
+							break;
+						case Op::Kind::Subtract:
+							simd::subtract(out, lane(op.lhs), lane(op.rhs), count);
+							break;
+						case Op::Kind::Multiply:
+							simd::multiply(out, lane(op.lhs), lane(op.rhs), count);
+							break;
+						case Op::Kind::Divide:
+							simd::divide(out, lane(op.lhs), lane(op.rhs), count);
+							break;
+						case Op::Kind::Modulo:
+							simd::map(out, lane(op.lhs), lane(op.rhs), modulo, count);
+							break;
+						case Op::Kind::Power:
+							simd::map(out, lane(op.lhs), lane(op.rhs), power, count);
+							break;
+						case Op::Kind::Negate:
+							simd::negate(out, lane(op.rhs), count);
+							break;
+						case Op::Kind::Unary:
+							simd::map(out, lane(op.rhs), op.unary, count);
+							break;
+						case Op::Kind::Binary:
+							simd::map(out, lane(op.lhs), lane(op.rhs), op.binary, count);
+							break;
+					}
+				}
+			}
+
+			/// Assign the variables the body assigns as iteration \a i of the last run() leaves them.
+			void leave(Context & context, std::size_t i) {
+				for (auto const & local : m_lowering.locals()) {
+					context.assign(local.slot, lane(local.op)[i]);
+				}
+			}
+
+		private:
+			Lowering const & m_lowering;
+			std::vector<double> m_lanes;
+		};
+
+		/// Loop values in order, with the point of each draw of the body at each, as drawn and in pixels.
+		struct Samples {
+			std::vector<double> values;
+			std::vector<double> xs, ys;
+			std::vector<double> pixel_xs, pixel_ys;
+			/// Whether the interval from each value to the next may still be halved.
+			std::vector<bool> open;
+
+			/// Append value \a i of \a samples, which have \a draws points each.
+			void append(Samples const & samples, std::size_t i, std::size_t draws, bool open) {
+				values.push_back(samples.values[i]);
+				auto first = i * draws;
+				xs.insert(xs.end(), samples.xs.begin() + first, samples.xs.begin() + first + draws);
+				ys.insert(ys.end(), samples.ys.begin() + first, samples.ys.begin() + first + draws);
+				pixel_xs.insert(pixel_xs.end(), samples.pixel_xs.begin() + first, samples.pixel_xs.begin() + first + draws);
+				pixel_ys.insert(pixel_ys.end(), samples.pixel_ys.begin() + first, samples.pixel_ys.begin() + first + draws);
+				this->open.push_back(open);
+			}
+		};
+
+	} // namespace
+
+	auto execute_batch(ForStatement const & loop, double from, double to, double step, Context & context) -> bool {
+		if (Context::is_special(loop.slot())) {
+			return false;
+		}
+		Lowering lowering(loop.slot(), context);
+		if (!lowering.body(loop.body())) {
+			return false;
+		}
+		auto trips = ForStatement::trip_count(from, to, step);
+		if (trips == 0) {
+			return true;
+		}
+
+		Kernel kernel(lowering);
+		if (!kernel.prepare(context)) {
+			return false;
+		}
+		auto const & draws = lowering.draws();
+		auto values = kernel.values();
+		auto base = context.randoms();
+		std::uint64_t randoms = lowering.randoms();
+		auto last = from;
+		std::size_t count = 0;
+		for (std::uint64_t first = 0; first < trips; first += block) {
+			count = static_cast<std::size_t>(std::min<std::uint64_t>(trips - first, block));
+			simd::ramp(values, from, step, static_cast<std::size_t>(first), count);
+			kernel.run(context, base + first * randoms, count);
+			if (draws.size() == 1) {
+				context.draw(kernel.lane(draws.front().x), kernel.lane(draws.front().y), count);
+			} else {
+				for (std::size_t i = 0; i < count; ++i) {
+					for (auto const & draw : draws) {
+						context.draw(kernel.lane(draw.x)[i], kernel.lane(draw.y)[i]);
+					}
+				}
+			}
+			last = values[count - 1];
+		}
+		context.randoms(base + trips * randoms);
+		context.assign(loop.slot(), last);
+		kernel.leave(context, count - 1);
+		return true;
+	}
+
+	constexpr std::size_t Sampler::initial_segments;
+	constexpr std::size_t Sampler::max_depth;
+	constexpr double Sampler::default_tolerance;
+
+	Sampler::Sampler(double tolerance) noexcept : m_tolerance(tolerance), m_statistics{0, 0, 0} {
+	}
+
+	auto Sampler::execute(ForStatement const & loop, double from, double to, double step, Context & context) -> bool {
+		if (Context::is_special(loop.slot())) {
+			return false;
+		}
+		Lowering lowering(loop.slot(), context);
+		if (!lowering.body(loop.body()) || lowering.randoms() != 0) {
+			return false;
+		}
+		auto trips = ForStatement::trip_count(from, to, step);
+		if (trips == std::numeric_limits<std::uint64_t>::max()) {
+			// A loop that never ends has no last value to sample up to.
+			return false;
+		}
+		if (trips == 0) {
+			return true;
+		}
+		Kernel kernel(lowering);
+		if (!kernel.prepare(context)) {
+			return false;
+		}
+
+		auto draws = lowering.draws().size();
+		auto evaluate = [&](Samples & samples) {
+			auto size = samples.values.size();
+			samples.xs.resize(size * draws);
+			samples.ys.resize(size * draws);
+			for (std::size_t first = 0; first < size; first += block) {
+				auto count = std::min(size - first, block);
+				std::copy(samples.values.begin() + first, samples.values.begin() + first + count, kernel.values());
+				kernel.run(context, 0, count);
+				for (std::size_t d = 0; d < draws; ++d) {
+					auto const & draw = lowering.draws()[d];
+					for (std::size_t i = 0; i < count; ++i) {
+						samples.xs[(first + i) * draws + d] = kernel.lane(draw.x)[i];
+						samples.ys[(first + i) * draws + d] = kernel.lane(draw.y)[i];
+					}
+				}
+			}
+			samples.pixel_xs = samples.xs;
+			samples.pixel_ys = samples.ys;
+			simd::transform(samples.pixel_xs.data(), samples.pixel_ys.data(), context.transform(), size * draws);
+			m_statistics.evaluations += size;
+		};
+		auto tolerance = m_tolerance * m_tolerance;
+		auto far = [&](Samples const & samples, std::size_t i) {
+			for (auto k = i * draws; k < (i + 1) * draws; ++k) {
+				auto dx = samples.pixel_xs[k + draws] - samples.pixel_xs[k];
+				auto dy = samples.pixel_ys[k + draws] - samples.pixel_ys[k];
+				if (dx * dx + dy * dy > tolerance) {
+					return true;
+				}
+			}
+			return false;
+		};
+
+		// Values the loop takes, evenly spaced among them and computed as the loop computes them.
+		Samples samples;
+		auto segments = std::min<std::uint64_t>(trips - 1, initial_segments);
+		for (std::uint64_t k = 0; k <= segments; ++k) {
+			auto i = k == segments ? trips - 1 : static_cast<std::uint64_t>(static_cast<double>(trips - 1) * k / segments);
+			samples.values.push_back(from + static_cast<double>(i) * step);
+		}
+		samples.open.assign(samples.values.size(), true);
+		evaluate(samples);
+
+		Samples middles, merged;
+		for (std::size_t depth = 0; depth < max_depth; ++depth) {
+			middles.values.clear();
+			for (std::size_t i = 0; i + 1 < samples.values.size(); ++i) {
+				if (samples.open[i] && far(samples, i)) {
+					middles.values.push_back(samples.values[i] + (samples.values[i + 1] - samples.values[i]) / 2);
+				} else {
+					samples.open[i] = false;
+				}
+			}
+			if (middles.values.empty()) {
+				break;
+			}
+			evaluate(middles);
+			merged = Samples();
+			std::size_t m = 0;
+			for (std::size_t i = 0; i < samples.values.size(); ++i) {
+				auto split = i + 1 < samples.values.size() && samples.open[i];
+				merged.append(samples, i, draws, split);
+				if (split) {
+					merged.append(middles, m++, draws, true);
+				}
+			}
+			std::swap(samples, merged);
+		}
+
+		if (draws == 1) {
+			context.draw(samples.xs.data(), samples.ys.data(), samples.values.size());
+		} else {
+			for (std::size_t k = 0; k < samples.xs.size(); ++k) {
+				context.draw(samples.xs[k], samples.ys[k]);
+			}
+		}
+
+		// The variables as the last iteration leaves them.
+		auto last = samples.values.back();
+		kernel.values()[0] = last;
+		kernel.run(context, 0, 1);
+		context.assign(loop.slot(), last);
+		kernel.leave(context, 0);
+
+		++m_statistics.loops;
+		m_statistics.iterations += trips;
+		return true;
+	}
+
+} // namespace br
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "ast.hpp"
+
+namespace br {
+
+	class Context;
+
+	/** \brief Run a for loop over whole blocks of loop values at once.
+	 **
+	 ** Applies to loops whose body only calls `draw` with numeric expressions of the loop variable,
+	 ** the built-in math functions and loop-invariant values, and assigns such expressions to variables
+	 ** that it does not read before assigning them. Such a body is lowered to array kernels
+	 ** (see simd.hpp) evaluated for a block of iterations, then the points are drawn in iteration order.
+	 ** The draw output is bit-for-bit what per-iteration evaluation produces.
+	 **
+	 ** \return false, having had no effect, if the loop does not qualify or an invariant does not
+	 **         evaluate to a number; the caller then runs the loop one iteration at a time
+	 */
+	auto execute_batch(ForStatement const & loop, double from, double to, double step, Context & context) -> bool;
+
+	/** \brief Draws the curves of for loops by adaptive sampling instead of at every step.
+	 **
+	 ** Applies to the loops execute_batch() does whose body does not read `rand`. The body is first
+	 ** evaluated at up to initial_segments + 1 of the values the loop takes, from the first to the last.
+	 ** Then each interval whose ends are drawn more than the tolerance apart in pixels, by any `draw` of
+	 ** the body, is halved, up to max_depth times. The points are drawn in order of the loop value, and
+	 ** the variables end as the last iteration leaves them. This is opt-in since the points drawn are not
+	 ** those of the loop as written: a coarse step gets more of them, a fine one fewer. A detail finer
+	 ** than the first intervals, e.g. a loop of the curve that comes back where it started, may be missed.
+	 */
+	class Sampler {
+	public:
+		static constexpr std::size_t initial_segments = 64;
+
+		static constexpr std::size_t max_depth = 16;
+
+		/// Pixels.
+		static constexpr double default_tolerance = 1.0;
+
+		struct Statistics {
+			/// Loops sampled.
+			std::size_t loops;
+			/// Loop values their bodies were evaluated at, and iterations they would have run.
+			std::uint64_t evaluations, iterations;
+		};
+
+		/// \param tolerance the greatest distance in pixels between consecutive points of a curve
+		explicit Sampler(double tolerance) noexcept;
+
+		/// \return false, having had no effect, if the loop does not qualify; the caller then runs it as written
+		auto execute(ForStatement const & loop, double from, double to, double step, Context & context) -> bool;
+
+		auto statistics() const noexcept -> Statistics const & {
+			return m_statistics;
+		}
+
+	private:
+		double m_tolerance;
+		Statistics m_statistics;
+	}; // class Sampler
+
+} // namespace br
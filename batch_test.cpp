@@ -0,0 +1,169 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "ast.hpp"
+#include "batch.hpp"
+#include "binder.hpp"
+#include "context.hpp"
+#include "device.hpp"
+#include "engine.hpp"
+#include "raph.hpp"
+#include "simd.hpp"
+#include "value.hpp"
+
+namespace {
+
+	/// Scripts whose last statement is a for loop that execute_batch() must run; the others set it up.
+	char const * const scripts[] = {
+		// `**` and `%`, of negative and fractional operands too, and division by zero.
+		"for t from -500 to 500 step 1\n"
+		"\tdraw(t ** 0.5, t % 7)\n"
+		"\tdraw(-t ** 3, 1 / t)\n"
+		"\tdraw(2 ** -t, t % -2.5)\n"
+		"end\n",
+		// Every unary math built-in, outside their domains too.
+		"for t from -3 to 3 step 0.01\n"
+		"\tdraw(sin(t), cos(t))\n"
+		"\tdraw(tan(t), asin(t))\n"
+		"\tdraw(acos(t), atan(t))\n"
+		"\tdraw(sqrt(t), exp(t))\n"
+		"\tdraw(ln(t), abs(t))\n"
+		"\tdraw(floor(t), ceil(t))\n"
+		"end\n",
+		// The binary ones.
+		"k = 0.3\n"
+		"for t from -4 to 4 step 0.013\n"
+		"\tdraw(atan2(t, k), atan2(k, t))\n"
+		"\tdraw(min(t, k), max(t, -k))\n"
+		"end\n",
+		// Assignments read after they are made, invariants, and the drawing transform.
+		"clear = (640, 480)\n"
+		"origin = (320, 240)\n"
+		"scale = (100, -100)\n"
+		"rot = PI / 7\n"
+		"a = 2\n"
+		"b = 3\n"
+		"for t from 0 to 2 * PI step PI / 500\n"
+		"\tr = sin(a * t) ** 2 + cos(b * t) % 0.5\n"
+		"\tx = r * cos(t)\n"
+		"\ty = r * sin(t) - ln(1 + abs(x))\n"
+		"\tdraw(x, y)\n"
+		"\tdraw(y * a, x / b)\n"
+		"end\n",
+		// A descending loop.
+		"for t from 10 to -10 step -0.37\n"
+		"\tdraw(t * t, exp(-t) ** 0.25)\n"
+		"end\n",
+		// A body that does not read the loop variable.
+		"c = 1.5\n"
+		"for t from 0 to 299 step 1\n"
+		"\tdraw(c ** 2, sqrt(c))\n"
+		"end\n",
+	};
+
+	/// Trip counts around multiples of the block of 256, for the loop `for t from 0 to n - 1 step 1`.
+	std::uint64_t const trips[] = {1, 2, 255, 256, 257, 511, 512, 513, 1000, 3 * 256 + 17};
+
+	/// The output of a run: the events the device got, and the variables afterwards, bit for bit.
+	auto outcome(br::Recorder const & recorder, br::Program const & program, br::Context const & context) -> std::string {
+		std::ostringstream result;
+		for (auto const & event : recorder.events()) {
+			std::uint64_t x, y;
+			std::memcpy(&x, &event.x, sizeof(x));
+			std::memcpy(&y, &event.y, sizeof(y));
+			result << static_cast<int>(event.kind) << ' ' << std::hex << x << ' ' << y << std::dec << '\n';
+		}
+		for (std::uint32_t slot = 0; slot < program.slots().size(); ++slot) {
+			auto value = context.variable(slot);
+			if (value != nullptr && value->is_number()) {
+				auto number = value->as_number();
+				std::uint64_t bits;
+				std::memcpy(&bits, &number, sizeof(bits));
+				result << *program.slots()[slot] << " = " << std::hex << bits << std::dec << '\n';
+			}
+		}
+		return result.str();
+	}
+
+	/// Whether the events of \a lhs and \a rhs are the same; if not, report the first difference.
+	auto same(std::string const & lhs, std::string const & rhs, std::string const & what) -> bool {
+		if (lhs == rhs) {
+			return true;
+		}
+		std::istringstream lines(lhs), other(rhs);
+		std::string line, other_line;
+		std::size_t number = 1;
+		while (std::getline(lines, line) && std::getline(other, other_line) && line == other_line) {
+			++number;
+		}
+		std::cerr << what << ": line " << number << " of the output differs: '" << line << "' per iteration, '"
+			<< other_line << "' batched" << std::endl;
+		return false;
+	}
+
+	/// Run \a source per iteration and batched at each SIMD level the CPU has. \return the number of failures
+	auto check(std::string const & source) -> std::size_t {
+		std::ostringstream diagnostics;
+		br::RaphParser parser("test", diagnostics);
+		auto program = parser.parse(source);
+		if (program == nullptr || parser.errors() != 0 || !br::bind(*program, parser)) {
+			std::cerr << "the script has errors:" << std::endl << source << diagnostics.str();
+			return 1;
+		}
+		auto const & stmts = program->stmts();
+		auto loop = dynamic_cast<br::ForStatement const *>(stmts[stmts.size() - 1]);
+
+		br::Recorder expected;
+		br::Context reference(expected, program->slots().size(), 1);
+		br::execute(*program, reference, br::Engine::Tree);
+		auto per_iteration = outcome(expected, *program, reference);
+
+		std::size_t failures = 0;
+		for (auto level : {br::simd::Level::Scalar, br::simd::Level::SSE2, br::simd::Level::AVX}) {
+			if (static_cast<int>(level) > static_cast<int>(br::simd::detect())) {
+				continue;
+			}
+			br::simd::select(level);
+			br::Recorder recorder;
+			br::Context context(recorder, program->slots().size(), 1);
+			for (std::size_t k = 0; k + 1 < stmts.size(); ++k) {
+				stmts[k]->invoke(context);
+			}
+			auto from = br::expect_number(loop->from().evaluate(context), "for-from");
+			auto to = br::expect_number(loop->to().evaluate(context), "for-to");
+			auto step = br::expect_number(loop->step().evaluate(context), "for-step");
+			std::string what = std::string(br::simd::level_name(level)) + ", script:\n" + source;
+			if (!br::execute_batch(*loop, from, to, step, context)) {
+				std::cerr << what << "the loop is not batched" << std::endl;
+				++failures;
+				continue;
+			}
+			context.flush();
+			if (!same(per_iteration, outcome(recorder, *program, context), what)) {
+				++failures;
+			}
+		}
+		br::simd::select(br::simd::detect());
+		return failures;
+	}
+
+} // namespace
+
+int main() {
+	std::size_t checked = 0, failures = 0;
+	for (auto script : scripts) {
+		failures += check(script);
+		++checked;
+	}
+	for (auto count : trips) {
+		std::ostringstream script;
+		script << "for t from 0 to " << count - 1 << " step 1\n\tu = t * 0.001\n\tdraw(sin(u) ** 2 % 0.3, u)\n\tdraw(t, -u)\nend\n";
+		failures += check(script.str());
+		++checked;
+	}
+	std::cout << checked << " loops checked at every SIMD level up to " << br::simd::level_name(br::simd::detect()) << ", "
+		<< failures << " differ from per-iteration evaluation" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
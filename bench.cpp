@@ -0,0 +1,452 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "binder.hpp"
+#include "context.hpp"
+#include "device.hpp"
+#include "engine.hpp"
+#include "optimizer.hpp"
+#include "raph.hpp"
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	void usage(char const * name) {
+		std::cerr << "Usage: " << name << " [options]" << std::endl
+			<< "Options:" << std::endl
+			<< "  --scale=N  multiply the size of every synthetic script by N (default: 1)" << std::endl
+			<< "  --repeat=N time every benchmark N times and keep the fastest (default: 5)" << std::endl
+			<< "  --filter=S only run the benchmarks whose name contains S" << std::endl
+			<< "  --output=FILE" << std::endl
+			<< "             write the results to FILE as well as to stdout" << std::endl
+			<< "  --baseline=FILE" << std::endl
+			<< "             compare with results written before by --output, and fail if any is slower" << std::endl
+			<< "  --tolerance=F" << std::endl
+			<< "             how much slower than the baseline a benchmark may be, as a fraction (default: 0.1)" << std::endl
+			<< "  --script=KIND" << std::endl
+			<< "             print the synthetic script KIND instead: expressions, statements, loops or draws" << std::endl;
+	}
+
+	/** \name Synthetic scripts
+	 ** Each is valid, draws something and grows linearly with \a scale.
+	 ** \{ */
+
+	/// Deeply nested arithmetic: statements whose right-hand sides are calls nested 200 deep.
+	auto expressions(std::size_t scale) -> std::string {
+		constexpr std::size_t depth = 200;
+		std::ostringstream script;
+		script << "a = 0.5\nb = 2\nc = -1.25\n";
+		for (std::size_t i = 0; i < 50 * scale; ++i) {
+			std::string expression = "a";
+			for (std::size_t level = 0; level < depth; ++level) {
+				static char const * const operators[] = {" + ", " * ", " - ", " / "};
+				static char const * const operands[] = {"b", "1.5", "sin(c)", "a * a", "0x10", "-b ** 2"};
+				auto operand = operands[(i * 7 + level) % 6];
+				if (level % 2 == 0) {
+					expression = "max(" + expression + operators[(i + level) % 4] + operand + ", c)";
+				} else {
+					expression = std::string("atan2(") + operand + ", " + expression + ")";
+				}
+			}
+			script << "v" << i % 16 << " = " << expression << "\n";
+		}
+		script << "draw(v0, v1)\n";
+		return script.str();
+	}
+
+	/// A long list of short assignments between 64 variables.
+	auto statements(std::size_t scale) -> std::string {
+		std::ostringstream script;
+		for (std::size_t i = 0; i < 64; ++i) {
+			script << "v" << i << " = " << i << "\n";
+		}
+		for (std::size_t i = 0; i < 20000 * scale; ++i) {
+			script << "v" << i % 64 << " = v" << i * 7 % 64 << " * 0.5 + v" << i * 13 % 64 << " - " << i % 100 << "\n";
+		}
+		script << "draw(v0, v1)\n";
+		return script.str();
+	}
+
+	/// Three nested loops, whose innermost body runs 64000 times per unit of scale.
+	auto loops(std::size_t scale) -> std::string {
+		std::ostringstream script;
+		script << "s = 0\n"
+			<< "for i from 1 to " << 40 * scale << " step 1\n"
+			<< "\tfor j from 1 to 40 step 1\n"
+			<< "\t\tfor k from 1 to 40 step 1\n"
+			<< "\t\t\ts = s + i * j - k / 2\n"
+			<< "\t\t\tif s > 1000 then\n"
+			<< "\t\t\t\ts = s - 1000\n"
+			<< "\t\t\tend\n"
+			<< "\t\tend\n"
+			<< "\t\tdraw(i, j)\n"
+			<< "\tend\n"
+			<< "end\n";
+		return script.str();
+	}
+
+	/// One loop drawing 200000 points per unit of scale.
+	auto draws(std::size_t scale) -> std::string {
+		std::ostringstream script;
+		script << "clear = (1024, 1024)\n"
+			<< "origin = (512, 512)\n"
+			<< "for t from 0 to " << 200000 * scale - 1 << " step 1\n"
+			<< "\tdraw(400 * sin(t * 0.0011), 400 * cos(t * 0.0017) + rand)\n"
+			<< "end\n";
+		return script.str();
+	}
+
+	/** \} */
+
+	struct Script {
+		char const * kind;
+		std::string source;
+		/// What evaluating it is measured in: "draw" for the points drawn, "stmt" for the top-level statements.
+		char const * unit;
+	};
+
+	/// Sends std::cerr nowhere while it exists, e.g. to mute what engines say about loops while they are timed.
+	class Quiet {
+	public:
+		Quiet() : m_buffer(std::cerr.rdbuf(nullptr)) {
+		}
+
+		Quiet(Quiet const &) = delete;
+
+		auto operator=(Quiet const &) -> Quiet & = delete;
+
+		~Quiet() noexcept {
+			std::cerr.rdbuf(m_buffer);
+		}
+
+	private:
+		std::streambuf * m_buffer;
+	};
+
+	/// Receives the output of a program and only counts it, so that evaluation is timed without drawing.
+	class Counter : public br::Device {
+	public:
+		std::size_t points = 0;
+
+		virtual void clear(std::size_t, std::size_t) override {
+		}
+
+		virtual void draw(double, double) override {
+			++points;
+		}
+
+		virtual void draw(double const *, double const *, std::size_t count) override {
+			points += count;
+		}
+
+		virtual void save() override {
+		}
+	};
+
+	/// A measurement: the fastest of the repeats, and how many items (bytes, nodes, points) it processed.
+	struct Result {
+		std::string name;
+		double seconds;
+		std::uint64_t items;
+		char const * unit;
+	};
+
+	class Suite {
+	public:
+		Suite(std::size_t repeat, std::string filter) : m_repeat(repeat), m_filter(std::move(filter)) {
+		}
+
+		/// Repeat \a run, which times what it measures itself with timed() and returns the items it processed.
+		void add(std::string const & name, char const * unit, std::function<auto (double & seconds) -> std::uint64_t> const & run) {
+			if (name.find(m_filter) == std::string::npos) {
+				return;
+			}
+			Result result{name, 0.0, 0, unit};
+			for (std::size_t i = 0; i < m_repeat; ++i) {
+				double seconds = 0.0;
+				result.items = run(seconds);
+				result.seconds = i == 0 ? seconds : std::min(result.seconds, seconds);
+			}
+			std::cerr << std::left << std::setw(32) << name << std::right << std::setw(12) << std::fixed << std::setprecision(3)
+				<< result.seconds * 1e3 << " ms" << std::setw(14) << std::setprecision(1) << result.items / std::max(result.seconds, 1e-12) / 1e6
+				<< " M" << unit << "/s" << std::endl;
+			m_results.push_back(result);
+		}
+
+		auto results() const noexcept -> std::vector<Result> const & {
+			return m_results;
+		}
+
+	private:
+		std::size_t m_repeat;
+		std::string m_filter;
+		std::vector<Result> m_results;
+	};
+
+	/// Time \a body, adding to \a seconds.
+	template< typename TBody >
+	auto timed(double & seconds, TBody const & body) -> decltype(body()) {
+		auto start = Clock::now();
+		auto result = body();
+		seconds += std::chrono::duration<double>(Clock::now() - start).count();
+		return result;
+	}
+
+	auto parse(std::string const & source) -> std::unique_ptr<br::Program> {
+		std::ostringstream diagnostics;
+		br::RaphParser parser("bench", diagnostics);
+		auto program = parser.parse(source);
+		if (program == nullptr || parser.errors() != 0 || !br::bind(*program, parser)) {
+			std::cerr << "a synthetic script has errors:" << std::endl << diagnostics.str();
+			std::exit(1);
+		}
+		return program;
+	}
+
+	void run_benchmarks(Suite & suite, std::vector<Script> const & scripts) {
+		// Micro benchmarks: one stage at a time.
+		for (auto const & script : scripts) {
+			auto name = std::string("/") + script.kind;
+			auto const & source = script.source;
+			suite.add("scan" + name, "B", [&](double & seconds) {
+				std::ostringstream diagnostics;
+				br::RaphParser parser("bench", diagnostics);
+				br::Program program;
+				program.file(program.sources().add(parser.filename()));
+				auto buffer = source + std::string(br::RaphParser::padding, '\0');
+				timed(seconds, [&]() { return parser.scan(&buffer[0], buffer.size(), program); });
+				return static_cast<std::uint64_t>(source.size());
+			});
+			suite.add("parse" + name, "B", [&](double & seconds) {
+				std::ostringstream diagnostics;
+				br::RaphParser parser("bench", diagnostics);
+				auto program = timed(seconds, [&]() { return parser.parse(source); });
+				return static_cast<std::uint64_t>(source.size());
+			});
+			suite.add("destroy" + name, "node", [&](double & seconds) {
+				std::ostringstream diagnostics;
+				br::RaphParser parser("bench", diagnostics);
+				auto program = parser.parse(source);
+				auto nodes = static_cast<std::uint64_t>(program->arena().objects());
+				timed(seconds, [&]() { program.reset(); return 0; });
+				return nodes;
+			});
+			suite.add("bind" + name, "node", [&](double & seconds) {
+				std::ostringstream diagnostics;
+				br::RaphParser parser("bench", diagnostics);
+				auto program = parser.parse(source);
+				timed(seconds, [&]() { return br::bind(*program, parser); });
+				return static_cast<std::uint64_t>(program->arena().objects());
+			});
+			suite.add("optimize" + name, "node", [&](double & seconds) {
+				auto program = parse(source);
+				auto nodes = static_cast<std::uint64_t>(br::count_nodes(*program));
+				timed(seconds, [&]() { return br::optimize(*program, false).loops; });
+				return nodes;
+			});
+			auto program = parse(source);
+			br::optimize(*program, false);
+			for (auto engine : {br::Engine::Tree, br::Engine::VM, br::Engine::Batch, br::Engine::Parallel, br::Engine::JIT}) {
+				suite.add("evaluate" + name + "/" + br::engine_name(engine), script.unit, [&](double & seconds) {
+					Counter counter;
+					br::Context context(counter, program->slots().size(), 1);
+					{
+						Quiet quiet;
+						timed(seconds, [&]() { br::execute(*program, context, engine); return 0; });
+					}
+					return static_cast<std::uint64_t>(std::strcmp(script.unit, "draw") == 0 ? counter.points : program->stmts().size());
+				});
+			}
+		}
+
+		suite.add("rasterize/points", "point", [&](double & seconds) {
+			std::size_t const count = 1 << 22;
+			std::vector<double> xs(count), ys(count);
+			std::mt19937_64 random(1);
+			std::uniform_real_distribution<double> uniform(-16.0, 1040.0);
+			for (std::size_t i = 0; i < count; ++i) {
+				xs[i] = uniform(random);
+				ys[i] = uniform(random);
+			}
+			br::Canvas canvas("raph-bench.pgm");
+			canvas.clear(1024, 1024);
+			timed(seconds, [&]() {
+				for (std::size_t i = 0; i < count; i += 4096) {
+					canvas.draw(&xs[i], &ys[i], std::min<std::size_t>(4096, count - i));
+				}
+				canvas.save();
+				return 0;
+			});
+			return static_cast<std::uint64_t>(count);
+		});
+
+		// Macro benchmarks: what running a script costs, from source to image.
+		for (auto const & script : scripts) {
+			suite.add(std::string("pipeline/") + script.kind, "B", [&](double & seconds) {
+				timed(seconds, [&]() {
+					std::ostringstream diagnostics;
+					br::RaphParser parser("bench", diagnostics);
+					auto program = parser.parse(script.source);
+					br::bind(*program, parser);
+					br::optimize(*program, false);
+					br::Canvas canvas("raph-bench.pgm");
+					br::Context context(canvas, program->slots().size(), 1);
+					Quiet quiet;
+					br::execute(*program, context, br::Engine::Tree);
+					canvas.save();
+					return 0;
+				});
+				return static_cast<std::uint64_t>(script.source.size());
+			});
+		}
+	}
+
+	/// Results as tab-separated lines: name, seconds, items, unit.
+	void write_results(std::ostream & stream, std::vector<Result> const & results) {
+		stream << "# benchmark\tseconds\titems\tunit" << std::endl;
+		stream << std::setprecision(9);
+		for (auto const & result : results) {
+			stream << result.name << '\t' << result.seconds << '\t' << result.items << '\t' << result.unit << std::endl;
+		}
+	}
+
+	auto read_results(std::string const & path, std::map<std::string, double> & seconds) -> bool {
+		std::ifstream stream(path);
+		if (!stream) {
+			std::cerr << "cannot open " << path << std::endl;
+			return false;
+		}
+		std::string line;
+		while (std::getline(stream, line)) {
+			if (line.empty() || line[0] == '#') {
+				continue;
+			}
+			std::istringstream fields(line);
+			std::string name;
+			double time;
+			if (std::getline(fields, name, '\t') && fields >> time) {
+				seconds[name] = time;
+			}
+		}
+		return true;
+	}
+
+	/// \return whether no benchmark is slower than in \a baseline by more than \a tolerance
+	auto compare(std::vector<Result> const & results, std::map<std::string, double> const & baseline, double tolerance) -> bool {
+		auto passed = true;
+		for (auto const & result : results) {
+			auto found = baseline.find(result.name);
+			if (found == baseline.end() || found->second <= 0.0) {
+				continue;
+			}
+			auto ratio = result.seconds / found->second;
+			if (ratio > 1.0 + tolerance) {
+				passed = false;
+				std::cerr << "regression: " << result.name << " takes " << std::fixed << std::setprecision(2) << ratio << "x as long as the baseline" << std::endl;
+			} else if (ratio < 1.0 - tolerance) {
+				std::cerr << "improvement: " << result.name << " takes " << std::fixed << std::setprecision(2) << ratio << "x as long as the baseline" << std::endl;
+			}
+		}
+		return passed;
+	}
+
+} // namespace
+
+int main(int argc, char * argv[]) {
+
+	std::size_t scale = 1;
+	std::size_t repeat = 5;
+	std::string filter;
+	std::string output;
+	std::string baseline;
+	double tolerance = 0.1;
+	std::string print;
+
+	for (int i = 1; i < argc; ++i) {
+		char * end = nullptr;
+		if (std::strncmp(argv[i], "--scale=", 8) == 0) {
+			scale = std::strtoul(argv[i] + 8, &end, 10);
+			if (end == argv[i] + 8 || *end != '\0' || scale == 0) {
+				std::cerr << "invalid scale: " << argv[i] + 8 << std::endl;
+				return 1;
+			}
+		} else if (std::strncmp(argv[i], "--repeat=", 9) == 0) {
+			repeat = std::strtoul(argv[i] + 9, &end, 10);
+			if (end == argv[i] + 9 || *end != '\0' || repeat == 0) {
+				std::cerr << "invalid repeat count: " << argv[i] + 9 << std::endl;
+				return 1;
+			}
+		} else if (std::strncmp(argv[i], "--filter=", 9) == 0) {
+			filter = argv[i] + 9;
+		} else if (std::strncmp(argv[i], "--output=", 9) == 0) {
+			output = argv[i] + 9;
+		} else if (std::strncmp(argv[i], "--baseline=", 11) == 0) {
+			baseline = argv[i] + 11;
+		} else if (std::strncmp(argv[i], "--tolerance=", 12) == 0) {
+			tolerance = std::strtod(argv[i] + 12, &end);
+			if (end == argv[i] + 12 || *end != '\0' || tolerance < 0) {
+				std::cerr << "invalid tolerance: " << argv[i] + 12 << std::endl;
+				return 1;
+			}
+		} else if (std::strncmp(argv[i], "--script=", 9) == 0) {
+			print = argv[i] + 9;
+		} else {
+			usage(argv[0]);
+			return std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	std::vector<Script> scripts = {
+		{"expressions", expressions(scale), "stmt"},
+		{"statements", statements(scale), "stmt"},
+		{"loops", loops(scale), "draw"},
+		{"draws", draws(scale), "draw"},
+	};
+	if (!print.empty()) {
+		for (auto const & script : scripts) {
+			if (print == script.kind) {
+				std::cout << script.source;
+				return 0;
+			}
+		}
+		std::cerr << "unknown script: " << print << std::endl;
+		return 1;
+	}
+	for (auto const & script : scripts) {
+		parse(script.source);
+	}
+
+	Suite suite(repeat, filter);
+	run_benchmarks(suite, scripts);
+
+	write_results(std::cout, suite.results());
+	if (!output.empty()) {
+		std::ofstream stream(output);
+		write_results(stream, suite.results());
+		if (!stream) {
+			std::cerr << "cannot write " << output << std::endl;
+			return 1;
+		}
+	}
+	if (!baseline.empty()) {
+		std::map<std::string, double> seconds;
+		if (!read_results(baseline, seconds)) {
+			return 1;
+		}
+		return compare(suite.results(), seconds, tolerance) ? 0 : 2;
+	}
+	return 0;
+}
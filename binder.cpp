@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "binder.hpp"
+#include "builtin.hpp"
+#include "raph.hpp"
+
+namespace br {
+
+	namespace {
+
+		char const * const special_names[special_slots] = {"clear", "origin", "scale", "rot"};
+
+		/// Collect the names of a program: those it assigns, in order of first assignment, and those it reads.
+		class Names : public Walker {
+		public:
+			std::vector<std::string const *> assigned;
+
+			std::vector<std::string const *> read;
+
+			using Walker::visit;
+
+			virtual void visit(Variable const & node) override {
+				if (m_read.insert(&node.id()).second) {
+					read.push_back(&node.id());
+				}
+			}
+
+			virtual void visit(ForStatement const & node) override {
+				assign(&node.id());
+				Walker::visit(node);
+			}
+
+			virtual void visit(AssignStatement const & node) override {
+				assign(&node.id());
+				Walker::visit(node);
+			}
+
+		private:
+			void assign(std::string const * name) {
+				if (m_assigned.insert(name).second) {
+					assigned.push_back(name);
+				}
+			}
+
+			std::unordered_set<std::string const *> m_assigned, m_read;
+		};
+
+		class Binding : public Rewriter {
+		public:
+			Binding(std::unordered_map<std::string const *, Symbol const *> const & symbols, Program const & program, RaphParser const & parser)
+				: m_symbols(symbols), m_program(program), m_parser(parser) {
+			}
+
+			bool failed = false;
+
+			virtual auto rewrite(Expression * node) -> Expression * override {
+				node->rewrite(*this);
+				auto variable = dynamic_cast<Variable *>(node);
+				if (variable != nullptr) {
+					auto symbol = m_symbols.at(&variable->id());
+					if (symbol->slot == no_slot && symbol->builtin == nullptr) {
+						error(*node, "undefined variable '" + variable->id() + "'");
+					}
+					variable->bind(symbol);
+				}
+				auto constant = dynamic_cast<Constant *>(node);
+				if (constant != nullptr) {
+					auto value = find_constant(constant->id());
+					if (value == nullptr) {
+						error(*node, "undefined constant '" + constant->id() + "'");
+					}
+					constant->bind(value);
+				}
+				return node;
+			}
+
+			virtual auto rewrite(Statement * node) -> Statement * override {
+				node->rewrite(*this);
+				auto assign = dynamic_cast<AssignStatement *>(node);
+				if (assign != nullptr) {
+					assign->bind(m_symbols.at(&assign->id())->slot);
+				}
+				auto loop = dynamic_cast<ForStatement *>(node);
+				if (loop != nullptr) {
+					loop->bind(m_symbols.at(&loop->id())->slot);
+				}
+				return node;
+			}
+
+		private:
+			void error(Node const & node, std::string const & message) {
+				m_parser.error(m_program.sources(), m_program.location(node.span()), message);
+				failed = true;
+			}
+
+			std::unordered_map<std::string const *, Symbol const *> const & m_symbols;
+			Program const & m_program;
+			RaphParser const & m_parser;
+		};
+
+	} // namespace
+
+	auto bind(Program & program, RaphParser const & parser) -> bool {
+		Names names;
+		program.accept(names);
+
+		std::vector<std::string const *> slots;
+		for (auto name : special_names) {
+			slots.push_back(program.name(name));
+		}
+		for (auto name : names.assigned) {
+			if (std::find(slots.begin(), slots.begin() + special_slots, name) == slots.begin() + special_slots) {
+				slots.push_back(name);
+			}
+		}
+		std::vector<Symbol> symbols;
+		std::unordered_map<std::string const *, std::uint32_t> indices;
+		auto add = [&](std::string const * name, std::uint32_t slot) {
+			if (indices.emplace(name, static_cast<std::uint32_t>(symbols.size())).second) {
+				symbols.push_back(Symbol{name, slot, find_builtin(*name)});
+			}
+		};
+		for (std::size_t slot = 0; slot < slots.size(); ++slot) {
+			add(slots[slot], static_cast<std::uint32_t>(slot));
+		}
+		for (auto name : names.read) {
+			add(name, no_slot);
+		}
+
+		auto table = program.array(symbols.data(), symbols.size());
+		std::unordered_map<std::string const *, Symbol const *> resolved;
+		for (auto const & entry : indices) {
+			resolved.emplace(entry.first, &table[entry.second]);
+		}
+		program.slots(program.array(slots.data(), slots.size()));
+
+		Binding binding(resolved, program, parser);
+		program.rewrite(binding);
+		return !binding.failed;
+	}
+
+} // namespace br
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "ast.hpp"
+
+namespace br {
+
+	class RaphParser;
+
+	/** \brief Resolve the names of \a program.
+	 **
+	 ** Every name assigned by the program, plus `clear`, `origin`, `scale` and `rot`, gets a frame slot.
+	 ** Variables are bound to the symbol of their name, which also refers to the built-in of that name,
+	 ** and constants to their value. A program must be bound before it is executed or compiled.
+	 **
+	 ** \return false if a name is neither assigned, a built-in nor a constant; each use of such a name
+	 **         is reported through \a parser with its location
+	 */
+	auto bind(Program & program, RaphParser const & parser) -> bool;
+
+} // namespace br
@@ -0,0 +1,109 @@
+#include <cmath>
+#include "builtin.hpp"
+#include "context.hpp"
+
+namespace br {
+
+	namespace {
+
+		template< double (* F)(double) >
+		auto math(Context &, Value const * arguments) -> Value {
+			return F(expect_number(arguments[0], "argument"));
+		}
+
+		template< double (* F)(double, double) >
+		auto math2(Context &, Value const * arguments) -> Value {
+			return F(expect_number(arguments[0], "first argument"), expect_number(arguments[1], "second argument"));
+		}
+
+		auto draw(Context & context, Value const * arguments) -> Value {
+			context.draw(expect_number(arguments[0], "draw x"), expect_number(arguments[1], "draw y"));
+			return Value();
+		}
+
+		auto save(Context & context, Value const *) -> Value {
+			context.save();
+			return Value();
+		}
+
+		auto rand(Context & context, Value const *) -> Value {
+			return context.random();
+		}
+
+		auto sin(double x) -> double { return std::sin(x); }
+		auto cos(double x) -> double { return std::cos(x); }
+		auto tan(double x) -> double { return std::tan(x); }
+		auto asin(double x) -> double { return std::asin(x); }
+		auto acos(double x) -> double { return std::acos(x); }
+		auto atan(double x) -> double { return std::atan(x); }
+		auto sqrt(double x) -> double { return std::sqrt(x); }
+		auto exp(double x) -> double { return std::exp(x); }
+		auto ln(double x) -> double { return std::log(x); }
+		auto abs(double x) -> double { return std::fabs(x); }
+		auto floor(double x) -> double { return std::floor(x); }
+		auto ceil(double x) -> double { return std::ceil(x); }
+		auto atan2(double y, double x) -> double { return std::atan2(y, x); }
+		auto min(double x, double y) -> double { return std::fmin(x, y); }
+		auto max(double x, double y) -> double { return std::fmax(x, y); }
+
+		Builtin const builtins[] = {
+			{"sin",   Builtin::Kind::Function, 1, math<sin>, sin, nullptr, true},
+			{"cos",   Builtin::Kind::Function, 1, math<cos>, cos, nullptr, true},
+			{"tan",   Builtin::Kind::Function, 1, math<tan>, tan, nullptr, true},
+			{"asin",  Builtin::Kind::Function, 1, math<asin>, asin, nullptr, true},
+			{"acos",  Builtin::Kind::Function, 1, math<acos>, acos, nullptr, true},
+			{"atan",  Builtin::Kind::Function, 1, math<atan>, atan, nullptr, true},
+			{"sqrt",  Builtin::Kind::Function, 1, math<sqrt>, sqrt, nullptr, true},
+			{"exp",   Builtin::Kind::Function, 1, math<exp>, exp, nullptr, true},
+			{"ln",    Builtin::Kind::Function, 1, math<ln>, ln, nullptr, true},
+			{"abs",   Builtin::Kind::Function, 1, math<abs>, abs, nullptr, true},
+			{"floor", Builtin::Kind::Function, 1, math<floor>, floor, nullptr, true},
+			{"ceil",  Builtin::Kind::Function, 1, math<ceil>, ceil, nullptr, true},
+			{"atan2", Builtin::Kind::Function, 2, math2<atan2>, nullptr, atan2, true},
+			{"min",   Builtin::Kind::Function, 2, math2<min>, nullptr, min, true},
+			{"max",   Builtin::Kind::Function, 2, math2<max>, nullptr, max, true},
+			{"draw",  Builtin::Kind::Function, 2, draw, nullptr, nullptr, false},
+			{"save",  Builtin::Kind::Function, 0, save, nullptr, nullptr, false},
+			{"rand",  Builtin::Kind::Property, 0, rand, nullptr, nullptr, false},
+		};
+
+		struct {
+			char const * name;
+			Value value;
+		} const constants[] = {
+			{"PI", 3.14159265358979323846},
+			{"E",  2.71828182845904523536},
+		};
+
+	} // namespace
+
+	auto find_builtin(std::string const & name) -> Builtin const * {
+		for (auto const & builtin : builtins) {
+			if (name == builtin.name) {
+				return &builtin;
+			}
+		}
+		return nullptr;
+	}
+
+	auto expect_function(Value const & func, std::size_t count) -> Builtin const * {
+		if (!func.is_function()) {
+			throw RuntimeError(std::string("cannot call a ") + type_name(func.type()));
+		}
+		auto builtin = func.as_function();
+		if (count != builtin->arity) {
+			throw RuntimeError(std::string(builtin->name) + " takes " + std::to_string(builtin->arity) + " argument(s), " + std::to_string(count) + " given");
+		}
+		return builtin;
+	}
+
+	auto find_constant(std::string const & name) -> Value const * {
+		for (auto const & constant : constants) {
+			if (name == constant.name) {
+				return &constant.value;
+			}
+		}
+		return nullptr;
+	}
+
+} // namespace br
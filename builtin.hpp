@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "value.hpp"
+
+namespace br {
+
+	class Context;
+
+	/// Upper bound on the number of arguments a built-in function takes.
+	constexpr std::size_t max_arity = 4;
+
+	/// A function or property provided by the runtime.
+	class Builtin {
+	public:
+		enum class Kind {
+			/// Called with arguments, e.g. `sin(t)`.
+			Function,
+			/// Evaluated whenever its name is read, e.g. `rand`.
+			Property,
+		};
+
+		using Callback = auto (*)(Context & context, Value const * arguments) -> Value;
+
+		using Unary = auto (*)(double) -> double;
+
+		using Binary = auto (*)(double, double) -> double;
+
+		char const * name;
+		Kind kind;
+		std::size_t arity;
+		Callback callback;
+		/// For numeric functions of one argument, the function itself; nullptr otherwise.
+		Unary unary;
+		/// For numeric functions of two arguments, the function itself; nullptr otherwise.
+		Binary binary;
+		/// Whether a call depends on its arguments only and has no effect, so equal calls may share one result.
+		bool pure;
+	}; // class Builtin
+
+	/// Look up a built-in function or property, nullptr if there is none.
+	auto find_builtin(std::string const & name) -> Builtin const *;
+
+	/// The built-in that \a func refers to; throws RuntimeError unless it is a function taking \a count arguments.
+	auto expect_function(Value const & func, std::size_t count) -> Builtin const *;
+
+	/// Look up a built-in constant such as `PI`, nullptr if there is none.
+	auto find_constant(std::string const & name) -> Value const *;
+
+} // namespace br
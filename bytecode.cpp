@@ -0,0 +1,634 @@
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <utility>
+#include "builtin.hpp"
+#include "bytecode.hpp"
+#include "context.hpp"
+
+#if defined(__GNUC__)
+#define RAPH_THREADED_DISPATCH 1
+#else
+#define RAPH_THREADED_DISPATCH 0
+#endif
+
+namespace br {
+
+	namespace {
+
+		/// What `n` names in TEST, JMPF and JMPT, for type errors.
+		enum Operand : std::uint8_t {
+			CONDITION,
+			AND_LHS,
+			AND_RHS,
+			OR_LHS,
+			OR_RHS,
+		};
+
+		char const * const operands[] = {
+			"condition",
+			"left operand of '&&'",
+			"right operand of '&&'",
+			"left operand of '||'",
+			"right operand of '||'",
+		};
+
+		char const * const opcode_names[] = {
+		#define RAPH_OPCODE_NAME(name, layout) #name,
+			RAPH_OPCODES(RAPH_OPCODE_NAME)
+		#undef RAPH_OPCODE_NAME
+		};
+
+		char const * const opcode_layouts[] = {
+		#define RAPH_OPCODE_LAYOUT(name, layout) layout,
+			RAPH_OPCODES(RAPH_OPCODE_LAYOUT)
+		#undef RAPH_OPCODE_LAYOUT
+		};
+
+		using Register = std::uint16_t;
+
+		/// Opcodes of the binary operators other than '&&' and '||', indexed by BinaryOperator.
+		Opcode const opcodes[] = {
+			Opcode::HALT, Opcode::HALT, Opcode::EQ, Opcode::NE, Opcode::LT, Opcode::GT, Opcode::LE, Opcode::GE,
+			Opcode::ADD, Opcode::SUB, Opcode::MUL, Opcode::DIV, Opcode::MOD, Opcode::POW,
+		};
+
+		class Compiler : public Visitor {
+		public:
+			auto compile(Program const & program) -> Bytecode {
+				for (auto name : program.slots()) {
+					m_bytecode.names.push_back(*name);
+				}
+				m_bytecode.variables = m_bytecode.names.size();
+				m_bytecode.builtins.assign(m_bytecode.variables, nullptr);
+				// The drawing transform is assigned by every Context before the program runs.
+				m_assigned.assign(m_bytecode.variables, false);
+				for (auto slot : {origin_slot, scale_slot, rot_slot}) {
+					m_assigned[slot] = true;
+				}
+				m_top = m_bytecode.variables;
+				m_bytecode.registers = m_top;
+				check_registers(m_top);
+				program.accept(*this);
+				emit(Opcode::HALT);
+				return std::move(m_bytecode);
+			}
+
+			virtual void visit(Variable const & node) override {
+				auto symbol = node.symbol();
+				if (symbol->slot != no_slot) {
+					if (!m_assigned[symbol->slot]) {
+						// Read like Context::lookup(): the built-in of the same name, or an error, until it is assigned.
+						m_bytecode.builtins[symbol->slot] = symbol->builtin;
+						emit(Opcode::LOADV, m_target, symbol->slot);
+					} else if (symbol->slot != m_target) {
+						emit(Opcode::MOVE, m_target, symbol->slot);
+					}
+					return;
+				}
+				auto builtin = symbol->builtin;
+				if (builtin->kind == Builtin::Kind::Function) {
+					emit_wide(Opcode::LOADK, m_target, constant(builtin));
+				} else {
+					emit_wide(Opcode::PROP, m_target, constant(builtin));
+				}
+			}
+
+			virtual void visit(Constant const & node) override {
+				emit_wide(Opcode::LOADK, m_target, constant(*node.value()));
+			}
+
+			virtual void visit(Numeric const & node) override {
+				emit_wide(Opcode::LOADK, m_target, constant(node.value()));
+			}
+
+			virtual void visit(Boolean const & node) override {
+				emit_wide(Opcode::LOADK, m_target, constant(node.value()));
+			}
+
+			virtual void visit(Vector const & node) override {
+				auto target = m_target;
+				auto top = m_top;
+				auto x = operand(node.x());
+				auto y = operand(node.y());
+				emit(Opcode::VEC, target, x, y);
+				m_top = top;
+			}
+
+			virtual void visit(FunctionCall const & node) override {
+				auto target = m_target;
+				auto top = m_top;
+				auto count = node.args().size();
+				auto callee = dynamic_cast<Variable const *>(&node.func());
+				auto builtin = callee != nullptr && callee->symbol()->slot == no_slot ? callee->symbol()->builtin : nullptr;
+				auto direct = builtin != nullptr && builtin->kind == Builtin::Kind::Function && builtin->arity == count;
+				auto base = direct ? m_top : temporary();
+				if (!direct) {
+					expression(node.func(), base);
+				}
+				auto arguments = m_top;
+				for (auto const & arg : node.args()) {
+					expression(*arg, temporary());
+				}
+				if (direct && constant(builtin) <= std::numeric_limits<Register>::max()) {
+					emit(Opcode::CALLK, target, static_cast<Register>(constant(builtin)), arguments);
+				} else {
+					if (direct) {
+						throw RuntimeError("compile: too many constants");
+					}
+					emit(Opcode::CALL, target, base, arguments, static_cast<std::uint8_t>(count < 0xFF ? count : 0xFF));
+				}
+				m_top = top;
+			}
+
+			virtual void visit(ArrayAccess const & node) override {
+				auto target = m_target;
+				auto top = m_top;
+				auto var = operand(node.var());
+				auto index = operand(node.index());
+				emit(Opcode::INDEX, target, var, index);
+				m_top = top;
+			}
+
+			virtual void visit(UnaryOperation const & node) override {
+				auto target = m_target;
+				auto top = m_top;
+				auto rhs = operand(node.rhs());
+				switch (node.op()) {
+					case UnaryOperator::Not:
+						emit(Opcode::NOT, target, rhs);
+						break;
+					case UnaryOperator::Plus:
+						emit(Opcode::POS, target, rhs);
+						break;
+					case UnaryOperator::Minus:
+						emit(Opcode::NEG, target, rhs);
+						break;
+				}
+				m_top = top;
+			}
+
+			virtual void visit(BinaryOperation const & node) override {
+				auto target = m_target;
+				auto top = m_top;
+				auto op = node.op();
+				if (op == BinaryOperator::And || op == BinaryOperator::Or) {
+					// The result register is written before the right operand is read, so it must not be a variable.
+					auto result = target < m_bytecode.variables ? temporary() : target;
+					auto is_and = op == BinaryOperator::And;
+					expression(node.lhs(), result);
+					auto skip = emit_wide(is_and ? Opcode::JMPF : Opcode::JMPT, result, 0, is_and ? AND_LHS : OR_LHS);
+					expression(node.rhs(), result);
+					emit(Opcode::TEST, result, 0, 0, is_and ? AND_RHS : OR_RHS);
+					patch(skip);
+					if (result != target) {
+						emit(Opcode::MOVE, target, result);
+					}
+					m_top = top;
+					return;
+				}
+				auto lhs = operand(node.lhs());
+				auto rhs = operand(node.rhs());
+				emit(opcodes[static_cast<std::size_t>(op)], target, lhs, rhs);
+				m_top = top;
+			}
+
+			virtual void visit(EmptyStatement const & node) override {
+			}
+
+			virtual void visit(CompoundStatement const & node) override {
+				for (auto const & statement : node.stmts()) {
+					statement->accept(*this);
+				}
+			}
+
+			virtual void visit(Program const & node) override {
+				for (auto const & statement : node.stmts()) {
+					statement->accept(*this);
+				}
+			}
+
+			virtual void visit(ConditionalStatement const & node) override {
+				auto top = m_top;
+				auto cond = operand(node.cond());
+				m_top = top;
+				auto when_false = emit_wide(Opcode::JMPF, cond, 0, CONDITION);
+				auto assigned = m_assigned;
+				node.when_true().accept(*this);
+				std::swap(assigned, m_assigned);
+				if (dynamic_cast<EmptyStatement const *>(&node.when_false()) != nullptr) {
+					patch(when_false);
+					return;
+				}
+				auto end = emit_wide(Opcode::JMP, 0, 0);
+				patch(when_false);
+				node.when_false().accept(*this);
+				patch(end);
+				for (std::size_t slot = 0; slot < m_assigned.size(); ++slot) {
+					m_assigned[slot] = m_assigned[slot] && assigned[slot];
+				}
+			}
+
+			virtual void visit(WhileStatement const & node) override {
+				loop(node.cond(), node.body(), Opcode::JMPF);
+			}
+
+			virtual void visit(UntilStatement const & node) override {
+				loop(node.cond(), node.body(), Opcode::JMPT);
+			}
+
+			virtual void visit(ForStatement const & node) override {
+				auto top = m_top;
+				// from, to (then the iterations left), step, iteration count, current value, whether exact_steps()
+				auto base = m_top;
+				for (int i = 0; i < 6; ++i) {
+					temporary();
+				}
+				expression(node.from(), base);
+				expression(node.to(), base + 1);
+				expression(node.step(), base + 2);
+				auto exit = emit_wide(Opcode::FORPREP, base, 0);
+				auto body = here();
+				auto assigned = m_assigned;
+				assign(node.slot(), base + 4);
+				node.body().accept(*this);
+				m_assigned = std::move(assigned);
+				emit_wide(Opcode::FORLOOP, base, body);
+				patch(exit);
+				m_top = top;
+			}
+
+			virtual void visit(AssignStatement const & node) override {
+				expression(node.expr(), node.slot());
+				define(node.slot());
+				if (Context::is_special(node.slot())) {
+					emit(Opcode::SETG, node.slot());
+				}
+			}
+
+			virtual void visit(ExpressionStatement const & node) override {
+				auto top = m_top;
+				expression(node.expr(), temporary());
+				m_top = top;
+			}
+
+		private:
+			void loop(Expression const & cond, Statement const & body, Opcode exit_when) {
+				auto top = m_top;
+				auto start = here();
+				auto value = operand(cond);
+				m_top = top;
+				auto exit = emit_wide(exit_when, value, 0, CONDITION);
+				auto assigned = m_assigned;
+				body.accept(*this);
+				m_assigned = std::move(assigned);
+				emit_wide(Opcode::JMP, 0, start);
+				patch(exit);
+			}
+
+			void assign(std::uint32_t slot, Register value) {
+				emit(Opcode::MOVE, slot, value);
+				define(slot);
+				if (Context::is_special(slot)) {
+					emit(Opcode::SETG, slot);
+				}
+			}
+
+			/// Note that \a slot has just been assigned, which the VM records unless it is known already.
+			void define(std::uint32_t slot) {
+				if (!m_assigned[slot]) {
+					emit(Opcode::DEFV, slot);
+					m_assigned[slot] = true;
+				}
+			}
+
+			void expression(Expression const & expr, Register target) {
+				m_target = target;
+				expr.accept(*this);
+			}
+
+			/// The register holding the value of \a expr: an assigned variable's own register, or a fresh temporary.
+			auto operand(Expression const & expr) -> Register {
+				auto variable = dynamic_cast<Variable const *>(&expr);
+				if (variable != nullptr && variable->symbol()->slot != no_slot && m_assigned[variable->symbol()->slot]) {
+					return static_cast<Register>(variable->symbol()->slot);
+				}
+				auto target = temporary();
+				expression(expr, target);
+				return target;
+			}
+
+			auto temporary() -> Register {
+				auto result = m_top++;
+				check_registers(m_top);
+				if (m_top > m_bytecode.registers) {
+					m_bytecode.registers = m_top;
+				}
+				return static_cast<Register>(result);
+			}
+
+			static void check_registers(std::size_t count) {
+				if (count > std::numeric_limits<Register>::max()) {
+					throw RuntimeError("compile: program needs too many registers");
+				}
+			}
+
+			auto constant(Value const & value) -> std::uint32_t {
+				std::uint64_t bits = 0;
+				switch (value.type()) {
+					case Value::Type::Number: {
+						auto number = value.as_number();
+						std::memcpy(&bits, &number, sizeof(bits));
+						break;
+					}
+					case Value::Type::Boolean:
+						bits = value.as_boolean();
+						break;
+					case Value::Type::Function:
+						bits = reinterpret_cast<std::uintptr_t>(value.as_function());
+						break;
+					default:
+						break;
+				}
+				auto key = std::make_pair(static_cast<int>(value.type()), bits);
+				auto iterator = m_constants.find(key);
+				if (iterator != m_constants.end()) {
+					return iterator->second;
+				}
+				auto index = static_cast<std::uint32_t>(m_bytecode.constants.size());
+				m_bytecode.constants.push_back(value);
+				m_constants.emplace(key, index);
+				return index;
+			}
+
+			auto here() const -> std::uint32_t {
+				return static_cast<std::uint32_t>(m_bytecode.code.size());
+			}
+
+			auto emit(Opcode op, std::size_t a = 0, std::size_t b = 0, std::size_t c = 0, std::uint8_t n = 0) -> std::size_t {
+				m_bytecode.code.push_back(Instruction{op, n, static_cast<std::uint16_t>(a), static_cast<std::uint16_t>(b), static_cast<std::uint16_t>(c)});
+				return m_bytecode.code.size() - 1;
+			}
+
+			auto emit_wide(Opcode op, std::size_t a, std::uint32_t wide, std::uint8_t n = 0) -> std::size_t {
+				return emit(op, a, wide & 0xFFFF, wide >> 16, n);
+			}
+
+			/// Point the jump at \a index to the next instruction to be emitted.
+			void patch(std::size_t index) {
+				auto & instruction = m_bytecode.code[index];
+				instruction.b = static_cast<std::uint16_t>(here() & 0xFFFF);
+				instruction.c = static_cast<std::uint16_t>(here() >> 16);
+			}
+
+			Bytecode m_bytecode;
+			std::map<std::pair<int, std::uint64_t>, std::uint32_t> m_constants;
+			std::size_t m_top = 0;
+			Register m_target = 0;
+			/// Whether each variable is assigned on every path to the code being emitted.
+			std::vector<bool> m_assigned;
+		};
+
+	} // namespace
+
+	void Bytecode::disassemble(std::ostream & ostream) const {
+		ostream << "; " << code.size() << " instructions, " << registers << " registers (" << variables << " variables), " << constants.size() << " constants" << std::endl;
+		auto reg = [&](std::uint16_t index) {
+			ostream << 'r' << index;
+			if (index < variables) {
+				ostream << '(' << names[index] << ')';
+			}
+		};
+		for (std::size_t pc = 0; pc < code.size(); ++pc) {
+			auto const & instruction = code[pc];
+			auto layout = opcode_layouts[static_cast<std::size_t>(instruction.op)];
+			ostream << std::setw(6) << pc << "  " << std::left << std::setw(8) << opcode_names[static_cast<std::size_t>(instruction.op)] << std::right;
+			auto narrow = std::strchr(layout, 'c') != nullptr;
+			std::string comment;
+			for (auto field = layout; *field != '\0'; ++field) {
+				switch (*field) {
+					case 'a':
+						reg(instruction.a);
+						break;
+					case 'b':
+						reg(instruction.b);
+						break;
+					case 'c':
+						reg(instruction.c);
+						break;
+					case 'k': {
+						auto k = narrow ? instruction.b : instruction.wide();
+						ostream << 'k' << k;
+						std::ostringstream value;
+						value << constants[k];
+						comment = value.str();
+						break;
+					}
+					case 'j':
+						ostream << "-> " << instruction.wide();
+						break;
+					default:
+						ostream << ", ";
+						continue;
+				}
+			}
+			if (instruction.op == Opcode::CALL) {
+				comment = std::to_string(instruction.n) + " argument(s)";
+			} else if (instruction.op == Opcode::TEST || instruction.op == Opcode::JMPF || instruction.op == Opcode::JMPT) {
+				comment = operands[instruction.n];
+			}
+			if (!comment.empty()) {
+				ostream << "    ; " << comment;
+			}
+			ostream << std::endl;
+		}
+	}
+
+	auto compile(Program const & program) -> Bytecode {
+		return Compiler().compile(program);
+	}
+
+	void execute(Bytecode const & bytecode, Context & context) {
+		std::vector<Value> registers(bytecode.registers);
+		// Whether each variable register is assigned, apart from its value: Void, as draw() returns, may be assigned.
+		std::vector<std::uint8_t> assigned(bytecode.variables, 0);
+		for (std::uint32_t i = 0; i < bytecode.variables; ++i) {
+			auto value = context.variable(i);
+			if (value != nullptr) {
+				registers[i] = *value;
+				assigned[i] = 1;
+			}
+		}
+		auto R = registers.data();
+		auto K = bytecode.constants.data();
+
+#if RAPH_THREADED_DISPATCH
+		// Direct threading: each instruction carries the address of its handler.
+		struct Threaded {
+			void const * label;
+			Instruction instruction;
+		};
+		static void const * const labels[] = {
+		#define RAPH_OPCODE_LABEL(name, layout) &&op_##name,
+			RAPH_OPCODES(RAPH_OPCODE_LABEL)
+		#undef RAPH_OPCODE_LABEL
+		};
+		std::vector<Threaded> threaded;
+		threaded.reserve(bytecode.code.size());
+		for (auto const & instruction : bytecode.code) {
+			threaded.push_back(Threaded{labels[static_cast<std::size_t>(instruction.op)], instruction});
+		}
+		auto const code = threaded.data();
+		auto pc = code;
+		#define RAPH_I (pc->instruction)
+		#define RAPH_CASE(name) op_##name:
+		#define RAPH_NEXT() do { ++pc; goto *pc->label; } while (false)
+		#define RAPH_JUMP(target) do { pc = code + (target); goto *pc->label; } while (false)
+		goto *pc->label;
+#else
+		auto const code = bytecode.code.data();
+		auto pc = code;
+		#define RAPH_I (*pc)
+		#define RAPH_CASE(name) case Opcode::name:
+		#define RAPH_NEXT() do { ++pc; goto dispatch; } while (false)
+		#define RAPH_JUMP(target) do { pc = code + (target); goto dispatch; } while (false)
+	dispatch:
+		switch (pc->op) {
+#endif
+		#define A (RAPH_I.a)
+		#define B (RAPH_I.b)
+		#define C (RAPH_I.c)
+		#define WIDE (RAPH_I.wide())
+		#define BINARY(name, function) RAPH_CASE(name) R[A] = function(R[B], R[C]); RAPH_NEXT();
+
+		RAPH_CASE(HALT)
+			goto halt;
+		RAPH_CASE(LOADK)
+			R[A] = K[WIDE];
+			RAPH_NEXT();
+		RAPH_CASE(MOVE)
+			R[A] = R[B];
+			RAPH_NEXT();
+		RAPH_CASE(LOADV)
+			if (!assigned[B]) {
+				R[A] = context.lookup(Symbol{&bytecode.names[B], B, bytecode.builtins[B]});
+			} else {
+				R[A] = R[B];
+			}
+			RAPH_NEXT();
+		RAPH_CASE(PROP)
+			R[A] = K[WIDE].as_function()->callback(context, nullptr);
+			RAPH_NEXT();
+		RAPH_CASE(SETG)
+			context.assign(A, R[A]);
+			RAPH_NEXT();
+		RAPH_CASE(DEFV)
+			assigned[A] = 1;
+			RAPH_NEXT();
+		RAPH_CASE(VEC) {
+			auto x = expect_number(R[B], "vector x");
+			auto y = expect_number(R[C], "vector y");
+			R[A] = Value(x, y);
+			RAPH_NEXT();
+		}
+		BINARY(INDEX, index)
+		BINARY(ADD, add)
+		BINARY(SUB, subtract)
+		BINARY(MUL, multiply)
+		BINARY(DIV, divide)
+		BINARY(MOD, modulo)
+		BINARY(POW, power)
+		RAPH_CASE(EQ)
+			R[A] = equal(R[B], R[C]);
+			RAPH_NEXT();
+		RAPH_CASE(NE)
+			R[A] = !equal(R[B], R[C]);
+			RAPH_NEXT();
+		BINARY(LT, less)
+		BINARY(GT, greater)
+		BINARY(LE, less_equal)
+		BINARY(GE, greater_equal)
+		RAPH_CASE(NOT)
+			R[A] = logical_not(R[B]);
+			RAPH_NEXT();
+		RAPH_CASE(POS)
+			R[A] = promote(R[B]);
+			RAPH_NEXT();
+		RAPH_CASE(NEG)
+			R[A] = negate(R[B]);
+			RAPH_NEXT();
+		RAPH_CASE(CALL)
+			R[A] = expect_function(R[B], RAPH_I.n)->callback(context, R + C);
+			RAPH_NEXT();
+		RAPH_CASE(CALLK)
+			R[A] = K[B].as_function()->callback(context, R + C);
+			RAPH_NEXT();
+		RAPH_CASE(TEST)
+			expect_boolean(R[A], operands[RAPH_I.n]);
+			RAPH_NEXT();
+		RAPH_CASE(JMP)
+			RAPH_JUMP(WIDE);
+		RAPH_CASE(JMPF)
+			if (!expect_boolean(R[A], operands[RAPH_I.n])) {
+				RAPH_JUMP(WIDE);
+			}
+			RAPH_NEXT();
+		RAPH_CASE(JMPT)
+			if (expect_boolean(R[A], operands[RAPH_I.n])) {
+				RAPH_JUMP(WIDE);
+			}
+			RAPH_NEXT();
+		RAPH_CASE(FORPREP) {
+			auto from = expect_number(R[A], "for-from");
+			auto to = expect_number(R[A + 1], "for-to");
+			auto step = expect_number(R[A + 2], "for-step");
+			if (!(step != 0)) {
+				throw RuntimeError("for-step must be non-zero");
+			}
+			auto count = ForStatement::trip_count(from, to, step);
+			R[A + 1] = static_cast<double>(count) - 1;
+			R[A + 3] = 0.0;
+			R[A + 4] = from;
+			R[A + 5] = ForStatement::exact_steps(from, step, count);
+			if (count == 0) {
+				RAPH_JUMP(WIDE);
+			}
+			RAPH_NEXT();
+		}
+		RAPH_CASE(FORLOOP) {
+			auto left = R[A + 1].as_number();
+			if (left > 0) {
+				auto i = R[A + 3].as_number() + 1;
+				auto step = R[A + 2].as_number();
+				R[A + 1] = left - 1;
+				R[A + 3] = i;
+				R[A + 4] = R[A + 5].as_boolean() ? R[A + 4].as_number() + step : R[A].as_number() + i * step;
+				RAPH_JUMP(WIDE);
+			}
+			RAPH_NEXT();
+		}
+
+#if !RAPH_THREADED_DISPATCH
+		}
+#endif
+		#undef BINARY
+		#undef WIDE
+		#undef C
+		#undef B
+		#undef A
+		#undef RAPH_JUMP
+		#undef RAPH_NEXT
+		#undef RAPH_CASE
+		#undef RAPH_I
+
+	halt:
+		for (std::uint32_t i = 0; i < bytecode.variables; ++i) {
+			if (assigned[i] && !Context::is_special(i)) {
+				context.assign(i, R[i]);
+			}
+		}
+	}
+
+} // namespace br
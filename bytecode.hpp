@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "value.hpp"
+
+namespace br {
+
+	class Builtin;
+	class Context;
+
+	/// X-macro over the opcodes: name, then the operand layout used by the disassembler.
+	#define RAPH_OPCODES(X) \
+		X(HALT,    "")      \
+		X(LOADK,   "a k")   \
+		X(MOVE,    "a b")   \
+		X(LOADV,   "a b")   \
+		X(PROP,    "a k")   \
+		X(SETG,    "a")     \
+		X(DEFV,    "a")     \
+		X(VEC,     "a b c") \
+		X(INDEX,   "a b c") \
+		X(ADD,     "a b c") \
+		X(SUB,     "a b c") \
+		X(MUL,     "a b c") \
+		X(DIV,     "a b c") \
+		X(MOD,     "a b c") \
+		X(POW,     "a b c") \
+		X(EQ,      "a b c") \
+		X(NE,      "a b c") \
+		X(LT,      "a b c") \
+		X(GT,      "a b c") \
+		X(LE,      "a b c") \
+		X(GE,      "a b c") \
+		X(NOT,     "a b")   \
+		X(POS,     "a b")   \
+		X(NEG,     "a b")   \
+		X(CALL,    "a b c") \
+		X(CALLK,   "a k c") \
+		X(TEST,    "a")     \
+		X(JMP,     "j")     \
+		X(JMPF,    "a j")   \
+		X(JMPT,    "a j")   \
+		X(FORPREP, "a j")   \
+		X(FORLOOP, "a j")
+
+	enum class Opcode : std::uint8_t {
+	#define RAPH_OPCODE_ENUM(name, layout) name,
+		RAPH_OPCODES(RAPH_OPCODE_ENUM)
+	#undef RAPH_OPCODE_ENUM
+	};
+
+	/** \brief One register-machine instruction, 8 bytes.
+	 **
+	 ** `a`, `b` and `c` are register numbers unless the layout says otherwise;
+	 ** constant indices and jump targets span `b` and `c` as a 32-bit value.
+	 ** `n` carries an argument count or the operand description used in type errors.
+	 */
+	struct Instruction {
+		Opcode op;
+		std::uint8_t n;
+		std::uint16_t a;
+		std::uint16_t b;
+		std::uint16_t c;
+
+		auto wide() const noexcept -> std::uint32_t {
+			return static_cast<std::uint32_t>(b) | static_cast<std::uint32_t>(c) << 16;
+		}
+	}; // struct Instruction
+
+	/// A compiled program: code, constant pool and the names of its global registers.
+	class Bytecode {
+	public:
+		std::vector<Instruction> code;
+		std::vector<Value> constants;
+		/// Names of the variable registers `[0, variables)`, which are the frame slots of the program.
+		std::vector<std::string> names;
+		/// What each variable register stands for while it is unassigned, see Context::lookup(); nullptr if nothing.
+		std::vector<Builtin const *> builtins;
+		std::size_t variables = 0;
+		std::size_t registers = 0;
+
+		void disassemble(std::ostream & ostream) const;
+	}; // class Bytecode
+
+	/// Compile a syntax tree into register-machine code.
+	auto compile(Program const & program) -> Bytecode;
+
+	/// Execute compiled code; variables are read from and written back to \a context.
+	void execute(Bytecode const & bytecode, Context & context);
+
+} // namespace br
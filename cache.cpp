@@ -0,0 +1,598 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "cache.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RAPH_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define RAPH_MMAP 0
+#endif
+
+#define RAPH_QUOTE(x) #x
+#define RAPH_STRING(x) RAPH_QUOTE(x)
+
+namespace br {
+
+	namespace {
+
+		/// Version of the entry format; part of every key, so that entries of other versions are never used.
+		constexpr std::uint32_t format = 1;
+
+		/** \brief The build of the parser; part of every key, so that a parser that could build other trees from
+		 **        the same source, though in the same format, never uses the entries of another.
+		 **
+		 ** The build defines RAPH_PARSER_REVISION as a digest of the sources of the scanner, the grammar, the
+		 ** tree, the source map and this file; without it, the time this file was compiled stands in.
+		 */
+#ifdef RAPH_PARSER_REVISION
+		char const revision[] = RAPH_STRING(RAPH_PARSER_REVISION);
+#else
+		char const revision[] = __DATE__ " " __TIME__;
+#endif
+
+		constexpr std::uint32_t byte_order = 0x01020304;
+
+		/// "RaphTree", as the first two words of an entry.
+		constexpr std::uint32_t magic[2] = {0x68706152, 0x65657254};
+
+		/// Words before the names: magic, format, byte order, key, source size, the counts of names, lines and
+		/// tree words, and the checksum of the words after the header.
+		constexpr std::size_t header_words = 13;
+
+		/// Deeper trees are taken as damage; the parser's stack is shallower.
+		constexpr std::size_t max_depth = 10000;
+
+		enum class Kind : std::uint32_t {
+			Variable,
+			Constant,
+			Numeric,
+			Boolean,
+			Vector,
+			FunctionCall,
+			ArrayAccess,
+			UnaryOperation,
+			BinaryOperation,
+			EmptyStatement,
+			CompoundStatement,
+			ConditionalStatement,
+			WhileStatement,
+			UntilStatement,
+			ForStatement,
+			AssignStatement,
+			ExpressionStatement,
+		};
+
+		/// Writes the nodes of a tree in prefix order: kind and operator, span, then the fields and the children.
+		class Writer : public Visitor {
+		public:
+			std::vector<std::uint32_t> words;
+			std::vector<std::string const *> names;
+
+			virtual void visit(Variable const & node) override {
+				begin(Kind::Variable, node);
+				name(node.id());
+			}
+
+			virtual void visit(Constant const & node) override {
+				begin(Kind::Constant, node);
+				name(node.id());
+			}
+
+			virtual void visit(Numeric const & node) override {
+				begin(Kind::Numeric, node);
+				auto value = node.value();
+				std::uint32_t halves[2];
+				std::memcpy(halves, &value, sizeof(halves));
+				words.insert(words.end(), halves, halves + 2);
+			}
+
+			virtual void visit(Boolean const & node) override {
+				begin(Kind::Boolean, node);
+				words.push_back(node.value() ? 1 : 0);
+			}
+
+			virtual void visit(Vector const & node) override {
+				begin(Kind::Vector, node);
+				node.x().accept(*this);
+				node.y().accept(*this);
+			}
+
+			virtual void visit(FunctionCall const & node) override {
+				begin(Kind::FunctionCall, node);
+				node.func().accept(*this);
+				words.push_back(static_cast<std::uint32_t>(node.args().size()));
+				for (auto arg : node.args()) {
+					arg->accept(*this);
+				}
+			}
+
+			virtual void visit(ArrayAccess const & node) override {
+				begin(Kind::ArrayAccess, node);
+				node.var().accept(*this);
+				node.index().accept(*this);
+			}
+
+			virtual void visit(UnaryOperation const & node) override {
+				begin(Kind::UnaryOperation, node, static_cast<std::uint32_t>(node.op()));
+				node.rhs().accept(*this);
+			}
+
+			virtual void visit(BinaryOperation const & node) override {
+				begin(Kind::BinaryOperation, node, static_cast<std::uint32_t>(node.op()));
+				node.lhs().accept(*this);
+				node.rhs().accept(*this);
+			}
+
+			virtual void visit(EmptyStatement const & node) override {
+				begin(Kind::EmptyStatement, node);
+			}
+
+			virtual void visit(CompoundStatement const & node) override {
+				begin(Kind::CompoundStatement, node);
+				statements(node.stmts());
+			}
+
+			virtual void visit(Program const & node) override {
+				statements(node.stmts());
+			}
+
+			virtual void visit(ConditionalStatement const & node) override {
+				begin(Kind::ConditionalStatement, node);
+				node.cond().accept(*this);
+				node.when_true().accept(*this);
+				node.when_false().accept(*this);
+			}
+
+			virtual void visit(WhileStatement const & node) override {
+				begin(Kind::WhileStatement, node);
+				node.cond().accept(*this);
+				node.body().accept(*this);
+			}
+
+			virtual void visit(UntilStatement const & node) override {
+				begin(Kind::UntilStatement, node);
+				node.cond().accept(*this);
+				node.body().accept(*this);
+			}
+
+			virtual void visit(ForStatement const & node) override {
+				begin(Kind::ForStatement, node);
+				name(node.id());
+				node.from().accept(*this);
+				node.to().accept(*this);
+				node.step().accept(*this);
+				node.body().accept(*this);
+			}
+
+			virtual void visit(AssignStatement const & node) override {
+				begin(Kind::AssignStatement, node);
+				name(node.id());
+				node.expr().accept(*this);
+			}
+
+			virtual void visit(ExpressionStatement const & node) override {
+				begin(Kind::ExpressionStatement, node);
+				node.expr().accept(*this);
+			}
+
+		private:
+			void begin(Kind kind, Node const & node, std::uint32_t op = 0) {
+				auto span = node.span();
+				words.push_back(static_cast<std::uint32_t>(kind) | op << 8);
+				words.push_back(span.begin);
+				words.push_back(span.end);
+			}
+
+			void name(std::string const & name) {
+				auto inserted = m_indices.emplace(&name, static_cast<std::uint32_t>(names.size()));
+				if (inserted.second) {
+					names.push_back(&name);
+				}
+				words.push_back(inserted.first->second);
+			}
+
+			void statements(Array<Statement *> const & stmts) {
+				words.push_back(static_cast<std::uint32_t>(stmts.size()));
+				for (auto stmt : stmts) {
+					stmt->accept(*this);
+				}
+			}
+
+			std::unordered_map<std::string const *, std::uint32_t> m_indices;
+		};
+
+		/// FNV-1a over words rather than bytes; it only has to notice damage, not spread keys.
+		auto checksum(std::uint32_t const * words, std::size_t count) noexcept -> std::uint64_t {
+			std::uint64_t hash = 0xCBF29CE484222325;
+			for (std::size_t i = 0; i < count; ++i) {
+				hash = (hash ^ words[i]) * 0x100000001B3;
+			}
+			return hash;
+		}
+
+		/// Thrown by Reader at the first word that does not fit the format.
+		struct Damaged {
+		};
+
+		/// Makes the nodes written by Writer in a program, checking every word against the end and the format.
+		class Reader {
+		public:
+			Reader(std::uint32_t const * words, std::uint32_t const * end, Program & program)
+				: m_words(words), m_end(end), m_program(program), m_depth(0) {
+			}
+
+			auto at() const noexcept -> std::uint32_t const * {
+				return m_words;
+			}
+
+			auto word() -> std::uint32_t {
+				if (m_words == m_end) {
+					throw Damaged();
+				}
+				return *m_words++;
+			}
+
+			/// \a count words, as a pointer into the entry.
+			auto words(std::size_t count) -> std::uint32_t const * {
+				if (static_cast<std::size_t>(m_end - m_words) < count) {
+					throw Damaged();
+				}
+				auto words = m_words;
+				m_words += count;
+				return words;
+			}
+
+			void names(std::size_t count) {
+				for (std::size_t i = 0; i < count; ++i) {
+					auto length = word();
+					auto text = reinterpret_cast<char const *>(words((static_cast<std::size_t>(length) + 3) / 4));
+					m_names.push_back(m_program.name(std::string(text, length)));
+				}
+			}
+
+			auto statements() -> Array<Statement *> {
+				auto count = word();
+				if (count > static_cast<std::size_t>(m_end - m_words)) {
+					throw Damaged();
+				}
+				std::vector<Statement *> stmts;
+				stmts.reserve(count);
+				for (std::uint32_t i = 0; i < count; ++i) {
+					stmts.push_back(statement());
+				}
+				return m_program.array(stmts.data(), stmts.size());
+			}
+
+			auto statement() -> Statement * {
+				Depth depth(*this);
+				Span span;
+				auto kind = begin(span);
+				switch (static_cast<Kind>(kind & 0xFF)) {
+					case Kind::EmptyStatement:
+						return m_program.make<EmptyStatement>(span);
+					case Kind::CompoundStatement:
+						return m_program.make<CompoundStatement>(span, statements());
+					case Kind::ConditionalStatement: {
+						auto cond = expression();
+						auto when_true = statement();
+						return m_program.make<ConditionalStatement>(span, cond, when_true, statement());
+					}
+					case Kind::WhileStatement: {
+						auto cond = expression();
+						return m_program.make<WhileStatement>(span, cond, statement());
+					}
+					case Kind::UntilStatement: {
+						auto cond = expression();
+						return m_program.make<UntilStatement>(span, cond, statement());
+					}
+					case Kind::ForStatement: {
+						auto id = name();
+						auto from = expression();
+						auto to = expression();
+						auto step = expression();
+						return m_program.make<ForStatement>(span, id, from, to, step, statement());
+					}
+					case Kind::AssignStatement: {
+						auto id = name();
+						return m_program.make<AssignStatement>(span, id, expression());
+					}
+					case Kind::ExpressionStatement:
+						return m_program.make<ExpressionStatement>(span, expression());
+					default:
+						throw Damaged();
+				}
+			}
+
+			auto expression() -> Expression * {
+				Depth depth(*this);
+				Span span;
+				auto kind = begin(span);
+				auto op = kind >> 8;
+				switch (static_cast<Kind>(kind & 0xFF)) {
+					case Kind::Variable:
+						return m_program.make<Variable>(span, name());
+					case Kind::Constant:
+						return m_program.make<Constant>(span, name());
+					case Kind::Numeric: {
+						double value;
+						std::memcpy(&value, words(2), sizeof(value));
+						return m_program.make<Numeric>(span, value);
+					}
+					case Kind::Boolean:
+						return m_program.make<Boolean>(span, word() != 0);
+					case Kind::Vector: {
+						auto x = expression();
+						return m_program.make<Vector>(span, x, expression());
+					}
+					case Kind::FunctionCall: {
+						auto func = expression();
+						auto count = word();
+						if (count > static_cast<std::size_t>(m_end - m_words)) {
+							throw Damaged();
+						}
+						std::vector<Expression *> args;
+						args.reserve(count);
+						for (std::uint32_t i = 0; i < count; ++i) {
+							args.push_back(expression());
+						}
+						return m_program.make<FunctionCall>(span, func, m_program.array(args.data(), args.size()));
+					}
+					case Kind::ArrayAccess: {
+						auto var = expression();
+						return m_program.make<ArrayAccess>(span, var, expression());
+					}
+					case Kind::UnaryOperation:
+						if (op > static_cast<std::uint32_t>(UnaryOperator::Minus)) {
+							throw Damaged();
+						}
+						return m_program.make<UnaryOperation>(span, static_cast<UnaryOperator>(op), expression());
+					case Kind::BinaryOperation: {
+						if (op > static_cast<std::uint32_t>(BinaryOperator::Power)) {
+							throw Damaged();
+						}
+						auto lhs = expression();
+						return m_program.make<BinaryOperation>(span, static_cast<BinaryOperator>(op), lhs, expression());
+					}
+					default:
+						throw Damaged();
+				}
+			}
+
+		private:
+			/// Counts the nodes being read, so that a cyclic or absurd entry fails instead of overflowing the stack.
+			class Depth {
+			public:
+				explicit Depth(Reader & reader) : m_reader(reader) {
+					if (++m_reader.m_depth > max_depth) {
+						throw Damaged();
+					}
+				}
+
+				~Depth() noexcept {
+					--m_reader.m_depth;
+				}
+
+			private:
+				Reader & m_reader;
+			};
+
+			auto begin(Span & span) -> std::uint32_t {
+				auto kind = word();
+				span.begin = word();
+				span.end = word();
+				return kind;
+			}
+
+			auto name() -> std::string const * {
+				auto index = word();
+				if (index >= m_names.size()) {
+					throw Damaged();
+				}
+				return m_names[index];
+			}
+
+			std::uint32_t const * m_words;
+			std::uint32_t const * m_end;
+			Program & m_program;
+			std::vector<std::string const *> m_names;
+			std::size_t m_depth;
+		};
+
+		auto read(std::uint32_t const * words, std::size_t count, std::uint64_t key, std::size_t size, std::string const & filename) -> std::unique_ptr<Program> {
+			if (count < header_words || words[0] != magic[0] || words[1] != magic[1] || words[2] != format || words[3] != byte_order) {
+				return nullptr;
+			}
+			if ((static_cast<std::uint64_t>(words[5]) << 32 | words[4]) != key || (static_cast<std::uint64_t>(words[7]) << 32 | words[6]) != size) {
+				return nullptr;
+			}
+			if ((static_cast<std::uint64_t>(words[12]) << 32 | words[11]) != checksum(words + header_words, count - header_words)) {
+				return nullptr;
+			}
+			std::unique_ptr<Program> program(new Program());
+			try {
+				Reader reader(words + header_words, words + count, *program);
+				reader.names(words[8]);
+
+				auto starts = reader.words(words[9]);
+				std::vector<std::uint32_t> lines(starts, starts + words[9]);
+				if (lines.empty() || lines.front() != 0 || lines.back() > size) {
+					throw Damaged();
+				}
+				for (std::size_t i = 1; i < lines.size(); ++i) {
+					if (lines[i] <= lines[i - 1]) {
+						throw Damaged();
+					}
+				}
+				program->file(program->sources().add(filename, std::move(lines)));
+
+				auto tree = reader.at();
+				program->stmts(reader.statements());
+				if (reader.at() != tree + words[10] || reader.at() != words + count) {
+					throw Damaged();
+				}
+			} catch (Damaged const &) {
+				return nullptr;
+			}
+			return program;
+		}
+
+#if RAPH_MMAP
+
+		/// A read-only mapping of a whole file.
+		class Mapping {
+		public:
+			explicit Mapping(std::string const & path) : m_memory(MAP_FAILED), m_size(0) {
+				auto file = open(path.c_str(), O_RDONLY);
+				if (file < 0) {
+					return;
+				}
+				struct stat status;
+				if (fstat(file, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+					m_size = static_cast<std::size_t>(status.st_size);
+					m_memory = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+				}
+				close(file);
+			}
+
+			Mapping(Mapping const &) = delete;
+
+			auto operator=(Mapping const &) -> Mapping & = delete;
+
+			~Mapping() noexcept {
+				if (m_memory != MAP_FAILED) {
+					munmap(m_memory, m_size);
+				}
+			}
+
+			auto words() const noexcept -> std::uint32_t const * {
+				return m_memory == MAP_FAILED ? nullptr : static_cast<std::uint32_t const *>(m_memory);
+			}
+
+			auto count() const noexcept -> std::size_t {
+				return m_size / sizeof(std::uint32_t);
+			}
+
+		private:
+			void * m_memory;
+			std::size_t m_size;
+		};
+
+#endif
+
+		/// A name for a temporary file that no other thread or process uses at the same time.
+		auto temporary(std::string const & path) -> std::string {
+			auto thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+#if RAPH_MMAP
+			return path + '.' + std::to_string(getpid()) + '.' + std::to_string(thread) + ".tmp";
+#else
+			return path + '.' + std::to_string(thread) + ".tmp";
+#endif
+		}
+
+	} // namespace
+
+	auto cache_key(char const * source, std::size_t size) noexcept -> std::uint64_t {
+		// 64-bit FNV-1a over the format version, the parser revision and then the source.
+		std::uint64_t hash = 0xCBF29CE484222325;
+		auto mix = [&hash](unsigned char byte) {
+			hash = (hash ^ byte) * 0x100000001B3;
+		};
+		for (int shift = 0; shift < 32; shift += 8) {
+			mix(static_cast<unsigned char>(format >> shift));
+		}
+		for (auto c : revision) {
+			mix(static_cast<unsigned char>(c));
+		}
+		for (std::size_t i = 0; i < size; ++i) {
+			mix(static_cast<unsigned char>(source[i]));
+		}
+		return hash;
+	}
+
+	auto cache_path(std::string const & directory, std::string const & script, std::uint64_t key) -> std::string {
+		if (directory.empty()) {
+			static std::string const extension = ".raph";
+			auto name = script;
+			if (name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0) {
+				name.erase(name.size() - extension.size());
+			}
+			return name + ".raphc";
+		}
+		char name[17];
+		std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+		return (directory.back() == '/' ? directory : directory + '/') + name + ".raphc";
+	}
+
+	auto save_program(Program const & program, std::uint64_t key, std::size_t size, std::string const & path) -> bool {
+		Writer writer;
+		program.accept(writer);
+		auto const & lines = program.sources().lines(program.file());
+
+		std::vector<std::uint32_t> words = {
+			magic[0], magic[1], format, byte_order,
+			static_cast<std::uint32_t>(key), static_cast<std::uint32_t>(key >> 32),
+			static_cast<std::uint32_t>(size), static_cast<std::uint32_t>(static_cast<std::uint64_t>(size) >> 32),
+			static_cast<std::uint32_t>(writer.names.size()), static_cast<std::uint32_t>(lines.size()), static_cast<std::uint32_t>(writer.words.size()),
+			0, 0,
+		};
+		for (auto name : writer.names) {
+			words.push_back(static_cast<std::uint32_t>(name->size()));
+			auto at = words.size();
+			words.resize(at + (name->size() + 3) / 4, 0);
+			std::memcpy(words.data() + at, name->data(), name->size());
+		}
+		words.insert(words.end(), lines.begin(), lines.end());
+		words.insert(words.end(), writer.words.begin(), writer.words.end());
+		auto sum = checksum(words.data() + header_words, words.size() - header_words);
+		words[11] = static_cast<std::uint32_t>(sum);
+		words[12] = static_cast<std::uint32_t>(sum >> 32);
+
+		auto partial = temporary(path);
+		{
+			std::ofstream file(partial, std::ios::binary);
+			file.write(reinterpret_cast<char const *>(words.data()), static_cast<std::streamsize>(words.size() * sizeof(std::uint32_t)));
+			if (!file.flush()) {
+				file.close();
+				std::remove(partial.c_str());
+				return false;
+			}
+		}
+		if (std::rename(partial.c_str(), path.c_str()) != 0) {
+			// Where rename() does not replace an existing file.
+			std::remove(path.c_str());
+			if (std::rename(partial.c_str(), path.c_str()) != 0) {
+				std::remove(partial.c_str());
+				return false;
+			}
+		}
+		return true;
+	}
+
+	auto load_program(std::string const & path, std::uint64_t key, std::size_t size, std::string const & filename) -> std::unique_ptr<Program> {
+#if RAPH_MMAP
+		Mapping mapping(path);
+		if (mapping.words() == nullptr) {
+			return nullptr;
+		}
+		return read(mapping.words(), mapping.count(), key, size, filename);
+#else
+		std::ifstream file(path, std::ios::binary);
+		std::vector<std::uint32_t> words;
+		std::uint32_t word;
+		while (file.read(reinterpret_cast<char *>(&word), sizeof(word))) {
+			words.push_back(word);
+		}
+		return words.empty() ? nullptr : read(words.data(), words.size(), key, size, filename);
+#endif
+	}
+
+} // namespace br
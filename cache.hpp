@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "ast.hpp"
+
+namespace br {
+
+	/** \brief Key of the cache entry of a source: a hash of its \a size bytes at \a source, of the version
+	 **        of the entry format, which changes whenever the syntax tree does, and of the revision of the
+	 **        parser, which changes whenever its sources do.
+	 */
+	auto cache_key(char const * source, std::size_t size) noexcept -> std::uint64_t;
+
+	/** \brief Where the entry of \a script, whose source has \a key, is kept.
+	 **
+	 ** \param directory the cache directory, where entries are named by key; if empty, the entry is the
+	 **        script's name with `.raph` replaced by `.raphc`, next to it
+	 */
+	auto cache_path(std::string const & directory, std::string const & script, std::uint64_t key) -> std::string;
+
+	/** \brief Write \a program, as parsed from \a size bytes of source with \a key, to the entry at \a path.
+	 **
+	 ** The entry holds the unbound syntax tree, its names and the line starts of its file, as 32-bit words
+	 ** in the byte order of this machine. It is written to a temporary file first and renamed, so that
+	 ** concurrent readers and writers only ever see whole entries.
+	 ** \return false if the entry could not be written
+	 */
+	auto save_program(Program const & program, std::uint64_t key, std::size_t size, std::string const & path) -> bool;
+
+	/** \brief Read the program at \a path, if it is an entry for \a size bytes of source with \a key.
+	 **
+	 ** The file is mapped into memory and its nodes are made in a new program's arena in one pass.
+	 ** \param filename the name the program's source file gets
+	 ** \return nullptr if there is no such entry, or it is for other source or another format, or damaged
+	 */
+	auto load_program(std::string const & path, std::uint64_t key, std::size_t size, std::string const & filename) -> std::unique_ptr<Program>;
+
+} // namespace br
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cmath>
+#include "builtin.hpp"
+#include "context.hpp"
+#include "random.hpp"
+
+namespace br {
+
+	Context::Context(Device & device, std::size_t slots, std::uint64_t seed)
+		: m_device(device), m_frame(slots < special_slots ? special_slots : slots, Variable{Value(), false}),
+		m_transform{1.0, 1.0, 1.0, 0.0, 0.0, 0.0}, m_seed(seed), m_randoms(0), m_batch(false), m_parallel(nullptr), m_jit(nullptr), m_sampler(nullptr) {
+		m_frame[origin_slot] = Variable{Value(0.0, 0.0), true};
+		m_frame[scale_slot] = Variable{Value(1.0, 1.0), true};
+		m_frame[rot_slot] = Variable{Value(0.0), true};
+		m_xs.reserve(draw_batch);
+		m_ys.reserve(draw_batch);
+	}
+
+	Context::Context(Context const & context, Device & device)
+		: m_device(device), m_frame(context.m_frame), m_transform(context.m_transform), m_seed(context.m_seed),
+		m_randoms(context.m_randoms), m_batch(context.m_batch), m_parallel(nullptr), m_jit(nullptr), m_sampler(nullptr) {
+		m_xs.reserve(draw_batch);
+		m_ys.reserve(draw_batch);
+	}
+
+	constexpr std::size_t Context::draw_batch;
+
+	auto Context::m_builtin(Symbol const & symbol) -> Value {
+		auto builtin = symbol.builtin;
+		if (builtin != nullptr) {
+			if (builtin->kind == Builtin::Kind::Property) {
+				return builtin->callback(*this, nullptr);
+			}
+			return builtin;
+		}
+		throw RuntimeError("undefined variable '" + *symbol.name + "'");
+	}
+
+	void Context::assign(std::uint32_t slot, Value const & value) {
+		auto & variable = m_frame[slot];
+		m_update(slot, value);
+		variable.value = value;
+		variable.assigned = true;
+	}
+
+	void Context::restore(std::uint32_t slot, Value const & value) {
+		if (slot != clear_slot) {
+			m_update(slot, value);
+		}
+		m_frame[slot] = Variable{value, true};
+	}
+
+	void Context::draw(double const * xs, double const * ys, std::size_t count) {
+		while (count > 0) {
+			auto taken = std::min(count, draw_batch - m_xs.size());
+			m_xs.insert(m_xs.end(), xs, xs + taken);
+			m_ys.insert(m_ys.end(), ys, ys + taken);
+			if (m_xs.size() == draw_batch) {
+				flush();
+			}
+			xs += taken;
+			ys += taken;
+			count -= taken;
+		}
+	}
+
+	void Context::flush() {
+		if (m_xs.empty()) {
+			return;
+		}
+		simd::transform(m_xs.data(), m_ys.data(), m_transform, m_xs.size());
+		m_device.draw(m_xs.data(), m_ys.data(), m_xs.size());
+		m_xs.clear();
+		m_ys.clear();
+	}
+
+	void Context::save() {
+		flush();
+		m_device.save();
+	}
+
+	auto Context::random() -> double {
+		return uniform(m_seed, m_randoms++);
+	}
+
+	void Context::m_update(std::uint32_t slot, Value const & value) {
+		if (is_special(slot)) {
+			// The queued points were drawn before the change.
+			flush();
+		}
+		switch (slot) {
+			case clear_slot: {
+				auto size = expect_vector(value, "clear");
+				// Pixels are addressed by 32-bit columns and rows; how many a device can hold is up to it.
+				if (!(size.x >= 0 && size.y >= 0 && size.x < 4294967296.0 && size.y < 4294967296.0)) {
+					throw RuntimeError("clear: invalid canvas size");
+				}
+				m_device.clear(static_cast<std::size_t>(size.x), static_cast<std::size_t>(size.y));
+				break;
+			}
+			case origin_slot: {
+				auto origin = expect_vector(value, "origin");
+				m_transform.origin_x = origin.x;
+				m_transform.origin_y = origin.y;
+				break;
+			}
+			case scale_slot: {
+				auto scale = expect_vector(value, "scale");
+				m_transform.scale_x = scale.x;
+				m_transform.scale_y = scale.y;
+				break;
+			}
+			case rot_slot: {
+				auto rot = expect_number(value, "rot");
+				m_transform.cos = std::cos(rot);
+				m_transform.sin = std::sin(rot);
+				break;
+			}
+			default:
+				break;
+		}
+	}
+
+} // namespace br
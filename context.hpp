@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "device.hpp"
+#include "simd.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
+
+namespace br {
+
+	class Jit;
+	class Parallel;
+	class Sampler;
+
+	/// Execution state of a running program: variables, drawing transform and output device.
+	class Context {
+	public:
+		/// \param slots the size of the variable frame of the program, see Program::slots()
+		/// \param seed the key of the stream of random numbers, see uniform()
+		Context(Device & device, std::size_t slots, std::uint64_t seed);
+
+		/// A copy of the variables and drawing state of \a context that draws to \a device and interprets loops serially.
+		Context(Context const & context, Device & device);
+
+		/// Read a variable, falling back to the built-in function or property of the same name.
+		auto lookup(Symbol const & symbol) -> Value {
+			if (symbol.slot != no_slot && m_frame[symbol.slot].assigned) {
+				return m_frame[symbol.slot].value;
+			}
+			return m_builtin(symbol);
+		}
+
+		/// A variable previously assigned, nullptr if there is none.
+		auto variable(std::uint32_t slot) const -> Value const * {
+			return slot != no_slot && m_frame[slot].assigned ? &m_frame[slot].value : nullptr;
+		}
+
+		/// Whether assigning the variable in \a slot has side effects on the drawing state.
+		static auto is_special(std::uint32_t slot) noexcept -> bool {
+			return slot < special_slots;
+		}
+
+		/// Write a variable; `clear`, `origin`, `scale` and `rot` also update the drawing state.
+		void assign(std::uint32_t slot, Value const & value);
+
+		/// Set a variable as assign() does, except that `clear` leaves the device alone: for replayed output.
+		void restore(std::uint32_t slot, Value const & value);
+
+		/// Make a variable that is not special unassigned again.
+		void unassign(std::uint32_t slot) noexcept {
+			m_frame[slot].assigned = false;
+		}
+
+		/** \brief Queue a point to be transformed by scale, rotation and origin and handed to the device.
+		 **
+		 ** Points are kept as separate arrays of x and y and transformed a batch at a time by
+		 ** simd::transform(); a batch ends when it is full, before the drawing state changes, and on flush().
+		 */
+		void draw(double x, double y) {
+			m_xs.push_back(x);
+			m_ys.push_back(y);
+			if (m_xs.size() == draw_batch) {
+				flush();
+			}
+		}
+
+		/// draw() each `(xs[i], ys[i])`.
+		void draw(double const * xs, double const * ys, std::size_t count);
+
+		/// Hand the queued points to the device.
+		void flush();
+
+		void save();
+
+		/// Uniform random number in [0, 1), the next one in the stream of the seed.
+		auto random() -> double;
+
+		auto seed() const noexcept -> std::uint64_t {
+			return m_seed;
+		}
+
+		/// The number of random numbers taken so far, which is the position of the next one in the stream.
+		auto randoms() const noexcept -> std::uint64_t {
+			return m_randoms;
+		}
+
+		/// Continue the stream at position \a randoms, e.g. that of an iteration run on another thread.
+		void randoms(std::uint64_t randoms) noexcept {
+			m_randoms = randoms;
+		}
+
+		/// The device, to which points queued by draw() may not have been handed yet.
+		auto device() const noexcept -> Device & {
+			return m_device;
+		}
+
+		/// Whether for loops may run as vectorised batches (see batch.hpp).
+		auto batch() const noexcept -> bool {
+			return m_batch;
+		}
+
+		void batch(bool enable) noexcept {
+			m_batch = enable;
+		}
+
+		/// Runs for loops with independent iterations on several threads, nullptr to run them serially.
+		auto parallel() const noexcept -> Parallel * {
+			return m_parallel;
+		}
+
+		void parallel(Parallel * parallel) noexcept {
+			m_parallel = parallel;
+		}
+
+		/// Compiles hot for loops to machine code, nullptr to interpret them.
+		auto jit() const noexcept -> Jit * {
+			return m_jit;
+		}
+
+		void jit(Jit * jit) noexcept {
+			m_jit = jit;
+		}
+
+		/// Samples the curves of for loops adaptively, nullptr to run them as written.
+		auto sampler() const noexcept -> Sampler * {
+			return m_sampler;
+		}
+
+		void sampler(Sampler * sampler) noexcept {
+			m_sampler = sampler;
+		}
+
+		/// The transform draw() applies, from the values of `origin`, `scale` and `rot`.
+		auto transform() const noexcept -> simd::Transform const & {
+			return m_transform;
+		}
+
+	private:
+		/// Points queued before they are transformed.
+		static constexpr std::size_t draw_batch = 1024;
+
+		struct Variable {
+			Value value;
+			bool assigned;
+		};
+
+		auto m_builtin(Symbol const & symbol) -> Value;
+
+		void m_update(std::uint32_t slot, Value const & value);
+
+		Device & m_device;
+		std::vector<Variable> m_frame;
+		simd::Transform m_transform;
+		std::vector<double> m_xs, m_ys;
+		std::uint64_t m_seed, m_randoms;
+		bool m_batch;
+		Parallel * m_parallel;
+		Jit * m_jit;
+		Sampler * m_sampler;
+	}; // class Context
+
+} // namespace br
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include "binder.hpp"
+#include "corpus.hpp"
+#include "raph.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RAPH_DIRENT 1
+#include <dirent.h>
+#include <sys/stat.h>
+#else
+#define RAPH_DIRENT 0
+#endif
+
+namespace br {
+
+	namespace {
+
+		auto is_script(std::string const & name) -> bool {
+			static std::string const extension = ".raph";
+			return name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0;
+		}
+
+		auto compile_script(std::string const & script, bool keep, bool cache, std::string const & directory) -> Compilation {
+			std::ostringstream diagnostics;
+			RaphParser parser(script, diagnostics);
+			parser.cache(cache, directory);
+			auto program = parser.parse();
+			auto succeeded = program != nullptr && bind(*program, parser) && parser.errors() == 0;
+			if (!succeeded || !keep) {
+				program.reset();
+			}
+			return Compilation{script, diagnostics.str(), parser.bytes(), succeeded, std::move(program)};
+		}
+
+	} // namespace
+
+	auto collect_scripts(std::string const & path, std::vector<std::string> & scripts) -> bool {
+#if RAPH_DIRENT
+		struct stat status;
+		if (stat(path.c_str(), &status) != 0) {
+			return false;
+		}
+		if (!S_ISDIR(status.st_mode)) {
+			scripts.push_back(path);
+			return true;
+		}
+		auto directory = opendir(path.c_str());
+		if (directory == nullptr) {
+			return false;
+		}
+		std::vector<std::string> names;
+		while (auto entry = readdir(directory)) {
+			if (entry->d_name[0] != '.') {
+				names.emplace_back(entry->d_name);
+			}
+		}
+		closedir(directory);
+		std::sort(names.begin(), names.end());
+
+		auto prefix = path.back() == '/' ? path : path + '/';
+		auto result = true;
+		for (auto const & name : names) {
+			auto child = prefix + name;
+			// Links are not followed into directories, where one to an ancestor would recurse without end.
+			if (lstat(child.c_str(), &status) != 0) {
+				result = false;
+			} else if (S_ISDIR(status.st_mode)) {
+				result = collect_scripts(child, scripts) && result;
+			} else if (!is_script(name)) {
+				continue;
+			} else if (!S_ISLNK(status.st_mode)) {
+				scripts.push_back(child);
+			} else if (stat(child.c_str(), &status) != 0) {
+				result = false;
+			} else if (!S_ISDIR(status.st_mode)) {
+				scripts.push_back(child);
+			}
+		}
+		return result;
+#else
+		scripts.push_back(path);
+		return true;
+#endif
+	}
+
+	auto compile_scripts(
+		std::vector<std::string> const & scripts,
+		ThreadPool & pool,
+		bool keep,
+		bool cache,
+		std::string const & directory
+	) -> std::vector<Compilation> {
+		std::vector<Compilation> results(scripts.size());
+		std::atomic<std::size_t> next(0);
+		pool.run([&](std::size_t) {
+			for (auto i = next++; i < scripts.size(); i = next++) {
+				results[i] = compile_script(scripts[i], keep, cache, directory);
+			}
+		});
+		return results;
+	}
+
+} // namespace br
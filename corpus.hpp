@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "pool.hpp"
+
+namespace br {
+
+	/// What parsing and binding one script gave.
+	struct Compilation {
+		std::string filename;
+		/// Everything the parser and the binder reported, in order, as they would have written it to stderr.
+		std::string diagnostics;
+		std::size_t bytes;
+		/// Whether the script parsed and bound without error.
+		bool succeeded;
+		/// The bound program, if it succeeded and was asked for.
+		std::unique_ptr<Program> program;
+	};
+
+	/** \brief Append to \a scripts \a path if it names a file, or else the `.raph` files under it, sorted
+	 **        by name, skipping names that start with a dot and symbolic links to directories.
+	 **
+	 ** \return false if \a path or a directory under it cannot be read
+	 */
+	auto collect_scripts(std::string const & path, std::vector<std::string> & scripts) -> bool;
+
+	/** \brief Parse and bind \a scripts on the workers of \a pool, which take the next script in turn.
+	 **
+	 ** Each script has its own parser, whose messages are kept apart rather than written as they come.
+	 ** \param keep whether to keep the programs, or only the diagnostics
+	 ** \param cache whether to cache parsed programs, passed on to RaphParser::cache()
+	 ** \param directory the directory passed on to RaphParser::cache()
+	 ** \return one result per script, in the order given
+	 */
+	auto compile_scripts(
+		std::vector<std::string> const & scripts,
+		ThreadPool & pool,
+		bool keep = false,
+		bool cache = false,
+		std::string const & directory = std::string()
+	) -> std::vector<Compilation>;
+
+} // namespace br
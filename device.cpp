@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "device.hpp"
+#include "error.hpp"
+#include "image.hpp"
+
+namespace br {
+
+	namespace {
+
+		/// Pixels buffered before they are drawn.
+		constexpr std::size_t pending_pixels = 1 << 16;
+
+		/// Below this many pixels, drawing them on one thread is faster than waking the others.
+		constexpr std::size_t parallel_pixels = 1 << 12;
+
+	} // namespace
+
+	Device::~Device() noexcept {
+	}
+
+	void Device::draw(double const * xs, double const * ys, std::size_t count) {
+		for (std::size_t i = 0; i < count; ++i) {
+			draw(xs[i], ys[i]);
+		}
+	}
+
+	constexpr std::size_t Canvas::tile_size;
+	constexpr std::size_t Canvas::max_pixels;
+
+	Canvas::Canvas(std::string const & filename, std::size_t threads)
+		: m_filename(filename), m_width(0), m_height(0), m_columns(0), m_rows(0), m_pool(threads), m_bins(m_pool.size()) {
+		m_pending.reserve(pending_pixels);
+	}
+
+	Canvas::~Canvas() noexcept {
+	}
+
+	void Canvas::clear(std::size_t width, std::size_t height) {
+		if (height != 0 && width > max_pixels / height) {
+			throw RuntimeError("clear: canvas too large to hold in memory");
+		}
+		m_width = width;
+		m_height = height;
+		m_columns = (width + tile_size - 1) / tile_size;
+		m_rows = (height + tile_size - 1) / tile_size;
+		m_tiles.assign(m_columns * m_rows * tile_size * tile_size, 0xFF);
+		m_pending.clear();
+		for (auto & bins : m_bins) {
+			bins.assign(m_columns * m_rows, std::vector<std::uint16_t>());
+		}
+	}
+
+	void Canvas::draw(double x, double y) {
+		auto column = std::floor(x + 0.5), row = std::floor(y + 0.5);
+		if (column >= 0 && row >= 0 && column < m_width && row < m_height) {
+			m_pending.push_back(Pixel{static_cast<std::uint32_t>(column), static_cast<std::uint32_t>(row)});
+			if (m_pending.size() == pending_pixels) {
+				m_flush();
+			}
+		}
+	}
+
+	void Canvas::draw(double const * xs, double const * ys, std::size_t count) {
+		auto width = static_cast<double>(m_width), height = static_cast<double>(m_height);
+		for (std::size_t i = 0; i < count; ++i) {
+			auto column = std::floor(xs[i] + 0.5), row = std::floor(ys[i] + 0.5);
+			if (column >= 0 && row >= 0 && column < width && row < height) {
+				m_pending.push_back(Pixel{static_cast<std::uint32_t>(column), static_cast<std::uint32_t>(row)});
+				if (m_pending.size() == pending_pixels) {
+					m_flush();
+				}
+			}
+		}
+	}
+
+	void Canvas::save() {
+		m_flush();
+		ImageWriter writer(m_filename, m_width, m_height, m_pool);
+		std::vector<std::uint8_t> line(m_columns * tile_size);
+		for (std::size_t row = 0; row < m_height; ++row) {
+			for (std::size_t column = 0; column < m_columns; ++column) {
+				auto tile = m_tiles.begin() + (m_tile(column * tile_size, row) * tile_size + row % tile_size) * tile_size;
+				std::copy(tile, tile + tile_size, line.begin() + column * tile_size);
+			}
+			writer.write(line.data(), 1);
+		}
+		writer.finish();
+	}
+
+	void Canvas::m_flush() {
+		auto const area = tile_size * tile_size;
+		auto offset = [](Pixel pixel) {
+			return static_cast<std::uint16_t>(pixel.row % tile_size * tile_size + pixel.column % tile_size);
+		};
+		if (m_pool.size() == 1 || m_pending.size() < parallel_pixels) {
+			for (auto pixel : m_pending) {
+				m_tiles[m_tile(pixel.column, pixel.row) * area + offset(pixel)] = 0x00;
+			}
+			m_pending.clear();
+			return;
+		}
+
+		auto workers = m_pool.size();
+		auto count = m_pending.size();
+		m_pool.run([&](std::size_t worker) {
+			auto & bins = m_bins[worker];
+			for (auto i = count * worker / workers, end = count * (worker + 1) / workers; i < end; ++i) {
+				auto pixel = m_pending[i];
+				bins[m_tile(pixel.column, pixel.row)].push_back(offset(pixel));
+			}
+		});
+		auto tiles = m_columns * m_rows;
+		m_pool.run([&](std::size_t worker) {
+			// Interleaved, as points tend to cluster in neighbouring tiles.
+			for (auto tile = worker; tile < tiles; tile += workers) {
+				auto pixels = &m_tiles[tile * area];
+				for (auto & bins : m_bins) {
+					for (auto index : bins[tile]) {
+						pixels[index] = 0x00;
+					}
+					bins[tile].clear();
+				}
+			}
+		});
+		m_pending.clear();
+	}
+
+	constexpr std::size_t SparseCanvas::tile_size;
+	constexpr std::size_t SparseCanvas::default_memory;
+	constexpr std::size_t SparseCanvas::max_tiles;
+	constexpr std::uint32_t SparseCanvas::none;
+
+	SparseCanvas::SparseCanvas(std::string const & filename, std::size_t memory, std::size_t threads)
+		: m_pool(threads), m_filename(filename), m_spill_name(filename + ".spill"), m_width(0), m_height(0), m_columns(0), m_rows(0),
+		m_capacity(std::max<std::size_t>(memory / (tile_size * tile_size), 1)), m_newest(none), m_oldest(none),
+		m_slots(0), m_statistics{0, 0, 0, 0, 0} {
+		m_pending.reserve(pending_pixels);
+		m_measure();
+	}
+
+	SparseCanvas::~SparseCanvas() noexcept {
+		if (m_spill.is_open()) {
+			m_spill.close();
+			std::remove(m_spill_name.c_str());
+		}
+	}
+
+	void SparseCanvas::clear(std::size_t width, std::size_t height) {
+		auto columns = (width + tile_size - 1) / tile_size, rows = (height + tile_size - 1) / tile_size;
+		if (rows != 0 && columns > max_tiles / rows) {
+			throw RuntimeError("clear: canvas has too many tiles");
+		}
+		// The scratch file is made as soon as it may be needed, so that one that cannot be fails here and not in a draw.
+		if (columns * rows > m_capacity && !m_spill.is_open()) {
+			m_spill.open(m_spill_name, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+			if (!m_spill.is_open()) {
+				throw RuntimeError("clear: cannot open " + m_spill_name + ": " + std::strerror(errno));
+			}
+		}
+		m_width = width;
+		m_height = height;
+		m_columns = columns;
+		m_rows = rows;
+		m_tiles.assign(columns * rows, Tile{none, none});
+		m_frames.clear();
+		m_memory.clear();
+		// Reserved, as growing by doubling would overshoot the budget.
+		auto frames = std::min(m_capacity, m_tiles.size());
+		m_frames.reserve(frames);
+		m_memory.reserve(frames * tile_size * tile_size);
+		m_newest = m_oldest = none;
+		m_pending.clear();
+		// The scratch file is written over from the start.
+		m_slots = 0;
+		m_measure();
+	}
+
+	void SparseCanvas::draw(double x, double y) {
+		m_push(x, y);
+	}
+
+	void SparseCanvas::draw(double const * xs, double const * ys, std::size_t count) {
+		for (std::size_t i = 0; i < count; ++i) {
+			m_push(xs[i], ys[i]);
+		}
+	}
+
+	void SparseCanvas::save() {
+		m_flush();
+		ImageWriter writer(m_filename, m_width, m_height, m_pool);
+		auto const area = tile_size * tile_size;
+		std::vector<std::uint8_t> strip(m_width * tile_size), spilled(area);
+		for (std::size_t row = 0; row < m_rows; ++row) {
+			auto lines = std::min(tile_size, m_height - row * tile_size);
+			for (std::size_t column = 0; column < m_columns; ++column) {
+				auto const & tile = m_tiles[row * m_columns + column];
+				std::uint8_t const * pixels = nullptr;
+				if (tile.frame != none) {
+					pixels = &m_memory[tile.frame * area];
+				} else if (tile.slot != none) {
+					m_read(tile.slot, spilled.data());
+					pixels = spilled.data();
+				}
+				auto left = column * tile_size;
+				auto width = std::min(tile_size, m_width - left);
+				for (std::size_t line = 0; line < lines; ++line) {
+					auto out = strip.begin() + line * m_width + left;
+					if (pixels != nullptr) {
+						std::copy(pixels + line * tile_size, pixels + line * tile_size + width, out);
+					} else {
+						std::fill(out, out + width, 0xFF);
+					}
+				}
+			}
+			writer.write(strip.data(), lines);
+			m_measure(strip.capacity() + spilled.capacity() + writer.memory());
+		}
+		writer.finish();
+	}
+
+	void SparseCanvas::m_push(double x, double y) {
+		auto column = std::floor(x + 0.5), row = std::floor(y + 0.5);
+		if (column >= 0 && row >= 0 && column < m_width && row < m_height) {
+			auto c = static_cast<std::size_t>(column), r = static_cast<std::size_t>(row);
+			auto tile = static_cast<std::uint32_t>(r / tile_size * m_columns + c / tile_size);
+			m_pending.push_back(Pixel{tile, static_cast<std::uint16_t>(r % tile_size * tile_size + c % tile_size)});
+			if (m_pending.size() == pending_pixels) {
+				m_flush();
+			}
+		}
+	}
+
+	void SparseCanvas::m_flush() {
+		// Each tile is then held once per flush, however the points jump between tiles.
+		std::sort(m_pending.begin(), m_pending.end(), [](Pixel const & lhs, Pixel const & rhs) {
+			return lhs.tile < rhs.tile;
+		});
+		for (std::size_t i = 0; i < m_pending.size(); ) {
+			auto tile = m_pending[i].tile;
+			auto pixels = m_hold(tile);
+			auto & frame = m_frames[m_tiles[tile].frame];
+			for (; i < m_pending.size() && m_pending[i].tile == tile; ++i) {
+				auto & pixel = pixels[m_pending[i].offset];
+				frame.dirty = frame.dirty || pixel != 0x00;
+				pixel = 0x00;
+			}
+		}
+		m_pending.clear();
+	}
+
+	auto SparseCanvas::m_hold(std::uint32_t tile) -> std::uint8_t * {
+		auto const area = tile_size * tile_size;
+		auto & entry = m_tiles[tile];
+		if (entry.frame != none) {
+			m_unlink(entry.frame);
+			m_link(entry.frame);
+			return &m_memory[entry.frame * area];
+		}
+
+		std::uint32_t frame;
+		if (m_frames.size() < m_capacity) {
+			frame = static_cast<std::uint32_t>(m_frames.size());
+			m_frames.push_back(Frame{tile, none, none, false});
+			m_memory.resize(m_frames.size() * area);
+			m_measure();
+		} else {
+			frame = m_oldest;
+			m_unlink(frame);
+			auto & evicted = m_tiles[m_frames[frame].tile];
+			if (m_frames[frame].dirty) {
+				if (evicted.slot == none) {
+					evicted.slot = m_slots++;
+					++m_statistics.spilled;
+				}
+				m_write(evicted.slot, &m_memory[frame * area]);
+			}
+			evicted.frame = none;
+		}
+
+		auto pixels = &m_memory[frame * area];
+		if (entry.slot != none) {
+			m_read(entry.slot, pixels);
+		} else {
+			std::fill(pixels, pixels + area, 0xFF);
+			++m_statistics.tiles;
+		}
+		m_frames[frame] = Frame{tile, none, none, false};
+		entry.frame = frame;
+		m_link(frame);
+		return pixels;
+	}
+
+	void SparseCanvas::m_unlink(std::uint32_t frame) noexcept {
+		auto & links = m_frames[frame];
+		(links.newer != none ? m_frames[links.newer].older : m_newest) = links.older;
+		(links.older != none ? m_frames[links.older].newer : m_oldest) = links.newer;
+		links.newer = links.older = none;
+	}
+
+	void SparseCanvas::m_link(std::uint32_t frame) noexcept {
+		auto & links = m_frames[frame];
+		links.newer = none;
+		links.older = m_newest;
+		(m_newest != none ? m_frames[m_newest].newer : m_oldest) = frame;
+		m_newest = frame;
+	}
+
+	void SparseCanvas::m_write(std::uint32_t slot, std::uint8_t const * pixels) {
+		auto const area = tile_size * tile_size;
+		m_spill.seekp(static_cast<std::streamoff>(slot) * area);
+		m_spill.write(reinterpret_cast<char const *>(pixels), area);
+		if (!m_spill) {
+			throw RuntimeError("cannot write " + m_spill_name);
+		}
+		++m_statistics.writes;
+	}
+
+	void SparseCanvas::m_read(std::uint32_t slot, std::uint8_t * pixels) {
+		auto const area = tile_size * tile_size;
+		m_spill.seekg(static_cast<std::streamoff>(slot) * area);
+		m_spill.read(reinterpret_cast<char *>(pixels), area);
+		if (!m_spill) {
+			throw RuntimeError("cannot read " + m_spill_name);
+		}
+		++m_statistics.reads;
+	}
+
+	void SparseCanvas::m_measure(std::size_t extra) noexcept {
+		auto held = m_memory.capacity() + m_frames.capacity() * sizeof(Frame) + m_tiles.capacity() * sizeof(Tile)
+			+ m_pending.capacity() * sizeof(Pixel) + extra;
+		m_statistics.peak = std::max(m_statistics.peak, held);
+	}
+
+	Recorder::~Recorder() noexcept {
+	}
+
+	void Recorder::clear(std::size_t width, std::size_t height) {
+		m_events.push_back(Event{Event::Kind::Clear, static_cast<double>(width), static_cast<double>(height)});
+	}
+
+	void Recorder::draw(double x, double y) {
+		m_events.push_back(Event{Event::Kind::Draw, x, y});
+	}
+
+	void Recorder::draw(double const * xs, double const * ys, std::size_t count) {
+		m_events.reserve(m_events.size() + count);
+		for (std::size_t i = 0; i < count; ++i) {
+			m_events.push_back(Event{Event::Kind::Draw, xs[i], ys[i]});
+		}
+	}
+
+	void Recorder::save() {
+		m_events.push_back(Event{Event::Kind::Save, 0.0, 0.0});
+	}
+
+} // namespace br
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "pool.hpp"
+
+namespace br {
+
+	/// Receives the output of a running program, in canvas coordinates.
+	class Device {
+	public:
+		virtual ~Device() noexcept;
+
+		/// `clear = (width, height)`: start a new blank image.
+		virtual void clear(std::size_t width, std::size_t height) = 0;
+
+		/// `draw(x, y)`, after the origin/scale/rot transform has been applied.
+		virtual void draw(double x, double y) = 0;
+
+		/// draw() each `(xs[i], ys[i])` in turn.
+		virtual void draw(double const * xs, double const * ys, std::size_t count);
+
+		/// `save()`: write out the current image.
+		virtual void save() = 0;
+	}; // class Device
+
+	/** \brief 8-bit grayscale framebuffer written out as a binary PGM or a PNG, see ImageWriter.
+	 **
+	 ** The image is stored as square tiles of tile_size pixels a side, each contiguous and small enough
+	 ** to stay in cache while it is drawn to. draw() only rounds a point to its pixel and appends it to a
+	 ** buffer; when the buffer fills up, and before save(), the workers of a ThreadPool bin a share of the
+	 ** buffered pixels each by tile, then each draws whole tiles from the bins of all workers. No two
+	 ** workers write to the same tile, so there is no lock, and as drawing a pixel only ever sets it to
+	 ** black, the image is the same for any number of threads.
+	 */
+	class Canvas : public Device {
+	public:
+		/// Pixels a side of a tile.
+		static constexpr std::size_t tile_size = 64;
+
+		/// The most pixels of an image; clear() throws RuntimeError for a larger one.
+		static constexpr std::size_t max_pixels = std::size_t(1) << 30;
+
+		/// \param threads the number of threads that draw, see ThreadPool
+		explicit Canvas(std::string const & filename, std::size_t threads = 0);
+
+		virtual ~Canvas() noexcept;
+
+		virtual void clear(std::size_t width, std::size_t height) override;
+
+		virtual void draw(double x, double y) override;
+
+		/// Rounds and clips the points in one pass over the arrays.
+		virtual void draw(double const * xs, double const * ys, std::size_t count) override;
+
+		virtual void save() override;
+
+		auto width() const noexcept -> std::size_t {
+			return m_width;
+		}
+
+		auto height() const noexcept -> std::size_t {
+			return m_height;
+		}
+
+	private:
+		struct Pixel {
+			std::uint32_t column, row;
+		};
+
+		/// Draw the buffered pixels.
+		void m_flush();
+
+		auto m_tile(std::size_t column, std::size_t row) const noexcept -> std::size_t {
+			return row / tile_size * m_columns + column / tile_size;
+		}
+
+		std::string m_filename;
+		std::size_t m_width, m_height;
+		/// Tiles across and down.
+		std::size_t m_columns, m_rows;
+		std::vector<std::uint8_t> m_tiles;
+		std::vector<Pixel> m_pending;
+		ThreadPool m_pool;
+		/// For each worker and tile, the offsets in the tile of the pixels to draw.
+		std::vector<std::vector<std::vector<std::uint16_t>>> m_bins;
+	}; // class Canvas
+
+	/** \brief 8-bit grayscale image stored sparsely, for images too large to hold in memory.
+	 **
+	 ** Tiles of tile_size pixels a side only take memory once a point lands in them; the tiles never
+	 ** drawn to are blank. At most as many tiles as fit in the memory budget are held at once: when
+	 ** another is needed, the one drawn to least recently is written to a scratch file next to the
+	 ** image, `<image>.spill`, and read back from there when it is drawn to again; clear() makes that
+	 ** file if the image has more tiles than the budget holds. Drawn pixels are
+	 ** buffered and drawn a tile at a time, in order of tile. save() writes the image one row of tiles
+	 ** at a time, so the image itself is never held whole either.
+	 */
+	class SparseCanvas : public Device {
+	public:
+		/// Pixels a side of a tile.
+		static constexpr std::size_t tile_size = 256;
+
+		/// Bytes.
+		static constexpr std::size_t default_memory = std::size_t(256) << 20;
+
+		/// The most tiles of an image; clear() throws RuntimeError for a larger one.
+		static constexpr std::size_t max_tiles = std::size_t(1) << 24;
+
+		struct Statistics {
+			/// Tiles drawn to, and written to the scratch file at least once.
+			std::size_t tiles, spilled;
+			/// Tiles written to the scratch file and read back from it.
+			std::size_t writes, reads;
+			/// The most bytes held at once, by tiles, the tables and the buffers.
+			std::size_t peak;
+		};
+
+		/** \param memory the bytes of tiles to hold at once; at least one tile is held
+		 ** \param threads the number of threads that encode the image on save(), see ThreadPool
+		 */
+		explicit SparseCanvas(std::string const & filename, std::size_t memory = default_memory, std::size_t threads = 0);
+
+		virtual ~SparseCanvas() noexcept;
+
+		virtual void clear(std::size_t width, std::size_t height) override;
+
+		virtual void draw(double x, double y) override;
+
+		virtual void draw(double const * xs, double const * ys, std::size_t count) override;
+
+		virtual void save() override;
+
+		auto statistics() const noexcept -> Statistics const & {
+			return m_statistics;
+		}
+
+		/// The path of the scratch file.
+		auto spill() const noexcept -> std::string const & {
+			return m_spill_name;
+		}
+
+	private:
+		static constexpr std::uint32_t none = 0xFFFFFFFF;
+
+		struct Pixel {
+			std::uint32_t tile;
+			/// Row and column in the tile.
+			std::uint16_t offset;
+		};
+
+		struct Tile {
+			/// Where it is held, or none.
+			std::uint32_t frame;
+			/// Where it is in the scratch file, or none if it was never written there.
+			std::uint32_t slot;
+		};
+
+		/// Memory holding a tile, linked from the most to the least recently drawn to.
+		struct Frame {
+			std::uint32_t tile;
+			std::uint32_t newer, older;
+			/// Whether it differs from its copy in the scratch file, if any.
+			bool dirty;
+		};
+
+		void m_push(double x, double y);
+
+		/// Draw the buffered pixels.
+		void m_flush();
+
+		/// The pixels of \a tile, read or made blank if it is not held, as the most recently drawn to.
+		auto m_hold(std::uint32_t tile) -> std::uint8_t *;
+
+		void m_unlink(std::uint32_t frame) noexcept;
+
+		void m_link(std::uint32_t frame) noexcept;
+
+		void m_write(std::uint32_t slot, std::uint8_t const * pixels);
+
+		void m_read(std::uint32_t slot, std::uint8_t * pixels);
+
+		/// Count \a extra bytes held besides the tiles, the tables and the buffer towards the peak.
+		void m_measure(std::size_t extra = 0) noexcept;
+
+		ThreadPool m_pool;
+		std::string m_filename, m_spill_name;
+		std::size_t m_width, m_height;
+		/// Tiles across and down.
+		std::size_t m_columns, m_rows;
+		/// The most frames.
+		std::size_t m_capacity;
+		std::vector<Tile> m_tiles;
+		std::vector<Frame> m_frames;
+		std::vector<std::uint8_t> m_memory;
+		/// The most and least recently drawn frames.
+		std::uint32_t m_newest, m_oldest;
+		std::vector<Pixel> m_pending;
+		std::fstream m_spill;
+		std::uint32_t m_slots;
+		Statistics m_statistics;
+	}; // class SparseCanvas
+
+	/// Records every call, so that the output of different engines can be compared.
+	class Recorder : public Device {
+	public:
+		struct Event {
+			enum class Kind : std::uint8_t {
+				Clear,
+				Draw,
+				Save,
+			};
+
+			Kind kind;
+			double x;
+			double y;
+		};
+
+		virtual ~Recorder() noexcept;
+
+		virtual void clear(std::size_t width, std::size_t height) override;
+
+		virtual void draw(double x, double y) override;
+
+		virtual void draw(double const * xs, double const * ys, std::size_t count) override;
+
+		virtual void save() override;
+
+		auto events() const noexcept -> std::vector<Event> const & {
+			return m_events;
+		}
+
+	private:
+		std::vector<Event> m_events;
+	}; // class Recorder
+
+} // namespace br
@@ -0,0 +1,144 @@
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include "bytecode.hpp"
+#include "device.hpp"
+#include "engine.hpp"
+#include "parallel.hpp"
+
+namespace br {
+
+	namespace {
+
+		struct {
+			char const * name;
+			Engine engine;
+		} const engine_names[] = {
+			{"tree",     Engine::Tree},
+			{"vm",       Engine::VM},
+			{"batch",    Engine::Batch},
+			{"parallel", Engine::Parallel},
+			{"jit",      Engine::JIT},
+		};
+
+		auto same(Recorder::Event const & lhs, Recorder::Event const & rhs) -> bool {
+			return lhs.kind == rhs.kind && std::memcmp(&lhs.x, &rhs.x, sizeof(lhs.x)) == 0 && std::memcmp(&lhs.y, &rhs.y, sizeof(lhs.y)) == 0;
+		}
+
+		auto operator<<(std::ostream & ostream, Recorder::Event const & event) -> std::ostream & {
+			ostream << std::setprecision(17);
+			switch (event.kind) {
+				case Recorder::Event::Kind::Clear:
+					return ostream << "clear(" << event.x << ", " << event.y << ')';
+				case Recorder::Event::Kind::Draw:
+					return ostream << "draw(" << event.x << ", " << event.y << ')';
+				case Recorder::Event::Kind::Save:
+					return ostream << "save()";
+			}
+			return ostream;
+		}
+
+		void run(Program const & program, Context & context, Engine engine, std::size_t threads, std::uint64_t threshold) {
+			switch (engine) {
+				case Engine::Tree:
+					program.invoke(context);
+					break;
+				case Engine::VM:
+					execute(compile(program), context);
+					break;
+				case Engine::Batch:
+					context.batch(true);
+					program.invoke(context);
+					break;
+				case Engine::Parallel: {
+					ThreadPool pool(threads);
+					Parallel parallel(pool, program, std::cerr);
+					context.parallel(&parallel);
+					program.invoke(context);
+					context.parallel(nullptr);
+					break;
+				}
+				case Engine::JIT: {
+					Jit jit(threshold, program, std::cerr);
+					context.jit(&jit);
+					program.invoke(context);
+					context.jit(nullptr);
+					break;
+				}
+			}
+		}
+
+	} // namespace
+
+	auto engine_name(Engine engine) noexcept -> char const * {
+		for (auto const & entry : engine_names) {
+			if (entry.engine == engine) {
+				return entry.name;
+			}
+		}
+		return "unknown";
+	}
+
+	auto find_engine(std::string const & name, Engine & engine) noexcept -> bool {
+		for (auto const & entry : engine_names) {
+			if (name == entry.name) {
+				engine = entry.engine;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void execute(Program const & program, Context & context, Engine engine, std::size_t threads, std::uint64_t threshold) {
+		try {
+			run(program, context, engine, threads, threshold);
+		} catch (RuntimeError const &) {
+			// The points drawn before the error are part of the output.
+			context.flush();
+			throw;
+		}
+		context.flush();
+	}
+
+	auto compare(Program const & program, std::vector<Engine> const & engines, std::uint64_t seed, std::ostream & report, std::size_t threads, std::uint64_t threshold) -> bool {
+		std::vector<Recorder> recorders(engines.size());
+		std::vector<std::string> errors(engines.size());
+		for (std::size_t i = 0; i < engines.size(); ++i) {
+			Context context(recorders[i], program.slots().size(), seed);
+			try {
+				execute(program, context, engines[i], threads, threshold);
+			} catch (RuntimeError const & error) {
+				errors[i] = error.what();
+			}
+			report << engine_name(engines[i]) << ": " << recorders[i].events().size() << " events";
+			if (!errors[i].empty()) {
+				report << ", runtime error: " << errors[i];
+			}
+			report << std::endl;
+		}
+		auto identical = true;
+		auto const & expected = recorders.front().events();
+		for (std::size_t i = 1; i < engines.size(); ++i) {
+			auto const & actual = recorders[i].events();
+			std::size_t j = 0;
+			while (j < expected.size() && j < actual.size() && same(expected[j], actual[j])) {
+				++j;
+			}
+			if (j < expected.size() || j < actual.size() || errors[i] != errors.front()) {
+				identical = false;
+				report << engine_name(engines[i]) << " differs from " << engine_name(engines.front()) << " at event " << j;
+				if (j < expected.size() && j < actual.size()) {
+					report << ": " << actual[j] << " instead of " << expected[j];
+				} else if (j == expected.size() && j == actual.size()) {
+					report << ": different runtime errors";
+				}
+				report << std::endl;
+			}
+		}
+		if (identical) {
+			report << "identical output from all engines" << std::endl;
+		}
+		return identical;
+	}
+
+} // namespace br
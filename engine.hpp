@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "context.hpp"
+#include "jit.hpp"
+
+namespace br {
+
+	/// How a program is executed.
+	enum class Engine {
+		/// Walk the syntax tree.
+		Tree,
+		/// Compile to register bytecode and run it on the virtual machine.
+		VM,
+		/// Walk the syntax tree, running qualifying for loops as vectorised batches.
+		Batch,
+		/// Walk the syntax tree, running for loops with independent iterations on several threads.
+		Parallel,
+		/// Walk the syntax tree, running hot for loops as native code (see jit.hpp).
+		JIT,
+	};
+
+	auto engine_name(Engine engine) noexcept -> char const *;
+
+	/// Parse an engine name as given on the command line.
+	auto find_engine(std::string const & name, Engine & engine) noexcept -> bool;
+
+	/** \param threads the number of threads of the parallel engine, 0 for one per hardware thread
+	 ** \param threshold the iterations a loop runs before the JIT engine compiles it
+	 */
+	void execute(Program const & program, Context & context, Engine engine, std::size_t threads = 0, std::uint64_t threshold = Jit::default_threshold);
+
+	/** \brief Run \a program once per engine, recording the device output, and compare the runs bit for bit.
+	 ** \param threads, threshold as for execute()
+	 ** \return whether every engine produced exactly the same clear/draw/save sequence as the first one
+	 */
+	auto compare(Program const & program, std::vector<Engine> const & engines, std::uint64_t seed, std::ostream & report, std::size_t threads = 0, std::uint64_t threshold = Jit::default_threshold) -> bool;
+
+} // namespace br
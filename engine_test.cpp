@@ -0,0 +1,91 @@
+#include <cstddef>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "ast.hpp"
+#include "binder.hpp"
+#include "engine.hpp"
+#include "raph.hpp"
+
+namespace {
+
+	/// Scripts that read variables before, or on some paths without, assigning them.
+	char const * const scripts[] = {
+		// A built-in property, read through a variable of its name before that is assigned.
+		"x = rand\n"
+		"draw(x, x)\n"
+		"rand = 3\n"
+		"draw(rand, x)\n",
+		// Built-in functions, read and called the same way.
+		"g = sin\n"
+		"draw(g(1), cos(0))\n"
+		"sin = 2\n"
+		"cos = sin * 3\n"
+		"draw(sin, cos)\n",
+		// A variable read before any assignment.
+		"draw(1, 1)\n"
+		"draw(y, 1)\n"
+		"y = 2\n",
+		// Assigned on one branch only, taken and not taken.
+		"if rand < 2 then a = 1 end\n"
+		"draw(a, 0)\n"
+		"unless rand < 2 then b = 1 end\n"
+		"draw(0, b)\n",
+		// Assigned on both branches.
+		"if rand < 0.5 then c = 1 else c = 2 end\n"
+		"draw(c, c + 1)\n",
+		// Assigned late in loop bodies and read early in later iterations, then after the loops.
+		"for t from 0 to 3 step 1\n"
+		"\tif t > 1 then draw(s, t) end\n"
+		"\ts = t * 2\n"
+		"end\n"
+		"i = 0\n"
+		"while i < 3 do\n"
+		"\tif i > 0 then draw(w, i) end\n"
+		"\tw = i\n"
+		"\ti = i + 1\n"
+		"end\n"
+		"draw(s, w)\n",
+		// A loop that never runs assigns neither its variable nor anything in its body.
+		"for t from 1 to 0 step 1\n"
+		"\tu = t\n"
+		"end\n"
+		"draw(0, 0)\n"
+		"draw(u, t)\n",
+		// Void, as draw() returns, assigned on one path: still assigned, rather than the built-in.
+		"if rand < 2 then sin = draw(0, 0) end\n"
+		"draw(sin(1), 0)\n",
+		"if rand > 2 then cos = draw(0, 0) end\n"
+		"draw(cos(0), 1)\n",
+	};
+
+	/// Run \a source on the tree engine and on the VM and compare their output. \return whether they agree
+	auto check(std::string const & source) -> bool {
+		std::ostringstream diagnostics;
+		br::RaphParser parser("test", diagnostics);
+		auto program = parser.parse(source);
+		if (program == nullptr || parser.errors() != 0 || !br::bind(*program, parser)) {
+			std::cerr << "the script has errors:" << std::endl << source << diagnostics.str();
+			return false;
+		}
+		std::ostringstream report;
+		if (!br::compare(*program, {br::Engine::Tree, br::Engine::VM}, 1, report)) {
+			std::cerr << "script:" << std::endl << source << report.str();
+			return false;
+		}
+		return true;
+	}
+
+} // namespace
+
+int main() {
+	std::size_t checked = 0, failures = 0;
+	for (auto script : scripts) {
+		if (!check(script)) {
+			++failures;
+		}
+		++checked;
+	}
+	std::cout << checked << " scripts checked, " << failures << " run differently on the VM and the tree engine" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
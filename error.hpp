@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+namespace br {
+
+	/// Error raised while executing a program.
+	class RuntimeError : public std::runtime_error {
+	public:
+		explicit RuntimeError(std::string const & message) : std::runtime_error(message) {
+		}
+	}; // class RuntimeError
+
+} // namespace br
@@ -0,0 +1,380 @@
+#include <vector>
+#include "builtin.hpp"
+#include "context.hpp"
+#include "flat.hpp"
+
+namespace br {
+
+	namespace {
+
+		using Op = FlatExpression::Op;
+
+		/// Scratch slots kept on the stack; longer expressions use the heap.
+		constexpr std::size_t inline_slots = 32;
+
+		/// Instructions of the binary operators other than '&&' and '||', indexed by BinaryOperator.
+		Op const binary_ops[] = {
+			Op::AndLeft, Op::OrLeft, Op::Equal, Op::NotEqual, Op::Less, Op::Greater, Op::LessEqual, Op::GreaterEqual,
+			Op::Add, Op::Subtract, Op::Multiply, Op::Divide, Op::Modulo, Op::Power,
+		};
+
+		char const * const op_names[] = {
+			"Literal", "Load", "VectorX", "Vector", "Callee", "Call", "Index",
+			"Not", "Promote", "Negate",
+			"Add", "Subtract", "Multiply", "Divide", "Modulo", "Power",
+			"Equal", "NotEqual", "Less", "Greater", "LessEqual", "GreaterEqual",
+			"AndLeft", "AndRight", "OrLeft", "OrRight",
+		};
+
+		class Flattener : public Visitor {
+		public:
+			auto flatten(Expression const & expression, Program & program) -> FlatExpression * {
+				expression.accept(*this);
+				return program.make<FlatExpression>(
+					expression.span(),
+					&expression,
+					program.array(m_ops.data(), m_ops.size()),
+					program.array(m_lhs.data(), m_lhs.size()),
+					program.array(m_rhs.data(), m_rhs.size()),
+					program.array(m_constants.data(), m_constants.size()),
+					program.array(m_symbols.data(), m_symbols.size()),
+					program.array(m_arguments.data(), m_arguments.size())
+				);
+			}
+
+			virtual void visit(Variable const & node) override {
+				emit(Op::Load, symbol(node.symbol()));
+			}
+
+			virtual void visit(Constant const & node) override {
+				emit(Op::Literal, constant(*node.value()));
+			}
+
+			virtual void visit(Numeric const & node) override {
+				emit(Op::Literal, constant(node.value()));
+			}
+
+			virtual void visit(Boolean const & node) override {
+				emit(Op::Literal, constant(node.value()));
+			}
+
+			virtual void visit(Vector const & node) override {
+				auto x = emit(Op::VectorX, operand(node.x()));
+				emit(Op::Vector, x, operand(node.y()));
+			}
+
+			virtual void visit(FunctionCall const & node) override {
+				auto count = static_cast<std::uint32_t>(node.args().size());
+				auto callee = emit(Op::Callee, operand(node.func()), count);
+				std::vector<std::uint32_t> slots;
+				for (auto const & arg : node.args()) {
+					slots.push_back(operand(*arg));
+				}
+				auto offset = static_cast<std::uint32_t>(m_arguments.size());
+				m_arguments.push_back(count);
+				m_arguments.insert(m_arguments.end(), slots.begin(), slots.end());
+				emit(Op::Call, callee, offset);
+			}
+
+			virtual void visit(ArrayAccess const & node) override {
+				auto var = operand(node.var());
+				emit(Op::Index, var, operand(node.index()));
+			}
+
+			virtual void visit(UnaryOperation const & node) override {
+				auto rhs = operand(node.rhs());
+				switch (node.op()) {
+					case UnaryOperator::Not:
+						emit(Op::Not, 0, rhs);
+						break;
+					case UnaryOperator::Plus:
+						emit(Op::Promote, 0, rhs);
+						break;
+					case UnaryOperator::Minus:
+						emit(Op::Negate, 0, rhs);
+						break;
+				}
+			}
+
+			virtual void visit(BinaryOperation const & node) override {
+				auto op = node.op();
+				if (op == BinaryOperator::And || op == BinaryOperator::Or) {
+					auto is_and = op == BinaryOperator::And;
+					auto test = emit(is_and ? Op::AndLeft : Op::OrLeft, operand(node.lhs()));
+					auto rhs = operand(node.rhs());
+					m_rhs[test] = emit(is_and ? Op::AndRight : Op::OrRight, rhs);
+					return;
+				}
+				auto lhs = operand(node.lhs());
+				auto rhs = operand(node.rhs());
+				emit(binary_ops[static_cast<std::size_t>(op)], lhs, rhs);
+			}
+
+			virtual void visit(EmptyStatement const & node) override {
+			}
+
+			virtual void visit(CompoundStatement const & node) override {
+			}
+
+			virtual void visit(Program const & node) override {
+			}
+
+			virtual void visit(ConditionalStatement const & node) override {
+			}
+
+			virtual void visit(WhileStatement const & node) override {
+			}
+
+			virtual void visit(UntilStatement const & node) override {
+			}
+
+			virtual void visit(ForStatement const & node) override {
+			}
+
+			virtual void visit(AssignStatement const & node) override {
+			}
+
+			virtual void visit(ExpressionStatement const & node) override {
+			}
+
+		private:
+			/// Emit the code of \a expression; \return the slot of its value.
+			auto operand(Expression const & expression) -> std::uint32_t {
+				expression.accept(*this);
+				return static_cast<std::uint32_t>(m_ops.size() - 1);
+			}
+
+			auto emit(Op op, std::uint32_t lhs, std::uint32_t rhs = 0) -> std::uint32_t {
+				m_ops.push_back(op);
+				m_lhs.push_back(lhs);
+				m_rhs.push_back(rhs);
+				return static_cast<std::uint32_t>(m_ops.size() - 1);
+			}
+
+			auto constant(Value const & value) -> std::uint32_t {
+				m_constants.push_back(value);
+				return static_cast<std::uint32_t>(m_constants.size() - 1);
+			}
+
+			auto symbol(Symbol const * symbol) -> std::uint32_t {
+				for (std::size_t i = 0; i < m_symbols.size(); ++i) {
+					if (m_symbols[i] == symbol) {
+						return static_cast<std::uint32_t>(i);
+					}
+				}
+				m_symbols.push_back(symbol);
+				return static_cast<std::uint32_t>(m_symbols.size() - 1);
+			}
+
+			std::vector<Op> m_ops;
+			std::vector<std::uint32_t> m_lhs, m_rhs;
+			std::vector<Value> m_constants;
+			std::vector<Symbol const *> m_symbols;
+			std::vector<std::uint32_t> m_arguments;
+		};
+
+		/// Flattens the top-level expressions of statements, leaving expression trees alone otherwise.
+		class Rewriting : public Rewriter {
+		public:
+			explicit Rewriting(Program & program) noexcept : m_program(program) {
+			}
+
+			virtual auto rewrite(Expression * node) -> Expression * override {
+				return flatten(*node, m_program);
+			}
+
+			virtual auto rewrite(Statement * node) -> Statement * override {
+				node->rewrite(*this);
+				return node;
+			}
+
+		private:
+			Program & m_program;
+		};
+
+	} // namespace
+
+	FlatExpression::~FlatExpression() noexcept {
+	}
+
+	auto FlatExpression::evaluate(Context & context) const -> Value {
+		if (m_ops.size() <= inline_slots) {
+			Value slots[inline_slots];
+			return m_run(context, slots);
+		}
+		std::vector<Value> slots(m_ops.size());
+		return m_run(context, slots.data());
+	}
+
+	auto FlatExpression::m_run(Context & context, Value * slots) const -> Value {
+		auto ops = m_ops.begin();
+		auto lhs = m_lhs.begin();
+		auto rhs = m_rhs.begin();
+		auto count = m_ops.size();
+		for (std::size_t i = 0; i < count; ++i) {
+			auto & slot = slots[i];
+			switch (ops[i]) {
+				case Op::Literal:
+					slot = m_constants[lhs[i]];
+					break;
+				case Op::Load:
+					slot = context.lookup(*m_symbols[lhs[i]]);
+					break;
+				case Op::VectorX:
+					slot = expect_number(slots[lhs[i]], "vector x");
+					break;
+				case Op::Vector:
+					slot = Value(slots[lhs[i]].as_number(), expect_number(slots[rhs[i]], "vector y"));
+					break;
+				case Op::Callee:
+					expect_function(slots[lhs[i]], rhs[i]);
+					slot = slots[lhs[i]];
+					break;
+				case Op::Call: {
+					auto arguments = m_arguments.begin() + rhs[i];
+					Value values[max_arity];
+					for (std::uint32_t k = 0; k < arguments[0]; ++k) {
+						values[k] = slots[arguments[k + 1]];
+					}
+					slot = slots[lhs[i]].as_function()->callback(context, values);
+					break;
+				}
+				case Op::Index:
+					slot = br::index(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::Not:
+					slot = logical_not(slots[rhs[i]]);
+					break;
+				case Op::Promote:
+					slot = promote(slots[rhs[i]]);
+					break;
+				case Op::Negate:
+					slot = negate(slots[rhs[i]]);
+					break;
+				case Op::Add:
+					slot = add(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::Subtract:
+					slot = subtract(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::Multiply:
+					slot = multiply(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::Divide:
+					slot = divide(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::Modulo:
+					slot = modulo(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::Power:
+					slot = power(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::Equal:
+					slot = equal(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::NotEqual:
+					slot = !equal(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::Less:
+					slot = less(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::Greater:
+					slot = greater(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::LessEqual:
+					slot = less_equal(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::GreaterEqual:
+					slot = greater_equal(slots[lhs[i]], slots[rhs[i]]);
+					break;
+				case Op::AndLeft:
+					if (!expect_boolean(slots[lhs[i]], "left operand of '&&'")) {
+						i = rhs[i];
+						slots[i] = false;
+					}
+					break;
+				case Op::AndRight:
+					slot = expect_boolean(slots[lhs[i]], "right operand of '&&'");
+					break;
+				case Op::OrLeft:
+					if (expect_boolean(slots[lhs[i]], "left operand of '||'")) {
+						i = rhs[i];
+						slots[i] = true;
+					}
+					break;
+				case Op::OrRight:
+					slot = expect_boolean(slots[lhs[i]], "right operand of '||'");
+					break;
+			}
+		}
+		return slots[count - 1];
+	}
+
+	void FlatExpression::print(std::ostream & ostream, std::size_t indent) const {
+		ostream << std::string(indent, '\t') << "<FlatExpression>: " << m_ops.size() << " instructions" << std::endl;
+		for (std::size_t i = 0; i < m_ops.size(); ++i) {
+			auto op = m_ops[i];
+			ostream << std::string(indent + 1, '\t') << i << ": " << op_names[static_cast<std::size_t>(op)];
+			switch (op) {
+				case Op::Literal:
+					ostream << ' ' << m_constants[m_lhs[i]];
+					break;
+				case Op::Load:
+					ostream << ' ' << *m_symbols[m_lhs[i]]->name;
+					break;
+				case Op::VectorX:
+				case Op::AndRight:
+				case Op::OrRight:
+					ostream << " @" << m_lhs[i];
+					break;
+				case Op::Callee:
+					ostream << " @" << m_lhs[i] << ", " << m_rhs[i] << " argument(s)";
+					break;
+				case Op::Call: {
+					ostream << " @" << m_lhs[i] << " (";
+					auto arguments = m_arguments.begin() + m_rhs[i];
+					for (std::uint32_t k = 0; k < arguments[0]; ++k) {
+						ostream << (k == 0 ? "@" : ", @") << arguments[k + 1];
+					}
+					ostream << ')';
+					break;
+				}
+				case Op::Not:
+				case Op::Promote:
+				case Op::Negate:
+					ostream << " @" << m_rhs[i];
+					break;
+				case Op::AndLeft:
+				case Op::OrLeft:
+					ostream << " @" << m_lhs[i] << " -> " << m_rhs[i];
+					break;
+				default:
+					ostream << " @" << m_lhs[i] << ", @" << m_rhs[i];
+					break;
+			}
+			ostream << std::endl;
+		}
+	}
+
+	void FlatExpression::accept(Visitor & visitor) const {
+		m_source->accept(visitor);
+	}
+
+	void FlatExpression::rewrite(Rewriter & rewriter) {
+	}
+
+	auto flatten(Expression const & expression, Program & program) -> FlatExpression * {
+		return Flattener().flatten(expression, program);
+	}
+
+	void flatten(Program & program) {
+		Rewriting rewriting(program);
+		program.rewrite(rewriting);
+	}
+
+	auto source(Expression const & expression) -> Expression const & {
+		auto flat = dynamic_cast<FlatExpression const *>(&expression);
+		return flat != nullptr ? flat->source() : expression;
+	}
+
+} // namespace br
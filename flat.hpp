@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "ast.hpp"
+
+namespace br {
+
+	/** \brief An expression tree lowered to contiguous arrays, evaluated by one linear scan.
+	 **
+	 ** Instruction i is stored across the parallel arrays ops()[i], lhs()[i] and rhs()[i], and its result
+	 ** goes to slot i of a scratch array; operands name earlier slots, so the code is in postfix order and
+	 ** the last instruction yields the value of the expression. Literals, symbols and call argument lists
+	 ** live in side pools. The code is equivalent to its source tree, down to evaluation order, side
+	 ** effects and error messages. Visitors see the source tree, print() shows the code.
+	 */
+	class FlatExpression : public Expression {
+	public:
+		enum class Op : std::uint8_t {
+			/// constants()[lhs]
+			Literal,
+			/// The variable or built-in symbols()[lhs].
+			Load,
+			/// Slot lhs, which must be a number: the x of a vector under construction.
+			VectorX,
+			/// The vector of slots lhs (from VectorX) and rhs, which must be a number.
+			Vector,
+			/// Slot lhs, which must be a function taking rhs arguments.
+			Callee,
+			/// Call slot lhs (from Callee) with arguments()[rhs] arguments, in the slots that follow it.
+			Call,
+			Index,
+			Not,
+			Promote,
+			Negate,
+			Add,
+			Subtract,
+			Multiply,
+			Divide,
+			Modulo,
+			Power,
+			Equal,
+			NotEqual,
+			Less,
+			Greater,
+			LessEqual,
+			GreaterEqual,
+			/// Slot lhs as the left operand of '&&': if false, slot rhs becomes false and the code continues after it.
+			AndLeft,
+			/// Slot lhs as the right operand of '&&'.
+			AndRight,
+			OrLeft,
+			OrRight,
+		};
+
+		FlatExpression(
+			Expression const * source,
+			Array<Op> ops,
+			Array<std::uint32_t> lhs,
+			Array<std::uint32_t> rhs,
+			Array<Value> constants,
+			Array<Symbol const *> symbols,
+			Array<std::uint32_t> arguments
+		) noexcept : m_source(source), m_ops(ops), m_lhs(lhs), m_rhs(rhs), m_constants(constants), m_symbols(symbols), m_arguments(arguments) {
+		}
+
+		virtual ~FlatExpression() noexcept;
+
+		virtual auto evaluate(Context & context) const -> Value override;
+
+		virtual void print(std::ostream & ostream, std::size_t indent = 0) const override;
+
+		virtual void accept(Visitor & visitor) const override;
+
+		virtual void rewrite(Rewriter & rewriter) override;
+
+		auto source() const noexcept -> Expression const & {
+			return *m_source;
+		}
+
+		auto ops() const noexcept -> Array<Op> const & {
+			return m_ops;
+		}
+
+		auto lhs() const noexcept -> Array<std::uint32_t> const & {
+			return m_lhs;
+		}
+
+		auto rhs() const noexcept -> Array<std::uint32_t> const & {
+			return m_rhs;
+		}
+
+		auto constants() const noexcept -> Array<Value> const & {
+			return m_constants;
+		}
+
+		auto symbols() const noexcept -> Array<Symbol const *> const & {
+			return m_symbols;
+		}
+
+		auto arguments() const noexcept -> Array<std::uint32_t> const & {
+			return m_arguments;
+		}
+
+	private:
+		auto m_run(Context & context, Value * slots) const -> Value;
+
+		Expression const * m_source;
+		Array<Op> m_ops;
+		Array<std::uint32_t> m_lhs, m_rhs;
+		Array<Value> m_constants;
+		Array<Symbol const *> m_symbols;
+		Array<std::uint32_t> m_arguments;
+	};
+
+	/// Lower \a expression, which must be bound (see bind()), into a FlatExpression allocated in \a program.
+	auto flatten(Expression const & expression, Program & program) -> FlatExpression *;
+
+	/// Replace every top-level expression of every statement of \a program with its flat encoding.
+	void flatten(Program & program);
+
+	/// The tree \a expression was lowered from if it is a FlatExpression, else \a expression itself.
+	auto source(Expression const & expression) -> Expression const &;
+
+} // namespace br
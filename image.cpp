@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+#include "error.hpp"
+#include "image.hpp"
+
+namespace br {
+
+	namespace {
+
+		std::uint8_t const png_signature[] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+
+		/// The header of a zlib stream of the default window size and level.
+		std::uint8_t const zlib_header[] = {0x78, 0x9C};
+
+		/// The PNG filter types.
+		enum Filter : std::uint8_t {
+			None,
+			Sub,
+			Up,
+			Average,
+			Paeth,
+		};
+
+		void put32(std::uint8_t * out, std::uint32_t value) noexcept {
+			out[0] = static_cast<std::uint8_t>(value >> 24);
+			out[1] = static_cast<std::uint8_t>(value >> 16);
+			out[2] = static_cast<std::uint8_t>(value >> 8);
+			out[3] = static_cast<std::uint8_t>(value);
+		}
+
+		auto paeth(int left, int up, int corner) noexcept -> int {
+			auto estimate = left + up - corner;
+			auto to_left = std::abs(estimate - left), to_up = std::abs(estimate - up), to_corner = std::abs(estimate - corner);
+			return to_left <= to_up && to_left <= to_corner ? left : to_up <= to_corner ? up : corner;
+		}
+
+		/// Byte \a i of \a row filtered with \a filter against \a prior, the row above.
+		template <Filter filter>
+		auto filtered(std::uint8_t const * row, std::uint8_t const * prior, std::size_t i) noexcept -> std::uint8_t {
+			int left = i > 0 ? row[i - 1] : 0, corner = i > 0 ? prior[i - 1] : 0;
+			switch (filter) {
+				case Sub:
+					return static_cast<std::uint8_t>(row[i] - left);
+				case Up:
+					return static_cast<std::uint8_t>(row[i] - prior[i]);
+				case Average:
+					return static_cast<std::uint8_t>(row[i] - (left + prior[i]) / 2);
+				case Paeth:
+					return static_cast<std::uint8_t>(row[i] - paeth(left, prior[i], corner));
+				default:
+					return row[i];
+			}
+		}
+
+		/// Filter \a row into \a out, and return the sum of the absolute values of the bytes taken as signed.
+		template <Filter filter>
+		auto filter_into(std::uint8_t const * row, std::uint8_t const * prior, std::size_t width, std::uint8_t * out) noexcept -> std::uint64_t {
+			std::uint64_t sum = 0;
+			for (std::size_t i = 0; i < width; ++i) {
+				auto byte = filtered<filter>(row, prior, i);
+				out[i] = byte;
+				sum += byte < 128 ? byte : 256 - byte;
+			}
+			return sum;
+		}
+
+		/** \brief Append \a row filtered against \a prior to \a out, preceded by its filter type.
+		 **
+		 ** The filter is the one that leaves the smallest sum; \a scratch holds the row filtered each way.
+		 */
+		void filter_row(std::uint8_t const * row, std::uint8_t const * prior, std::size_t width,
+				std::vector<std::uint8_t> & scratch, std::vector<std::uint8_t> & out) {
+			scratch.resize(5 * width);
+			std::uint64_t const sums[] = {
+				filter_into<None>(row, prior, width, &scratch[None * width]),
+				filter_into<Sub>(row, prior, width, &scratch[Sub * width]),
+				filter_into<Up>(row, prior, width, &scratch[Up * width]),
+				filter_into<Average>(row, prior, width, &scratch[Average * width]),
+				filter_into<Paeth>(row, prior, width, &scratch[Paeth * width]),
+			};
+			auto best = static_cast<std::size_t>(std::min_element(sums, sums + 5) - sums);
+			out.push_back(static_cast<std::uint8_t>(best));
+			out.insert(out.end(), &scratch[best * width], &scratch[best * width] + width);
+		}
+
+	} // namespace
+
+	/// The state of a worker encoding one band at a time.
+	struct ImageWriter::Band {
+		Band() : stream() {
+			if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+				throw RuntimeError("cannot start to compress: out of memory");
+			}
+		}
+
+		~Band() noexcept {
+			deflateEnd(&stream);
+		}
+
+		/// Filter and deflate \a count rows, as the end of the stream if \a last.
+		void encode(std::uint8_t const * rows, std::uint8_t const * prior, std::size_t width, std::size_t count, bool last) {
+			input.clear();
+			for (std::size_t row = 0; row < count; ++row) {
+				filter_row(rows + row * width, row > 0 ? rows + (row - 1) * width : prior, width, scratch, input);
+			}
+			adler = adler32(adler32(0, Z_NULL, 0), input.data(), static_cast<uInt>(input.size()));
+
+			// A stream of its own, which the next band's continues as it ends on a byte boundary and not in a final block.
+			deflateReset(&stream);
+			stream.next_in = input.data();
+			stream.avail_in = static_cast<uInt>(input.size());
+			output.clear();
+			auto status = Z_OK;
+			do {
+				auto used = output.size();
+				output.resize(used + deflateBound(&stream, stream.avail_in) + 16);
+				stream.next_out = output.data() + used;
+				stream.avail_out = static_cast<uInt>(output.size() - used);
+				status = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+				if (status == Z_STREAM_ERROR) {
+					throw RuntimeError("cannot compress the image");
+				}
+				output.resize(output.size() - stream.avail_out);
+			} while (last ? status != Z_STREAM_END : stream.avail_out == 0);
+		}
+
+		z_stream stream;
+		std::vector<std::uint8_t> scratch;
+		/// The filtered rows, and their Adler-32.
+		std::vector<std::uint8_t> input;
+		uLong adler;
+		std::vector<std::uint8_t> output;
+	};
+
+	constexpr std::size_t ImageWriter::band_bytes;
+	constexpr int ImageWriter::level;
+
+	auto ImageWriter::format(std::string const & filename) -> Format {
+		auto dot = filename.rfind('.');
+		if (dot == std::string::npos || filename.find('/', dot) != std::string::npos) {
+			return Format::PGM;
+		}
+		auto extension = filename.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) {
+			return static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+		});
+		return extension == "png" ? Format::PNG : Format::PGM;
+	}
+
+	ImageWriter::ImageWriter(std::string const & filename, std::size_t width, std::size_t height, ThreadPool & pool)
+		: m_filename(filename), m_width(width), m_height(height), m_format(format(filename)), m_pool(pool),
+		m_band_rows(std::max<std::size_t>(band_bytes / (width + 1), 1)), m_adler(adler32(0, Z_NULL, 0)), m_started(false) {
+		if (m_format == Format::PNG && (width == 0 || height == 0 || width > 0x7FFFFFFF || height > 0x7FFFFFFF)) {
+			throw RuntimeError("cannot write a PNG of " + std::to_string(width) + " by " + std::to_string(height) + " pixels");
+		}
+		m_file.open(filename, std::ios::binary);
+		if (!m_file) {
+			throw RuntimeError("cannot open " + filename + ": " + std::strerror(errno));
+		}
+		if (m_format == Format::PGM) {
+			m_file << "P5\n" << width << ' ' << height << "\n255\n";
+			return;
+		}
+
+		m_file.write(reinterpret_cast<char const *>(png_signature), sizeof(png_signature));
+		std::uint8_t header[13];
+		put32(header, static_cast<std::uint32_t>(width));
+		put32(header + 4, static_cast<std::uint32_t>(height));
+		// 8 bits of gray per pixel, deflate, adaptive filtering, no interlacing.
+		header[8] = 8;
+		header[9] = header[10] = header[11] = header[12] = 0;
+		m_chunk("IHDR", header, sizeof(header));
+		m_previous.assign(width, 0);
+		m_rows.reserve(m_band_rows * m_pool.size() * width);
+		for (std::size_t worker = 0; worker < m_pool.size(); ++worker) {
+			m_bands.emplace_back(new Band());
+		}
+	}
+
+	ImageWriter::~ImageWriter() noexcept {
+	}
+
+	void ImageWriter::write(std::uint8_t const * rows, std::size_t count) {
+		if (m_format == Format::PGM) {
+			m_file.write(reinterpret_cast<char const *>(rows), count * m_width);
+			return;
+		}
+		auto capacity = m_band_rows * m_bands.size() * m_width;
+		auto size = count * m_width;
+		while (size > 0) {
+			auto taken = std::min(size, capacity - m_rows.size());
+			m_rows.insert(m_rows.end(), rows, rows + taken);
+			rows += taken;
+			size -= taken;
+			if (m_rows.size() == capacity) {
+				m_encode(false);
+			}
+		}
+	}
+
+	void ImageWriter::finish() {
+		if (m_format == Format::PNG) {
+			m_encode(true);
+			m_chunk("IEND", nullptr, 0);
+		}
+		m_file.flush();
+		if (!m_file) {
+			throw RuntimeError("cannot write " + m_filename);
+		}
+	}
+
+	auto ImageWriter::memory() const noexcept -> std::size_t {
+		auto bytes = m_rows.capacity() + m_previous.capacity();
+		for (auto const & band : m_bands) {
+			bytes += band->scratch.capacity() + band->input.capacity() + band->output.capacity();
+		}
+		return bytes;
+	}
+
+	void ImageWriter::m_encode(bool last) {
+		auto rows = m_width == 0 ? 0 : m_rows.size() / m_width;
+		auto bands = std::min((rows + m_band_rows - 1) / m_band_rows, m_bands.size());
+		if (last && bands == 0) {
+			// The final block of the stream, with no rows in it.
+			bands = 1;
+		}
+		m_pool.run([&](std::size_t worker) {
+			if (worker >= bands) {
+				return;
+			}
+			auto first = std::min(worker * m_band_rows, rows), count = std::min(m_band_rows, rows - first);
+			auto prior = first > 0 ? &m_rows[(first - 1) * m_width] : m_previous.data();
+			m_bands[worker]->encode(m_rows.data() + first * m_width, prior, m_width, count, last && worker == bands - 1);
+		});
+
+		for (std::size_t band = 0; band < bands; ++band) {
+			auto & encoded = *m_bands[band];
+			m_adler = adler32_combine(m_adler, encoded.adler, static_cast<z_off_t>(encoded.input.size()));
+			if (!m_started) {
+				encoded.output.insert(encoded.output.begin(), zlib_header, zlib_header + sizeof(zlib_header));
+				m_started = true;
+			}
+			if (last && band == bands - 1) {
+				std::uint8_t trailer[4];
+				put32(trailer, static_cast<std::uint32_t>(m_adler));
+				encoded.output.insert(encoded.output.end(), trailer, trailer + sizeof(trailer));
+			}
+			m_chunk("IDAT", encoded.output.data(), encoded.output.size());
+		}
+		if (rows > 0) {
+			std::copy(m_rows.end() - m_width, m_rows.end(), m_previous.begin());
+		}
+		m_rows.clear();
+	}
+
+	void ImageWriter::m_chunk(char const * type, std::uint8_t const * data, std::size_t size) {
+		std::uint8_t length[4], crc[4];
+		put32(length, static_cast<std::uint32_t>(size));
+		auto checksum = crc32(0, reinterpret_cast<Bytef const *>(type), 4);
+		if (size > 0) {
+			checksum = crc32(checksum, data, static_cast<uInt>(size));
+		}
+		put32(crc, static_cast<std::uint32_t>(checksum));
+		m_file.write(reinterpret_cast<char const *>(length), 4);
+		m_file.write(type, 4);
+		m_file.write(reinterpret_cast<char const *>(data), static_cast<std::streamsize>(size));
+		m_file.write(reinterpret_cast<char const *>(crc), 4);
+	}
+
+} // namespace br
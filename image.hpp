@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "pool.hpp"
+
+namespace br {
+
+	/** \brief Writes an 8-bit grayscale image to a file a few rows at a time: as PNG if its name ends in `.png`,
+	 **        as binary PGM otherwise.
+	 **
+	 ** PGM is the pixels as they are after a short header, the fastest to write, for pipelines that encode the
+	 ** image later. For PNG the rows are gathered into bands of about band_bytes, one for each worker of the
+	 ** pool, and the workers encode a band each at once: every row gets the filter that leaves the smallest sum
+	 ** of absolute differences, as in libpng, and the band is deflated on its own and ended on a byte boundary
+	 ** by a sync flush. So the bands, one IDAT chunk each, make up one zlib stream, whose Adler-32 checksum is
+	 ** combined from theirs. Only the rows of one band per worker are held at once.
+	 */
+	class ImageWriter {
+	public:
+		enum class Format {
+			PGM,
+			PNG,
+		};
+
+		/// Bytes of filtered rows in a band of a PNG.
+		static constexpr std::size_t band_bytes = std::size_t(256) << 10;
+
+		/// zlib compression level of a PNG, 0 to 9.
+		static constexpr int level = 6;
+
+		/// The format of a file named \a filename.
+		static auto format(std::string const & filename) -> Format;
+
+		/// Create \a filename and write the header. \throw RuntimeError if it cannot be, or if the image cannot be a PNG
+		ImageWriter(std::string const & filename, std::size_t width, std::size_t height, ThreadPool & pool);
+
+		ImageWriter(ImageWriter const &) = delete;
+
+		auto operator=(ImageWriter const &) -> ImageWriter & = delete;
+
+		~ImageWriter() noexcept;
+
+		/// Write the next \a count rows, of width bytes each one after the other from \a rows.
+		void write(std::uint8_t const * rows, std::size_t count);
+
+		/// Write what is left once every row has been written. \throw RuntimeError if the file cannot be written
+		void finish();
+
+		/// Bytes held for rows and bands.
+		auto memory() const noexcept -> std::size_t;
+
+	private:
+		struct Band;
+
+		/// Encode the gathered rows in parallel and write them, as the end of the image if \a last.
+		void m_encode(bool last);
+
+		void m_chunk(char const * type, std::uint8_t const * data, std::size_t size);
+
+		std::string m_filename;
+		std::size_t m_width, m_height;
+		Format m_format;
+		ThreadPool & m_pool;
+		std::ofstream m_file;
+		/// Rows gathered, at most m_band_rows for each band.
+		std::vector<std::uint8_t> m_rows;
+		std::size_t m_band_rows;
+		/// The last row encoded, which the first row gathered is filtered against; zeros before the first.
+		std::vector<std::uint8_t> m_previous;
+		std::vector<std::unique_ptr<Band>> m_bands;
+		/// Adler-32 of the filtered rows encoded so far.
+		unsigned long m_adler;
+		bool m_started;
+	}; // class ImageWriter
+
+} // namespace br
@@ -0,0 +1,904 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+#include "builtin.hpp"
+#include "context.hpp"
+#include "flat.hpp"
+#include "jit.hpp"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#define RAPH_JIT 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define RAPH_JIT 0
+#endif
+
+namespace br {
+
+	namespace {
+
+		/// A run of the code of a loop: the context it draws to, and what stopped it, if anything.
+		struct Run {
+			Context * context;
+			std::exception_ptr error;
+		};
+
+		/// The code of a loop: runs \a trips iterations over the frame \a values.
+		using Function = void (*)(double * values, Run * run, std::uint64_t trips);
+
+		constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+		/// The places of the frame, in doubles: the loop variable, the loop bounds and the sign bit, then the
+		/// variables the body assigns, then temporaries, then the values computed before the loop.
+		constexpr std::size_t parameter_value = 0;
+		constexpr std::size_t from_value = 1;
+		constexpr std::size_t step_value = 2;
+		constexpr std::size_t sign_value = 3;
+		constexpr std::size_t fixed_values = 4;
+
+		/// The bits of a variable of the frame not yet assigned, a signaling NaN: arithmetic only yields quiet ones.
+		constexpr std::uint64_t blank_bits = 0x7FF00000000B1A4Bull;
+
+		auto blank() noexcept -> double {
+			double value;
+			std::memcpy(&value, &blank_bits, sizeof(value));
+			return value;
+		}
+
+		auto is_blank(double value) noexcept -> bool {
+			std::uint64_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			return bits == blank_bits;
+		}
+
+		/// Temporaries in the frame, which bounds how deeply operands that need code can nest.
+		constexpr std::size_t max_temporaries = 64;
+
+		// Called from the generated code, which has no unwind information to throw through.
+
+		/// \return true if the device failed, the exception being kept in \a run for the caller to rethrow
+		auto draw(Run * run, double x, double y) noexcept -> bool {
+			try {
+				run->context->draw(x, y);
+				return false;
+			} catch (...) {
+				run->error = std::current_exception();
+				return true;
+			}
+		}
+
+		/// Never fails: the numbers are computed from the seed and their position alone.
+		auto random(Run * run) noexcept -> double {
+			return run->context->random();
+		}
+
+		auto modulo(double lhs, double rhs) -> double {
+			return std::fmod(lhs, rhs);
+		}
+
+		auto power(double lhs, double rhs) -> double {
+			return std::pow(lhs, rhs);
+		}
+
+		template< typename F >
+		auto address(F function) noexcept -> std::uint64_t {
+			return reinterpret_cast<std::uint64_t>(function);
+		}
+
+		/** \brief Emits the few x86-64 instructions the compiler needs.
+		 **
+		 ** Values are in xmm0 and xmm1; rbx holds the frame, r12 the Run, r13 the iteration and r14 the
+		 ** number of iterations, all preserved by calls.
+		 */
+		class Assembler {
+		public:
+			/// The opcodes of the scalar double arithmetic instructions.
+			enum class Arithmetic : std::uint8_t {
+				Add = 0x58,
+				Multiply = 0x59,
+				Subtract = 0x5C,
+				Divide = 0x5E,
+			};
+
+			/// The second opcode bytes of the conditional jumps, by the flags they test.
+			enum class Condition : std::uint8_t {
+				Below = 0x82,
+				AboveEqual = 0x83,
+				Equal = 0x84,
+				NotEqual = 0x85,
+				BelowEqual = 0x86,
+				Above = 0x87,
+				Parity = 0x8A,
+			};
+
+			/// The machine code, once every label used has been bound.
+			auto code() -> std::vector<std::uint8_t> const & {
+				for (auto const & patch : m_patches) {
+					auto offset = static_cast<std::int32_t>(m_labels[patch.label] - (patch.at + 4));
+					std::memcpy(&m_code[patch.at], &offset, sizeof(offset));
+				}
+				m_patches.clear();
+				return m_code;
+			}
+
+			/// Save the registers the code uses and set them up from the arguments.
+			void prologue() {
+				// Five pushes after the return address leave the stack aligned for calls.
+				emit({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});
+				emit({0x48, 0x89, 0xFB}); // mov rbx, rdi
+				emit({0x49, 0x89, 0xF4}); // mov r12, rsi
+				emit({0x49, 0x89, 0xD6}); // mov r14, rdx
+				emit({0x45, 0x31, 0xED}); // xor r13d, r13d
+			}
+
+			void epilogue() {
+				emit({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+			}
+
+			/// xmm0 = the iteration as a double
+			void iteration() {
+				emit({0xF2, 0x49, 0x0F, 0x2A, 0xC5}); // cvtsi2sd xmm0, r13
+			}
+
+			/// Go to the next iteration, back to \a label unless it was the last one.
+			void next(std::size_t label) {
+				emit({0x49, 0xFF, 0xC5}); // inc r13
+				emit({0x4D, 0x39, 0xF5}); // cmp r13, r14
+				jump(Condition::Below, label);
+			}
+
+			/// movsd xmm, [frame + index]
+			void load(int xmm, std::size_t index) {
+				frame(0xF2, 0x10, xmm, index);
+			}
+
+			/// movsd [frame + index], xmm
+			void store(std::size_t index, int xmm) {
+				frame(0xF2, 0x11, xmm, index);
+			}
+
+			/// xmm = xmm op [frame + index]
+			void arithmetic(Arithmetic op, int xmm, std::size_t index) {
+				frame(0xF2, static_cast<std::uint8_t>(op), xmm, index);
+			}
+
+			/// lhs = lhs op rhs
+			void arithmetic(Arithmetic op, int lhs, int rhs) {
+				registers(0xF2, static_cast<std::uint8_t>(op), lhs, rhs);
+			}
+
+			/// movapd lhs, rhs
+			void move(int lhs, int rhs) {
+				registers(0x66, 0x28, lhs, rhs);
+			}
+
+			/// xorpd lhs, rhs
+			void exclusive_or(int lhs, int rhs) {
+				registers(0x66, 0x57, lhs, rhs);
+			}
+
+			/// ucomisd lhs, rhs
+			void compare(int lhs, int rhs) {
+				registers(0x66, 0x2E, lhs, rhs);
+			}
+
+			/// Call a function with the System V calling convention, the Run as first integer argument.
+			void call(std::uint64_t function, bool context) {
+				if (context) {
+					emit({0x4C, 0x89, 0xE7}); // mov rdi, r12
+				}
+				emit({0x48, 0xB8}); // mov rax, function
+				for (int shift = 0; shift < 64; shift += 8) {
+					m_code.push_back(static_cast<std::uint8_t>(function >> shift));
+				}
+				emit({0xFF, 0xD0}); // call rax
+			}
+
+			/// Go to \a label if the function last called returned true.
+			void failed(std::size_t label) {
+				emit({0x84, 0xC0}); // test al, al
+				jump(Condition::NotEqual, label);
+			}
+
+			auto label() -> std::size_t {
+				m_labels.push_back(0);
+				return m_labels.size() - 1;
+			}
+
+			void bind(std::size_t label) {
+				m_labels[label] = m_code.size();
+			}
+
+			void jump(std::size_t label) {
+				emit({0xE9});
+				patch(label);
+			}
+
+			void jump(Condition condition, std::size_t label) {
+				emit({0x0F, static_cast<std::uint8_t>(condition)});
+				patch(label);
+			}
+
+		private:
+			struct Patch {
+				std::size_t at, label;
+			};
+
+			void emit(std::initializer_list<std::uint8_t> bytes) {
+				m_code.insert(m_code.end(), bytes);
+			}
+
+			/// An SSE2 instruction with a register and a frame operand, [rbx + disp32].
+			void frame(std::uint8_t prefix, std::uint8_t opcode, int xmm, std::size_t index) {
+				emit({prefix, 0x0F, opcode, static_cast<std::uint8_t>(0x83 | xmm << 3)});
+				auto offset = static_cast<std::int32_t>(index * sizeof(double));
+				auto bytes = reinterpret_cast<std::uint8_t const *>(&offset);
+				m_code.insert(m_code.end(), bytes, bytes + sizeof(offset));
+			}
+
+			/// An SSE2 instruction with two register operands.
+			void registers(std::uint8_t prefix, std::uint8_t opcode, int lhs, int rhs) {
+				emit({prefix, 0x0F, opcode, static_cast<std::uint8_t>(0xC0 | lhs << 3 | rhs)});
+			}
+
+			void patch(std::size_t label) {
+				m_patches.push_back(Patch{m_code.size(), label});
+				emit({0, 0, 0, 0});
+			}
+
+			std::vector<std::uint8_t> m_code;
+			std::vector<std::size_t> m_labels;
+			std::vector<Patch> m_patches;
+		};
+
+		/// Executable memory holding a copy of some machine code.
+		class Code {
+		public:
+			explicit Code(std::vector<std::uint8_t> const & code) : m_memory(nullptr), m_size(0) {
+#if RAPH_JIT
+				auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+				m_size = (code.size() + page - 1) / page * page;
+				auto memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (memory == MAP_FAILED) {
+					return;
+				}
+				std::memcpy(memory, code.data(), code.size());
+				// Never writable and executable at once.
+				if (mprotect(memory, m_size, PROT_READ | PROT_EXEC) != 0) {
+					munmap(memory, m_size);
+					return;
+				}
+				m_memory = memory;
+#endif
+			}
+
+			Code(Code const &) = delete;
+
+			auto operator=(Code const &) -> Code & = delete;
+
+			~Code() noexcept {
+#if RAPH_JIT
+				if (m_memory != nullptr) {
+					munmap(m_memory, m_size);
+				}
+#endif
+			}
+
+			/// The code as a function, nullptr if it could not be made executable.
+			auto function() const noexcept -> Function {
+				return reinterpret_cast<Function>(m_memory);
+			}
+
+		private:
+			void * m_memory;
+			std::size_t m_size;
+		};
+
+		/// Whether an expression reads a value that changes during the loop, and whether it can be
+		/// evaluated before the loop without side effects.
+		class Invariance : public Walker {
+		public:
+			Invariance(std::uint32_t slot, std::vector<std::uint32_t> const & locals, std::vector<std::uint32_t> & unassigned)
+				: m_slot(slot), m_locals(locals), m_unassigned(unassigned), m_rand(find_builtin("rand")) {
+			}
+
+			bool varying = false;
+
+			bool pure = true;
+
+			using Walker::visit;
+
+			virtual void visit(Variable const & node) override {
+				auto symbol = node.symbol();
+				if (symbol->slot == m_slot || std::find(m_locals.begin(), m_locals.end(), symbol->slot) != m_locals.end()) {
+					varying = true;
+				} else if (symbol->builtin == m_rand) {
+					varying = true;
+				} else if (symbol->builtin != nullptr && symbol->builtin->kind == Builtin::Kind::Property) {
+					pure = false;
+				}
+			}
+
+			virtual void visit(FunctionCall const & node) override {
+				auto callee = dynamic_cast<Variable const *>(&node.func());
+				auto symbol = callee != nullptr ? callee->symbol() : nullptr;
+				if (symbol == nullptr || symbol->slot == m_slot || symbol->builtin == nullptr || !symbol->builtin->pure
+					|| std::find(m_locals.begin(), m_locals.end(), symbol->slot) != m_locals.end()) {
+					pure = false;
+				} else if (symbol->slot != no_slot) {
+					// Calls the built-in only as long as the name is not assigned.
+					m_unassigned.push_back(symbol->slot);
+				}
+				for (auto const & arg : node.args()) {
+					arg->accept(*this);
+				}
+			}
+
+		private:
+			std::uint32_t m_slot;
+			std::vector<std::uint32_t> const & m_locals;
+			std::vector<std::uint32_t> & m_unassigned;
+			Builtin const * m_rand;
+		};
+
+		/** \brief Generates the code of a loop.
+		 **
+		 ** Expressions are computed into xmm0; an operand that needs code of its own is computed after the
+		 ** other one has been saved to a temporary, so nothing lives in a register across a call.
+		 */
+		class Compiler : public Visitor {
+		public:
+			explicit Compiler(ForStatement const & loop) : m_loop(loop), m_rand(find_builtin("rand")), m_draw(find_builtin("draw")) {
+			}
+
+			/// Why the loop cannot be compiled, empty if it can.
+			std::string reason;
+
+			/// The variables the body assigns, after the fixed values of the frame.
+			std::vector<std::uint32_t> locals;
+
+			/// For each of those, whether its value before the loop may be read or kept.
+			std::vector<bool> live;
+
+			/// The expressions computed before the loop, after the temporaries.
+			std::vector<Expression const *> invariants;
+
+			/// The slots whose built-in the code calls or reads, which must therefore not be assigned.
+			std::vector<std::uint32_t> unassigned;
+
+			auto compile() -> std::vector<std::uint8_t> const & {
+				for (auto slot : assigned_slots(m_loop.body())) {
+					if (slot != m_loop.slot() && std::find(locals.begin(), locals.end(), slot) == locals.end()) {
+						locals.push_back(slot);
+					}
+				}
+				if (Context::is_special(m_loop.slot())) {
+					fail("it assigns '" + m_loop.id() + "'");
+				}
+				live.assign(locals.size(), false);
+
+				m_assembler.prologue();
+				m_exit = m_assembler.label();
+				auto top = m_assembler.label();
+				m_assembler.bind(top);
+				m_assembler.iteration();
+				m_assembler.arithmetic(Assembler::Arithmetic::Multiply, 0, step_value);
+				m_assembler.arithmetic(Assembler::Arithmetic::Add, 0, from_value);
+				m_assembler.store(parameter_value, 0);
+				statement(m_loop.body());
+				m_assembler.next(top);
+				m_assembler.bind(m_exit);
+				m_assembler.epilogue();
+
+				// A variable not assigned in every iteration keeps its value from before the loop.
+				for (std::size_t k = 0; k < locals.size(); ++k) {
+					live[k] = live[k] || std::find(m_certain.begin(), m_certain.end(), locals[k]) == m_certain.end();
+				}
+				std::sort(unassigned.begin(), unassigned.end());
+				unassigned.erase(std::unique(unassigned.begin(), unassigned.end()), unassigned.end());
+				return m_assembler.code();
+			}
+
+			/// The size of the frame in doubles.
+			auto frame_size() const noexcept -> std::size_t {
+				return invariant_base() + invariants.size();
+			}
+
+			virtual void visit(Variable const & node) override {
+				auto symbol = node.symbol();
+				if (symbol->builtin == m_rand) {
+					if (symbol->slot != no_slot) {
+						unassigned.push_back(symbol->slot);
+					}
+					m_assembler.call(address(random), true);
+				} else {
+					fail("it reads '" + node.id() + "'");
+				}
+			}
+
+			virtual void visit(Constant const & node) override {
+				fail("it reads '" + node.id() + "'");
+			}
+
+			virtual void visit(Numeric const & node) override {
+				fail("it computes a number in an unexpected way");
+			}
+
+			virtual void visit(Boolean const & node) override {
+				fail("it computes a boolean");
+			}
+
+			virtual void visit(Vector const & node) override {
+				fail("it computes a vector");
+			}
+
+			virtual void visit(FunctionCall const & node) override {
+				auto builtin = callee(node);
+				auto count = node.args().size();
+				if (builtin != nullptr && builtin->unary != nullptr && count == 1) {
+					generate(*node.args().front());
+					m_assembler.call(address(builtin->unary), false);
+				} else if (builtin != nullptr && builtin->binary != nullptr && count == 2) {
+					operands(*node.args().front(), *node.args().back());
+					m_assembler.call(address(builtin->binary), false);
+				} else {
+					fail("it calls a function other than a built-in math function");
+				}
+			}
+
+			virtual void visit(ArrayAccess const & node) override {
+				fail("it indexes a vector");
+			}
+
+			virtual void visit(UnaryOperation const & node) override {
+				switch (node.op()) {
+					case UnaryOperator::Plus:
+						generate(node.rhs());
+						break;
+					case UnaryOperator::Minus:
+						generate(node.rhs());
+						m_assembler.load(1, sign_value);
+						m_assembler.exclusive_or(0, 1);
+						break;
+					case UnaryOperator::Not:
+						fail("it computes a boolean");
+						break;
+				}
+			}
+
+			virtual void visit(BinaryOperation const & node) override {
+				Assembler::Arithmetic op;
+				switch (node.op()) {
+					case BinaryOperator::Add:
+						op = Assembler::Arithmetic::Add;
+						break;
+					case BinaryOperator::Subtract:
+						op = Assembler::Arithmetic::Subtract;
+						break;
+					case BinaryOperator::Multiply:
+						op = Assembler::Arithmetic::Multiply;
+						break;
+					case BinaryOperator::Divide:
+						op = Assembler::Arithmetic::Divide;
+						break;
+					case BinaryOperator::Modulo:
+						operands(node.lhs(), node.rhs());
+						m_assembler.call(address(modulo), false);
+						return;
+					case BinaryOperator::Power:
+						operands(node.lhs(), node.rhs());
+						m_assembler.call(address(power), false);
+						return;
+					default:
+						fail("it computes a boolean");
+						return;
+				}
+				generate(node.lhs());
+				auto rhs = place(node.rhs());
+				if (rhs != none) {
+					m_assembler.arithmetic(op, 0, rhs);
+					return;
+				}
+				auto temporary = push();
+				m_assembler.store(temporary, 0);
+				generate(node.rhs());
+				m_assembler.move(1, 0);
+				m_assembler.load(0, temporary);
+				m_assembler.arithmetic(op, 0, 1);
+				pop();
+			}
+
+			virtual void visit(EmptyStatement const & node) override {
+			}
+
+			virtual void visit(CompoundStatement const & node) override {
+				for (auto const & stmt : node.stmts()) {
+					statement(*stmt);
+				}
+			}
+
+			virtual void visit(Program const & node) override {
+				fail("it contains a program");
+			}
+
+			virtual void visit(ConditionalStatement const & node) override {
+				auto when_false = m_assembler.label(), end = m_assembler.label();
+				branch(source(node.cond()), false, when_false);
+				++m_branches;
+				statement(node.when_true());
+				m_assembler.jump(end);
+				m_assembler.bind(when_false);
+				statement(node.when_false());
+				--m_branches;
+				m_assembler.bind(end);
+			}
+
+			virtual void visit(WhileStatement const & node) override {
+				fail("it contains a loop");
+			}
+
+			virtual void visit(UntilStatement const & node) override {
+				fail("it contains a loop");
+			}
+
+			virtual void visit(ForStatement const & node) override {
+				fail("it contains a loop");
+			}
+
+			virtual void visit(AssignStatement const & node) override {
+				if (Context::is_special(node.slot())) {
+					fail("it assigns '" + node.id() + "'");
+					return;
+				}
+				generate(source(node.expr()));
+				auto local = std::find(locals.begin(), locals.end(), node.slot());
+				m_assembler.store(local != locals.end() ? fixed_values + (local - locals.begin()) : parameter_value, 0);
+				if (m_branches == 0) {
+					m_certain.push_back(node.slot());
+				}
+			}
+
+			virtual void visit(ExpressionStatement const & node) override {
+				auto call = dynamic_cast<FunctionCall const *>(&source(node.expr()));
+				if (call == nullptr || callee(*call) != m_draw || call->args().size() != 2) {
+					fail("it evaluates an expression other than a call of 'draw'");
+					return;
+				}
+				operands(*call->args().front(), *call->args().back());
+				m_assembler.call(address(draw), true);
+				// The frame is left as it was when the device failed, as the interpreter would leave the variables.
+				m_assembler.failed(m_exit);
+			}
+
+		private:
+			void statement(Statement const & node) {
+				if (reason.empty()) {
+					node.accept(*this);
+				}
+			}
+
+			/// Compute a numeric expression into xmm0.
+			void generate(Expression const & expr) {
+				if (!reason.empty()) {
+					return;
+				}
+				auto index = place(expr);
+				if (index != none) {
+					m_assembler.load(0, index);
+				} else {
+					expr.accept(*this);
+				}
+			}
+
+			/// Compute \a lhs into xmm0 and \a rhs into xmm1, in that order.
+			void operands(Expression const & lhs, Expression const & rhs) {
+				generate(lhs);
+				auto index = place(rhs);
+				if (index != none) {
+					m_assembler.load(1, index);
+					return;
+				}
+				auto temporary = push();
+				m_assembler.store(temporary, 0);
+				generate(rhs);
+				m_assembler.move(1, 0);
+				m_assembler.load(0, temporary);
+				pop();
+			}
+
+			/// Jump to \a label if \a cond is \a when, or fall through.
+			void branch(Expression const & cond, bool when, std::size_t label) {
+				if (!reason.empty()) {
+					return;
+				}
+				auto unary = dynamic_cast<UnaryOperation const *>(&cond);
+				if (unary != nullptr && unary->op() == UnaryOperator::Not) {
+					branch(unary->rhs(), !when, label);
+					return;
+				}
+				auto binary = dynamic_cast<BinaryOperation const *>(&cond);
+				if (binary == nullptr) {
+					fail("it branches on something other than a comparison");
+					return;
+				}
+				using Condition = Assembler::Condition;
+				switch (binary->op()) {
+					case BinaryOperator::And:
+					case BinaryOperator::Or: {
+						// Short-circuits to the result when the left operand decides it.
+						auto decisive = binary->op() == BinaryOperator::Or;
+						if (decisive == when) {
+							branch(binary->lhs(), when, label);
+							branch(binary->rhs(), when, label);
+						} else {
+							auto skip = m_assembler.label();
+							branch(binary->lhs(), !when, skip);
+							branch(binary->rhs(), when, label);
+							m_assembler.bind(skip);
+						}
+						break;
+					}
+					case BinaryOperator::Less:
+						// ucomisd sets the carry flag when unordered, so a comparison with NaN is false.
+						operands(binary->lhs(), binary->rhs());
+						m_assembler.compare(1, 0);
+						m_assembler.jump(when ? Condition::Above : Condition::BelowEqual, label);
+						break;
+					case BinaryOperator::LessEqual:
+						operands(binary->lhs(), binary->rhs());
+						m_assembler.compare(1, 0);
+						m_assembler.jump(when ? Condition::AboveEqual : Condition::Below, label);
+						break;
+					case BinaryOperator::Greater:
+						operands(binary->lhs(), binary->rhs());
+						m_assembler.compare(0, 1);
+						m_assembler.jump(when ? Condition::Above : Condition::BelowEqual, label);
+						break;
+					case BinaryOperator::GreaterEqual:
+						operands(binary->lhs(), binary->rhs());
+						m_assembler.compare(0, 1);
+						m_assembler.jump(when ? Condition::AboveEqual : Condition::Below, label);
+						break;
+					case BinaryOperator::Equal:
+					case BinaryOperator::NotEqual: {
+						// Equal only if ordered, that is without the parity flag.
+						operands(binary->lhs(), binary->rhs());
+						m_assembler.compare(0, 1);
+						if ((binary->op() == BinaryOperator::Equal) == when) {
+							auto skip = m_assembler.label();
+							m_assembler.jump(Condition::Parity, skip);
+							m_assembler.jump(Condition::Equal, label);
+							m_assembler.bind(skip);
+						} else {
+							m_assembler.jump(Condition::Parity, label);
+							m_assembler.jump(Condition::NotEqual, label);
+						}
+						break;
+					}
+					default:
+						fail("it branches on something other than a comparison");
+						break;
+				}
+			}
+
+			/// The place in the frame that holds the value of \a expr, none if it takes code to compute.
+			auto place(Expression const & expr) -> std::size_t {
+				auto variable = dynamic_cast<Variable const *>(&expr);
+				if (variable != nullptr) {
+					auto slot = variable->symbol()->slot;
+					if (slot == m_loop.slot()) {
+						return parameter_value;
+					}
+					auto local = std::find(locals.begin(), locals.end(), slot);
+					if (local != locals.end()) {
+						auto k = static_cast<std::size_t>(local - locals.begin());
+						// Read before being assigned in this iteration: the previous one's, or the value before the loop.
+						if (std::find(m_certain.begin(), m_certain.end(), slot) == m_certain.end()) {
+							live[k] = true;
+						}
+						return fixed_values + k;
+					}
+				}
+				Invariance invariance(m_loop.slot(), locals, unassigned);
+				expr.accept(invariance);
+				if (invariance.varying) {
+					return none;
+				}
+				if (!invariance.pure) {
+					fail("it calls a function other than a built-in math function");
+					return none;
+				}
+				auto found = std::find(invariants.begin(), invariants.end(), &expr);
+				if (found == invariants.end()) {
+					invariants.push_back(&expr);
+					found = invariants.end() - 1;
+				}
+				return invariant_base() + static_cast<std::size_t>(found - invariants.begin());
+			}
+
+			/// The built-in a call calls, nullptr if the callee may be something else.
+			auto callee(FunctionCall const & call) -> Builtin const * {
+				auto variable = dynamic_cast<Variable const *>(&call.func());
+				if (variable == nullptr) {
+					return nullptr;
+				}
+				auto slot = variable->symbol()->slot;
+				if (slot == m_loop.slot() || std::find(locals.begin(), locals.end(), slot) != locals.end()) {
+					return nullptr;
+				}
+				if (slot != no_slot) {
+					unassigned.push_back(slot);
+				}
+				return variable->symbol()->builtin;
+			}
+
+			auto push() -> std::size_t {
+				if (m_temporaries == max_temporaries) {
+					fail("its expressions are nested too deeply");
+					return fixed_values;
+				}
+				return temporary_base() + m_temporaries++;
+			}
+
+			void pop() {
+				if (m_temporaries > 0) {
+					--m_temporaries;
+				}
+			}
+
+			auto temporary_base() const noexcept -> std::size_t {
+				return fixed_values + locals.size();
+			}
+
+			auto invariant_base() const noexcept -> std::size_t {
+				return temporary_base() + max_temporaries;
+			}
+
+			void fail(std::string const & message) {
+				if (reason.empty()) {
+					reason = message;
+				}
+			}
+
+			ForStatement const & m_loop;
+			Builtin const * m_rand;
+			Builtin const * m_draw;
+			Assembler m_assembler;
+			/// The end of the code, where it returns early once a call of 'draw' fails.
+			std::size_t m_exit = 0;
+			/// The variables assigned in every iteration so far.
+			std::vector<std::uint32_t> m_certain;
+			std::size_t m_branches = 0;
+			std::size_t m_temporaries = 0;
+		};
+
+	} // namespace
+
+	constexpr std::uint64_t Jit::default_threshold;
+
+	struct Jit::Loop {
+		/// Iterations run by the interpreter, until the loop is compiled.
+		std::uint64_t iterations = 0;
+		bool failed = false;
+		std::unique_ptr<Code> code;
+		std::vector<std::uint32_t> locals;
+		std::vector<bool> live;
+		std::vector<Expression const *> invariants;
+		std::vector<std::uint32_t> unassigned;
+		std::vector<double> values;
+	};
+
+	Jit::Jit(std::uint64_t threshold, Program const & program, std::ostream & log) : m_threshold(threshold), m_program(program), m_log(log), m_compiled(0) {
+	}
+
+	Jit::~Jit() noexcept {
+	}
+
+	auto Jit::supported() noexcept -> bool {
+		return RAPH_JIT != 0;
+	}
+
+	auto Jit::execute(ForStatement const & loop, double from, double to, double step, Context & context) -> bool {
+		if (!supported()) {
+			return false;
+		}
+		auto & compiled = m_loops[&loop];
+		if (compiled == nullptr) {
+			compiled.reset(new Loop);
+		}
+		auto trips = ForStatement::trip_count(from, to, step);
+		if (compiled->code == nullptr) {
+			if (compiled->failed) {
+				return false;
+			}
+			compiled->iterations += std::min(trips, m_threshold);
+			if (compiled->iterations < m_threshold) {
+				return false;
+			}
+			m_compile(loop, *compiled);
+			if (compiled->code == nullptr) {
+				return false;
+			}
+		}
+
+		for (auto slot : compiled->unassigned) {
+			if (context.variable(slot) != nullptr) {
+				return false;
+			}
+		}
+		auto & values = compiled->values;
+		values[from_value] = from;
+		values[step_value] = step;
+		values[sign_value] = -0.0;
+		for (std::size_t k = 0; k < compiled->locals.size(); ++k) {
+			if (compiled->live[k]) {
+				auto value = context.variable(compiled->locals[k]);
+				if (value == nullptr || !value->is_number()) {
+					return false;
+				}
+				values[fixed_values + k] = value->as_number();
+			} else {
+				// Assigned before it is read in every iteration; if the first fails, it may not have been yet.
+				values[fixed_values + k] = blank();
+			}
+		}
+		auto invariants = values.size() - compiled->invariants.size();
+		for (std::size_t k = 0; k < compiled->invariants.size(); ++k) {
+			Value value;
+			try {
+				value = compiled->invariants[k]->evaluate(context);
+			} catch (RuntimeError const &) {
+				return false;
+			}
+			if (!value.is_number()) {
+				return false;
+			}
+			values[invariants + k] = value.as_number();
+		}
+		if (trips == 0) {
+			return true;
+		}
+
+		Run run{&context, nullptr};
+		compiled->code->function()(values.data(), &run, trips);
+		context.assign(loop.slot(), values[parameter_value]);
+		for (std::size_t k = 0; k < compiled->locals.size(); ++k) {
+			if (!is_blank(values[fixed_values + k])) {
+				context.assign(compiled->locals[k], values[fixed_values + k]);
+			}
+		}
+		if (run.error != nullptr) {
+			std::rethrow_exception(run.error);
+		}
+		return true;
+	}
+
+	void Jit::m_compile(ForStatement const & loop, Loop & compiled) {
+		Compiler compiler(loop);
+		auto const & code = compiler.compile();
+		if (compiler.reason.empty()) {
+			compiled.code.reset(new Code(code));
+			if (compiled.code->function() == nullptr) {
+				compiled.code.reset();
+				compiler.reason = "executable memory is not available";
+			}
+		}
+		if (!compiler.reason.empty()) {
+			compiled.failed = true;
+			auto at = m_program.sources().resolve(m_program.location(loop.span()).begin);
+			m_log << at.line << ':' << at.column << ": for loop over '" << loop.id() << "' is not compiled: " << compiler.reason << std::endl;
+			return;
+		}
+		compiled.locals = compiler.locals;
+		compiled.live = compiler.live;
+		compiled.invariants = compiler.invariants;
+		compiled.unassigned = compiler.unassigned;
+		compiled.values.assign(compiler.frame_size(), 0.0);
+		++m_compiled;
+	}
+
+} // namespace br
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include "ast.hpp"
+
+namespace br {
+
+	class Context;
+
+	/** \brief Compiles hot for loops to x86-64 machine code.
+	 **
+	 ** A loop is compiled once it has run threshold iterations in all, if its body only assigns numeric
+	 ** expressions to variables, calls `draw`, and branches with `if` on comparisons of numeric expressions
+	 ** joined by `!`, `&&` and `||`. The numeric expressions may read the loop variable, the variables the
+	 ** body assigns and `rand`, and call the built-in math functions; their sub-expressions that read none
+	 ** of these are evaluated by the interpreter before the loop. The code computes in SSE2 registers and
+	 ** a frame of doubles and calls the math functions directly, one scalar instruction per operation, so
+	 ** it draws exactly what the tree walker draws. Anything else is left to the interpreter.
+	 **
+	 ** Code is only generated on x86-64 with POSIX mmap(); elsewhere every loop is interpreted.
+	 */
+	class Jit {
+	public:
+		/// Iterations a loop runs, in all, before it is compiled.
+		static constexpr std::uint64_t default_threshold = 1000;
+
+		/// \param log where to report, once per loop of \a program, why a hot loop is not compiled
+		Jit(std::uint64_t threshold, Program const & program, std::ostream & log);
+
+		~Jit() noexcept;
+
+		/// Whether machine code can be generated and run on this platform.
+		static auto supported() noexcept -> bool;
+
+		/** \return false, having had no effect, if the loop is not hot or not compiled, or a variable it
+		 **         reads is not a number; the caller then interprets it
+		 */
+		auto execute(ForStatement const & loop, double from, double to, double step, Context & context) -> bool;
+
+		/// The number of loops compiled so far.
+		auto compiled() const noexcept -> std::size_t {
+			return m_compiled;
+		}
+
+	private:
+		struct Loop;
+
+		void m_compile(ForStatement const & loop, Loop & compiled);
+
+		std::uint64_t m_threshold;
+		Program const & m_program;
+		std::ostream & m_log;
+		std::unordered_map<ForStatement const *, std::unique_ptr<Loop>> m_loops;
+		std::size_t m_compiled;
+	}; // class Jit
+
+} // namespace br
@@ -1,204 +1,188 @@
 #pragma once
 
-#include <cstddef>
-#include <string>
+#include <algorithm>
+#include <cstdint>
 #include <ostream>
-#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace br {
 
-	/// Abstract a position.
+	/** \brief Abstract a position: a byte offset in one of the files of a SourceMap.
+	 **
+	 ** Positions are two words and are copied freely by the scanner and the parser; they are only turned
+	 ** into lines and columns, by SourceMap, when a message is written.
+	 */
 	class Position {
 	public:
 		/// Construct a position.
-		explicit Position(std::shared_ptr<std::string> const & filename = nullptr, unsigned int line = 1, unsigned int column = 1)
-				: filename(filename), line(line), column(column)
-		{
-		}
-
-		/** \name Line and Column related manipulators
-		 ** \{ */
-		/// (line related) Advance to the COUNT next lines.
-		void lines(int count = 1) {
-			if (count != 0) {
-				column = 1;
-				line = m_add(line, count, 1);
-			}
-		}
-
-		/// (column related) Advance to the COUNT next columns.
-		void columns(int count = 1) {
-			column = m_add(column, count, 1);
-		}
-		/** \} */
-
-		/// Add \a width columns, in place.
-		auto operator+=(int width) -> Position & {
-			columns(width);
-			return *this;
-		}
-
-		/// Add \a width columns.
-		auto operator+(int width) -> Position {
-			Position result = *this;
-			result += width;
-			return result;
-		}
-
-		/// Subtract \a width columns, in place.
-		auto operator-=(int width) -> Position & {
-			operator+=(-width);
-			return *this;
+		constexpr explicit Position(std::uint32_t file = 0, std::uint32_t offset = 0) noexcept : file(file), offset(offset) {
 		}
 
-		/// Add \a width columns.
-		auto operator-(int width) -> Position {
-			Position result = *this;
-			result -= width;
-			return result;
+		/// Advance \a count bytes.
+		void columns(int count = 1) noexcept {
+			offset = count < 0 && static_cast<std::uint32_t>(-count) > offset ? 0 : offset + count;
 		}
 
-		auto operator==(Position const & other) const -> bool {
-			return line == other.line && column == other.column &&
-					(filename == other.filename || (filename != nullptr && other.filename != nullptr && *filename == *other.filename)
-			);
+		auto operator==(Position const & other) const noexcept -> bool {
+			return file == other.file && offset == other.offset;
 		}
 
-		auto operator!=(Position const & other) const -> bool {
+		auto operator!=(Position const & other) const noexcept -> bool {
 			return !operator==(other);
 		}
 
 	public:
-		/// File name to which this position refers.
-		std::shared_ptr<std::string> filename;
-		/// Current line number.
-		unsigned int line;
-		/// Current column number.
-		unsigned int column;
-
-	private:
-		/// Compute max(min, lhs+rhs) (provided min <= lhs).
-		static auto m_add(unsigned int lhs, int rhs, unsigned int min) -> unsigned int {
-			return (0 < rhs || -static_cast<unsigned int>(rhs) < lhs ? rhs + lhs : min);
-		}
-	};// class Position
-
-	template< typename TChar >
-	inline auto operator<<(std::basic_ostream<TChar> & stream, Position const & position) -> std::basic_ostream<TChar> & {
-		if (position.filename != nullptr) {
-			stream << *position.filename << ':';
-		}
-		return stream << position.line << '.' << position.column;
-	}
+		/// Id of the file, given by SourceMap::add().
+		std::uint32_t file;
+		/// Bytes from the start of the file.
+		std::uint32_t offset;
+	}; // class Position
 
 	/// Abstract a location.
 	class Location {
 	public:
 		/// Construct a location from \a b to \a e.
-		Location(Position const & begin, Position const & end) : begin(begin), end(end) {
+		constexpr Location(Position const & begin, Position const & end) noexcept : begin(begin), end(end) {
 		}
 
 		/// Construct a 0-width location in \a p.
-		explicit Location(Position const & position = Position()) : begin(position), end(position) {
-		}
-
-		/// Construct a 0-width location in \a f, \a l, \a c.
-		explicit Location(
-			std::shared_ptr<std::string> const & filename,
-			unsigned int line = 1,
-			unsigned int column = 1
-		) : begin(filename, line, column), end(filename, line, column) {
+		constexpr explicit Location(Position const & position = Position()) noexcept : begin(position), end(position) {
 		}
 
-		/** \name Line and Column related manipulators
+		/** \name Manipulators used by the scanner
 		 ** \{ */
 	public:
 		/// Reset initial location to final location.
-		void step() {
+		void step() noexcept {
 			begin = end;
 		}
 
-		/// Extend the current location to the COUNT next columns.
-		void columns(int count = 1) {
-			end += count;
-		}
-
-		/// Extend the current location to the COUNT next lines.
-		void lines(int count = 1) {
-			end.lines(count);
+		/// Extend the current location by \a count bytes.
+		void columns(int count = 1) noexcept {
+			end.columns(count);
 		}
 		/** \} */
 
 	public:
 		/// Join two locations, in place.
-		auto operator+=(Location const & other) -> Location & {
+		auto operator+=(Location const & other) noexcept -> Location & {
 			end = other.end;
 			return *this;
 		}
 
-		auto operator+(Location const & other) const -> Location {
+		auto operator+(Location const & other) const noexcept -> Location {
 			Location result(*this);
 			result += other;
 			return result;
 		}
 
-		/// Add \a width columns to the end position, in place.
-		auto operator+=(int width) -> Location & {
-			columns(width);
-			return *this;
-		}
-
-		auto operator+(int width) const -> Location {
-			Location result(*this);
-			result += width;
-			return result;
-		}
-
-		/// Subtract \a width columns to the end position, in place.
-		auto operator-=(int width) -> Location & {
-			columns(-width);
-			return *this;
-		}
-
-		auto operator-(int width) const -> Location {
-			Location result(*this);
-			result -= width;
-			return result;
-		}
-
-		auto operator==(Location const & other) const -> bool {
+		auto operator==(Location const & other) const noexcept -> bool {
 			return begin == other.begin && end == other.end;
 		}
 
-		auto operator!=(Location const & other) const -> bool {
+		auto operator!=(Location const & other) const noexcept -> bool {
 			return !operator==(other);
 		}
 
 	public:
 		/// Beginning of the located region.
 		Position begin;
-		/// End of the located region.
+		/// End of the located region, one past its last byte.
 		Position end;
-	};
+	}; // class Location
 
-	/** \brief Intercept output stream redirection.
-	 ** \param ostr the destination output stream
-	 ** \param loc a reference to the location to redirect
-	 **
-	 ** Avoid duplicate information.
-	 */
+	/// Raw form of a location, for parser traces: the file id and the byte offsets.
 	template< typename TChar >
 	inline auto operator<<(std::basic_ostream< TChar > & stream, Location const & location) -> std::basic_ostream< TChar > & {
-		unsigned int end_column = 0 < location.end.column ? location.end.column - 1 : 0;
-		stream << location.begin;
-		if (location.end.filename != nullptr && (location.begin.filename == nullptr || *location.begin.filename != *location.end.filename)) {
-			stream << '-' << location.end.filename << ':' << location.end.line << '.' << end_column;
-		} else if (location.begin.line < location.end.line) {
-			stream << '-' << location.end.line << '.' << end_column;
-		} else if (location.begin.column < end_column) {
-			stream << '-' << end_column;
+		stream << '#' << location.begin.file << '@' << location.begin.offset;
+		if (location.end.file != location.begin.file) {
+			stream << "-#" << location.end.file << '@' << location.end.offset;
+		} else if (location.end.offset != location.begin.offset) {
+			stream << '-' << location.end.offset;
 		}
 		return stream;
 	}
 
+	/** \brief The names of the source files and where their lines start.
+	 **
+	 ** The scanner reports each line break as it passes it, so resolving a position takes a binary search
+	 ** over the line starts of its file, without the source.
+	 */
+	class SourceMap {
+	public:
+		/// A position as people count it: lines and columns from 1.
+		struct Coordinates {
+			std::string const * filename;
+			std::uint32_t line;
+			std::uint32_t column;
+		};
+
+		/// Add a file named \a filename. \return its id
+		auto add(std::string const & filename) -> std::uint32_t {
+			m_files.push_back(File{filename, {0}});
+			return static_cast<std::uint32_t>(m_files.size() - 1);
+		}
+
+		/// Add a file named \a filename whose lines start at \a lines, as lines() of another map gives them.
+		auto add(std::string const & filename, std::vector<std::uint32_t> lines) -> std::uint32_t {
+			m_files.push_back(File{filename, std::move(lines)});
+			return static_cast<std::uint32_t>(m_files.size() - 1);
+		}
+
+		/// Offsets of the first byte of each line of \a file, ascending; the first is 0.
+		auto lines(std::uint32_t file) const -> std::vector<std::uint32_t> const & {
+			return m_files[file].lines;
+		}
+
+		void lines(std::uint32_t file, std::vector<std::uint32_t> lines) {
+			m_files[file].lines = std::move(lines);
+		}
+
+		/// The number of files added.
+		auto files() const noexcept -> std::size_t {
+			return m_files.size();
+		}
+
+		/// Record that every byte of \a breaks is a line break, each starting a line after it.
+		void breaks(Location const & breaks) {
+			auto & lines = m_files[breaks.begin.file].lines;
+			for (auto offset = breaks.begin.offset; offset < breaks.end.offset; ++offset) {
+				if (offset >= lines.back()) {
+					lines.push_back(offset + 1);
+				}
+			}
+		}
+
+		auto resolve(Position const & position) const -> Coordinates {
+			auto const & file = m_files[position.file];
+			auto line = std::upper_bound(file.lines.begin(), file.lines.end(), position.offset) - file.lines.begin();
+			return Coordinates{&file.name, static_cast<std::uint32_t>(line), position.offset - file.lines[line - 1] + 1};
+		}
+
+		/// Write \a location as `file:line.column`, followed by where it ends if that is elsewhere.
+		template< typename TChar >
+		void print(std::basic_ostream< TChar > & stream, Location const & location) const {
+			auto begin = resolve(location.begin), end = resolve(location.end);
+			std::uint32_t end_column = 0 < end.column ? end.column - 1 : 0;
+			stream << *begin.filename << ':' << begin.line << '.' << begin.column;
+			if (location.end.file != location.begin.file) {
+				stream << '-' << *end.filename << ':' << end.line << '.' << end_column;
+			} else if (begin.line < end.line) {
+				stream << '-' << end.line << '.' << end_column;
+			} else if (begin.column < end_column) {
+				stream << '-' << end_column;
+			}
+		}
+
+	private:
+		struct File {
+			std::string name;
+			std::vector<std::uint32_t> lines;
+		};
+
+		std::vector<File> m_files;
+	}; // class SourceMap
+
 } // br
@@ -1,21 +1,481 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <memory>
-#include <typeinfo>
+#include <random>
+#include <string>
+#include <vector>
+#include "batch.hpp"
+#include "binder.hpp"
+#include "bytecode.hpp"
+#include "context.hpp"
+#include "corpus.hpp"
+#include "device.hpp"
+#include "engine.hpp"
+#include "flat.hpp"
+#include "optimizer.hpp"
+#include "parallel.hpp"
+#include "pool.hpp"
+#include "profile.hpp"
 #include "raph.hpp"
+#include "reparse.hpp"
+#include "simd.hpp"
+#include "watch.hpp"
 
-int main() {
+namespace {
 
-	br::RaphParser parser("test.raph");
+	void usage(char const * name) {
+		std::cerr << "Usage: " << name << " [options] [script]" << std::endl
+			<< "       " << name << " --check [--threads=N] path..." << std::endl
+			<< "Options:" << std::endl
+			<< "  -o FILE    write the image saved by save() to FILE, as PNG if it ends in .png (default: <script>.pgm)" << std::endl
+			<< "  --print    print the syntax tree instead of running the program" << std::endl
+			<< "  --engine=E execute with engine E: tree (default), vm, batch, parallel or jit" << std::endl
+			<< "  --simd=L   use SIMD level L for batched loops: scalar, sse2 or avx (default: best supported)" << std::endl
+			<< "  --seed=N   take random numbers from the stream of seed N (default: a random seed)" << std::endl
+			<< "  --threads=N" << std::endl
+			<< "             draw the image and run parallel loops with N threads (default: one per hardware thread)" << std::endl
+			<< "  --jit-threshold=N" << std::endl
+			<< "             compile a for loop to machine code once it has run N iterations (default: " << br::Jit::default_threshold << ')' << std::endl
+			<< "  --adaptive[=PIXELS]" << std::endl
+			<< "             draw for loops that only compute and draw points by sampling their curves adaptively: halve the steps" << std::endl
+			<< "             where consecutive points are more than PIXELS apart (default: " << br::Sampler::default_tolerance << "), widen them elsewhere" << std::endl
+			<< "  --sparse[=MB]" << std::endl
+			<< "             store the image as tiles made when first drawn to, holding at most MB of them in memory" << std::endl
+			<< "             (default: " << (br::SparseCanvas::default_memory >> 20) << ") and the rest in <image>.spill; report the peak memory" << std::endl
+			<< "  --disassemble" << std::endl
+			<< "             print the bytecode instead of running the program" << std::endl
+			<< "  --compare  run with every engine and compare their draw output bit for bit" << std::endl
+			<< "  --cache[=DIR]" << std::endl
+			<< "             keep parsed programs in DIR (default: next to each script, as <script>.raphc)" << std::endl
+			<< "             and load them from there instead of parsing while the script is unchanged" << std::endl
+			<< "  --reparse=FILE" << std::endl
+			<< "             parse the script, then FILE as an edited version of it, parsing again only what changed;" << std::endl
+			<< "             FILE is then run" << std::endl
+			<< "  --watch    run the script, then again whenever it is saved, replaying the output of top-level statements" << std::endl
+			<< "             that are unchanged and start from the same variables instead of running them" << std::endl
+			<< "  --profile[=FILE]" << std::endl
+			<< "             run on the tree engine, timing every statement and function call and counting the points they draw;" << std::endl
+			<< "             write the time by stack of statements and calls to FILE (default: <script>.folded) for flame graph tools" << std::endl
+			<< "             and print the script annotated with it" << std::endl
+			<< "  --check    parse and bind every script given, and the .raph files in every directory given, on N threads;" << std::endl
+			<< "             report their errors script by script and the throughput, without running them" << std::endl
+			<< "  --flat     evaluate expressions from a flat array encoding instead of the tree" << std::endl
+			<< "  --stats    report the size of the syntax tree and what the optimizer did on stderr" << std::endl
+			<< "  -O0        run the program as written, without folding constants, hoisting out of loops and simplifying expressions" << std::endl
+			<< "  --fast-math" << std::endl
+			<< "             also simplify in ways that may change results by rounding, e.g. reassociate `x + 1 + 2`" << std::endl;
+	}
+
+	void stats(br::Program const & program, std::ostream & ostream) {
+		auto const & arena = program.arena();
+		ostream << "syntax tree: " << arena.objects() << " nodes, "
+			<< arena.arrays() << " sequences of " << arena.elements() << " children, "
+			<< program.names() << " distinct names" << std::endl
+			<< "arena: " << arena.used() << " bytes used, "
+			<< arena.reserved() << " bytes in " << arena.blocks() << " block(s)" << std::endl;
+	}
 
-	auto program = parser.parse();
+	/// Parse and bind \a paths in parallel for --check. \return the exit status
+	auto check(std::vector<std::string> const & paths, std::size_t threads, bool cache, std::string const & directory) -> int {
+		auto status = 0;
+		std::vector<std::string> scripts;
+		for (auto const & path : paths) {
+			if (!br::collect_scripts(path, scripts)) {
+				std::cerr << "[Raph] cannot read " << path << std::endl;
+				status = 1;
+			}
+		}
 
-	std::cerr << std::endl;
+		br::ThreadPool pool(threads);
+		auto start = std::chrono::steady_clock::now();
+		auto results = br::compile_scripts(scripts, pool, false, cache, directory);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-	if (program != nullptr) {
-		program->print(std::cout);
+		std::size_t bytes = 0, failed = 0;
+		for (auto const & result : results) {
+			std::cerr << result.diagnostics;
+			bytes += result.bytes;
+			if (!result.succeeded) {
+				++failed;
+			}
+		}
+		auto seconds = std::max(elapsed.count(), 1e-9);
+		std::cerr << "checked " << results.size() << " script(s), " << bytes << " bytes, on " << pool.size() << " thread(s) in "
+			<< elapsed.count() << " s: " << failed << " failed; "
+			<< results.size() / seconds << " files/s, " << bytes / seconds / 1e6 << " MB/s" << std::endl;
+		return failed == 0 ? status : 1;
+	}
+
+	auto read_file(std::string const & path, std::string & source) -> bool {
+		std::ifstream stream(path, std::ios::binary);
+		if (!stream) {
+			std::cerr << "cannot open " << path << std::endl;
+			return false;
+		}
+		source.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+		return !stream.bad();
+	}
+
+	/// Parse \a script, then \a edited through \a reparser, for --reparse. \return the edited program, or nullptr
+	auto reparse(br::Reparser & reparser, std::string const & script, std::string const & edited, bool show_stats) -> br::Program * {
+		std::string source;
+		if (!read_file(script, source) || reparser.parse(source) == nullptr || !read_file(edited, source)) {
+			return nullptr;
+		}
+		auto program = reparser.parse(source);
+		if (program != nullptr && show_stats) {
+			std::cerr << "reparse: " << reparser.scanned() << " of " << source.size() << " bytes scanned again" << std::endl;
+		}
+		return program;
+	}
+
+	/// Bind, optimize and flatten \a program as the options ask. \return false if it has errors
+	auto prepare(br::Program & program, br::RaphParser const & parser, bool optimize, bool fast_math, bool flat, bool show_stats) -> bool {
+		if (!br::bind(program, parser)) {
+			return false;
+		}
+
+		if (optimize) {
+			auto before = br::count_nodes(program);
+			auto optimizations = br::optimize(program, fast_math);
+			if (show_stats) {
+				std::cerr << "optimizer: " << before << " nodes before, " << br::count_nodes(program) << " after" << std::endl;
+				std::cerr << "optimizer: " << optimizations.hoisted << " hoisted out of " << optimizations.loops << " loop(s), "
+					<< optimizations.shared << " shared" << std::endl;
+			}
+		}
+
+		if (flat) {
+			br::flatten(program);
+		}
+
+		if (show_stats) {
+			stats(program, std::cerr);
+		}
+		return true;
+	}
+
+	/// The device that draws to \a image: a SparseCanvas holding \a memory bytes of tiles, or a Canvas if that is 0.
+	auto make_canvas(std::string const & image, std::size_t threads, std::size_t memory) -> std::unique_ptr<br::Device> {
+		if (memory != 0) {
+			return std::unique_ptr<br::Device>(new br::SparseCanvas(image, memory, threads));
+		}
+		return std::unique_ptr<br::Device>(new br::Canvas(image, threads));
+	}
+
+	/** \brief Run the script of \a parser, then again each time it is saved, for --watch.
+	 **
+	 ** Every run draws to a new image, written to \a image on save(), and takes the same random numbers.
+	 ** \return the exit status, once the script can no longer be watched
+	 */
+	auto watch(br::RaphParser const & parser, std::string const & image, std::function<bool (br::Program &)> const & prepare,
+			br::Engine engine, std::size_t threads, std::uint64_t threshold, std::uint64_t seed, br::Sampler * sampler, std::size_t memory) -> int {
+		br::Watcher watcher(parser.filename());
+		br::RenderCache cache;
+		do {
+			auto start = std::chrono::steady_clock::now();
+			auto errors = parser.errors();
+			auto program = parser.parse();
+			// A version with errors is not run, so that the cache still holds the last one without.
+			if (program == nullptr || !prepare(*program) || parser.errors() != errors) {
+				continue;
+			}
+			auto canvas = make_canvas(image, threads, memory);
+			br::Tape tape(*canvas);
+			br::Context context(tape, program->slots().size(), seed);
+			context.sampler(sampler);
+			// Statements are run one at a time, so the engines that compile a whole program do not apply.
+			std::unique_ptr<br::ThreadPool> pool;
+			std::unique_ptr<br::Parallel> parallel;
+			std::unique_ptr<br::Jit> jit;
+			context.batch(engine == br::Engine::Batch);
+			if (engine == br::Engine::Parallel) {
+				pool.reset(new br::ThreadPool(threads));
+				parallel.reset(new br::Parallel(*pool, *program, std::cerr));
+				context.parallel(parallel.get());
+			} else if (engine == br::Engine::JIT) {
+				jit.reset(new br::Jit(threshold, *program, std::cerr));
+				context.jit(jit.get());
+			}
+			try {
+				auto statistics = cache.run(*program, context, tape);
+				std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+				std::cerr << "watch: ran " << statistics.run << " statement(s) and replayed " << statistics.replayed << " in " << elapsed.count() << " ms" << std::endl;
+			} catch (br::RuntimeError const & error) {
+				parser.error(std::string("runtime error: ") + error.what());
+			}
+		} while (watcher.wait());
+		return 1;
+	}
+
+	/// The name of the file \a script with its extension replaced with \a extension.
+	auto output_name(std::string const & script, char const * extension) -> std::string {
+		auto name = script.empty() || script == "-" ? std::string("raph") : script;
+		auto dot = name.rfind('.');
+		if (dot != std::string::npos && name.find('/', dot) == std::string::npos) {
+			name.erase(dot);
+		}
+		return name + extension;
+	}
+
+} // namespace
+
+int main(int argc, char * argv[]) {
+
+	std::vector<std::string> scripts;
+	std::string output;
+	bool print = false;
+	bool disassemble = false;
+	bool compare = false;
+	bool checking = false;
+	bool cache = false;
+	std::string cache_directory;
+	std::string edited;
+	bool watching = false;
+	bool profiling = false;
+	std::string profile;
+	bool show_stats = false;
+	bool flat = false;
+	bool optimize = true;
+	bool fast_math = false;
+	std::size_t threads = 0;
+	std::uint64_t threshold = br::Jit::default_threshold;
+	std::uint64_t seed = 0;
+	bool seeded = false;
+	double tolerance = 0;
+	std::size_t memory = 0;
+	auto engine = br::Engine::Tree;
+
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			output = argv[++i];
+		} else if (std::strcmp(argv[i], "--print") == 0) {
+			print = true;
+		} else if (std::strncmp(argv[i], "--engine=", 9) == 0) {
+			if (!br::find_engine(argv[i] + 9, engine)) {
+				std::cerr << "unknown engine: " << argv[i] + 9 << std::endl;
+				return 1;
+			}
+		} else if (std::strncmp(argv[i], "--simd=", 7) == 0) {
+			br::simd::Level level;
+			if (!br::simd::find_level(argv[i] + 7, level)) {
+				std::cerr << "unknown SIMD level: " << argv[i] + 7 << std::endl;
+				return 1;
+			}
+			br::simd::select(level);
+		} else if (std::strncmp(argv[i], "--seed=", 7) == 0) {
+			char * end;
+			seed = std::strtoull(argv[i] + 7, &end, 0);
+			if (end == argv[i] + 7 || *end != '\0') {
+				std::cerr << "invalid seed: " << argv[i] + 7 << std::endl;
+				return 1;
+			}
+			seeded = true;
+		} else if (std::strncmp(argv[i], "--threads=", 10) == 0) {
+			char * end;
+			threads = std::strtoul(argv[i] + 10, &end, 10);
+			if (end == argv[i] + 10 || *end != '\0' || threads == 0) {
+				std::cerr << "invalid thread count: " << argv[i] + 10 << std::endl;
+				return 1;
+			}
+		} else if (std::strncmp(argv[i], "--jit-threshold=", 16) == 0) {
+			char * end;
+			threshold = std::strtoull(argv[i] + 16, &end, 10);
+			if (end == argv[i] + 16 || *end != '\0') {
+				std::cerr << "invalid JIT threshold: " << argv[i] + 16 << std::endl;
+				return 1;
+			}
+		} else if (std::strcmp(argv[i], "--adaptive") == 0) {
+			tolerance = br::Sampler::default_tolerance;
+		} else if (std::strncmp(argv[i], "--adaptive=", 11) == 0) {
+			char * end;
+			tolerance = std::strtod(argv[i] + 11, &end);
+			if (end == argv[i] + 11 || *end != '\0' || !(tolerance > 0)) {
+				std::cerr << "invalid tolerance: " << argv[i] + 11 << std::endl;
+				return 1;
+			}
+		} else if (std::strcmp(argv[i], "--sparse") == 0) {
+			memory = br::SparseCanvas::default_memory;
+		} else if (std::strncmp(argv[i], "--sparse=", 9) == 0) {
+			char * end;
+			auto megabytes = std::strtoull(argv[i] + 9, &end, 10);
+			if (end == argv[i] + 9 || *end != '\0' || megabytes == 0 || megabytes > (std::numeric_limits<std::size_t>::max() >> 20)) {
+				std::cerr << "invalid memory size: " << argv[i] + 9 << std::endl;
+				return 1;
+			}
+			memory = static_cast<std::size_t>(megabytes) << 20;
+		} else if (std::strcmp(argv[i], "--disassemble") == 0) {
+			disassemble = true;
+		} else if (std::strcmp(argv[i], "--compare") == 0) {
+			compare = true;
+		} else if (std::strcmp(argv[i], "--cache") == 0) {
+			cache = true;
+		} else if (std::strncmp(argv[i], "--cache=", 8) == 0) {
+			cache = true;
+			cache_directory = argv[i] + 8;
+		} else if (std::strncmp(argv[i], "--reparse=", 10) == 0) {
+			edited = argv[i] + 10;
+		} else if (std::strcmp(argv[i], "--watch") == 0) {
+			watching = true;
+		} else if (std::strcmp(argv[i], "--profile") == 0) {
+			profiling = true;
+		} else if (std::strncmp(argv[i], "--profile=", 10) == 0) {
+			profiling = true;
+			profile = argv[i] + 10;
+		} else if (std::strcmp(argv[i], "--check") == 0) {
+			checking = true;
+		} else if (std::strcmp(argv[i], "--flat") == 0) {
+			flat = true;
+		} else if (std::strcmp(argv[i], "--stats") == 0) {
+			show_stats = true;
+		} else if (std::strcmp(argv[i], "-O0") == 0) {
+			optimize = false;
+		} else if (std::strcmp(argv[i], "--fast-math") == 0) {
+			fast_math = true;
+		} else if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0) {
+			usage(argv[0]);
+			return 0;
+		} else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+			usage(argv[0]);
+			return 1;
+		} else {
+			scripts.push_back(argv[i]);
+		}
+	}
+
+	if (checking) {
+		return check(scripts, threads, cache, cache_directory);
+	}
+
+	// Only --check takes several scripts.
+	if (scripts.size() > 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	auto script = scripts.empty() ? std::string("test.raph") : scripts.front();
+
+	br::RaphParser parser(script);
+	parser.cache(cache, cache_directory);
+
+	if (!seeded) {
+		std::random_device device;
+		seed = static_cast<std::uint64_t>(device()) << 32 | device();
+	}
+
+	if (profiling && (watching || flat || tolerance > 0 || engine != br::Engine::Tree)) {
+		std::cerr << "--profile times the nodes of the syntax tree, so it runs on the tree engine only, without --flat, --adaptive or --watch" << std::endl;
+		return 1;
+	}
+
+	if (tolerance > 0 && engine == br::Engine::VM) {
+		std::cerr << "--adaptive samples the loops the syntax tree runs, which the vm engine does not" << std::endl;
+		return 1;
+	}
+	std::unique_ptr<br::Sampler> sampler;
+	if (tolerance > 0) {
+		sampler.reset(new br::Sampler(tolerance));
+	}
+
+	if (watching) {
+		if (engine == br::Engine::VM) {
+			std::cerr << "--watch runs one statement at a time, which the vm engine cannot" << std::endl;
+			return 1;
+		}
+		auto prepared = [&](br::Program & program) {
+			return prepare(program, parser, optimize, fast_math, flat, show_stats);
+		};
+		return watch(parser, output.empty() ? output_name(script, ".pgm") : output, prepared, engine, threads, threshold, seed, sampler.get(), memory);
+	}
+
+	br::Reparser reparser(parser);
+	std::unique_ptr<br::Program> parsed;
+	br::Program * program = nullptr;
+	if (edited.empty()) {
+		parsed = parser.parse();
+		program = parsed.get();
 	} else {
+		program = reparse(reparser, script, edited, show_stats);
+	}
+
+	if (program == nullptr) {
 		std::cerr << "Program is empty!" << std::endl;
+		return 1;
+	}
+
+	if (!prepare(*program, parser, optimize, fast_math, flat, show_stats)) {
+		return 1;
+	}
+
+	if (print) {
+		program->print(std::cout);
+		return 0;
+	}
+
+	if (show_stats) {
+		std::cerr << "seed: " << seed << std::endl;
+	}
+	auto status = 0;
+	std::unique_ptr<br::Device> canvas;
+	std::unique_ptr<br::Profiler> profiler;
+	try {
+		if (disassemble) {
+			br::compile(*program).disassemble(std::cout);
+			return 0;
+		}
+		if (compare) {
+			std::cout << "seed: " << seed << ", SIMD: " << br::simd::level_name(br::simd::level()) << std::endl;
+			return br::compare(*program, {br::Engine::Tree, br::Engine::VM, br::Engine::Batch, br::Engine::Parallel, br::Engine::JIT}, seed, std::cout, threads, threshold) ? 0 : 1;
+		}
+		canvas = make_canvas(output.empty() ? output_name(edited.empty() ? script : edited, ".pgm") : output, threads, memory);
+		br::Context context(*canvas, program->slots().size(), seed);
+		context.sampler(sampler.get());
+		if (profiling) {
+			std::string source;
+			if (script != "-") {
+				read_file(edited.empty() ? script : edited, source);
+			}
+			profiler.reset(new br::Profiler(*program, source));
+		}
+		br::execute(*program, context, engine, threads, threshold);
+	} catch (br::RuntimeError const & error) {
+		parser.error(std::string("runtime error: ") + error.what());
+		status = 1;
+	}
+
+	auto sparse = dynamic_cast<br::SparseCanvas const *>(canvas.get());
+	if (sparse != nullptr) {
+		auto const & statistics = sparse->statistics();
+		std::cerr << "sparse canvas: " << statistics.tiles << " tile(s) drawn, " << statistics.spilled << " spilled to " << sparse->spill()
+			<< " (" << statistics.writes << " writes, " << statistics.reads << " reads); peak memory "
+			<< (statistics.peak + (1 << 19)) / (1 << 20) << " MB of a " << (memory >> 20) << " MB budget for tiles" << std::endl;
+	}
+
+	if (sampler != nullptr && show_stats) {
+		auto const & statistics = sampler->statistics();
+		std::cerr << "adaptive: " << statistics.loops << " loop(s) sampled at " << statistics.evaluations << " values instead of "
+			<< statistics.iterations << " iterations" << std::endl;
+	}
+
+	// A program that failed is profiled up to the error.
+	if (profiler != nullptr) {
+		auto path = profile.empty() ? output_name(edited.empty() ? script : edited, ".folded") : profile;
+		std::ofstream stream(path);
+		profiler->collapse(stream);
+		if (!stream) {
+			std::cerr << "cannot write " << path << std::endl;
+			status = 1;
+		}
+		profiler->annotate(std::cout);
 	}
 
-	return 0;
-}
\ No newline at end of file
+	return status;
+}
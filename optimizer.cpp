@@ -0,0 +1,1206 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "builtin.hpp"
+#include "error.hpp"
+#include "optimizer.hpp"
+
+namespace br {
+
+	namespace {
+
+		/// What an expression evaluates to whenever its evaluation succeeds.
+		enum class Type : std::uint8_t {
+			/// Any value.
+			Unknown,
+			Number,
+			Boolean,
+			Vector,
+			/// No value yet, while variable types are being inferred.
+			Unassigned,
+		};
+
+		auto meet(Type lhs, Type rhs) noexcept -> Type {
+			if (lhs == Type::Unassigned) {
+				return rhs;
+			}
+			if (rhs == Type::Unassigned) {
+				return lhs;
+			}
+			return lhs == rhs ? lhs : Type::Unknown;
+		}
+
+		auto type_of(Value const & value) noexcept -> Type {
+			switch (value.type()) {
+				case Value::Type::Number:
+					return Type::Number;
+				case Value::Type::Boolean:
+					return Type::Boolean;
+				case Value::Type::Vector:
+					return Type::Vector;
+				default:
+					return Type::Unknown;
+			}
+		}
+
+		auto arithmetic(Type type) noexcept -> bool {
+			return type == Type::Number || type == Type::Vector;
+		}
+
+		/// The numeric built-in that a call invokes directly, nullptr if the callee may be anything else.
+		auto numeric_builtin(FunctionCall const & call) -> Builtin const * {
+			auto variable = dynamic_cast<Variable const *>(&call.func());
+			if (variable == nullptr || variable->symbol()->slot != no_slot) {
+				return nullptr;
+			}
+			auto builtin = variable->symbol()->builtin;
+			if (!builtin->pure || (builtin->unary == nullptr && builtin->binary == nullptr)) {
+				return nullptr;
+			}
+			return builtin;
+		}
+
+		/// Infers the type of expressions, given the types of the variables by slot.
+		class Typing : public Visitor {
+		public:
+			explicit Typing(std::vector<Type> const & slots) noexcept : m_slots(slots), m_result(Type::Unknown) {
+			}
+
+			auto type(Expression const & expression) -> Type {
+				expression.accept(*this);
+				return m_result;
+			}
+
+			virtual void visit(Variable const & node) override {
+				auto symbol = node.symbol();
+				// An unassigned variable reads as the built-in of the same name, if any.
+				if (symbol->slot == no_slot || symbol->builtin != nullptr) {
+					m_result = Type::Unknown;
+				} else {
+					m_result = m_slots[symbol->slot];
+				}
+			}
+
+			virtual void visit(Constant const & node) override {
+				m_result = type_of(*node.value());
+			}
+
+			virtual void visit(Numeric const & node) override {
+				m_result = Type::Number;
+			}
+
+			virtual void visit(Boolean const & node) override {
+				m_result = Type::Boolean;
+			}
+
+			virtual void visit(Vector const & node) override {
+				m_result = Type::Vector;
+			}
+
+			virtual void visit(FunctionCall const & node) override {
+				m_result = numeric_builtin(node) != nullptr ? Type::Number : Type::Unknown;
+			}
+
+			virtual void visit(ArrayAccess const & node) override {
+				m_result = Type::Number;
+			}
+
+			virtual void visit(UnaryOperation const & node) override {
+				auto rhs = type(node.rhs());
+				if (rhs == Type::Unassigned) {
+					m_result = rhs;
+				} else if (node.op() == UnaryOperator::Not) {
+					m_result = rhs == Type::Boolean ? rhs : Type::Unknown;
+				} else {
+					m_result = arithmetic(rhs) ? rhs : Type::Unknown;
+				}
+			}
+
+			virtual void visit(BinaryOperation const & node) override {
+				auto lhs = type(node.lhs());
+				auto rhs = type(node.rhs());
+				if (lhs == Type::Unassigned || rhs == Type::Unassigned) {
+					m_result = Type::Unassigned;
+					return;
+				}
+				m_result = Type::Unknown;
+				switch (node.op()) {
+					case BinaryOperator::Or:
+					case BinaryOperator::And:
+						if (lhs == Type::Boolean && rhs == Type::Boolean) {
+							m_result = Type::Boolean;
+						}
+						break;
+					case BinaryOperator::Equal:
+					case BinaryOperator::NotEqual:
+					case BinaryOperator::Less:
+					case BinaryOperator::Greater:
+					case BinaryOperator::LessEqual:
+					case BinaryOperator::GreaterEqual:
+						m_result = Type::Boolean;
+						break;
+					case BinaryOperator::Add:
+					case BinaryOperator::Subtract:
+						if (lhs == rhs && arithmetic(lhs)) {
+							m_result = lhs;
+						}
+						break;
+					case BinaryOperator::Multiply:
+						if (lhs == Type::Number && arithmetic(rhs)) {
+							m_result = rhs;
+						} else if (lhs == Type::Vector && rhs == Type::Number) {
+							m_result = lhs;
+						}
+						break;
+					case BinaryOperator::Divide:
+						if (arithmetic(lhs) && rhs == Type::Number) {
+							m_result = lhs;
+						}
+						break;
+					case BinaryOperator::Modulo:
+					case BinaryOperator::Power:
+						m_result = Type::Number;
+						break;
+				}
+			}
+
+			virtual void visit(EmptyStatement const & node) override {
+			}
+
+			virtual void visit(CompoundStatement const & node) override {
+			}
+
+			virtual void visit(Program const & node) override {
+			}
+
+			virtual void visit(ConditionalStatement const & node) override {
+			}
+
+			virtual void visit(WhileStatement const & node) override {
+			}
+
+			virtual void visit(UntilStatement const & node) override {
+			}
+
+			virtual void visit(ForStatement const & node) override {
+			}
+
+			virtual void visit(AssignStatement const & node) override {
+			}
+
+			virtual void visit(ExpressionStatement const & node) override {
+			}
+
+		private:
+			std::vector<Type> const & m_slots;
+			Type m_result;
+		};
+
+		/// Collect every assignment of a program, loop variables included.
+		class Assignments : public Walker {
+		public:
+			std::vector<std::pair<std::uint32_t, Expression const *>> assignments;
+
+			std::vector<std::uint32_t> loops;
+
+			using Walker::visit;
+
+			virtual void visit(ForStatement const & node) override {
+				loops.push_back(node.slot());
+				Walker::visit(node);
+			}
+
+			virtual void visit(AssignStatement const & node) override {
+				assignments.emplace_back(node.slot(), &node.expr());
+				Walker::visit(node);
+			}
+		};
+
+		/** \brief The type of each variable of \a program, by slot.
+		 **
+		 ** Starts from the assumption that every variable is unassigned and refines it until the type of
+		 ** each variable agrees with all of its assignments, so `x = 0 ... x = x + 1` keeps x a number.
+		 ** The special variables only ever hold the type their assignment checks for.
+		 */
+		auto infer(Program const & program) -> std::vector<Type> {
+			Assignments assignments;
+			program.accept(assignments);
+
+			std::vector<Type> types(program.slots().size(), Type::Unassigned);
+			types[clear_slot] = types[origin_slot] = types[scale_slot] = Type::Vector;
+			types[rot_slot] = Type::Number;
+			Typing typing(types);
+			for (auto changed = true; changed; ) {
+				std::vector<Type> next(types.size(), Type::Unassigned);
+				for (auto slot : assignments.loops) {
+					next[slot] = meet(next[slot], Type::Number);
+				}
+				for (auto const & assignment : assignments.assignments) {
+					next[assignment.first] = meet(next[assignment.first], typing.type(*assignment.second));
+				}
+				changed = false;
+				for (std::size_t slot = special_slots; slot < types.size(); ++slot) {
+					changed = changed || next[slot] != types[slot];
+					types[slot] = next[slot];
+				}
+			}
+			for (auto & type : types) {
+				if (type == Type::Unassigned) {
+					type = Type::Unknown;
+				}
+			}
+			return types;
+		}
+
+		/// The value of a literal or constant expression; false if \a expression is not one.
+		auto literal(Expression const & expression, Value & value) -> bool {
+			auto numeric = dynamic_cast<Numeric const *>(&expression);
+			if (numeric != nullptr) {
+				value = numeric->value();
+				return true;
+			}
+			auto boolean = dynamic_cast<Boolean const *>(&expression);
+			if (boolean != nullptr) {
+				value = boolean->value();
+				return true;
+			}
+			auto constant = dynamic_cast<Constant const *>(&expression);
+			if (constant != nullptr) {
+				value = *constant->value();
+				return true;
+			}
+			auto vector = dynamic_cast<Vector const *>(&expression);
+			Value x, y;
+			if (vector != nullptr && literal(vector->x(), x) && literal(vector->y(), y) && x.is_number() && y.is_number()) {
+				value = Value(x.as_number(), y.as_number());
+				return true;
+			}
+			return false;
+		}
+
+		/// Whether \a expression is a literal number equal to \a number, down to the sign of zero.
+		auto is_number(Expression const & expression, double number) -> bool {
+			Value value;
+			return literal(expression, value) && value.is_number()
+				&& value.as_number() == number && std::signbit(value.as_number()) == std::signbit(number);
+		}
+
+		auto is_zero(Expression const & expression) -> bool {
+			return is_number(expression, 0.0) || is_number(expression, -0.0);
+		}
+
+		auto evaluate(BinaryOperator op, Value const & lhs, Value const & rhs) -> Value {
+			switch (op) {
+				case BinaryOperator::Equal:
+					return equal(lhs, rhs);
+				case BinaryOperator::NotEqual:
+					return !equal(lhs, rhs);
+				case BinaryOperator::Less:
+					return less(lhs, rhs);
+				case BinaryOperator::Greater:
+					return greater(lhs, rhs);
+				case BinaryOperator::LessEqual:
+					return less_equal(lhs, rhs);
+				case BinaryOperator::GreaterEqual:
+					return greater_equal(lhs, rhs);
+				case BinaryOperator::Add:
+					return add(lhs, rhs);
+				case BinaryOperator::Subtract:
+					return subtract(lhs, rhs);
+				case BinaryOperator::Multiply:
+					return multiply(lhs, rhs);
+				case BinaryOperator::Divide:
+					return divide(lhs, rhs);
+				case BinaryOperator::Modulo:
+					return modulo(lhs, rhs);
+				case BinaryOperator::Power:
+					return power(lhs, rhs);
+				default:
+					throw RuntimeError("cannot fold binary operator");
+			}
+		}
+
+		/// The children of a node being rewritten belong to the same tree, so they may be rewritten too.
+		template< typename T >
+		auto mutable_node(T const & node) noexcept -> T * {
+			return const_cast<T *>(&node);
+		}
+
+		/// Replaces each expression with a simpler equivalent, bottom up.
+		class Folding : public Rewriter {
+		public:
+			Folding(Program & program, std::vector<Type> const & slots, bool fast_math)
+				: m_program(program), m_typing(slots), m_fast_math(fast_math) {
+			}
+
+			virtual auto rewrite(Expression * node) -> Expression * override {
+				node->rewrite(*this);
+				auto folded = fold(*node);
+				return folded != nullptr ? folded : node;
+			}
+
+			virtual auto rewrite(Statement * node) -> Statement * override {
+				node->rewrite(*this);
+				Value cond;
+				auto conditional = dynamic_cast<ConditionalStatement *>(node);
+				if (conditional != nullptr && literal(conditional->cond(), cond) && cond.is_boolean()) {
+					return mutable_node(cond.as_boolean() ? conditional->when_true() : conditional->when_false());
+				}
+				auto loop = dynamic_cast<WhileStatement *>(node);
+				if (loop != nullptr && literal(loop->cond(), cond) && cond.is_boolean() && !cond.as_boolean()) {
+					return m_program.make<EmptyStatement>(node->span());
+				}
+				auto until = dynamic_cast<UntilStatement *>(node);
+				if (until != nullptr && literal(until->cond(), cond) && cond.is_boolean() && cond.as_boolean()) {
+					return m_program.make<EmptyStatement>(node->span());
+				}
+				return node;
+			}
+
+		private:
+			auto fold(Expression & node) -> Expression * {
+				try {
+					auto constant = dynamic_cast<Constant *>(&node);
+					if (constant != nullptr) {
+						return make(*constant->value(), node.span());
+					}
+					auto call = dynamic_cast<FunctionCall *>(&node);
+					if (call != nullptr) {
+						return fold(*call);
+					}
+					auto access = dynamic_cast<ArrayAccess *>(&node);
+					Value var, index;
+					if (access != nullptr && literal(access->var(), var) && literal(access->index(), index)) {
+						return make(br::index(var, index), node.span());
+					}
+					auto unary = dynamic_cast<UnaryOperation *>(&node);
+					if (unary != nullptr) {
+						return fold(*unary);
+					}
+					auto binary = dynamic_cast<BinaryOperation *>(&node);
+					if (binary != nullptr) {
+						return fold(*binary);
+					}
+				} catch (RuntimeError const &) {
+					// Left for the program to fail on when it gets there.
+				}
+				return nullptr;
+			}
+
+			auto fold(FunctionCall & node) -> Expression * {
+				auto builtin = numeric_builtin(node);
+				if (builtin == nullptr || node.args().size() != builtin->arity) {
+					return nullptr;
+				}
+				double arguments[2] = {0.0, 0.0};
+				for (std::size_t i = 0; i < node.args().size(); ++i) {
+					Value value;
+					if (!literal(*node.args()[i], value) || !value.is_number()) {
+						return nullptr;
+					}
+					arguments[i] = value.as_number();
+				}
+				auto result = builtin->unary != nullptr ? builtin->unary(arguments[0]) : builtin->binary(arguments[0], arguments[1]);
+				return m_program.make<Numeric>(node.span(), result);
+			}
+
+			auto fold(UnaryOperation & node) -> Expression * {
+				Value rhs;
+				if (literal(node.rhs(), rhs)) {
+					switch (node.op()) {
+						case UnaryOperator::Not:
+							return make(logical_not(rhs), node.span());
+						case UnaryOperator::Plus:
+							return make(promote(rhs), node.span());
+						case UnaryOperator::Minus:
+							return make(negate(rhs), node.span());
+					}
+				}
+				auto type = m_typing.type(node.rhs());
+				if (node.op() == UnaryOperator::Plus && arithmetic(type)) {
+					return mutable_node(node.rhs());
+				}
+				// -(-x) is x and !(!x) is x, but only if the inner operation cannot fail.
+				auto inner = dynamic_cast<UnaryOperation const *>(&node.rhs());
+				if (inner != nullptr && inner->op() == node.op() && node.op() != UnaryOperator::Plus) {
+					auto operand = m_typing.type(inner->rhs());
+					if (node.op() == UnaryOperator::Not ? operand == Type::Boolean : arithmetic(operand)) {
+						return mutable_node(inner->rhs());
+					}
+				}
+				return nullptr;
+			}
+
+			auto fold(BinaryOperation & node) -> Expression * {
+				auto op = node.op();
+				Value lhs, rhs;
+				auto lhs_literal = literal(node.lhs(), lhs);
+				auto rhs_literal = literal(node.rhs(), rhs);
+				if (op == BinaryOperator::And || op == BinaryOperator::Or) {
+					return fold_logical(node, lhs_literal, lhs);
+				}
+				if (lhs_literal && rhs_literal) {
+					return make(evaluate(op, lhs, rhs), node.span());
+				}
+
+				auto lhs_type = m_typing.type(node.lhs());
+				auto rhs_type = m_typing.type(node.rhs());
+				auto x = mutable_node(node.lhs());
+				switch (op) {
+					case BinaryOperator::Add:
+						if (lhs_type == Type::Number && (is_number(node.rhs(), -0.0) || (m_fast_math && is_zero(node.rhs())))) {
+							return x;
+						}
+						if (rhs_type == Type::Number && (is_number(node.lhs(), -0.0) || (m_fast_math && is_zero(node.lhs())))) {
+							return mutable_node(node.rhs());
+						}
+						break;
+					case BinaryOperator::Subtract:
+						if (lhs_type == Type::Number && (is_number(node.rhs(), 0.0) || (m_fast_math && is_zero(node.rhs())))) {
+							return x;
+						}
+						if (m_fast_math && lhs_type == Type::Number && rhs_literal && rhs.is_number()) {
+							return reassociate(BinaryOperator::Add, x, -rhs.as_number(), node.span());
+						}
+						break;
+					case BinaryOperator::Multiply:
+						if (arithmetic(lhs_type) && is_number(node.rhs(), 1.0)) {
+							return x;
+						}
+						if (arithmetic(rhs_type) && is_number(node.lhs(), 1.0)) {
+							return mutable_node(node.rhs());
+						}
+						break;
+					case BinaryOperator::Divide:
+						if (arithmetic(lhs_type) && is_number(node.rhs(), 1.0)) {
+							return x;
+						}
+						if (m_fast_math && arithmetic(lhs_type) && rhs_literal && rhs.is_number() && rhs.as_number() != 0) {
+							return reassociate(BinaryOperator::Multiply, x, 1.0 / rhs.as_number(), node.span());
+						}
+						break;
+					case BinaryOperator::Power:
+						if (lhs_type == Type::Number && is_number(node.rhs(), 1.0)) {
+							return x;
+						}
+						break;
+					default:
+						break;
+				}
+
+				if (m_fast_math && (op == BinaryOperator::Add || op == BinaryOperator::Multiply)) {
+					// Vectors can be scaled but not offset by a number.
+					auto operand = [op](Type type) {
+						return op == BinaryOperator::Add ? type == Type::Number : arithmetic(type);
+					};
+					// The literal goes on the right, where reassociate() looks for it.
+					if (lhs_literal && lhs.is_number() && operand(rhs_type)) {
+						return reassociate(op, mutable_node(node.rhs()), lhs.as_number(), node.span());
+					}
+					auto inner = dynamic_cast<BinaryOperation const *>(&node.lhs());
+					if (rhs_literal && rhs.is_number() && operand(lhs_type) && inner != nullptr && inner->op() == op) {
+						return reassociate(op, x, rhs.as_number(), node.span());
+					}
+				}
+				return nullptr;
+			}
+
+			auto fold_logical(BinaryOperation & node, bool lhs_literal, Value const & lhs) -> Expression * {
+				if (!lhs_literal || !lhs.is_boolean()) {
+					return nullptr;
+				}
+				auto is_and = node.op() == BinaryOperator::And;
+				// `false && x` and `true || x` never evaluate x.
+				if (lhs.as_boolean() != is_and) {
+					return make(lhs, node.span());
+				}
+				Value rhs;
+				if (literal(node.rhs(), rhs) && rhs.is_boolean()) {
+					return make(rhs, node.span());
+				}
+				if (m_typing.type(node.rhs()) == Type::Boolean) {
+					return mutable_node(node.rhs());
+				}
+				return nullptr;
+			}
+
+			/// `x op c`, merging c into a literal right operand of x if x is `y op c'`.
+			auto reassociate(BinaryOperator op, Expression * x, double c, Span span) -> Expression * {
+				auto inner = dynamic_cast<BinaryOperation *>(x);
+				Value value;
+				if (inner != nullptr && inner->op() == op && literal(inner->rhs(), value) && value.is_number()) {
+					auto merged = op == BinaryOperator::Add ? value.as_number() + c : value.as_number() * c;
+					return m_program.make<BinaryOperation>(span, op, mutable_node(inner->lhs()), m_program.make<Numeric>(span, merged));
+				}
+				return m_program.make<BinaryOperation>(span, op, x, m_program.make<Numeric>(span, c));
+			}
+
+			/// A literal node for \a value, nullptr if there is no literal syntax for it.
+			auto make(Value const & value, Span span) -> Expression * {
+				switch (value.type()) {
+					case Value::Type::Number:
+						return m_program.make<Numeric>(span, value.as_number());
+					case Value::Type::Boolean:
+						return m_program.make<Boolean>(span, value.as_boolean());
+					case Value::Type::Vector:
+						return m_program.make<Vector>(
+							span,
+							m_program.make<Numeric>(span, value.as_vector().x),
+							m_program.make<Numeric>(span, value.as_vector().y)
+						);
+					default:
+						return nullptr;
+				}
+			}
+
+			Program & m_program;
+			Typing m_typing;
+			bool m_fast_math;
+		};
+
+		/// Collect the direct children of an expression, in the order they are evaluated.
+		class Children : public Rewriter {
+		public:
+			std::vector<Expression *> children;
+
+			virtual auto rewrite(Expression * node) -> Expression * override {
+				children.push_back(node);
+				return node;
+			}
+
+			virtual auto rewrite(Statement * node) -> Statement * override {
+				return node;
+			}
+		};
+
+		/// Collect the whole expressions of a statement and the statements nested in it.
+		class Roots : public Rewriter {
+		public:
+			std::vector<Expression *> roots;
+
+			virtual auto rewrite(Expression * node) -> Expression * override {
+				roots.push_back(node);
+				return node;
+			}
+
+			virtual auto rewrite(Statement * node) -> Statement * override {
+				node->rewrite(*this);
+				return node;
+			}
+		};
+
+		/// Replaces subexpressions with reads of the temporaries that hold their value.
+		class Substitution : public Rewriter {
+		public:
+			explicit Substitution(std::unordered_map<Expression const *, Expression *> const & replacements) noexcept
+				: m_replacements(replacements) {
+			}
+
+			virtual auto rewrite(Expression * node) -> Expression * override {
+				auto replacement = m_replacements.find(node);
+				if (replacement != m_replacements.end()) {
+					return replacement->second;
+				}
+				node->rewrite(*this);
+				return node;
+			}
+
+			virtual auto rewrite(Statement * node) -> Statement * override {
+				node->rewrite(*this);
+				return node;
+			}
+
+		private:
+			std::unordered_map<Expression const *, Expression *> const & m_replacements;
+		};
+
+		void mark(std::vector<bool> & assigned, std::uint32_t slot) {
+			if (assigned.size() <= slot) {
+				assigned.resize(slot + 1, false);
+			}
+			assigned[slot] = true;
+		}
+
+		/// Whether the sorted \a lhs and \a rhs have no element in common.
+		auto disjoint(std::vector<std::uint32_t> const & lhs, std::vector<std::uint32_t> const & rhs) -> bool {
+			auto l = lhs.begin();
+			auto r = rhs.begin();
+			while (l != lhs.end() && r != rhs.end()) {
+				if (*l == *r) {
+					return false;
+				}
+				if (*l < *r) {
+					++l;
+				} else {
+					++r;
+				}
+			}
+			return true;
+		}
+
+		/// What is known about a subexpression.
+		struct Info {
+			/// Whether evaluating the expression can neither fail nor have an effect.
+			bool safe;
+			/// Equal for expressions of the same shape and operands.
+			std::string key;
+			/// The slots of the variables read, sorted.
+			std::vector<std::uint32_t> inputs;
+		};
+
+		/** \brief Finds out which subexpressions may be evaluated ahead of where they occur.
+		 **
+		 ** That is the case of those that can neither fail nor have an effect: numeric operations on
+		 ** operands of proven types, calls of pure built-ins, and reads of variables certainly assigned by
+		 ** then. Evaluating them earlier is unobservable, as long as nothing they read is assigned since.
+		 */
+		class Analysis {
+		public:
+			explicit Analysis(std::vector<Type> const & slots) noexcept : m_typing(slots) {
+			}
+
+			/// Forget what was found, before analysing expressions where other variables are assigned.
+			void clear() {
+				m_info.clear();
+			}
+
+			/// \param assigned the slots certainly assigned before \a expression is evaluated
+			auto analyse(Expression const & expression, std::vector<bool> const & assigned) -> Info const & {
+				auto known = m_info.find(&expression);
+				if (known != m_info.end()) {
+					return known->second;
+				}
+				Info info{false, std::string(), std::vector<std::uint32_t>()};
+				Children children;
+				mutable_node(expression)->rewrite(children);
+				std::vector<Type> types;
+				auto safe = true;
+				for (auto child : children.children) {
+					auto const & operand = analyse(*child, assigned);
+					safe = safe && operand.safe;
+					info.inputs.insert(info.inputs.end(), operand.inputs.begin(), operand.inputs.end());
+					types.push_back(m_typing.type(*child));
+				}
+				info.key = key(expression, children.children, info.inputs);
+				info.safe = safe && this->safe(expression, types, assigned);
+				std::sort(info.inputs.begin(), info.inputs.end());
+				info.inputs.erase(std::unique(info.inputs.begin(), info.inputs.end()), info.inputs.end());
+				return m_info.emplace(&expression, std::move(info)).first->second;
+			}
+
+			auto type(Expression const & expression) -> Type {
+				return m_typing.type(expression);
+			}
+
+		private:
+			/// Whether \a expression can be evaluated without failing or having an effect, given that its
+			/// operands can and have the types \a operands.
+			auto safe(Expression const & expression, std::vector<Type> const & operands, std::vector<bool> const & assigned) -> bool {
+				auto variable = dynamic_cast<Variable const *>(&expression);
+				if (variable != nullptr) {
+					auto symbol = variable->symbol();
+					if (symbol->slot == no_slot) {
+						return symbol->builtin->kind == Builtin::Kind::Function;
+					}
+					return symbol->slot < assigned.size() && assigned[symbol->slot];
+				}
+				if (dynamic_cast<Vector const *>(&expression) != nullptr) {
+					return operands[0] == Type::Number && operands[1] == Type::Number;
+				}
+				auto call = dynamic_cast<FunctionCall const *>(&expression);
+				if (call != nullptr) {
+					auto builtin = numeric_builtin(*call);
+					if (builtin == nullptr || call->args().size() != builtin->arity) {
+						return false;
+					}
+					return std::all_of(operands.begin() + 1, operands.end(), [](Type type) { return type == Type::Number; });
+				}
+				auto access = dynamic_cast<ArrayAccess const *>(&expression);
+				if (access != nullptr) {
+					Value index;
+					return operands[0] == Type::Vector && literal(access->index(), index) && index.is_number()
+						&& (index.as_number() == 0.0 || index.as_number() == 1.0);
+				}
+				auto unary = dynamic_cast<UnaryOperation const *>(&expression);
+				if (unary != nullptr) {
+					return unary->op() == UnaryOperator::Not ? operands[0] == Type::Boolean : arithmetic(operands[0]);
+				}
+				auto binary = dynamic_cast<BinaryOperation const *>(&expression);
+				if (binary != nullptr) {
+					auto lhs = operands[0];
+					auto rhs = operands[1];
+					switch (binary->op()) {
+						case BinaryOperator::Or:
+						case BinaryOperator::And:
+							return lhs == Type::Boolean && rhs == Type::Boolean;
+						case BinaryOperator::Equal:
+						case BinaryOperator::NotEqual:
+							return lhs == rhs && lhs != Type::Unknown;
+						case BinaryOperator::Less:
+						case BinaryOperator::Greater:
+						case BinaryOperator::LessEqual:
+						case BinaryOperator::GreaterEqual:
+						case BinaryOperator::Modulo:
+						case BinaryOperator::Power:
+							return lhs == Type::Number && rhs == Type::Number;
+						default:
+							return m_typing.type(expression) != Type::Unknown;
+					}
+				}
+				// Literals and constants.
+				return true;
+			}
+
+			/// A description of \a expression that is equal for expressions of the same shape and operands.
+			auto key(Expression const & expression, std::vector<Expression *> const & children, std::vector<std::uint32_t> & inputs) -> std::string {
+				std::string result;
+				auto variable = dynamic_cast<Variable const *>(&expression);
+				Value value;
+				if (variable != nullptr) {
+					auto slot = variable->symbol()->slot;
+					if (slot == no_slot) {
+						return variable->id();
+					}
+					inputs.push_back(slot);
+					return "$" + std::to_string(slot);
+				} else if (literal(expression, value) && children.empty()) {
+					std::ostringstream stream;
+					stream << std::hexfloat << value;
+					return stream.str();
+				}
+				auto unary = dynamic_cast<UnaryOperation const *>(&expression);
+				auto binary = dynamic_cast<BinaryOperation const *>(&expression);
+				if (unary != nullptr) {
+					result = spelling(unary->op());
+				} else if (binary != nullptr) {
+					result = spelling(binary->op());
+				} else if (dynamic_cast<FunctionCall const *>(&expression) != nullptr) {
+					result = "()";
+				} else if (dynamic_cast<ArrayAccess const *>(&expression) != nullptr) {
+					result = "[]";
+				}
+				result += '(';
+				for (auto child : children) {
+					result += m_info.at(child).key;
+					result += ',';
+				}
+				result += ')';
+				return result;
+			}
+
+			Typing m_typing;
+			std::unordered_map<Expression const *, Info> m_info;
+		};
+
+		/// The variables the passes below add to a program, each assigned in one place only.
+		class Temporaries {
+		public:
+			struct Temporary {
+				std::string const * name;
+				Symbol const * symbol;
+			};
+
+			Temporaries(Program & program, std::vector<Type> & slots)
+				: m_program(program), m_slots(slots), m_names(program.slots().begin(), program.slots().end()) {
+			}
+
+			/// A new temporary holding values of type \a type.
+			auto make(Type type) -> Temporary {
+				auto slot = static_cast<std::uint32_t>(m_names.size());
+				auto name = m_program.name("$" + std::to_string(slot));
+				m_names.push_back(name);
+				m_slots.push_back(type);
+				return Temporary{name, m_program.arena().make<Symbol>(Symbol{name, slot, nullptr})};
+			}
+
+			auto read(Temporary const & temporary, Span span) -> Expression * {
+				auto variable = m_program.make<Variable>(span, temporary.name);
+				variable->bind(temporary.symbol);
+				return variable;
+			}
+
+			auto define(Temporary const & temporary, Expression * value) -> Statement * {
+				auto definition = m_program.make<AssignStatement>(value->span(), temporary.name, value);
+				definition->bind(temporary.symbol->slot);
+				return definition;
+			}
+
+			/// Add the temporaries to the frame of the program.
+			void commit() {
+				m_program.slots(m_program.array(m_names.data(), m_names.size()));
+			}
+
+		private:
+			Program & m_program;
+			std::vector<Type> & m_slots;
+			std::vector<std::string const *> m_names;
+		};
+
+		/** \brief Moves the calls and operations that a loop does not change out of it.
+		 **
+		 ** A subexpression of the condition or body of a loop is invariant if nothing in the loop may assign
+		 ** a variable it reads. Each maximal invariant call, operation or component access that is safe (see
+		 ** Analysis) to evaluate before the loop is assigned to a new variable just before it, once for equal
+		 ** ones, and read from there. The bounds and step of a for-loop are evaluated once anyway. Loops are
+		 ** handled outer first, so that what depends on an outer loop variable only leaves the inner loops.
+		 */
+		class Hoisting {
+		public:
+			Hoisting(Program & program, Analysis & analysis, Temporaries & temporaries) noexcept
+				: hoisted(0), loops(0), m_program(program), m_analysis(analysis), m_temporaries(temporaries) {
+			}
+
+			/// The number of subexpressions moved out of loops.
+			std::size_t hoisted;
+
+			/// The number of loops something was moved out of.
+			std::size_t loops;
+
+			void run(std::vector<bool> const & assigned) {
+				m_program.stmts(block(m_program.stmts(), assigned));
+			}
+
+		private:
+			/// Hoist within the statements of a block; \a assigned holds the slots certainly assigned before it.
+			auto block(Array<Statement *> const & stmts, std::vector<bool> assigned) -> Array<Statement *> {
+				std::vector<Statement *> result;
+				for (auto statement : stmts) {
+					auto count = result.size();
+					hoist(*statement, assigned, result);
+					for (auto k = count; k < result.size(); ++k) {
+						mark(assigned, static_cast<AssignStatement const *>(result[k])->slot());
+					}
+					result.push_back(statement);
+					nested(*statement, assigned);
+					auto assign = dynamic_cast<AssignStatement const *>(statement);
+					if (assign != nullptr) {
+						mark(assigned, assign->slot());
+					}
+				}
+				if (result.size() == stmts.size()) {
+					return stmts;
+				}
+				return m_program.array(result.data(), result.size());
+			}
+
+			void nested(Statement & statement, std::vector<bool> const & assigned) {
+				auto compound = dynamic_cast<CompoundStatement *>(&statement);
+				if (compound != nullptr) {
+					compound->stmts(block(compound->stmts(), assigned));
+					return;
+				}
+				auto conditional = dynamic_cast<ConditionalStatement *>(&statement);
+				if (conditional != nullptr) {
+					nested(*mutable_node(conditional->when_true()), assigned);
+					nested(*mutable_node(conditional->when_false()), assigned);
+					return;
+				}
+				auto loop = dynamic_cast<WhileStatement *>(&statement);
+				if (loop != nullptr) {
+					nested(*mutable_node(loop->body()), assigned);
+					return;
+				}
+				auto until = dynamic_cast<UntilStatement *>(&statement);
+				if (until != nullptr) {
+					nested(*mutable_node(until->body()), assigned);
+					return;
+				}
+				auto range = dynamic_cast<ForStatement *>(&statement);
+				if (range != nullptr) {
+					auto inner = assigned;
+					mark(inner, range->slot());
+					nested(*mutable_node(range->body()), inner);
+				}
+			}
+
+			/// If \a statement is a loop, move its invariants out into \a definitions.
+			void hoist(Statement & statement, std::vector<bool> const & assigned, std::vector<Statement *> & definitions) {
+				Roots roots;
+				auto loop = dynamic_cast<WhileStatement const *>(&statement);
+				auto until = dynamic_cast<UntilStatement const *>(&statement);
+				auto range = dynamic_cast<ForStatement const *>(&statement);
+				if (loop != nullptr) {
+					roots.roots.push_back(mutable_node(loop->cond()));
+					mutable_node(loop->body())->rewrite(roots);
+				} else if (until != nullptr) {
+					roots.roots.push_back(mutable_node(until->cond()));
+					mutable_node(until->body())->rewrite(roots);
+				} else if (range != nullptr) {
+					mutable_node(range->body())->rewrite(roots);
+				} else {
+					return;
+				}
+
+				auto writes = assigned_slots(statement);
+				std::sort(writes.begin(), writes.end());
+				m_analysis.clear();
+				m_available.clear();
+				m_replacements.clear();
+				auto count = definitions.size();
+				for (auto root : roots.roots) {
+					scan(*root, assigned, writes, definitions);
+				}
+				if (definitions.size() == count) {
+					return;
+				}
+				++loops;
+				hoisted += definitions.size() - count;
+				Substitution substitution(m_replacements);
+				statement.rewrite(substitution);
+			}
+
+			/// Record the maximal invariant subexpressions of \a expression, with a definition for each new one.
+			void scan(Expression & expression, std::vector<bool> const & assigned, std::vector<std::uint32_t> const & writes, std::vector<Statement *> & definitions) {
+				auto const & info = m_analysis.analyse(expression, assigned);
+				auto candidate = info.safe && !info.inputs.empty() && (
+					dynamic_cast<FunctionCall const *>(&expression) != nullptr
+					|| dynamic_cast<BinaryOperation const *>(&expression) != nullptr
+					|| dynamic_cast<ArrayAccess const *>(&expression) != nullptr
+				);
+				if (candidate && disjoint(info.inputs, writes)) {
+					auto available = m_available.find(info.key);
+					if (available == m_available.end()) {
+						auto temporary = m_temporaries.make(m_analysis.type(expression));
+						available = m_available.emplace(info.key, temporary).first;
+						definitions.push_back(m_temporaries.define(temporary, &expression));
+					}
+					m_replacements.emplace(&expression, m_temporaries.read(available->second, expression.span()));
+					return;
+				}
+				Children children;
+				expression.rewrite(children);
+				for (auto child : children.children) {
+					scan(*child, assigned, writes, definitions);
+				}
+			}
+
+			Program & m_program;
+			Analysis & m_analysis;
+			Temporaries & m_temporaries;
+			/// Temporaries of the invariants of the current loop, by key.
+			std::unordered_map<std::string, Temporaries::Temporary> m_available;
+			std::unordered_map<Expression const *, Expression *> m_replacements;
+		};
+
+		/** \brief Computes each repeated pure call or operation of a block once, into a temporary.
+		 **
+		 ** Within the statements of one block, an occurrence of a call or operation is the same as an earlier
+		 ** one if both have the same shape and operands and no statement in between may assign a variable
+		 ** they read. Each subexpression that is safe (see Analysis) and has more than one occurrence is
+		 ** assigned to a new variable just before the statement of its first occurrence, and read from there.
+		 */
+		class Elimination {
+		public:
+			Elimination(Program & program, Analysis & analysis, Temporaries & temporaries) noexcept
+				: shared(0), m_program(program), m_analysis(analysis), m_temporaries(temporaries) {
+			}
+
+			/// The number of subexpressions computed once for several occurrences.
+			std::size_t shared;
+
+			void run(std::vector<bool> assigned) {
+				m_program.stmts(block(m_program.stmts(), assigned));
+			}
+
+		private:
+			struct Entry {
+				Expression * first;
+				std::size_t statement;
+				std::size_t count;
+				std::vector<std::uint32_t> inputs;
+			};
+
+			/// Eliminate within the statements of a block; \a assigned holds the slots certainly assigned before it.
+			auto block(Array<Statement *> const & stmts, std::vector<bool> & assigned) -> Array<Statement *> {
+				m_entries.clear();
+				m_available.clear();
+				m_occurrences.clear();
+				m_analysis.clear();
+				std::vector<std::vector<bool>> before;
+				for (std::size_t i = 0; i < stmts.size(); ++i) {
+					before.push_back(assigned);
+					auto assign = dynamic_cast<AssignStatement *>(stmts[i]);
+					auto expression = dynamic_cast<ExpressionStatement *>(stmts[i]);
+					if (assign != nullptr) {
+						scan(*mutable_node(assign->expr()), i, assigned);
+					} else if (expression != nullptr) {
+						scan(*mutable_node(expression->expr()), i, assigned);
+					}
+					kill(assigned_slots(*stmts[i]));
+					if (assign != nullptr) {
+						mark(assigned, assign->slot());
+					}
+				}
+
+				auto result = define(stmts);
+				// Nested blocks reuse the state of this one, so they go last.
+				for (std::size_t i = 0; i < stmts.size(); ++i) {
+					nested(*stmts[i], before[i]);
+				}
+				return result;
+			}
+
+			void nested(Statement & statement, std::vector<bool> const & assigned) {
+				auto inner = assigned;
+				auto compound = dynamic_cast<CompoundStatement *>(&statement);
+				if (compound != nullptr) {
+					compound->stmts(block(compound->stmts(), inner));
+					return;
+				}
+				auto conditional = dynamic_cast<ConditionalStatement *>(&statement);
+				if (conditional != nullptr) {
+					nested(*mutable_node(conditional->when_true()), assigned);
+					nested(*mutable_node(conditional->when_false()), assigned);
+					return;
+				}
+				auto loop = dynamic_cast<WhileStatement *>(&statement);
+				if (loop != nullptr) {
+					nested(*mutable_node(loop->body()), assigned);
+					return;
+				}
+				auto until = dynamic_cast<UntilStatement *>(&statement);
+				if (until != nullptr) {
+					nested(*mutable_node(until->body()), assigned);
+					return;
+				}
+				auto range = dynamic_cast<ForStatement *>(&statement);
+				if (range != nullptr) {
+					mark(inner, range->slot());
+					nested(*mutable_node(range->body()), inner);
+				}
+			}
+
+			/// Record the shareable subexpressions of \a expression; repeats are not searched further.
+			void scan(Expression & expression, std::size_t statement, std::vector<bool> const & assigned) {
+				auto const & info = m_analysis.analyse(expression, assigned);
+				auto candidate = info.safe && !info.inputs.empty()
+					&& (dynamic_cast<FunctionCall const *>(&expression) != nullptr || dynamic_cast<BinaryOperation const *>(&expression) != nullptr);
+				if (candidate) {
+					auto available = m_available.find(info.key);
+					if (available != m_available.end()) {
+						++m_entries[available->second].count;
+						m_occurrences.emplace_back(&expression, available->second);
+						return;
+					}
+				}
+				Children children;
+				expression.rewrite(children);
+				for (auto child : children.children) {
+					scan(*child, statement, assigned);
+				}
+				if (candidate) {
+					// After the children, so that temporaries are defined inner first.
+					m_available.emplace(info.key, m_entries.size());
+					m_occurrences.emplace_back(&expression, m_entries.size());
+					m_entries.push_back(Entry{&expression, statement, 1, info.inputs});
+				}
+			}
+
+			/// Forget the subexpressions that read a variable in \a slots.
+			void kill(std::vector<std::uint32_t> const & slots) {
+				for (auto available = m_available.begin(); available != m_available.end(); ) {
+					auto const & inputs = m_entries[available->second].inputs;
+					if (std::find_first_of(inputs.begin(), inputs.end(), slots.begin(), slots.end()) != inputs.end()) {
+						available = m_available.erase(available);
+					} else {
+						++available;
+					}
+				}
+			}
+
+			/// The statements of the block, with a temporary for each entry that occurs more than once.
+			auto define(Array<Statement *> const & stmts) -> Array<Statement *> {
+				std::vector<Temporaries::Temporary> temporaries(m_entries.size(), Temporaries::Temporary{nullptr, nullptr});
+				for (std::size_t k = 0; k < m_entries.size(); ++k) {
+					if (m_entries[k].count > 1) {
+						temporaries[k] = m_temporaries.make(m_analysis.type(*m_entries[k].first));
+						++shared;
+					}
+				}
+				std::unordered_map<Expression const *, Expression *> replacements;
+				for (auto const & occurrence : m_occurrences) {
+					auto const & temporary = temporaries[occurrence.second];
+					if (temporary.symbol != nullptr) {
+						replacements.emplace(occurrence.first, m_temporaries.read(temporary, occurrence.first->span()));
+					}
+				}
+				if (replacements.empty()) {
+					return stmts;
+				}
+
+				Substitution substitution(replacements);
+				std::vector<Statement *> result;
+				std::size_t k = 0;
+				for (std::size_t i = 0; i < stmts.size(); ++i) {
+					for (; k < m_entries.size() && m_entries[k].statement == i; ++k) {
+						auto const & entry = m_entries[k];
+						auto const & temporary = temporaries[k];
+						if (temporary.symbol == nullptr) {
+							continue;
+						}
+						entry.first->rewrite(substitution);
+						result.push_back(m_temporaries.define(temporary, entry.first));
+					}
+					stmts[i]->rewrite(substitution);
+					result.push_back(stmts[i]);
+				}
+				return m_program.array(result.data(), result.size());
+			}
+
+			Program & m_program;
+			Analysis & m_analysis;
+			Temporaries & m_temporaries;
+			std::vector<Entry> m_entries;
+			/// Entries by key, while no variable they read may have been assigned.
+			std::unordered_map<std::string, std::size_t> m_available;
+			std::vector<std::pair<Expression const *, std::size_t>> m_occurrences;
+		};
+
+		class Counting : public Rewriter {
+		public:
+			std::size_t count = 0;
+
+			virtual auto rewrite(Expression * node) -> Expression * override {
+				++count;
+				node->rewrite(*this);
+				return node;
+			}
+
+			virtual auto rewrite(Statement * node) -> Statement * override {
+				++count;
+				node->rewrite(*this);
+				return node;
+			}
+		};
+
+	} // namespace
+
+	auto optimize(Program & program, bool fast_math) -> Optimizations {
+		auto slots = infer(program);
+		Folding folding(program, slots, fast_math);
+		program.rewrite(folding);
+
+		std::vector<bool> assigned(slots.size(), false);
+		assigned[origin_slot] = assigned[scale_slot] = assigned[rot_slot] = true;
+		Analysis analysis(slots);
+		Temporaries temporaries(program, slots);
+		Hoisting hoisting(program, analysis, temporaries);
+		hoisting.run(assigned);
+		Elimination elimination(program, analysis, temporaries);
+		elimination.run(assigned);
+		temporaries.commit();
+		return Optimizations{hoisting.hoisted, hoisting.loops, elimination.shared};
+	}
+
+	auto count_nodes(Program & program) -> std::size_t {
+		Counting counting;
+		program.rewrite(counting);
+		return counting.count + 1;
+	}
+
+} // namespace br
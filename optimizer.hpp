@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include "ast.hpp"
+
+namespace br {
+
+	/// What optimize() did to a program.
+	struct Optimizations {
+		/// Calls, operations and component accesses moved out of loops.
+		std::size_t hoisted;
+		/// Loops that something was moved out of.
+		std::size_t loops;
+		/// Repeated calls and operations computed once instead.
+		std::size_t shared;
+	};
+
+	/** \brief Simplify \a program, which must be bound (see bind()), in place.
+	 **
+	 ** Folds operations, component accesses and calls of numeric built-ins whose operands are literals or
+	 ** constants, removes branches of conditionals and loops whose condition is a literal, and applies
+	 ** algebraic identities that hold exactly in IEEE arithmetic for the operand types the pass can prove,
+	 ** such as `x * 1`, `x / 1`, `x - 0` and `-(-x)`. Nothing is folded that would raise an error; such
+	 ** operations are left to fail at run time as before, with the same message.
+	 **
+	 ** Then calls of pure built-ins, operations and component accesses in a loop that read nothing the
+	 ** loop assigns are computed once before it, and those that occur more than once in a block, with no
+	 ** assignment to what they read in between, are computed once into a new variable. See
+	 ** Program::slots() for the names of these temporaries, which start with `$`.
+	 **
+	 ** \param fast_math also apply rewrites that may change results by rounding: `x + 0`, `x / c` as
+	 **        `x * (1 / c)` and the reassociation of chained additions and multiplications by literals
+	 */
+	auto optimize(Program & program, bool fast_math) -> Optimizations;
+
+	/// The number of nodes in the tree of \a program, including the program itself.
+	auto count_nodes(Program & program) -> std::size_t;
+
+} // namespace br
@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <string>
+#include <vector>
+#include "builtin.hpp"
+#include "context.hpp"
+#include "parallel.hpp"
+
+namespace br {
+
+	namespace {
+
+		/// Chunks handed out per worker in a round; more balance the load better, fewer cost less to merge.
+		constexpr std::size_t chunks_per_worker = 8;
+
+		/// Upper bound on the iterations of a chunk, which bounds the points buffered in a round.
+		constexpr std::size_t max_chunk = 1024;
+
+		/** \brief Finds out whether the iterations of a loop body are independent.
+		 **
+		 ** Walks the body in evaluation order, keeping the slots certainly assigned so far in the iteration;
+		 ** reading a slot that the body assigns but that is not among those may read the previous iteration.
+		 */
+		class Independence : public Walker {
+		public:
+			Independence(std::vector<std::uint32_t> const & written, std::uint32_t slot)
+				: m_written(written), m_assigned(1, slot), m_draw(find_builtin("draw")), m_rand(find_builtin("rand")) {
+			}
+
+			/// Why the iterations may depend on each other or on their order, empty if they may not.
+			std::string reason;
+
+			/// How many random numbers every iteration reads.
+			std::uint64_t randoms = 0;
+
+			using Walker::visit;
+
+			virtual void visit(Variable const & node) override {
+				auto symbol = node.symbol();
+				if (symbol->slot != no_slot && assigned(symbol->slot)) {
+					return;
+				}
+				// An unassigned variable reads as the built-in of the same name.
+				if (symbol->builtin == m_rand) {
+					// Each iteration can start at its own position in the stream if they all read as many.
+					if (m_varying == 0) {
+						++randoms;
+					} else {
+						fail("it reads 'rand' a varying number of times");
+					}
+				} else if (symbol->builtin != nullptr && symbol->builtin->kind == Builtin::Kind::Property) {
+					fail("it reads '" + node.id() + "'");
+				} else if (symbol->slot != no_slot && written(symbol->slot)) {
+					fail("it may read '" + node.id() + "' before assigning it");
+				}
+			}
+
+			virtual void visit(FunctionCall const & node) override {
+				auto callee = dynamic_cast<Variable const *>(&node.func());
+				if (callee == nullptr || callee->symbol()->slot != no_slot) {
+					fail("it calls a function held in a variable");
+				} else if (!callee->symbol()->builtin->pure && callee->symbol()->builtin != m_draw) {
+					fail("it calls '" + callee->id() + "'");
+				}
+				Walker::visit(node);
+			}
+
+			virtual void visit(BinaryOperation const & node) override {
+				node.lhs().accept(*this);
+				// The right operand of a logical operator is not always evaluated.
+				auto logical = node.op() == BinaryOperator::And || node.op() == BinaryOperator::Or;
+				m_varying += logical;
+				node.rhs().accept(*this);
+				m_varying -= logical;
+			}
+
+			virtual void visit(ConditionalStatement const & node) override {
+				node.cond().accept(*this);
+				auto before = m_assigned;
+				++m_varying;
+				node.when_true().accept(*this);
+				auto when_true = m_assigned;
+				m_assigned = before;
+				node.when_false().accept(*this);
+				--m_varying;
+				std::sort(when_true.begin(), when_true.end());
+				std::sort(m_assigned.begin(), m_assigned.end());
+				std::vector<std::uint32_t> both;
+				std::set_intersection(when_true.begin(), when_true.end(), m_assigned.begin(), m_assigned.end(), std::back_inserter(both));
+				m_assigned = both;
+			}
+
+			virtual void visit(WhileStatement const & node) override {
+				++m_varying;
+				node.cond().accept(*this);
+				repeated(node.body());
+				--m_varying;
+			}
+
+			virtual void visit(UntilStatement const & node) override {
+				++m_varying;
+				node.cond().accept(*this);
+				repeated(node.body());
+				--m_varying;
+			}
+
+			virtual void visit(ForStatement const & node) override {
+				node.from().accept(*this);
+				node.to().accept(*this);
+				node.step().accept(*this);
+				assign(node.slot(), node.id());
+				auto before = m_assigned;
+				++m_varying;
+				node.body().accept(*this);
+				--m_varying;
+				// The loop variable is not assigned if there is no iteration.
+				m_assigned = before;
+				m_assigned.pop_back();
+			}
+
+			virtual void visit(AssignStatement const & node) override {
+				node.expr().accept(*this);
+				assign(node.slot(), node.id());
+			}
+
+		private:
+			/// Visit a body that may run any number of times, so assigns nothing for certain.
+			void repeated(Statement const & body) {
+				auto before = m_assigned;
+				body.accept(*this);
+				m_assigned = before;
+			}
+
+			void assign(std::uint32_t slot, std::string const & name) {
+				if (Context::is_special(slot)) {
+					fail("it assigns '" + name + "'");
+				}
+				m_assigned.push_back(slot);
+			}
+
+			auto written(std::uint32_t slot) const -> bool {
+				return std::binary_search(m_written.begin(), m_written.end(), slot);
+			}
+
+			auto assigned(std::uint32_t slot) const -> bool {
+				return std::find(m_assigned.begin(), m_assigned.end(), slot) != m_assigned.end();
+			}
+
+			void fail(std::string const & message) {
+				if (reason.empty()) {
+					reason = message;
+				}
+			}
+
+			std::vector<std::uint32_t> const & m_written;
+			std::vector<std::uint32_t> m_assigned;
+			Builtin const * m_draw;
+			Builtin const * m_rand;
+			/// How many enclosing constructs may evaluate what is visited other than once per iteration.
+			std::size_t m_varying = 0;
+		};
+
+		/// What a chunk of iterations did.
+		struct Chunk {
+			std::uint64_t first, count;
+			/// The points drawn, after the transform.
+			std::vector<double> xs, ys;
+			/// For each assigned slot, its value after the last iteration of the chunk that assigned it.
+			std::vector<Value> values;
+			std::vector<bool> assigned;
+			std::exception_ptr error;
+			/// The position in the random stream when the error was raised.
+			std::uint64_t randoms;
+		};
+
+		/// Buffers the points drawn by a chunk of iterations.
+		class Points : public Device {
+		public:
+			Chunk * chunk = nullptr;
+
+			virtual ~Points() noexcept {
+			}
+
+			virtual void clear(std::size_t width, std::size_t height) override {
+			}
+
+			virtual void draw(double x, double y) override {
+				chunk->xs.push_back(x);
+				chunk->ys.push_back(y);
+			}
+
+			virtual void draw(double const * xs, double const * ys, std::size_t count) override {
+				chunk->xs.insert(chunk->xs.end(), xs, xs + count);
+				chunk->ys.insert(chunk->ys.end(), ys, ys + count);
+			}
+
+			virtual void save() override {
+			}
+		};
+
+	} // namespace
+
+	struct Parallel::Plan {
+		/// Why the loop runs serially, empty if it does not.
+		std::string reason;
+		/// The slots the body assigns, sorted, not including that of the loop.
+		std::vector<std::uint32_t> written;
+		/// The random numbers an iteration reads.
+		std::uint64_t randoms = 0;
+	};
+
+	Parallel::Parallel(ThreadPool & pool, Program const & program, std::ostream & log) : m_pool(pool), m_program(program), m_log(log) {
+	}
+
+	Parallel::~Parallel() noexcept {
+	}
+
+	auto Parallel::execute(ForStatement const & loop, double from, double to, double step, Context & context) -> bool {
+		auto const & plan = m_plan(loop);
+		auto trips = ForStatement::trip_count(from, to, step);
+		if (!plan.reason.empty() || m_pool.size() == 1 || trips < 2) {
+			return false;
+		}
+
+		auto workers = m_pool.size();
+		auto const & written = plan.written;
+		auto size = std::max<std::uint64_t>(1, std::min<std::uint64_t>(max_chunk, trips / (workers * chunks_per_worker)));
+		std::vector<Points> devices(workers);
+		std::vector<Context> contexts;
+		contexts.reserve(workers);
+		for (auto & device : devices) {
+			contexts.emplace_back(context, device);
+		}
+		// Iteration i reads the numbers a serial run would: those following the ones of the iterations before.
+		auto base = context.randoms();
+		// The chunks' points go to the device directly, after those drawn before the loop.
+		context.flush();
+		std::vector<Chunk> chunks(workers * chunks_per_worker);
+		for (auto & chunk : chunks) {
+			chunk.values.resize(written.size() + 1);
+			chunk.assigned.resize(written.size() + 1);
+		}
+
+		for (std::uint64_t first = 0; first < trips; ) {
+			// One round: as many chunks as fit, taken by whichever worker is free.
+			std::size_t round = 0;
+			for (; round < chunks.size() && first < trips; ++round, first += size) {
+				chunks[round].first = first;
+				chunks[round].count = std::min<std::uint64_t>(size, trips - first);
+			}
+			std::atomic<std::size_t> next(0), failed(round);
+			m_pool.run([&](std::size_t worker) {
+				auto & local = contexts[worker];
+				// Keep the values the iteration run last assigned, up to an error if it raised one.
+				auto record = [&](Chunk & chunk) {
+					for (std::size_t j = 0; j <= written.size(); ++j) {
+						auto value = local.variable(j < written.size() ? written[j] : loop.slot());
+						if (value != nullptr) {
+							chunk.values[j] = *value;
+							chunk.assigned[j] = true;
+						}
+					}
+				};
+				for (std::size_t k; (k = next++) < round && k < failed; ) {
+					auto & chunk = chunks[k];
+					devices[worker].chunk = &chunk;
+					chunk.xs.clear();
+					chunk.ys.clear();
+					std::fill(chunk.assigned.begin(), chunk.assigned.end(), false);
+					chunk.error = nullptr;
+					try {
+						for (auto i = chunk.first; i < chunk.first + chunk.count; ++i) {
+							for (auto slot : written) {
+								local.unassign(slot);
+							}
+							local.assign(loop.slot(), from + static_cast<double>(i) * step);
+							local.randoms(base + i * plan.randoms);
+							loop.body().invoke(local);
+							record(chunk);
+						}
+						local.flush();
+					} catch (...) {
+						chunk.error = std::current_exception();
+						chunk.randoms = local.randoms();
+						record(chunk);
+						local.flush();
+						for (auto current = failed.load(); k < current && !failed.compare_exchange_weak(current, k); ) {
+						}
+					}
+				}
+			});
+
+			for (std::size_t k = 0; k < round; ++k) {
+				auto const & chunk = chunks[k];
+				context.device().draw(chunk.xs.data(), chunk.ys.data(), chunk.xs.size());
+				// The values of a chunk that failed are as of the error, as a serial run would leave them.
+				for (std::size_t j = 0; j <= written.size(); ++j) {
+					if (chunk.assigned[j]) {
+						context.assign(j < written.size() ? written[j] : loop.slot(), chunk.values[j]);
+					}
+				}
+				if (chunk.error != nullptr) {
+					context.randoms(chunk.randoms);
+					std::rethrow_exception(chunk.error);
+				}
+			}
+		}
+		context.randoms(base + trips * plan.randoms);
+		return true;
+	}
+
+	auto Parallel::m_plan(ForStatement const & loop) -> Plan const & {
+		auto & plan = m_plans[&loop];
+		if (plan != nullptr) {
+			return *plan;
+		}
+		plan.reset(new Plan);
+		auto & written = plan->written;
+		written = assigned_slots(loop.body());
+		std::sort(written.begin(), written.end());
+		written.erase(std::unique(written.begin(), written.end()), written.end());
+		written.erase(std::remove(written.begin(), written.end(), loop.slot()), written.end());
+
+		if (Context::is_special(loop.slot())) {
+			plan->reason = "it assigns '" + loop.id() + "'";
+		} else {
+			Independence independence(written, loop.slot());
+			loop.body().accept(independence);
+			plan->reason = independence.reason;
+			plan->randoms = independence.randoms;
+		}
+		if (!plan->reason.empty()) {
+			auto at = m_program.sources().resolve(m_program.location(loop.span()).begin);
+			m_log << at.line << ':' << at.column << ": for loop over '" << loop.id() << "' runs serially: " << plan->reason << std::endl;
+		}
+		return *plan;
+	}
+
+} // namespace br
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include "ast.hpp"
+#include "pool.hpp"
+
+namespace br {
+
+	class Context;
+
+	/** \brief Runs the iterations of for loops on several threads when they do not depend on each other.
+	 **
+	 ** A loop qualifies if its body only calls `draw` and pure built-ins, reads `rand` the same number of
+	 ** times in every iteration, does not assign `clear`, `origin`, `scale` or `rot`, and reads each
+	 ** variable it assigns only after assigning it in the same iteration. Its iterations are then cut into
+	 ** chunks that the workers of a ThreadPool take in turn, each with a copy of the variables and a buffer
+	 ** for the points drawn. Iteration i reads the random numbers at its serial position in the stream,
+	 ** the buffers are drawn in iteration order, and each variable the body assigns is left with its value
+	 ** from the last iteration that assigned it, so the output and the variables afterwards are those of a
+	 ** serial run, up to the first runtime error, which is then raised.
+	 */
+	class Parallel {
+	public:
+		/// \param log where to report, once per loop of \a program, why it runs serially
+		Parallel(ThreadPool & pool, Program const & program, std::ostream & log);
+
+		~Parallel() noexcept;
+
+		/// \return false, having had no effect, if the loop does not qualify; the caller then runs it serially
+		auto execute(ForStatement const & loop, double from, double to, double step, Context & context) -> bool;
+
+	private:
+		struct Plan;
+
+		auto m_plan(ForStatement const & loop) -> Plan const &;
+
+		ThreadPool & m_pool;
+		Program const & m_program;
+		std::ostream & m_log;
+		std::unordered_map<ForStatement const *, std::unique_ptr<Plan>> m_plans;
+	}; // class Parallel
+
+} // namespace br
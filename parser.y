@@ -1,12 +1,11 @@
 %code requires{
 #include <string>
 #include <memory>
-#include <list>
 #include "../ast.hpp"
 #include "../location.hpp"
 #include "../raph.hpp"
 #define YY_NULLPTR nullptr
-#define YY_DECL int yylex(br::Parser::semantic_type * yylval, br::Parser::location_type * yylloc, void * yyscanner, br::RaphParser const & parser)
+#define YY_DECL int yylex(br::Parser::semantic_type * yylval, br::Parser::location_type * yylloc, void * yyscanner, br::RaphParser const & parser, br::Program & program)
 }
 %code provides{
 extern "C" {
@@ -34,6 +33,9 @@ extern "C" {
 	void yyset_lineno(int line_number, YYScan scanner);
 	auto yyget_column(YYScan scanner) -> int;
 	void yyset_column(int column_no, YYScan scanner);
+	using YYBuffer = struct yy_buffer_state *;
+	auto yy_scan_buffer(char * base, YYSize size, YYScan scanner) -> YYBuffer;
+	void yy_delete_buffer(YYBuffer buffer, YYScan scanner);
 } // extern "C"
 }
 %define api.namespace {br}
@@ -45,9 +47,13 @@ extern "C" {
 %locations
 %param { void * yyscanner }
 %param { RaphParser const & parser }
-%parse-param { std::shared_ptr<Program> & program }
+%param { Program & program }
 %initial-action {
-	@$.begin.filename = @$.end.filename = std::make_shared<std::string>(parser.filename());
+	// A program parsed before, and parsed into again for part of its source, keeps its file.
+	if (program.sources().files() == 0) {
+		program.file(program.sources().add(parser.filename()));
+	}
+	@$ = Location(Position(program.file()));
 }
 %token
 	END_OF_FILE         0 "end of file"
@@ -95,15 +101,13 @@ extern "C" {
 %token <std::string>
 	TOKEN_VARIABLE
 	TOKEN_CONSTANT
-%type < std::shared_ptr<Program> >
-	program
-%type < std::shared_ptr< std::list< std::shared_ptr<Statement> > > >
+%type < List<Statement *> >
 	statements
-%type < std::shared_ptr<Statement> >
+%type <Statement *>
 	statement
 	compound-statement
 	optional-else
-%type < std::shared_ptr<Expression> >
+%type <Expression *>
 	expression
 	logical-or-expression
 	logical-and-expression
@@ -115,7 +119,7 @@ extern "C" {
 	unary-expression
 	postfix-expression
 	primary-expression
-%type < std::shared_ptr< std::list< std::shared_ptr<Expression> > > >
+%type < List<Expression *> >
 	optional-arguments
 	arguments
 %type <bool>
@@ -125,33 +129,32 @@ extern "C" {
 program
 	: statements optional-delimiters
 		{
-			program = $[program] = std::make_shared<Program>($[statements]);
+			program.stmts(program.array($[statements]));
 		}
 	;
 statements
 	: %empty
 		{
-			$[statements] = std::make_shared< std::list< std::shared_ptr<Statement> > >();
+			$[statements] = List<Statement *>();
 		}
 	| statement
 		{
-			$[statements] = std::make_shared< std::list< std::shared_ptr<Statement> > >();
-			$[statements]->push_back($[statement]);
+			$[statements].push_back(program.arena(), $[statement]);
 		}
 	| statements[current] delimiters statement
 		{
 			$$ = $[current];
-			$$->push_back($[statement]);
+			$$.push_back(program.arena(), $[statement]);
 		}
 	| error statement
 		{
-			$[statements] = std::make_shared< std::list< std::shared_ptr<Statement> > >();
+			$[statements] = List<Statement *>();
 		}
 	;
 compound-statement
 	: statements optional-delimiters
 		{
-			$[compound-statement] = std::make_shared<CompoundStatement>($[statements]);
+			$[compound-statement] = program.make<CompoundStatement>(@$, program.array($[statements]));
 		}
 	;
 statement
@@ -161,31 +164,31 @@ statement
 		}
 	| "if" expression then compound-statement[when-true] optional-else[when-false] "end"
 		{
-			$[statement] = std::make_shared<ConditionalStatement>($[expression], $[when-true], $[when-false]);
+			$[statement] = program.make<ConditionalStatement>(@$, $[expression], $[when-true], $[when-false]);
 		}
 	| "unless" expression then compound-statement[when-false] optional-else[when-true] "end"
 		{
-			$[statement] = std::make_shared<ConditionalStatement>($[expression], $[when-false], $[when-true]);
+			$[statement] = program.make<ConditionalStatement>(@$, $[expression], $[when-false], $[when-true]);
 		}
 	| "while" expression do compound-statement "end"
 		{
-			$[statement] = std::make_shared<WhileStatement>($[expression], $[compound-statement]);
+			$[statement] = program.make<WhileStatement>(@$, $[expression], $[compound-statement]);
 		}
 	| "until" expression do compound-statement "end"
 		{
-			$[statement] = std::make_shared<UntilStatement>($[expression], $[compound-statement]);
+			$[statement] = program.make<UntilStatement>(@$, $[expression], $[compound-statement]);
 		}
 	| "for" TOKEN_VARIABLE[id] "from" expression[from] "to" expression[to] "step" expression[step] compound-statement[body] "end"
 		{
-			$[statement] = std::make_shared<ForStatement>($[id], $[from], $[to], $[step], $[body]);
+			$[statement] = program.make<ForStatement>(@$, program.name($[id]), $[from], $[to], $[step], $[body]);
 		}
 	| TOKEN_VARIABLE[id] "=" expression
 		{
-			$[statement] = std::make_shared<AssignStatement>($[id], $[expression]);
+			$[statement] = program.make<AssignStatement>(@$, program.name($[id]), $[expression]);
 		}
 	| expression
 		{
-			$[statement] = std::make_shared<ExpressionStatement>($[expression]);
+			$[statement] = program.make<ExpressionStatement>(@$, $[expression]);
 		}
 	;
 then
@@ -201,7 +204,7 @@ do
 optional-else
 	: %empty
 		{
-			$$ = std::make_shared<EmptyStatement>();
+			$$ = program.make<EmptyStatement>(@$);
 		}
 	| "else" compound-statement
 		{
@@ -215,124 +218,124 @@ logical-or-expression[res]
 	: logical-and-expression { $$ = $1; }
 	| logical-or-expression[lhs] "||" logical-and-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>("||", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::Or, $[lhs], $[rhs]);
 		}
 	;
 logical-and-expression[res]
 	: equality-expression { $$ = $1; }
 	| logical-and-expression[lhs] "&&" equality-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>("&&", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::And, $[lhs], $[rhs]);
 		}
 	;
 equality-expression[res]
 	: relation-expression { $$ = $1; }
 	| relation-expression[lhs] "==" relation-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>("==", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::Equal, $[lhs], $[rhs]);
 		}
 	| relation-expression[lhs] "!=" relation-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>("!=", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::NotEqual, $[lhs], $[rhs]);
 		}
 relation-expression[res]
 	: additive-expression { $$ = $1; }
 	| relation-expression[lhs] "<" additive-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>("<", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::Less, $[lhs], $[rhs]);
 		}
 	| relation-expression[lhs] ">" additive-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>(">", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::Greater, $[lhs], $[rhs]);
 		}
 	| relation-expression[lhs] "<=" additive-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>("<=", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::LessEqual, $[lhs], $[rhs]);
 		}
 	| relation-expression[lhs] ">=" additive-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>(">=", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::GreaterEqual, $[lhs], $[rhs]);
 		}
 	;
 additive-expression[res]
 	: multiplicative-expression { $$ = $1; }
 	| additive-expression[lhs] "+" multiplicative-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>("+", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::Add, $[lhs], $[rhs]);
 		}
 	| additive-expression[lhs] "-" multiplicative-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>("-", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::Subtract, $[lhs], $[rhs]);
 		}
 	;
 multiplicative-expression[res]
 	: power-expression { $$ = $1; }
 	| multiplicative-expression[lhs] "*" power-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>("*", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::Multiply, $[lhs], $[rhs]);
 		}
 	| multiplicative-expression[lhs] "/" power-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>("/", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::Divide, $[lhs], $[rhs]);
 		}
 	| multiplicative-expression[lhs] "%" power-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>("%", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::Modulo, $[lhs], $[rhs]);
 		}
 	;
 power-expression[res]
 	: unary-expression { $$ = $1; }
 	| unary-expression[lhs] "**" power-expression[rhs]
 		{
-			$[res] = std::make_shared<BinaryOperation>("**", $[lhs], $[rhs]);
+			$[res] = program.make<BinaryOperation>(@$, BinaryOperator::Power, $[lhs], $[rhs]);
 		}
 	;
 unary-expression[res]
 	: postfix-expression { $$ = $1; }
 	| "!" unary-expression[rhs]
 		{
-			$[res] = std::make_shared<UnaryOperation>("!", $[rhs]);
+			$[res] = program.make<UnaryOperation>(@$, UnaryOperator::Not, $[rhs]);
 		}
 	| "+" unary-expression[rhs]
 		{
-			$[res] = std::make_shared<UnaryOperation>("+", $[rhs]);
+			$[res] = program.make<UnaryOperation>(@$, UnaryOperator::Plus, $[rhs]);
 		}
 	| "-" unary-expression[rhs]
 		{
-			$[res] = std::make_shared<UnaryOperation>("-", $[rhs]);
+			$[res] = program.make<UnaryOperation>(@$, UnaryOperator::Minus, $[rhs]);
 		}
 	;
 postfix-expression[expr]
 	: primary-expression { $$ = $1; }
 	| postfix-expression[func] "(" optional-arguments[args] ")"
 		{
-			$[expr] = std::make_shared<FunctionCall>($[func], $[args]);
+			$[expr] = program.make<FunctionCall>(@$, $[func], program.array($[args]));
 		}
 	| postfix-expression[var] "[" expression[index] "]"
 		{
-			$[expr] = std::make_shared<ArrayAccess>($[var], $[index]);
+			$[expr] = program.make<ArrayAccess>(@$, $[var], $[index]);
 		}
 	;
 primary-expression[expr]
 	: TOKEN_VARIABLE[id]
 		{
-			$[expr] = std::make_shared<Variable>($[id]);
+			$[expr] = program.make<Variable>(@$, program.name($[id]));
 		}
 	| TOKEN_CONSTANT[id]
 		{
-			$[expr] = std::make_shared<Constant>($[id]);
+			$[expr] = program.make<Constant>(@$, program.name($[id]));
 		}
 	| TOKEN_NUMERIC[value]
 		{
-			$[expr] = std::make_shared<Numeric>($[value]);
+			$[expr] = program.make<Numeric>(@$, $[value]);
 		}
 	| boolean-literal[value]
 		{
-			$[expr] = std::make_shared<Boolean>($[value]);
+			$[expr] = program.make<Boolean>(@$, $[value]);
 		}
 	| "(" expression[x] "," expression[y] ")"
 		{
-			$[expr] = std::make_shared<Vector>($[x], $[y]);
+			$[expr] = program.make<Vector>(@$, $[x], $[y]);
 		}
 	;
 boolean-literal
@@ -342,19 +345,19 @@ boolean-literal
 optional-arguments[arguments]
 	: %empty
 		{
-			$[arguments] = std::make_shared< std::list< std::shared_ptr<Expression> > >();
+			$[arguments] = List<Expression *>();
 		}
 	| arguments { $$ = $1; }
 	;
 arguments
 	: expression[argument]
 		{
-			$[arguments] = std::make_shared< std::list< std::shared_ptr<Expression> > >(std::list< std::shared_ptr<Expression> >{$[argument]});
+			$[arguments].push_back(program.arena(), $[argument]);
 		}
 	| arguments[current] "," expression
 		{
 			$$ = $[current];
-			$$->push_back($[expression]);
+			$$.push_back(program.arena(), $[expression]);
 		}
 	;
 optional-delimiters
@@ -371,5 +374,5 @@ delimiters
 	;
 %%
 void br::Parser::error(location_type const & location, std::string const & message) {
-	parser.error(location, message);
+	parser.error(program.sources(), location, message);
 }
\ No newline at end of file
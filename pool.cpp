@@ -0,0 +1,82 @@
+#include "pool.hpp"
+
+namespace br {
+
+	ThreadPool::ThreadPool(std::size_t workers) : m_job(nullptr), m_generation(0), m_running(0), m_stop(false) {
+		if (workers == 0) {
+			workers = hardware_workers();
+		}
+		for (std::size_t worker = 1; worker < workers; ++worker) {
+			m_threads.emplace_back(&ThreadPool::m_work, this, worker);
+		}
+	}
+
+	ThreadPool::~ThreadPool() noexcept {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_start.notify_all();
+		for (auto & thread : m_threads) {
+			thread.join();
+		}
+	}
+
+	void ThreadPool::run(std::function<void(std::size_t)> const & job) {
+		if (m_threads.empty()) {
+			job(0);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_job = &job;
+			m_error = nullptr;
+			m_running = m_threads.size();
+			++m_generation;
+		}
+		m_start.notify_all();
+		m_call(0);
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this] { return m_running == 0; });
+		m_job = nullptr;
+		if (m_error != nullptr) {
+			std::rethrow_exception(m_error);
+		}
+	}
+
+	auto ThreadPool::hardware_workers() noexcept -> std::size_t {
+		auto count = std::thread::hardware_concurrency();
+		return count == 0 ? 1 : count;
+	}
+
+	void ThreadPool::m_work(std::size_t worker) {
+		std::size_t generation = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_start.wait(lock, [&] { return m_stop || m_generation != generation; });
+				if (m_stop) {
+					return;
+				}
+				generation = m_generation;
+			}
+			m_call(worker);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (--m_running == 0) {
+				m_done.notify_one();
+			}
+		}
+	}
+
+	void ThreadPool::m_call(std::size_t worker) {
+		try {
+			(*m_job)(worker);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_error == nullptr) {
+				m_error = std::current_exception();
+			}
+		}
+	}
+
+} // namespace br
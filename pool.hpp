@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace br {
+
+	/** \brief A fixed set of threads that run one job at a time, all of them together.
+	 **
+	 ** The calling thread takes part as worker 0, so a pool of one worker runs jobs inline and starts no thread.
+	 */
+	class ThreadPool {
+	public:
+		/// \param workers the number of workers, including the calling thread; 0 for one per hardware thread
+		explicit ThreadPool(std::size_t workers = 0);
+
+		ThreadPool(ThreadPool const &) = delete;
+
+		auto operator=(ThreadPool const &) -> ThreadPool & = delete;
+
+		~ThreadPool() noexcept;
+
+		auto size() const noexcept -> std::size_t {
+			return m_threads.size() + 1;
+		}
+
+		/// Call `job(worker)` once for each worker, 0 to size() - 1, and wait for all calls to return.
+		/// The first exception thrown by a call is rethrown here.
+		void run(std::function<void(std::size_t)> const & job);
+
+		/// The number of threads the hardware runs at once, at least 1.
+		static auto hardware_workers() noexcept -> std::size_t;
+
+	private:
+		void m_work(std::size_t worker);
+
+		void m_call(std::size_t worker);
+
+		std::vector<std::thread> m_threads;
+		std::mutex m_mutex;
+		std::condition_variable m_start, m_done;
+		std::function<void(std::size_t)> const * m_job;
+		/// Incremented for each job, so that a worker runs it once.
+		std::size_t m_generation;
+		std::size_t m_running;
+		std::exception_ptr m_error;
+		bool m_stop;
+	}; // class ThreadPool
+
+} // namespace br
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <iomanip>
+#include <utility>
+#include "builtin.hpp"
+#include "profile.hpp"
+
+namespace br {
+
+	namespace {
+
+		/// Longest label kept, in bytes.
+		constexpr std::size_t max_label = 48;
+
+		/// Runs a site until it goes out of scope, however it ends.
+		class Scope {
+		public:
+			Scope(Profiler & profiler, std::uint32_t site) : m_profiler(profiler) {
+				profiler.enter(site);
+			}
+
+			Scope(Scope const &) = delete;
+
+			auto operator=(Scope const &) -> Scope & = delete;
+
+			~Scope() noexcept {
+				m_profiler.leave();
+			}
+
+		private:
+			Profiler & m_profiler;
+		};
+
+		/// A statement timed by a profiler; visitors and printing see the statement itself.
+		class ProfiledStatement : public Statement {
+		public:
+			ProfiledStatement(Statement * statement, Profiler & profiler, std::uint32_t site) noexcept
+				: m_statement(statement), m_profiler(profiler), m_site(site) {
+			}
+
+			virtual ~ProfiledStatement() noexcept {
+			}
+
+			virtual void invoke(Context & context) const override {
+				Scope scope(m_profiler, m_site);
+				m_statement->invoke(context);
+			}
+
+			virtual void print(std::ostream & ostream, std::size_t indent = 0) const override {
+				m_statement->print(ostream, indent);
+			}
+
+			virtual void accept(Visitor & visitor) const override {
+				m_statement->accept(visitor);
+			}
+
+			virtual void rewrite(Rewriter & rewriter) override {
+				m_statement = rewriter.rewrite(m_statement);
+			}
+
+		private:
+			Statement * m_statement;
+			Profiler & m_profiler;
+			std::uint32_t m_site;
+		};
+
+		/// A function call timed by a profiler, which also counts the points drawn by calls of `draw`.
+		class ProfiledCall : public Expression {
+		public:
+			ProfiledCall(Expression * call, bool draws, Profiler & profiler, std::uint32_t site) noexcept
+				: m_call(call), m_draws(draws), m_profiler(profiler), m_site(site) {
+			}
+
+			virtual ~ProfiledCall() noexcept {
+			}
+
+			virtual auto evaluate(Context & context) const -> Value override {
+				Scope scope(m_profiler, m_site);
+				auto value = m_call->evaluate(context);
+				if (m_draws) {
+					m_profiler.drawn();
+				}
+				return value;
+			}
+
+			virtual void print(std::ostream & ostream, std::size_t indent = 0) const override {
+				m_call->print(ostream, indent);
+			}
+
+			virtual void accept(Visitor & visitor) const override {
+				m_call->accept(visitor);
+			}
+
+			virtual void rewrite(Rewriter & rewriter) override {
+				m_call = rewriter.rewrite(m_call);
+			}
+
+		private:
+			Expression * m_call;
+			bool m_draws;
+			Profiler & m_profiler;
+			std::uint32_t m_site;
+		};
+
+		/// Wraps every statement but blocks and every call in a tree, numbering them as sites.
+		class Instrumenting : public Rewriter {
+		public:
+			Instrumenting(Program & program, Profiler & profiler, std::vector<Profiler::Site> & sites) noexcept
+				: m_program(program), m_profiler(profiler), m_sites(sites), m_draw(find_builtin("draw")) {
+			}
+
+			virtual auto rewrite(Expression * node) -> Expression * override {
+				node->rewrite(*this);
+				auto call = dynamic_cast<FunctionCall const *>(node);
+				if (call == nullptr) {
+					return node;
+				}
+				return m_program.make<ProfiledCall>(node->span(), node, draws(*call), m_profiler, site(*node, true, ""));
+			}
+
+			virtual auto rewrite(Statement * node) -> Statement * override {
+				node->rewrite(*this);
+				if (dynamic_cast<CompoundStatement const *>(node) != nullptr || dynamic_cast<EmptyStatement const *>(node) != nullptr) {
+					return node;
+				}
+				// A call made a statement, e.g. `draw(x, y);`, is timed as a call only.
+				auto expression = dynamic_cast<ExpressionStatement const *>(node);
+				if (expression != nullptr && dynamic_cast<ProfiledCall const *>(&expression->expr()) != nullptr) {
+					return node;
+				}
+				// The temporaries of optimize() have the span of the expression they hold.
+				auto assignment = dynamic_cast<AssignStatement const *>(node);
+				auto temporary = assignment != nullptr && assignment->id().compare(0, 1, "$") == 0;
+				return m_program.make<ProfiledStatement>(node->span(), node, m_profiler, site(*node, false, temporary ? assignment->id() + " = " : ""));
+			}
+
+		private:
+			/// Whether \a call calls the built-in `draw`, which draws a point each time it returns.
+			auto draws(FunctionCall const & call) const noexcept -> bool {
+				auto variable = dynamic_cast<Variable const *>(&call.func());
+				return variable != nullptr && variable->symbol() != nullptr
+					&& variable->symbol()->slot == no_slot && variable->symbol()->builtin == m_draw;
+			}
+
+			/// Number a new site for \a node, whose label will start with \a prefix.
+			auto site(Node const & node, bool call, std::string const & prefix) -> std::uint32_t {
+				m_sites.push_back(Profiler::Site{node.span(), prefix, 0, call, 0, 0, 0, 0});
+				return static_cast<std::uint32_t>(m_sites.size() - 1);
+			}
+
+			Program & m_program;
+			Profiler & m_profiler;
+			std::vector<Profiler::Site> & m_sites;
+			Builtin const * m_draw;
+		};
+
+		/// The first line of \a span in \a source with its blanks collapsed, without a final `;` and other `;` made `,` for collapse().
+		auto label(std::string const & source, Span span) -> std::string {
+			std::string label;
+			for (auto offset = span.begin; offset < span.end && offset < source.size(); ++offset) {
+				auto c = source[offset];
+				if (c == '\n' || c == '\r') {
+					break;
+				}
+				if (c == ' ' || c == '\t') {
+					if (!label.empty() && label.back() != ' ') {
+						label.push_back(' ');
+					}
+				} else {
+					label.push_back(c == ';' ? ',' : c);
+				}
+			}
+			while (!label.empty() && (label.back() == ' ' || label.back() == ',')) {
+				label.pop_back();
+			}
+			if (label.size() > max_label) {
+				label.resize(max_label - 3);
+				label += "...";
+			}
+			return label;
+		}
+
+		auto milliseconds(std::uint64_t nanoseconds) -> double {
+			return static_cast<double>(nanoseconds) / 1e6;
+		}
+
+	} // namespace
+
+	Profiler::Profiler(Program & program, std::string source)
+		: m_source(std::move(source)), m_frames{Frame{0, 0, 0}}, m_total(0), m_points(0) {
+		Instrumenting instrumenting(program, *this, m_sites);
+		program.rewrite(instrumenting);
+		m_recent.assign(m_sites.size(), 0);
+
+		auto const & sources = program.sources();
+		auto known = program.file() < sources.files();
+		if (known) {
+			m_filename = *sources.resolve(Position(program.file())).filename;
+		}
+		for (auto & site : m_sites) {
+			site.line = known ? sources.resolve(program.location(site.span).begin).line : 0;
+			auto text = label(m_source, site.span);
+			site.label += text.empty() ? (site.call ? "call" : "statement") : text;
+		}
+	}
+
+	void Profiler::enter(std::uint32_t site) {
+		auto frame = m_frame(m_runs.empty() ? 0 : m_runs.back().frame, site);
+		m_runs.push_back(Run{frame, std::chrono::steady_clock::time_point(), 0, 0});
+		// Last, so that finding the frame is not counted.
+		m_runs.back().start = std::chrono::steady_clock::now();
+	}
+
+	void Profiler::drawn() noexcept {
+		if (!m_runs.empty()) {
+			++m_runs.back().points;
+		}
+	}
+
+	void Profiler::leave() noexcept {
+		auto end = std::chrono::steady_clock::now();
+		auto run = m_runs.back();
+		m_runs.pop_back();
+
+		auto inclusive = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - run.start).count());
+		auto exclusive = inclusive - std::min(run.children, inclusive);
+		auto & frame = m_frames[run.frame];
+		frame.exclusive += exclusive;
+		auto & site = m_sites[frame.site];
+		++site.count;
+		site.inclusive += inclusive;
+		site.exclusive += exclusive;
+		site.points += run.points;
+
+		if (m_runs.empty()) {
+			m_total += inclusive;
+			m_points += run.points;
+		} else {
+			m_runs.back().children += inclusive;
+			m_runs.back().points += run.points;
+		}
+	}
+
+	void Profiler::collapse(std::ostream & ostream) const {
+		std::vector<std::string> names;
+		for (auto const & site : m_sites) {
+			names.push_back(site.label + " (" + (m_filename.empty() ? std::string("line") : m_filename + ':') + std::to_string(site.line) + ')');
+		}
+		std::vector<std::uint32_t> stack;
+		for (std::uint32_t i = 1; i < m_frames.size(); ++i) {
+			if (m_frames[i].exclusive == 0) {
+				continue;
+			}
+			stack.clear();
+			for (auto frame = i; frame != 0; frame = m_frames[frame].parent) {
+				stack.push_back(m_frames[frame].site);
+			}
+			for (auto site = stack.rbegin(); site != stack.rend(); ++site) {
+				ostream << (site == stack.rbegin() ? "" : ";") << names[*site];
+			}
+			ostream << ' ' << m_frames[i].exclusive << '\n';
+		}
+		ostream.flush();
+	}
+
+	void Profiler::annotate(std::ostream & ostream) const {
+		std::vector<std::string> lines;
+		std::size_t begin = 0;
+		while (begin < m_source.size()) {
+			auto end = m_source.find('\n', begin);
+			end = end == std::string::npos ? m_source.size() : end;
+			lines.push_back(m_source.substr(begin, end - begin));
+			begin = end + 1;
+		}
+
+		// By line, the outermost site starting on it and the time spent in all of them.
+		std::vector<Site const *> outermost(lines.size() + 1, nullptr);
+		std::vector<std::uint64_t> exclusive(lines.size() + 1, 0);
+		for (auto const & site : m_sites) {
+			if (site.line == 0) {
+				continue;
+			}
+			if (site.line >= outermost.size()) {
+				outermost.resize(site.line + 1, nullptr);
+				exclusive.resize(site.line + 1, 0);
+				lines.resize(site.line);
+			}
+			auto & outer = outermost[site.line];
+			if (outer == nullptr || site.span.end - site.span.begin > outer->span.end - outer->span.begin) {
+				outer = &site;
+			}
+			exclusive[site.line] += site.exclusive;
+		}
+
+		auto flags = ostream.flags();
+		auto precision = ostream.precision();
+		ostream << "# " << (m_filename.empty() ? std::string("program") : m_filename) << ": "
+			<< std::fixed << std::setprecision(3) << milliseconds(m_total) << " ms, " << m_points << " point(s) drawn" << std::endl;
+		ostream << "#" << std::setw(11) << "runs" << std::setw(12) << "total ms" << std::setw(12) << "self ms" << std::setw(11) << "points" << std::endl;
+		for (std::size_t line = 1; line < outermost.size(); ++line) {
+			auto site = outermost[line];
+			if (site == nullptr) {
+				ostream << std::string(47, ' ');
+			} else {
+				ostream << std::setw(12) << site->count << std::setw(12) << milliseconds(site->inclusive)
+					<< std::setw(12) << milliseconds(exclusive[line]) << std::setw(11) << site->points;
+			}
+			ostream << " | " << lines[line - 1] << '\n';
+		}
+		ostream.flush();
+		ostream.flags(flags);
+		ostream.precision(precision);
+	}
+
+	auto Profiler::m_frame(std::uint32_t parent, std::uint32_t site) -> std::uint32_t {
+		auto & recent = m_recent[site];
+		if (recent != 0 && m_frames[recent].parent == parent) {
+			return recent;
+		}
+		auto key = static_cast<std::uint64_t>(parent) << 32 | site;
+		auto found = m_children.find(key);
+		if (found != m_children.end()) {
+			recent = found->second;
+			return recent;
+		}
+		recent = static_cast<std::uint32_t>(m_frames.size());
+		m_frames.push_back(Frame{site, parent, 0});
+		m_children.emplace(key, recent);
+		return recent;
+	}
+
+} // namespace br
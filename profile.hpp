@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.hpp"
+
+namespace br {
+
+	/** \brief Where a program spends its time, statement by statement and call by call.
+	 **
+	 ** The profiler puts a node around each statement and function call of the program that times it
+	 ** on the way in and out; a program that is not profiled is left as it was, and runs as fast. Each
+	 ** site accumulates how often it ran, the time spent in it with and without the sites it ran, and
+	 ** the points drawn by calls of `draw` in it. Times are also kept by stack of sites, for flame graphs.
+	 ** The wrappers are tree nodes, so the program must run on the tree engine.
+	 */
+	class Profiler {
+	public:
+		/// A statement or function call of the program.
+		struct Site {
+			Span span;
+			/// The first line of its source, or what it is if the source is unknown.
+			std::string label;
+			/// Line of the source it starts on, from 1.
+			std::uint32_t line;
+			bool call;
+			/// Runs.
+			std::uint64_t count;
+			/// Nanoseconds spent in it, and in it but not in the sites it ran.
+			std::uint64_t inclusive, exclusive;
+			/// Points drawn in it, including by the sites it ran.
+			std::uint64_t points;
+		};
+
+		/** \brief Instrument \a program, which must be bound, to profile its runs.
+		 **
+		 ** \param source the text \a program was parsed from, to label the sites and annotate; may be empty
+		 */
+		Profiler(Program & program, std::string source);
+
+		Profiler(Profiler const &) = delete;
+
+		auto operator=(Profiler const &) -> Profiler & = delete;
+
+		/// Start a run of \a site, within the run of the site last entered and not left.
+		void enter(std::uint32_t site);
+
+		/// Count a point drawn by the site last entered.
+		void drawn() noexcept;
+
+		/// End the run of the site last entered.
+		void leave() noexcept;
+
+		auto sites() const noexcept -> std::vector<Site> const & {
+			return m_sites;
+		}
+
+		/// Write the nanoseconds spent in each stack of sites as flame graph tools take them: `site;site;... count`.
+		void collapse(std::ostream & ostream) const;
+
+		/// Write the source, each line preceded by the runs, time and points of the outermost site starting on it.
+		void annotate(std::ostream & ostream) const;
+
+	private:
+		/// A node of the tree of stacks: a site as run from its parent.
+		struct Frame {
+			std::uint32_t site;
+			std::uint32_t parent;
+			std::uint64_t exclusive;
+		};
+
+		/// A run in progress.
+		struct Run {
+			std::uint32_t frame;
+			std::chrono::steady_clock::time_point start;
+			std::uint64_t children;
+			std::uint64_t points;
+		};
+
+		/// The frame below \a parent for \a site, made if needed.
+		auto m_frame(std::uint32_t parent, std::uint32_t site) -> std::uint32_t;
+
+		std::string m_source;
+		std::string m_filename;
+		std::vector<Site> m_sites;
+		/// Frame 0 is the root, of no site.
+		std::vector<Frame> m_frames;
+		/// Frames by parent in the high half and site in the low half.
+		std::unordered_map<std::uint64_t, std::uint32_t> m_children;
+		/// By site, the frame it last ran in; most runs are from the same parent as the one before.
+		std::vector<std::uint32_t> m_recent;
+		std::vector<Run> m_runs;
+		/// Nanoseconds and points of the runs of top-level sites.
+		std::uint64_t m_total, m_points;
+	}; // class Profiler
+
+} // namespace br
@@ -0,0 +1,117 @@
+#include "random.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace br {
+
+	namespace {
+
+		constexpr std::uint32_t multipliers[2] = {0xD2511F53, 0xCD9E8D57};
+
+		/// Added to the key halves after each round, from the golden ratio and sqrt(3) - 1.
+		constexpr std::uint32_t weyl[2] = {0x9E3779B9, 0xBB67AE85};
+
+		constexpr int rounds = 10;
+
+		/// Scale the 27 and 26 high bits of two words to a multiple of 2^-53, as genrand_res53() does.
+		auto to_double(std::uint32_t high, std::uint32_t low) noexcept -> double {
+			return (static_cast<double>(high >> 5) * 67108864.0 + static_cast<double>(low >> 6)) * (1.0 / 9007199254740992.0);
+		}
+
+#if defined(__SSE2__)
+
+		/// The high and low halves of the products of the four lanes of \a lhs by \a rhs.
+		void multiply(__m128i lhs, __m128i rhs, __m128i & high, __m128i & low) noexcept {
+			auto even = _mm_mul_epu32(lhs, rhs);
+			auto odd = _mm_mul_epu32(_mm_srli_epi64(lhs, 32), rhs);
+			auto first = _mm_unpacklo_epi32(even, odd);
+			auto second = _mm_unpackhi_epi32(even, odd);
+			low = _mm_unpacklo_epi64(first, second);
+			high = _mm_unpackhi_epi64(first, second);
+		}
+
+		/// philox() for the four counters in the lanes of \a c0 (low words) and \a c1 (high words).
+		void philox(std::uint64_t key, __m128i & c0, __m128i & c1, __m128i & c2, __m128i & c3) noexcept {
+			auto k0 = static_cast<std::uint32_t>(key), k1 = static_cast<std::uint32_t>(key >> 32);
+			auto m0 = _mm_set1_epi32(static_cast<int>(multipliers[0]));
+			auto m1 = _mm_set1_epi32(static_cast<int>(multipliers[1]));
+			c2 = c3 = _mm_setzero_si128();
+			for (int round = 0; round < rounds; ++round) {
+				__m128i high0, low0, high1, low1;
+				multiply(c0, m0, high0, low0);
+				multiply(c2, m1, high1, low1);
+				auto next0 = _mm_xor_si128(_mm_xor_si128(high1, c1), _mm_set1_epi32(static_cast<int>(k0)));
+				auto next2 = _mm_xor_si128(_mm_xor_si128(high0, c3), _mm_set1_epi32(static_cast<int>(k1)));
+				c0 = next0;
+				c1 = low1;
+				c2 = next2;
+				c3 = low0;
+				k0 += weyl[0];
+				k1 += weyl[1];
+			}
+		}
+
+#endif
+
+	} // namespace
+
+	auto philox(std::uint64_t key, std::uint64_t counter) noexcept -> std::array<std::uint32_t, 4> {
+		std::uint32_t k0 = static_cast<std::uint32_t>(key), k1 = static_cast<std::uint32_t>(key >> 32);
+		std::array<std::uint32_t, 4> c = {{static_cast<std::uint32_t>(counter), static_cast<std::uint32_t>(counter >> 32), 0, 0}};
+		for (int round = 0; round < rounds; ++round) {
+			auto p0 = static_cast<std::uint64_t>(multipliers[0]) * c[0];
+			auto p1 = static_cast<std::uint64_t>(multipliers[1]) * c[2];
+			c = {{
+				static_cast<std::uint32_t>(p1 >> 32) ^ c[1] ^ k0,
+				static_cast<std::uint32_t>(p1),
+				static_cast<std::uint32_t>(p0 >> 32) ^ c[3] ^ k1,
+				static_cast<std::uint32_t>(p0),
+			}};
+			k0 += weyl[0];
+			k1 += weyl[1];
+		}
+		return c;
+	}
+
+	auto uniform(std::uint64_t seed, std::uint64_t counter) noexcept -> double {
+		auto block = philox(seed, counter);
+		return to_double(block[0], block[1]);
+	}
+
+	void uniform(double * out, std::uint64_t seed, std::uint64_t first, std::uint64_t stride, std::size_t count) noexcept {
+		std::size_t i = 0;
+#if defined(__SSE2__)
+		for (; i + 4 <= count; i += 4) {
+			std::uint64_t counters[4];
+			for (std::size_t lane = 0; lane < 4; ++lane) {
+				counters[lane] = first + (i + lane) * stride;
+			}
+			auto c0 = _mm_set_epi32(
+				static_cast<int>(counters[3]), static_cast<int>(counters[2]),
+				static_cast<int>(counters[1]), static_cast<int>(counters[0])
+			);
+			auto c1 = _mm_set_epi32(
+				static_cast<int>(counters[3] >> 32), static_cast<int>(counters[2] >> 32),
+				static_cast<int>(counters[1] >> 32), static_cast<int>(counters[0] >> 32)
+			);
+			__m128i c2, c3;
+			philox(seed, c0, c1, c2, c3);
+			// The 27 and 26 bits fit in a signed lane, so the conversion is exact.
+			auto high = _mm_srli_epi32(c0, 5), low = _mm_srli_epi32(c1, 6);
+			auto scale = _mm_set1_pd(67108864.0), unit = _mm_set1_pd(1.0 / 9007199254740992.0);
+			for (std::size_t half = 0; half < 2; ++half) {
+				auto value = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(high), scale), _mm_cvtepi32_pd(low)), unit);
+				_mm_storeu_pd(out + i + 2 * half, value);
+				high = _mm_srli_si128(high, 8);
+				low = _mm_srli_si128(low, 8);
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			out[i] = uniform(seed, first + i * stride);
+		}
+	}
+
+} // namespace br
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace br {
+
+	/** \brief The Philox4x32-10 counter-based generator: a keyed bijection of 128-bit blocks.
+	 **
+	 ** Unlike a sequential generator there is no state to share; any number can be computed from its
+	 ** position alone, so threads and vectorised loops produce the same stream as a serial run.
+	 ** \param key the seed
+	 ** \param counter the position in the stream
+	 */
+	auto philox(std::uint64_t key, std::uint64_t counter) noexcept -> std::array<std::uint32_t, 4>;
+
+	/// The uniform number in [0, 1), a multiple of 2^-53, at position \a counter of the stream of \a seed.
+	auto uniform(std::uint64_t seed, std::uint64_t counter) noexcept -> double;
+
+	/// `out[i] = uniform(seed, first + i * stride)`, four at a time with SSE2 where available.
+	void uniform(double * out, std::uint64_t seed, std::uint64_t first, std::uint64_t stride, std::size_t count) noexcept;
+
+} // namespace br
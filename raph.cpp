@@ -1,54 +1,255 @@
 #include <cerrno>
 #include <cstdio>
-#include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include "cache.hpp"
 #include "raph.hpp"
 #include "gen/parser.hpp"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define RAPH_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define RAPH_MMAP 0
+#endif
+
 namespace br {
 
-	RaphParser::RaphParser(std::string const & filename, bool trace_scanning, bool trace_parsing) : m_filename(filename), m_trace_scanning(trace_scanning), m_trace_parsing(trace_parsing) {
+	namespace {
+
+#if RAPH_MMAP
+
+		/** \brief A private, writable mapping of a file followed by padding zero bytes.
+		 **
+		 ** Pages are only copied if the scanner writes to them. The mapping is laid over anonymous memory
+		 ** one page longer than needed, so the padding exists even when the file ends at a page boundary.
+		 */
+		class Mapping {
+		public:
+			Mapping() : m_memory(nullptr), m_size(0) {
+			}
+
+			Mapping(Mapping const &) = delete;
+
+			auto operator=(Mapping const &) -> Mapping & = delete;
+
+			~Mapping() noexcept {
+				if (m_memory != nullptr) {
+					munmap(m_memory, m_size);
+				}
+			}
+
+			/// \return 0, or the errno of the failure
+			auto map(int file, std::size_t length) -> int {
+				auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+				m_size = (length + RaphParser::padding + page - 1) / page * page;
+				auto memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (memory == MAP_FAILED) {
+					return errno;
+				}
+				m_memory = memory;
+				if (mmap(memory, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, file, 0) == MAP_FAILED) {
+					return errno;
+				}
+				return 0;
+			}
+
+			auto data() const noexcept -> char * {
+				return static_cast<char *>(m_memory);
+			}
+
+		private:
+			void * m_memory;
+			std::size_t m_size;
+		};
+
+#endif
+
+	} // namespace
+
+	constexpr std::size_t RaphParser::padding;
+
+	RaphParser::RaphParser(std::string const & filename, bool trace_scanning, bool trace_parsing) : RaphParser(filename, std::cerr, trace_scanning, trace_parsing) {
+	}
+
+	RaphParser::RaphParser(std::string const & filename, std::ostream & diagnostics, bool trace_scanning, bool trace_parsing)
+			: m_filename(filename), m_diagnostics(diagnostics), m_errors(0), m_bytes(0), m_caching(false), m_trace_scanning(trace_scanning), m_trace_parsing(trace_parsing) {
 	}
 
 	RaphParser::~RaphParser() {
 	}
 
-	std::shared_ptr<Program> RaphParser::parse() const {
-		YYScan scanner;
-		yylex_init(&scanner);
-		yyset_debug(m_trace_scanning, scanner);
-		auto closer = [](FILE * file) {
-			if (file != stdin) {
-				std::fclose(file);
-			}
-		};
-		std::unique_ptr< FILE, decltype(closer) > file(stdin, closer);
-		if (!filename().empty() && filename() != "-") {
-			file.reset(std::fopen(filename().c_str(), "r"));
-			if (file == nullptr) {
-				this->error("cannot open " + filename() + ": " + strerror(errno));
-				std::exit(EXIT_FAILURE);
+	std::unique_ptr<Program> RaphParser::parse() const {
+		if (filename().empty() || filename() == "-") {
+			m_bytes = 0;
+			YYScan scanner;
+			yylex_init(&scanner);
+			yyset_in(stdin, scanner);
+			auto program = m_parse(scanner);
+			yylex_destroy(scanner);
+			return program;
+		}
+
+#if RAPH_MMAP
+		auto file = open(filename().c_str(), O_RDONLY);
+		if (file < 0) {
+			this->error("cannot open " + filename() + ": " + std::strerror(errno));
+			return nullptr;
+		}
+		struct stat status;
+		auto failure = fstat(file, &status) != 0 ? errno : 0;
+		// Pipes and other special files cannot be mapped, and an empty file has nothing to map.
+		if (failure == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+			auto length = static_cast<std::size_t>(status.st_size);
+			Mapping mapping;
+			failure = mapping.map(file, length);
+			close(file);
+			if (failure != 0) {
+				this->error("cannot map " + filename() + ": " + std::strerror(failure));
+				return nullptr;
 			}
+			return parse(mapping.data(), length + padding);
+		}
+		close(file);
+		if (failure != 0) {
+			this->error("cannot read " + filename() + ": " + std::strerror(failure));
+			return nullptr;
 		}
-		yyset_in(file.get(), scanner);
+#endif
 
-		std::shared_ptr<br::Program> program;
+		std::ifstream stream(filename(), std::ios::binary);
+		if (!stream) {
+			this->error("cannot open " + filename() + ": " + std::strerror(errno));
+			return nullptr;
+		}
+		std::string source((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+		if (stream.bad()) {
+			this->error("cannot read " + filename());
+			return nullptr;
+		}
+		return parse(std::move(source));
+	}
 
-		Parser parser(scanner, *this, program);
-		parser.set_debug_level(m_trace_parsing);
-		parser.parse();
+	std::unique_ptr<Program> RaphParser::parse(std::string source) const {
+		auto length = source.size();
+		source.append(padding, '\0');
+		return parse(&source[0], length + padding);
+	}
+
+	std::unique_ptr<Program> RaphParser::parse(char * buffer, std::size_t size) const {
+		m_bytes = size < padding ? 0 : size - padding;
+		// The key is taken before scanning, which writes to the buffer.
+		std::uint64_t key = 0;
+		std::string entry;
+		auto named = !filename().empty() && filename() != "-";
+		if (m_caching && (named || !m_cache_directory.empty()) && !m_trace_scanning && !m_trace_parsing) {
+			key = cache_key(buffer, m_bytes);
+			entry = cache_path(m_cache_directory, filename(), key);
+			auto program = load_program(entry, key, m_bytes, filename());
+			if (program != nullptr) {
+				return program;
+			}
+		}
 
+		YYScan scanner;
+		yylex_init(&scanner);
+		auto state = yy_scan_buffer(buffer, size, scanner);
+		if (state == nullptr) {
+			yylex_destroy(scanner);
+			this->error("invalid input buffer for " + filename());
+			return nullptr;
+		}
+		auto errors = m_errors;
+		auto program = m_parse(scanner);
+		yy_delete_buffer(state, scanner);
 		yylex_destroy(scanner);
+		// Only programs without errors are kept, so that a cached program reports none.
+		if (program != nullptr && !entry.empty() && m_errors == errors) {
+			save_program(*program, key, m_bytes, entry);
+		}
 		return program;
 	}
 
-	void RaphParser::error(Location const & location, std::string const & message) const {
-		std::cerr << "[Raph] " << location << ": " << message << std::endl;
+	bool RaphParser::parse(char * buffer, std::size_t size, Program & program, Array<Statement *> & statements) const {
+		YYScan scanner;
+		yylex_init(&scanner);
+		auto state = yy_scan_buffer(buffer, size, scanner);
+		if (state == nullptr) {
+			yylex_destroy(scanner);
+			this->error("invalid input buffer for " + filename());
+			return false;
+		}
+		auto errors = m_errors;
+		auto stmts = program.stmts();
+		auto lines = program.sources().lines(program.file());
+		auto parsed = m_parse(scanner, program) && m_errors == errors;
+		yy_delete_buffer(state, scanner);
+		yylex_destroy(scanner);
+		statements = program.stmts();
+		program.stmts(stmts);
+		program.sources().lines(program.file(), std::move(lines));
+		return parsed;
+	}
+
+	auto RaphParser::scan(char * buffer, std::size_t size, Program & program) const -> std::size_t {
+		YYScan scanner;
+		yylex_init(&scanner);
+		auto state = yy_scan_buffer(buffer, size, scanner);
+		if (state == nullptr) {
+			yylex_destroy(scanner);
+			this->error("invalid input buffer for " + filename());
+			return 0;
+		}
+		Parser::semantic_type value;
+		Location location(Position(program.file()));
+		std::size_t tokens = 0;
+		for (;;) {
+			auto token = yylex(&value, &location, scanner, *this, program);
+			if (token == Parser::token::END_OF_FILE) {
+				break;
+			}
+			if (token == Parser::token::TOKEN_VARIABLE || token == Parser::token::TOKEN_CONSTANT) {
+				value.destroy<std::string>();
+			} else if (token == Parser::token::TOKEN_NUMERIC) {
+				value.destroy<double>();
+			}
+			++tokens;
+		}
+		yy_delete_buffer(state, scanner);
+		yylex_destroy(scanner);
+		return tokens;
+	}
+
+	void RaphParser::error(SourceMap const & sources, Location const & location, std::string const & message) const {
+		++m_errors;
+		m_diagnostics << "[Raph] ";
+		sources.print(m_diagnostics, location);
+		m_diagnostics << ": " << message << std::endl;
 	}
 
 	void RaphParser::error(std::string const & message) const {
-		std::cerr << "[Raph] " << message << std::endl;
+		++m_errors;
+		m_diagnostics << "[Raph] " << message << std::endl;
+	}
+
+	std::unique_ptr<Program> RaphParser::m_parse(void * scanner) const {
+		std::unique_ptr<Program> program(new Program());
+		if (!m_parse(scanner, *program)) {
+			program.reset();
+		}
+		return program;
+	}
+
+	bool RaphParser::m_parse(void * scanner, Program & program) const {
+		yyset_debug(m_trace_scanning, scanner);
+		Parser parser(scanner, *this, program);
+		parser.set_debug_level(m_trace_parsing);
+		return parser.parse() == 0;
 	}
 
-} // namespace br
\ No newline at end of file
+} // namespace br
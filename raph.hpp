@@ -1,7 +1,9 @@
 #pragma once
 
-#include <string>
+#include <cstddef>
 #include <memory>
+#include <ostream>
+#include <string>
 #include "ast.hpp"
 #include "location.hpp"
 
@@ -9,23 +11,97 @@ namespace br {
 
 	class RaphParser {
 	public:
+		/// Bytes flex requires after the source in parse(char *, std::size_t), all '\0'.
+		static constexpr std::size_t padding = 2;
+
 		RaphParser(std::string const & filename, bool trace_scanning = false, bool trace_parsing = false);
 
+		/// \param diagnostics where error() writes, instead of the standard error
+		RaphParser(std::string const & filename, std::ostream & diagnostics, bool trace_scanning = false, bool trace_parsing = false);
+
 		virtual ~RaphParser();
 
 		auto filename() const -> std::string const & {
 			return m_filename;
 		}
 
-		std::shared_ptr<Program> parse() const;
+		/** \brief Parse the file given to the constructor, or the standard input if its name is empty or "-".
+		 **
+		 ** A regular file is mapped into memory and scanned in place rather than read through stdio.
+		 ** \return the syntax tree, or nullptr if the input could not be read or parsed
+		 */
+		std::unique_ptr<Program> parse() const;
+
+		/// Parse \a source, scanning it in place; messages still refer to filename().
+		std::unique_ptr<Program> parse(std::string source) const;
+
+		/** \brief Parse the \a size bytes at \a buffer in place, without copying them.
+		 **
+		 ** As flex requires, the last padding bytes must be '\0' and are not part of the source; the scanner
+		 ** writes to the other bytes while it runs.
+		 */
+		std::unique_ptr<Program> parse(char * buffer, std::size_t size) const;
 
-		void error(Location const & location, std::string const & message) const;
+		/** \brief Parse the statements in \a size bytes at \a buffer, as the previous overload does, into
+		 **        \a program, a program parsed before, rather than into a new one.
+		 **
+		 ** The nodes are made in the program's arena and their names pooled with its own, but its statements
+		 ** and source map are left as they were. The spans of the new nodes are offsets from \a buffer, so
+		 ** messages about them are misplaced: parse the whole source to report errors.
+		 ** \return false if there was an error
+		 */
+		bool parse(char * buffer, std::size_t size, Program & program, Array<Statement *> & statements) const;
+
+		/** \brief Scan the \a size bytes at \a buffer, laid out as for parse(char *, std::size_t), without parsing.
+		 **
+		 ** Lines are recorded in the source map of \a program, whose file must be set, as parsing would.
+		 ** \return the number of tokens
+		 */
+		auto scan(char * buffer, std::size_t size, Program & program) const -> std::size_t;
+
+		/// Report \a message at \a location, a location in one of \a sources.
+		void error(SourceMap const & sources, Location const & location, std::string const & message) const;
 
 		void error(std::string const & message) const;
 
+		/** \brief Keep the programs parsed from files in a cache, and take them from there instead of parsing
+		 **        while their source is unchanged.
+		 **
+		 ** \param directory an existing directory for the entries; if empty, each entry is kept next to its script
+		 */
+		void cache(bool enabled, std::string const & directory = std::string()) {
+			m_caching = enabled;
+			m_cache_directory = directory;
+		}
+
+		/// The number of messages error() has written.
+		auto errors() const noexcept -> std::size_t {
+			return m_errors;
+		}
+
+		/// The size of the source read by the last parse.
+		auto bytes() const noexcept -> std::size_t {
+			return m_bytes;
+		}
+
 	private:
+		/// Run the parser on a scanner whose input has been set.
+		std::unique_ptr<Program> m_parse(void * scanner) const;
+
+		bool m_parse(void * scanner, Program & program) const;
+
 		std::string m_filename;
 
+		std::ostream & m_diagnostics;
+
+		mutable std::size_t m_errors;
+
+		mutable std::size_t m_bytes;
+
+		bool m_caching;
+
+		std::string m_cache_directory;
+
 		bool m_trace_scanning;
 
 		bool m_trace_parsing;
@@ -0,0 +1,261 @@
+#include <sstream>
+#include <vector>
+#include "reparse.hpp"
+
+namespace br {
+
+	namespace {
+
+		constexpr auto none = std::string::npos;
+
+		/// Adds delta to every offset of a span at or after from.
+		class Shift : public Rewriter {
+		public:
+			Shift(std::size_t from, std::ptrdiff_t delta) noexcept : m_from(from), m_delta(delta) {
+			}
+
+			virtual auto rewrite(Expression * node) -> Expression * override {
+				node->rewrite(*this);
+				move(*node);
+				return node;
+			}
+
+			virtual auto rewrite(Statement * node) -> Statement * override {
+				node->rewrite(*this);
+				move(*node);
+				return node;
+			}
+
+		private:
+			void move(Node & node) const noexcept {
+				auto span = node.span();
+				span.begin = moved(span.begin);
+				span.end = moved(span.end);
+				node.span(span);
+			}
+
+			auto moved(std::uint32_t offset) const noexcept -> std::uint32_t {
+				return offset < m_from ? offset : static_cast<std::uint32_t>(static_cast<std::ptrdiff_t>(offset) + m_delta);
+			}
+
+			std::size_t m_from;
+			std::ptrdiff_t m_delta;
+		};
+
+		auto blank(char c) noexcept -> bool {
+			return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+		}
+
+		/// Where the delimiter after a statement ending at \a at is, past blanks and a comment; none if what follows is not one.
+		auto delimiter_after(std::string const & source, std::size_t at) noexcept -> std::size_t {
+			while (at < source.size()) {
+				auto c = source[at];
+				if (blank(c)) {
+					++at;
+				} else if (c == '#' || (at + 1 < source.size() && (c == '-' || c == '/') && source[at + 1] == c)) {
+					at = source.find('\n', at);
+				} else {
+					return c == '\n' || c == ';' ? at : none;
+				}
+			}
+			return none;
+		}
+
+		/// Where the line break before a statement starting at \a at is, past blanks; none if there is none.
+		auto break_before(std::string const & source, std::size_t at) noexcept -> std::size_t {
+			while (at > 0 && blank(source[at - 1])) {
+				--at;
+			}
+			return at > 0 && source[at - 1] == '\n' ? at - 1 : none;
+		}
+
+		/// The bodies of a block statement, in which statements could be parsed again on their own.
+		auto bodies(Statement const * stmt) -> std::vector<CompoundStatement const *> {
+			std::vector<Statement const *> candidates = {stmt};
+			auto conditional = dynamic_cast<ConditionalStatement const *>(stmt);
+			if (conditional != nullptr) {
+				candidates = {&conditional->when_true(), &conditional->when_false()};
+			}
+			auto loop = dynamic_cast<WhileStatement const *>(stmt);
+			if (loop != nullptr) {
+				candidates = {&loop->body()};
+			}
+			auto until = dynamic_cast<UntilStatement const *>(stmt);
+			if (until != nullptr) {
+				candidates = {&until->body()};
+			}
+			auto range = dynamic_cast<ForStatement const *>(stmt);
+			if (range != nullptr) {
+				candidates = {&range->body()};
+			}
+			std::vector<CompoundStatement const *> bodies;
+			for (auto candidate : candidates) {
+				auto compound = dynamic_cast<CompoundStatement const *>(candidate);
+				if (compound != nullptr) {
+					bodies.push_back(compound);
+				}
+			}
+			return bodies;
+		}
+
+		auto line_starts(std::string const & source) -> std::vector<std::uint32_t> {
+			std::vector<std::uint32_t> lines = {0};
+			for (auto at = source.find('\n'); at != none; at = source.find('\n', at + 1)) {
+				lines.push_back(static_cast<std::uint32_t>(at + 1));
+			}
+			return lines;
+		}
+
+	} // namespace
+
+	/// The statements first to last, exclusive, of a list, to be parsed again from the bytes begin to end of the last source.
+	struct Reparser::Cut {
+		/// The program or the CompoundStatement whose list it is.
+		Statement * owner;
+		std::size_t first, last;
+		std::size_t begin, end;
+	};
+
+	Reparser::Reparser(RaphParser const & parser) : m_parser(parser), m_baseline(0), m_scanned(0) {
+	}
+
+	Reparser::~Reparser() noexcept {
+	}
+
+	auto Reparser::parse(std::string source) -> Program * {
+		if (m_program == nullptr || m_program->arena().used() > 2 * m_baseline) {
+			return m_full(std::move(source));
+		}
+		if (source == m_source) {
+			m_scanned = 0;
+			return m_program.get();
+		}
+
+		// The bytes begin to end of the last source became begin to end + delta.
+		std::size_t begin = 0;
+		auto common = std::min(source.size(), m_source.size());
+		while (begin < common && source[begin] == m_source[begin]) {
+			++begin;
+		}
+		std::size_t suffix = 0;
+		while (suffix < common - begin && source[source.size() - 1 - suffix] == m_source[m_source.size() - 1 - suffix]) {
+			++suffix;
+		}
+
+		Cut cut;
+		if (!m_cut(m_program->stmts(), m_program.get(), begin, m_source.size() - suffix, cut) || !m_splice(source, cut)) {
+			return m_full(std::move(source));
+		}
+		m_program->sources().lines(m_program->file(), line_starts(source));
+		m_source = std::move(source);
+		return m_program.get();
+	}
+
+	auto Reparser::m_cut(Array<Statement *> const & stmts, Statement * owner, std::size_t begin, std::size_t end, Cut & cut) const -> bool {
+		auto const & source = m_source;
+		auto top = owner == m_program.get();
+		auto count = stmts.size();
+		if (!top && count == 0) {
+			return false;
+		}
+
+		// Statements whose delimiter is before the change are kept, and so are those after a line break after it.
+		// Only a line break ends the part parsed again: a change before a `;` could make it part of a comment.
+		std::size_t first = 0;
+		while (first < count) {
+			auto tail = delimiter_after(source, stmts[first]->span().end);
+			if (tail == none || tail >= begin) {
+				break;
+			}
+			++first;
+		}
+		auto last = first;
+		while (last < count) {
+			auto lead = break_before(source, stmts[last]->span().begin);
+			if (lead != none && lead >= end) {
+				break;
+			}
+			++last;
+		}
+
+		// A change within one block is looked for in its bodies first.
+		if (last == first + 1) {
+			for (auto body : bodies(stmts[first])) {
+				if (m_cut(body->stmts(), const_cast<CompoundStatement *>(body), begin, end, cut)) {
+					return true;
+				}
+			}
+		}
+
+		cut = Cut{owner, first, last, 0, source.size()};
+		if (first > 0) {
+			cut.begin = delimiter_after(source, stmts[first - 1]->span().end) + 1;
+		} else if (!top) {
+			// From the line break before the first statement, if that is in the body; otherwise the new first
+			// statement could move where the body starts.
+			auto lead = break_before(source, stmts[0]->span().begin);
+			if (lead == none || lead >= begin || owner->span().begin > lead) {
+				return false;
+			}
+			cut.begin = lead + 1;
+		}
+		if (last < count) {
+			cut.end = stmts[last]->span().begin;
+		} else if (!top) {
+			auto tail = delimiter_after(source, stmts[count - 1]->span().end);
+			if (tail == none || source[tail] != '\n' || tail < end) {
+				return false;
+			}
+			cut.end = tail + 1;
+		}
+		return true;
+	}
+
+	auto Reparser::m_splice(std::string const & source, Cut const & cut) -> bool {
+		auto delta = static_cast<std::ptrdiff_t>(source.size()) - static_cast<std::ptrdiff_t>(m_source.size());
+		auto length = static_cast<std::size_t>(static_cast<std::ptrdiff_t>(cut.end - cut.begin) + delta);
+		auto text = source.substr(cut.begin, length);
+		text.append(RaphParser::padding, '\0');
+
+		// Errors are left to a full parse, which reports them where they are.
+		std::ostringstream discarded;
+		RaphParser parser(m_parser.filename(), discarded);
+		Array<Statement *> parsed;
+		if (!parser.parse(&text[0], text.size(), *m_program, parsed)) {
+			return false;
+		}
+		m_scanned = length;
+
+		Shift after(cut.end, delta);
+		m_program->rewrite(after);
+		Shift into(0, static_cast<std::ptrdiff_t>(cut.begin));
+		for (auto & stmt : parsed) {
+			stmt = into.rewrite(stmt);
+		}
+
+		auto program = dynamic_cast<Program *>(cut.owner);
+		auto compound = dynamic_cast<CompoundStatement *>(cut.owner);
+		auto const & stmts = program != nullptr ? program->stmts() : compound->stmts();
+		std::vector<Statement *> spliced(stmts.begin(), stmts.begin() + cut.first);
+		spliced.insert(spliced.end(), parsed.begin(), parsed.end());
+		spliced.insert(spliced.end(), stmts.begin() + cut.last, stmts.end());
+		auto array = m_program->array(spliced.data(), spliced.size());
+		if (program != nullptr) {
+			program->stmts(array);
+		} else {
+			compound->stmts(array);
+		}
+		return true;
+	}
+
+	auto Reparser::m_full(std::string source) -> Program * {
+		m_scanned = source.size();
+		auto errors = m_parser.errors();
+		m_program = m_parser.parse(source);
+		m_source = std::move(source);
+		// What the parser recovered from an error could end differently with the rest of the source changed.
+		m_baseline = m_parser.errors() == errors && m_program != nullptr ? m_program->arena().used() : 0;
+		return m_program.get();
+	}
+
+} // namespace br
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "ast.hpp"
+#include "raph.hpp"
+
+namespace br {
+
+	/** \brief Parses successive versions of one script, parsing again only the statements each edit touches.
+	 **
+	 ** Each source is compared with the last one parsed to find the bytes that changed. In the innermost
+	 ** statement list around them, that of the program or the body of a `begin`, `if`, `unless`, `while`,
+	 ** `until` or `for` block, the statements from the line break before the change to the line break
+	 ** after it are parsed again into the same arena and spliced in. Every other node is kept, its span
+	 ** moved by the change in length, so the tree is that of a full parse. The whole source is parsed
+	 ** instead the first time, after a version with errors, when the statements parsed again have an error,
+	 ** so that it is reported in context, and when the nodes replaced so far take more room in the arena
+	 ** than a full parse would.
+	 **
+	 ** bind() and optimize() change the tree in place, so they must not be run on it while later versions
+	 ** are to be parsed.
+	 */
+	class Reparser {
+	public:
+		/// \param parser what parses the whole source and reports errors
+		explicit Reparser(RaphParser const & parser);
+
+		Reparser(Reparser const &) = delete;
+
+		auto operator=(Reparser const &) -> Reparser & = delete;
+
+		~Reparser() noexcept;
+
+		/** \brief Parse \a source, the next version of the script.
+		 **
+		 ** \return the program, as RaphParser::parse() would return it, owned by the reparser and valid until
+		 **         the next call
+		 */
+		auto parse(std::string source) -> Program *;
+
+		/// Bytes of source the last call scanned: all of them after a full parse.
+		auto scanned() const noexcept -> std::size_t {
+			return m_scanned;
+		}
+
+	private:
+		struct Cut;
+
+		auto m_cut(Array<Statement *> const & stmts, Statement * owner, std::size_t begin, std::size_t end, Cut & cut) const -> bool;
+
+		auto m_splice(std::string const & source, Cut const & cut) -> bool;
+
+		auto m_full(std::string source) -> Program *;
+
+		RaphParser const & m_parser;
+		std::unique_ptr<Program> m_program;
+		std::string m_source;
+		/// Arena bytes used after the last full parse; 0 if it reported errors, so that the next parse is full too.
+		std::size_t m_baseline;
+		std::size_t m_scanned;
+	}; // class Reparser
+
+} // namespace br
@@ -0,0 +1,385 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "raph.hpp"
+#include "reparse.hpp"
+
+namespace {
+
+	/// A script with statements at the top level and in every kind of block, nested.
+	char const * const script =
+		"clear = (400, 300)\n"
+		"x = 1; y = 2\n"
+		"-- a comment\n"
+		"begin\n"
+		"\tz = x + y\n"
+		"\tbegin\n"
+		"\t\tw = z * 2\n"
+		"\tend\n"
+		"end\n"
+		"if x < y then\n"
+		"\tdraw(x, y)\n"
+		"else\n"
+		"\tdraw(y, x)\n"
+		"end\n"
+		"unless x > y\n"
+		"\tx = x + 1\n"
+		"end\n"
+		"while x < 10 do\n"
+		"\tx = x + 1\n"
+		"\tif x == 5 then y = 0 end\n"
+		"end\n"
+		"until y > 3\n"
+		"\ty = y + 1\n"
+		"end\n"
+		"for t from 0 to 2 * PI step PI / 90\n"
+		"\tr = sin(4 * t)\n"
+		"\tif r > 0 then\n"
+		"\t\tdraw(r * cos(t), r * sin(t))\n"
+		"\tend\n"
+		"\tfor s from 0 to 1 step 0.25\n"
+		"\t\tdraw(s, t)\n"
+		"\tend\n"
+		"end\n"
+		"save()\n";
+
+	/// An edit: replace the first occurrence of \a from, searched for after \a after, by \a to.
+	struct Edit {
+		char const * after;
+		char const * from;
+		char const * to;
+	};
+
+	/// Edits inside each kind of block, at statement boundaries, across blocks and with errors.
+	Edit const edits[] = {
+		{"", "x = 1", "x = 3"},
+		{"", "x = 1; y = 2", "x = 1"},
+		{"", "y = 2\n", "y = 2\nv = 7\n"},
+		{"", "-- a comment", "-- (a, b"},
+		{"", "\tz = x + y", "\tz = x - y"},
+		{"", "\t\tw = z * 2\n", ""},
+		{"", "\tend\nend\nif", "\t\tw = 1\n\tend\nend\nif"},
+		{"", "draw(x, y)", "draw(x + 1, y)"},
+		{"", "\tdraw(y, x)\n", "\tdraw(y, x)\n\tdraw(x, x)\n"},
+		{"", "else\n\tdraw(y, x)\n", ""},
+		{"", "\tx = x + 1\nend\nwhile", "\tx = x + 2; y = 1\nend\nwhile"},
+		{"while", "if x == 5 then y = 0 end", "if x == 5 then y = 0 else y = 1 end"},
+		{"until", "y = y + 1", "y = y + 1 + x"},
+		{"", "r = sin(4 * t)", "r = cos(3 * t)"},
+		{"", "\t\tdraw(r * cos(t), r * sin(t))\n", "\t\tdraw(r, t)\n\t\tdraw(t, r)\n"},
+		{"", "\t\tdraw(s, t)", "\t\tdraw(t, s)"},
+		{"", "step 0.25", "step 0.5"},
+		{"", "end\nsave()", "\tdraw(0, 0)\nend\nsave()"},
+		{"", "save()\n", "save()\ndraw(1, 1)\n"},
+		{"", "begin\n\tz", "begin\n\tbegin end\n\tz"},
+		{"", "\tend\nend\nif", "\tend\nif"},
+		{"", "if x < y then", "if x < y then\n\tend"},
+		{"", "draw(x, y)", "draw(x, )"},
+		{"", "x = 1; y = 2", "x = 1; ; y = 2"},
+		{"", "\n", "\n\n"},
+		{"", "for t", "for"},
+	};
+
+	/// Whole statements the random edits insert at the start of a line, which keep a valid script valid.
+	char const * const lines[] = {
+		"z = 3\n", "draw(x, y)\n", "x = x * 2; y = -y\n", "-- note\n", "\n", "begin\n\tw = 1\nend\n",
+		"if x > 1 then\n\tdraw(x, 0)\nelse\n\tx = 0\nend\n", "for i from 0 to 3 step 1\n\tdraw(i, i)\nend\n",
+		"while x < 0 do x = x + 1 end\n", "unless y then y = 1 end\n",
+	};
+
+	/// Fragments the random edits insert: tokens, delimiters and whole lines, some of them unbalanced.
+	char const * const fragments[] = {
+		"\n", ";", " ", "x", "7", "+ 1", "* y", "(1, 2)", "draw(x, y)", "\nz = 3\n", "begin\n", "end\n", "\nend",
+		"if x then\n", "else\n", "for i from 0 to 3 step 1\n", "while y do\n", "-- ", "#", "sin(", ")", "[0]",
+		"\tw = w + 1\n", "0x1.8p1", "true", "&&", "PI",
+	};
+
+	/// The span of every node of a tree, in the order of a walk.
+	class Spans : public br::Walker {
+	public:
+		std::vector<std::uint64_t> spans;
+
+		virtual void visit(br::Variable const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::Constant const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::Numeric const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::Boolean const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::Vector const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::FunctionCall const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::ArrayAccess const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::UnaryOperation const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::BinaryOperation const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::EmptyStatement const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::CompoundStatement const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::Program const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::ConditionalStatement const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::WhileStatement const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::UntilStatement const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::ForStatement const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::AssignStatement const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+		virtual void visit(br::ExpressionStatement const & node) override {
+			record(node);
+			Walker::visit(node);
+		}
+
+	private:
+		void record(br::Node const & node) {
+			spans.push_back(std::uint64_t(node.span().begin) << 32 | node.span().end);
+		}
+	};
+
+	/// What a parse of a source shows: its tree, printed, the spans of its nodes, and its diagnostics.
+	struct Outcome {
+		std::string tree;
+		std::vector<std::uint64_t> spans;
+		std::string diagnostics;
+
+		auto operator==(Outcome const & other) const -> bool {
+			return tree == other.tree && spans == other.spans && diagnostics == other.diagnostics;
+		}
+	};
+
+	auto outcome(br::Program const * program, std::string diagnostics) -> Outcome {
+		Outcome result{"(errors)", {}, std::move(diagnostics)};
+		if (program != nullptr) {
+			std::ostringstream tree;
+			program->print(tree);
+			result.tree = tree.str();
+			Spans spans;
+			program->accept(spans);
+			result.spans = std::move(spans.spans);
+		}
+		return result;
+	}
+
+	/// Checks each version of a script parsed by a Reparser against a full parse of it.
+	class Checker {
+	public:
+		Checker() : m_parser("test", m_diagnostics), m_reparser(m_parser), m_checked(0), m_failed(0), m_partial(0), m_scanned(0), m_bytes(0) {
+		}
+
+		void check(std::string const & source, std::string const & what) {
+			m_diagnostics.str("");
+			auto program = m_reparser.parse(source);
+			auto reparsed = outcome(program, m_diagnostics.str());
+			m_scanned += m_reparser.scanned();
+			if (m_reparser.scanned() < source.size()) {
+				++m_partial;
+			}
+			m_bytes += source.size();
+
+			std::ostringstream diagnostics;
+			br::RaphParser parser("test", diagnostics);
+			auto full = parser.parse(source);
+			auto parsed = outcome(full.get(), diagnostics.str());
+
+			++m_checked;
+			if (!(reparsed == parsed)) {
+				++m_failed;
+				std::cerr << "reparse differs from a full parse after " << what << ":" << std::endl << source << std::endl
+					<< "--- full parse" << std::endl << parsed.tree << parsed.diagnostics
+					<< "--- reparse" << std::endl << reparsed.tree << reparsed.diagnostics << std::endl;
+			}
+		}
+
+		auto failed() const noexcept -> std::size_t {
+			return m_failed;
+		}
+
+		/// The versions of which only a part was parsed again.
+		auto partial() const noexcept -> std::size_t {
+			return m_partial;
+		}
+
+		void report(std::ostream & ostream) const {
+			ostream << m_checked << " versions checked, " << m_partial << " of them parsed again in part, " << m_failed
+				<< " differ from a full parse; "
+				<< m_scanned << " of " << m_bytes << " bytes scanned again" << std::endl;
+		}
+
+	private:
+		std::ostringstream m_diagnostics;
+		br::RaphParser m_parser;
+		br::Reparser m_reparser;
+		std::size_t m_checked, m_failed, m_partial, m_scanned, m_bytes;
+	};
+
+	/// Whether \a line holds whole statements, so that removing it leaves a valid script valid: it ends as
+	/// many blocks as it begins, and has no `else`.
+	auto whole(std::string const & line) -> bool {
+		int depth = 0;
+		std::istringstream words(line);
+		std::string word;
+		while (words >> word) {
+			if (word == "begin" || word == "if" || word == "unless" || word == "while" || word == "until" || word == "for") {
+				++depth;
+			} else if (word == "end") {
+				--depth;
+			} else if (word == "else" || word == "--") {
+				return word == "--" && depth == 0;
+			}
+		}
+		return depth == 0;
+	}
+
+	/// \return \a source with \a edit applied, or empty if it does not apply
+	auto apply(std::string const & source, Edit const & edit) -> std::string {
+		auto at = source.find(edit.from, source.find(edit.after));
+		if (at == std::string::npos) {
+			return std::string();
+		}
+		auto result = source;
+		result.replace(at, std::string(edit.from).size(), edit.to);
+		return result;
+	}
+
+} // namespace
+
+int main(int argc, char * argv[]) {
+	std::size_t random_edits = 2000;
+	if (argc > 1) {
+		random_edits = static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10));
+	}
+
+	// Each edit made to the script, then undone.
+	Checker checker;
+	for (auto const & edit : edits) {
+		auto edited = apply(script, edit);
+		if (edited.empty()) {
+			std::cerr << "edit '" << edit.from << "' does not apply" << std::endl;
+			return 1;
+		}
+		checker.check(script, "the original script");
+		checker.check(edited, std::string("replacing '") + edit.from + "' by '" + edit.to + "'");
+	}
+
+	// Random edits that keep the script valid, one after the other: statements inserted at the start of a line,
+	// in any block, and lines of a single statement removed.
+	std::mt19937 random(20160901);
+	std::string source = script;
+	checker.check(source, "the original script");
+	for (std::size_t i = 0; i < random_edits; ++i) {
+		if (random() % 64 == 0) {
+			source = script;
+		}
+		std::vector<std::size_t> starts{0};
+		for (std::size_t at = 0; at + 1 < source.size(); ++at) {
+			if (source[at] == '\n') {
+				starts.push_back(at + 1);
+			}
+		}
+		auto start = starts[random() % starts.size()];
+		auto line = source.substr(start, source.find('\n', start) + 1 - start);
+		std::ostringstream what;
+		if (random() % 2 == 0 && whole(line)) {
+			what << "edit " << i << ": removing the line at " << start;
+			source.erase(start, line.size());
+		} else {
+			auto inserted = lines[random() % (sizeof(lines) / sizeof(lines[0]))];
+			what << "edit " << i << ": inserting '" << inserted << "' at " << start;
+			source.insert(start, inserted);
+		}
+		checker.check(source, what.str());
+	}
+	if (checker.partial() == 0) {
+		std::cerr << "no version was parsed again in part" << std::endl;
+		return 1;
+	}
+
+	// Random edits of any bytes, which mostly leave errors, with an occasional return to the original.
+	source = script;
+	checker.check(source, "the original script");
+	for (std::size_t i = 0; i < random_edits; ++i) {
+		if (random() % 16 == 0) {
+			source = script;
+		}
+		auto at = random() % (source.size() + 1);
+		std::ostringstream what;
+		if (random() % 3 == 0 && at < source.size()) {
+			auto length = std::min<std::size_t>(random() % 12 + 1, source.size() - at);
+			what << "edit " << i << ": erasing " << length << " bytes at " << at;
+			source.erase(at, length);
+		} else {
+			auto fragment = fragments[random() % (sizeof(fragments) / sizeof(fragments[0]))];
+			what << "edit " << i << ": inserting '" << fragment << "' at " << at;
+			source.insert(at, fragment);
+		}
+		checker.check(source, what.str());
+	}
+
+	checker.report(std::cout);
+	return checker.failed() == 0 ? 0 : 1;
+}
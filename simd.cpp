@@ -0,0 +1,361 @@
+#include "simd.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RAPH_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define RAPH_SIMD_X86 0
+#endif
+
+namespace br {
+
+	namespace simd {
+
+		namespace {
+
+			using Binary = void (*)(double *, double const *, double const *, std::size_t);
+
+			using Unary = void (*)(double *, double const *, std::size_t);
+
+			using Fill = void (*)(double *, double, std::size_t);
+
+			using Ramp = void (*)(double *, double, double, std::size_t, std::size_t);
+
+			using Affine = void (*)(double *, double *, Transform const &, std::size_t);
+
+			struct Kernels {
+				Binary add, subtract, multiply, divide;
+				Unary negate;
+				Fill fill;
+				Ramp ramp;
+				Affine transform;
+			};
+
+			/// One point of transform(), also the tail of the packed kernels.
+			inline void transform_point(double & x, double & y, Transform const & transform) {
+				auto scaled_x = x * transform.scale_x, scaled_y = y * transform.scale_y;
+				x = scaled_x * transform.cos + scaled_y * transform.sin + transform.origin_x;
+				y = scaled_y * transform.cos - scaled_x * transform.sin + transform.origin_y;
+			}
+
+			#define RAPH_SCALAR_BINARY(name, op) \
+				void scalar_##name(double * out, double const * lhs, double const * rhs, std::size_t count) { \
+					for (std::size_t i = 0; i < count; ++i) { \
+						out[i] = lhs[i] op rhs[i]; \
+					} \
+				}
+
+			RAPH_SCALAR_BINARY(add, +)
+			RAPH_SCALAR_BINARY(subtract, -)
+			RAPH_SCALAR_BINARY(multiply, *)
+			RAPH_SCALAR_BINARY(divide, /)
+
+			void scalar_negate(double * out, double const * rhs, std::size_t count) {
+				for (std::size_t i = 0; i < count; ++i) {
+					out[i] = -rhs[i];
+				}
+			}
+
+			void scalar_fill(double * out, double value, std::size_t count) {
+				for (std::size_t i = 0; i < count; ++i) {
+					out[i] = value;
+				}
+			}
+
+			void scalar_ramp(double * out, double from, double step, std::size_t first, std::size_t count) {
+				for (std::size_t i = 0; i < count; ++i) {
+					out[i] = from + static_cast<double>(first + i) * step;
+				}
+			}
+
+			void scalar_transform(double * xs, double * ys, Transform const & transform, std::size_t count) {
+				for (std::size_t i = 0; i < count; ++i) {
+					transform_point(xs[i], ys[i], transform);
+				}
+			}
+
+			Kernels const scalar = {
+				scalar_add, scalar_subtract, scalar_multiply, scalar_divide,
+				scalar_negate, scalar_fill, scalar_ramp, scalar_transform,
+			};
+
+#if RAPH_SIMD_X86
+
+			// The index vector of ramp() stays exact as long as the iteration count is below 2^53.
+
+			#define RAPH_SSE2_BINARY(name, op, intrinsic) \
+				__attribute__((target("sse2"))) \
+				void sse2_##name(double * out, double const * lhs, double const * rhs, std::size_t count) { \
+					std::size_t i = 0; \
+					for (; i + 2 <= count; i += 2) { \
+						_mm_storeu_pd(out + i, intrinsic(_mm_loadu_pd(lhs + i), _mm_loadu_pd(rhs + i))); \
+					} \
+					for (; i < count; ++i) { \
+						out[i] = lhs[i] op rhs[i]; \
+					} \
+				}
+
+			RAPH_SSE2_BINARY(add, +, _mm_add_pd)
+			RAPH_SSE2_BINARY(subtract, -, _mm_sub_pd)
+			RAPH_SSE2_BINARY(multiply, *, _mm_mul_pd)
+			RAPH_SSE2_BINARY(divide, /, _mm_div_pd)
+
+			__attribute__((target("sse2")))
+			void sse2_negate(double * out, double const * rhs, std::size_t count) {
+				auto sign = _mm_set1_pd(-0.0);
+				std::size_t i = 0;
+				for (; i + 2 <= count; i += 2) {
+					_mm_storeu_pd(out + i, _mm_xor_pd(_mm_loadu_pd(rhs + i), sign));
+				}
+				for (; i < count; ++i) {
+					out[i] = -rhs[i];
+				}
+			}
+
+			__attribute__((target("sse2")))
+			void sse2_fill(double * out, double value, std::size_t count) {
+				auto broadcast = _mm_set1_pd(value);
+				std::size_t i = 0;
+				for (; i + 2 <= count; i += 2) {
+					_mm_storeu_pd(out + i, broadcast);
+				}
+				for (; i < count; ++i) {
+					out[i] = value;
+				}
+			}
+
+			__attribute__((target("sse2")))
+			void sse2_ramp(double * out, double from, double step, std::size_t first, std::size_t count) {
+				auto index = _mm_set_pd(static_cast<double>(first + 1), static_cast<double>(first));
+				auto increment = _mm_set1_pd(2.0), base = _mm_set1_pd(from), stride = _mm_set1_pd(step);
+				std::size_t i = 0;
+				for (; i + 2 <= count; i += 2) {
+					_mm_storeu_pd(out + i, _mm_add_pd(base, _mm_mul_pd(index, stride)));
+					index = _mm_add_pd(index, increment);
+				}
+				for (; i < count; ++i) {
+					out[i] = from + static_cast<double>(first + i) * step;
+				}
+			}
+
+			// Separate multiplies and adds rather than fused ones, which would round differently from draw().
+
+			__attribute__((target("sse2")))
+			void sse2_transform(double * xs, double * ys, Transform const & transform, std::size_t count) {
+				auto scale_x = _mm_set1_pd(transform.scale_x), scale_y = _mm_set1_pd(transform.scale_y);
+				auto cos = _mm_set1_pd(transform.cos), sin = _mm_set1_pd(transform.sin);
+				auto origin_x = _mm_set1_pd(transform.origin_x), origin_y = _mm_set1_pd(transform.origin_y);
+				std::size_t i = 0;
+				for (; i + 2 <= count; i += 2) {
+					auto x = _mm_mul_pd(_mm_loadu_pd(xs + i), scale_x), y = _mm_mul_pd(_mm_loadu_pd(ys + i), scale_y);
+					_mm_storeu_pd(xs + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(x, cos), _mm_mul_pd(y, sin)), origin_x));
+					_mm_storeu_pd(ys + i, _mm_add_pd(_mm_sub_pd(_mm_mul_pd(y, cos), _mm_mul_pd(x, sin)), origin_y));
+				}
+				for (; i < count; ++i) {
+					transform_point(xs[i], ys[i], transform);
+				}
+			}
+
+			Kernels const sse2 = {
+				sse2_add, sse2_subtract, sse2_multiply, sse2_divide,
+				sse2_negate, sse2_fill, sse2_ramp, sse2_transform,
+			};
+
+			#define RAPH_AVX_BINARY(name, op, intrinsic) \
+				__attribute__((target("avx"))) \
+				void avx_##name(double * out, double const * lhs, double const * rhs, std::size_t count) { \
+					std::size_t i = 0; \
+					for (; i + 4 <= count; i += 4) { \
+						_mm256_storeu_pd(out + i, intrinsic(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i))); \
+					} \
+					for (; i < count; ++i) { \
+						out[i] = lhs[i] op rhs[i]; \
+					} \
+				}
+
+			RAPH_AVX_BINARY(add, +, _mm256_add_pd)
+			RAPH_AVX_BINARY(subtract, -, _mm256_sub_pd)
+			RAPH_AVX_BINARY(multiply, *, _mm256_mul_pd)
+			RAPH_AVX_BINARY(divide, /, _mm256_div_pd)
+
+			__attribute__((target("avx")))
+			void avx_negate(double * out, double const * rhs, std::size_t count) {
+				auto sign = _mm256_set1_pd(-0.0);
+				std::size_t i = 0;
+				for (; i + 4 <= count; i += 4) {
+					_mm256_storeu_pd(out + i, _mm256_xor_pd(_mm256_loadu_pd(rhs + i), sign));
+				}
+				for (; i < count; ++i) {
+					out[i] = -rhs[i];
+				}
+			}
+
+			__attribute__((target("avx")))
+			void avx_fill(double * out, double value, std::size_t count) {
+				auto broadcast = _mm256_set1_pd(value);
+				std::size_t i = 0;
+				for (; i + 4 <= count; i += 4) {
+					_mm256_storeu_pd(out + i, broadcast);
+				}
+				for (; i < count; ++i) {
+					out[i] = value;
+				}
+			}
+
+			__attribute__((target("avx")))
+			void avx_ramp(double * out, double from, double step, std::size_t first, std::size_t count) {
+				auto index = _mm256_set_pd(
+					static_cast<double>(first + 3), static_cast<double>(first + 2),
+					static_cast<double>(first + 1), static_cast<double>(first)
+				);
+				auto increment = _mm256_set1_pd(4.0), base = _mm256_set1_pd(from), stride = _mm256_set1_pd(step);
+				std::size_t i = 0;
+				for (; i + 4 <= count; i += 4) {
+					_mm256_storeu_pd(out + i, _mm256_add_pd(base, _mm256_mul_pd(index, stride)));
+					index = _mm256_add_pd(index, increment);
+				}
+				for (; i < count; ++i) {
+					out[i] = from + static_cast<double>(first + i) * step;
+				}
+			}
+
+			__attribute__((target("avx")))
+			void avx_transform(double * xs, double * ys, Transform const & transform, std::size_t count) {
+				auto scale_x = _mm256_set1_pd(transform.scale_x), scale_y = _mm256_set1_pd(transform.scale_y);
+				auto cos = _mm256_set1_pd(transform.cos), sin = _mm256_set1_pd(transform.sin);
+				auto origin_x = _mm256_set1_pd(transform.origin_x), origin_y = _mm256_set1_pd(transform.origin_y);
+				std::size_t i = 0;
+				for (; i + 4 <= count; i += 4) {
+					auto x = _mm256_mul_pd(_mm256_loadu_pd(xs + i), scale_x), y = _mm256_mul_pd(_mm256_loadu_pd(ys + i), scale_y);
+					_mm256_storeu_pd(xs + i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, cos), _mm256_mul_pd(y, sin)), origin_x));
+					_mm256_storeu_pd(ys + i, _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(y, cos), _mm256_mul_pd(x, sin)), origin_y));
+				}
+				for (; i < count; ++i) {
+					transform_point(xs[i], ys[i], transform);
+				}
+			}
+
+			Kernels const avx = {
+				avx_add, avx_subtract, avx_multiply, avx_divide,
+				avx_negate, avx_fill, avx_ramp, avx_transform,
+			};
+
+#endif
+
+			auto kernels_for(Level level) noexcept -> Kernels const * {
+				switch (level) {
+#if RAPH_SIMD_X86
+					case Level::AVX:
+						return &avx;
+					case Level::SSE2:
+						return &sse2;
+#endif
+					default:
+						return &scalar;
+				}
+			}
+
+			Level g_level = detect();
+
+			Kernels const * g_kernels = kernels_for(g_level);
+
+			struct {
+				char const * name;
+				Level level;
+			} const level_names[] = {
+				{"scalar", Level::Scalar},
+				{"sse2",   Level::SSE2},
+				{"avx",    Level::AVX},
+			};
+
+		} // namespace
+
+		auto level_name(Level level) noexcept -> char const * {
+			for (auto const & entry : level_names) {
+				if (entry.level == level) {
+					return entry.name;
+				}
+			}
+			return "unknown";
+		}
+
+		auto find_level(std::string const & name, Level & level) noexcept -> bool {
+			for (auto const & entry : level_names) {
+				if (name == entry.name) {
+					level = entry.level;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		auto detect() noexcept -> Level {
+#if RAPH_SIMD_X86
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx")) {
+				return Level::AVX;
+			}
+			if (__builtin_cpu_supports("sse2")) {
+				return Level::SSE2;
+			}
+#endif
+			return Level::Scalar;
+		}
+
+		auto level() noexcept -> Level {
+			return g_level;
+		}
+
+		void select(Level level) noexcept {
+			auto best = detect();
+			g_level = static_cast<int>(level) < static_cast<int>(best) ? level : best;
+			g_kernels = kernels_for(g_level);
+		}
+
+		void add(double * out, double const * lhs, double const * rhs, std::size_t count) noexcept {
+			g_kernels->add(out, lhs, rhs, count);
+		}
+
+		void subtract(double * out, double const * lhs, double const * rhs, std::size_t count) noexcept {
+			g_kernels->subtract(out, lhs, rhs, count);
+		}
+
+		void multiply(double * out, double const * lhs, double const * rhs, std::size_t count) noexcept {
+			g_kernels->multiply(out, lhs, rhs, count);
+		}
+
+		void divide(double * out, double const * lhs, double const * rhs, std::size_t count) noexcept {
+			g_kernels->divide(out, lhs, rhs, count);
+		}
+
+		void negate(double * out, double const * rhs, std::size_t count) noexcept {
+			g_kernels->negate(out, rhs, count);
+		}
+
+		void fill(double * out, double value, std::size_t count) noexcept {
+			g_kernels->fill(out, value, count);
+		}
+
+		void ramp(double * out, double from, double step, std::size_t first, std::size_t count) noexcept {
+			g_kernels->ramp(out, from, step, first, count);
+		}
+
+		void transform(double * xs, double * ys, Transform const & transform, std::size_t count) noexcept {
+			g_kernels->transform(xs, ys, transform, count);
+		}
+
+		void map(double * out, double const * rhs, double (* function)(double), std::size_t count) {
+			for (std::size_t i = 0; i < count; ++i) {
+				out[i] = function(rhs[i]);
+			}
+		}
+
+		void map(double * out, double const * lhs, double const * rhs, double (* function)(double, double), std::size_t count) {
+			for (std::size_t i = 0; i < count; ++i) {
+				out[i] = function(lhs[i], rhs[i]);
+			}
+		}
+
+	} // namespace simd
+
+} // namespace br
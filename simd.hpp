@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace br {
+
+	/** \brief Array kernels used by batched loop execution and the drawing transform.
+	 **
+	 ** Every kernel computes exactly what the scalar evaluator computes for each element:
+	 ** the arithmetic kernels use SSE2/AVX packed instructions, which round like their scalar forms,
+	 ** and the transcendental ones call the same libm function per element.
+	 */
+	namespace simd {
+
+		enum class Level {
+			Scalar,
+			SSE2,
+			AVX,
+		};
+
+		auto level_name(Level level) noexcept -> char const *;
+
+		auto find_level(std::string const & name, Level & level) noexcept -> bool;
+
+		/// Best level supported by the running CPU.
+		auto detect() noexcept -> Level;
+
+		/// Level used by the kernels, initially detect().
+		auto level() noexcept -> Level;
+
+		/// Use \a level, or the best supported level below it.
+		void select(Level level) noexcept;
+
+		void add(double * out, double const * lhs, double const * rhs, std::size_t count) noexcept;
+
+		void subtract(double * out, double const * lhs, double const * rhs, std::size_t count) noexcept;
+
+		void multiply(double * out, double const * lhs, double const * rhs, std::size_t count) noexcept;
+
+		void divide(double * out, double const * lhs, double const * rhs, std::size_t count) noexcept;
+
+		void negate(double * out, double const * rhs, std::size_t count) noexcept;
+
+		void fill(double * out, double value, std::size_t count) noexcept;
+
+		/// `out[i] = from + (first + i) * step`, the values a for loop takes.
+		void ramp(double * out, double from, double step, std::size_t first, std::size_t count) noexcept;
+
+		/// The drawing transform: scale, then rotate clockwise by the angle of \a cos and \a sin, then translate.
+		struct Transform {
+			double scale_x, scale_y;
+			double cos, sin;
+			double origin_x, origin_y;
+		};
+
+		/// Apply \a transform in place to the points `(xs[i], ys[i])`.
+		void transform(double * xs, double * ys, Transform const & transform, std::size_t count) noexcept;
+
+		void map(double * out, double const * rhs, double (* function)(double), std::size_t count);
+
+		void map(double * out, double const * lhs, double const * rhs, double (* function)(double, double), std::size_t count);
+
+	} // namespace simd
+
+} // namespace br
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace br {
+
+	class Builtin;
+
+	/// Slot of a name that is never assigned.
+	constexpr std::uint32_t no_slot = 0xFFFFFFFF;
+
+	/// Frame slots of the variables that drive drawing, reserved in every program.
+	constexpr std::uint32_t clear_slot = 0;
+	constexpr std::uint32_t origin_slot = 1;
+	constexpr std::uint32_t scale_slot = 2;
+	constexpr std::uint32_t rot_slot = 3;
+	constexpr std::uint32_t special_slots = 4;
+
+	/// A name used in a program, resolved by bind().
+	struct Symbol {
+		std::string const * name;
+		/// Frame slot of the variable of this name; no_slot if the program never assigns it.
+		std::uint32_t slot;
+		/// What the name refers to while its variable is unassigned; nullptr if nothing.
+		Builtin const * builtin;
+	};
+
+} // namespace br
@@ -0,0 +1,105 @@
+#include <sstream>
+#include "builtin.hpp"
+#include "value.hpp"
+
+namespace br {
+
+	auto type_name(Value::Type type) noexcept -> char const * {
+		switch (type) {
+			case Value::Type::Void:
+				return "void";
+			case Value::Type::Number:
+				return "number";
+			case Value::Type::Boolean:
+				return "boolean";
+			case Value::Type::Vector:
+				return "vector";
+			case Value::Type::Function:
+				return "function";
+		}
+		return "unknown";
+	}
+
+	auto operator<<(std::ostream & ostream, Value const & value) -> std::ostream & {
+		switch (value.type()) {
+			case Value::Type::Void:
+				return ostream << "void";
+			case Value::Type::Number:
+				return ostream << value.as_number();
+			case Value::Type::Boolean:
+				return ostream << (value.as_boolean() ? "true" : "false");
+			case Value::Type::Vector:
+				return ostream << '(' << value.as_vector().x << ", " << value.as_vector().y << ')';
+			case Value::Type::Function:
+				return ostream << value.as_function()->name;
+		}
+		return ostream;
+	}
+
+	void unary_type_error(char const * op, Value const & rhs) {
+		std::ostringstream message;
+		message << "invalid operand to unary '" << op << "': " << type_name(rhs.type());
+		throw RuntimeError(message.str());
+	}
+
+	void binary_type_error(char const * op, Value const & lhs, Value const & rhs) {
+		std::ostringstream message;
+		message << "invalid operands to binary '" << op << "': " << type_name(lhs.type()) << " and " << type_name(rhs.type());
+		throw RuntimeError(message.str());
+	}
+
+	auto expect_number(Value const & value, char const * what) -> double {
+		if (!value.is_number()) {
+			throw RuntimeError(std::string(what) + " must be a number, not " + type_name(value.type()));
+		}
+		return value.as_number();
+	}
+
+	auto expect_boolean(Value const & value, char const * what) -> bool {
+		if (!value.is_boolean()) {
+			throw RuntimeError(std::string(what) + " must be a boolean, not " + type_name(value.type()));
+		}
+		return value.as_boolean();
+	}
+
+	auto expect_vector(Value const & value, char const * what) -> Point {
+		if (!value.is_vector()) {
+			throw RuntimeError(std::string(what) + " must be a vector, not " + type_name(value.type()));
+		}
+		return value.as_vector();
+	}
+
+	auto equal(Value const & lhs, Value const & rhs) -> bool {
+		if (lhs.type() != rhs.type()) {
+			binary_type_error("==", lhs, rhs);
+		}
+		switch (lhs.type()) {
+			case Value::Type::Number:
+				return lhs.as_number() == rhs.as_number();
+			case Value::Type::Boolean:
+				return lhs.as_boolean() == rhs.as_boolean();
+			case Value::Type::Vector:
+				return lhs.as_vector().x == rhs.as_vector().x && lhs.as_vector().y == rhs.as_vector().y;
+			case Value::Type::Function:
+				return lhs.as_function() == rhs.as_function();
+			default:
+				binary_type_error("==", lhs, rhs);
+		}
+	}
+
+	auto index(Value const & var, Value const & index) -> Value {
+		if (var.is_vector() && index.is_number()) {
+			if (index.as_number() == 0.0) {
+				return var.as_vector().x;
+			}
+			if (index.as_number() == 1.0) {
+				return var.as_vector().y;
+			}
+			std::ostringstream message;
+			message << "vector index out of range: " << index.as_number();
+			throw RuntimeError(message.str());
+		}
+		binary_type_error("[]", var, index);
+	}
+
+} // namespace br
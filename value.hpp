@@ -0,0 +1,226 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include "error.hpp"
+
+namespace br {
+
+	class Builtin;
+
+	/// A pair of coordinates.
+	struct Point {
+		double x;
+		double y;
+	}; // struct Point
+
+	/// Unboxed tagged value manipulated by the evaluator.
+	class Value {
+	public:
+		enum class Type : std::uint8_t {
+			Void,
+			Number,
+			Boolean,
+			Vector,
+			Function,
+		};
+
+		constexpr Value() noexcept : m_type(Type::Void), m_vector{0.0, 0.0} {
+		}
+
+		constexpr Value(double number) noexcept : m_type(Type::Number), m_number(number) {
+		}
+
+		constexpr Value(bool boolean) noexcept : m_type(Type::Boolean), m_boolean(boolean) {
+		}
+
+		constexpr Value(double x, double y) noexcept : m_type(Type::Vector), m_vector{x, y} {
+		}
+
+		constexpr Value(Builtin const * function) noexcept : m_type(Type::Function), m_function(function) {
+		}
+
+		auto type() const noexcept -> Type {
+			return m_type;
+		}
+
+		auto is_void() const noexcept -> bool {
+			return m_type == Type::Void;
+		}
+
+		auto is_number() const noexcept -> bool {
+			return m_type == Type::Number;
+		}
+
+		auto is_boolean() const noexcept -> bool {
+			return m_type == Type::Boolean;
+		}
+
+		auto is_vector() const noexcept -> bool {
+			return m_type == Type::Vector;
+		}
+
+		auto is_function() const noexcept -> bool {
+			return m_type == Type::Function;
+		}
+
+		auto as_number() const noexcept -> double {
+			return m_number;
+		}
+
+		auto as_boolean() const noexcept -> bool {
+			return m_boolean;
+		}
+
+		auto as_vector() const noexcept -> Point const & {
+			return m_vector;
+		}
+
+		auto as_function() const noexcept -> Builtin const * {
+			return m_function;
+		}
+
+	private:
+		Type m_type;
+		union {
+			double m_number;
+			bool m_boolean;
+			Point m_vector;
+			Builtin const * m_function;
+		};
+	}; // class Value
+
+	auto type_name(Value::Type type) noexcept -> char const *;
+
+	auto operator<<(std::ostream & ostream, Value const & value) -> std::ostream &;
+
+	[[noreturn]] void unary_type_error(char const * op, Value const & rhs);
+
+	[[noreturn]] void binary_type_error(char const * op, Value const & lhs, Value const & rhs);
+
+	/// Extract a number, or fail with a message naming \a what.
+	auto expect_number(Value const & value, char const * what) -> double;
+
+	/// Extract a boolean, or fail with a message naming \a what.
+	auto expect_boolean(Value const & value, char const * what) -> bool;
+
+	/// Extract a vector, or fail with a message naming \a what.
+	auto expect_vector(Value const & value, char const * what) -> Point;
+
+	inline auto add(Value const & lhs, Value const & rhs) -> Value {
+		if (lhs.is_number() && rhs.is_number()) {
+			return lhs.as_number() + rhs.as_number();
+		}
+		if (lhs.is_vector() && rhs.is_vector()) {
+			return Value(lhs.as_vector().x + rhs.as_vector().x, lhs.as_vector().y + rhs.as_vector().y);
+		}
+		binary_type_error("+", lhs, rhs);
+	}
+
+	inline auto subtract(Value const & lhs, Value const & rhs) -> Value {
+		if (lhs.is_number() && rhs.is_number()) {
+			return lhs.as_number() - rhs.as_number();
+		}
+		if (lhs.is_vector() && rhs.is_vector()) {
+			return Value(lhs.as_vector().x - rhs.as_vector().x, lhs.as_vector().y - rhs.as_vector().y);
+		}
+		binary_type_error("-", lhs, rhs);
+	}
+
+	inline auto multiply(Value const & lhs, Value const & rhs) -> Value {
+		if (lhs.is_number()) {
+			if (rhs.is_number()) {
+				return lhs.as_number() * rhs.as_number();
+			}
+			if (rhs.is_vector()) {
+				return Value(lhs.as_number() * rhs.as_vector().x, lhs.as_number() * rhs.as_vector().y);
+			}
+		} else if (lhs.is_vector() && rhs.is_number()) {
+			return Value(lhs.as_vector().x * rhs.as_number(), lhs.as_vector().y * rhs.as_number());
+		}
+		binary_type_error("*", lhs, rhs);
+	}
+
+	inline auto divide(Value const & lhs, Value const & rhs) -> Value {
+		if (lhs.is_number() && rhs.is_number()) {
+			return lhs.as_number() / rhs.as_number();
+		}
+		if (lhs.is_vector() && rhs.is_number()) {
+			return Value(lhs.as_vector().x / rhs.as_number(), lhs.as_vector().y / rhs.as_number());
+		}
+		binary_type_error("/", lhs, rhs);
+	}
+
+	inline auto modulo(Value const & lhs, Value const & rhs) -> Value {
+		if (lhs.is_number() && rhs.is_number()) {
+			return std::fmod(lhs.as_number(), rhs.as_number());
+		}
+		binary_type_error("%", lhs, rhs);
+	}
+
+	inline auto power(Value const & lhs, Value const & rhs) -> Value {
+		if (lhs.is_number() && rhs.is_number()) {
+			return std::pow(lhs.as_number(), rhs.as_number());
+		}
+		binary_type_error("**", lhs, rhs);
+	}
+
+	auto equal(Value const & lhs, Value const & rhs) -> bool;
+
+	inline auto less(Value const & lhs, Value const & rhs) -> Value {
+		if (lhs.is_number() && rhs.is_number()) {
+			return lhs.as_number() < rhs.as_number();
+		}
+		binary_type_error("<", lhs, rhs);
+	}
+
+	inline auto greater(Value const & lhs, Value const & rhs) -> Value {
+		if (lhs.is_number() && rhs.is_number()) {
+			return lhs.as_number() > rhs.as_number();
+		}
+		binary_type_error(">", lhs, rhs);
+	}
+
+	inline auto less_equal(Value const & lhs, Value const & rhs) -> Value {
+		if (lhs.is_number() && rhs.is_number()) {
+			return lhs.as_number() <= rhs.as_number();
+		}
+		binary_type_error("<=", lhs, rhs);
+	}
+
+	inline auto greater_equal(Value const & lhs, Value const & rhs) -> Value {
+		if (lhs.is_number() && rhs.is_number()) {
+			return lhs.as_number() >= rhs.as_number();
+		}
+		binary_type_error(">=", lhs, rhs);
+	}
+
+	inline auto logical_not(Value const & rhs) -> Value {
+		if (rhs.is_boolean()) {
+			return !rhs.as_boolean();
+		}
+		unary_type_error("!", rhs);
+	}
+
+	inline auto promote(Value const & rhs) -> Value {
+		if (rhs.is_number() || rhs.is_vector()) {
+			return rhs;
+		}
+		unary_type_error("+", rhs);
+	}
+
+	inline auto negate(Value const & rhs) -> Value {
+		if (rhs.is_number()) {
+			return -rhs.as_number();
+		}
+		if (rhs.is_vector()) {
+			return Value(-rhs.as_vector().x, -rhs.as_vector().y);
+		}
+		unary_type_error("-", rhs);
+	}
+
+	/// Component access: `vector[0]` is x, `vector[1]` is y.
+	auto index(Value const & var, Value const & index) -> Value;
+
+} // namespace br
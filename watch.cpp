@@ -0,0 +1,494 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <unordered_set>
+#include "builtin.hpp"
+#include "watch.hpp"
+
+#if defined(__linux__)
+#define RAPH_INOTIFY 1
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#define RAPH_INOTIFY 0
+#endif
+
+namespace br {
+
+	namespace {
+
+		/// How long a file must be left alone after a write before it is taken as saved.
+		constexpr int settle_milliseconds = 50;
+
+		/// 64-bit FNV-1a, fed a word at a time.
+		class Hash {
+		public:
+			Hash() noexcept : m_value(0xcbf29ce484222325) {
+			}
+
+			void mix(std::uint64_t word) noexcept {
+				for (auto i = 0; i < 8; ++i) {
+					m_value = (m_value ^ (word >> 8 * i & 0xFF)) * 0x100000001b3;
+				}
+			}
+
+			void mix(double number) noexcept {
+				std::uint64_t word;
+				std::memcpy(&word, &number, sizeof(word));
+				mix(word);
+			}
+
+			void mix(std::string const & text) noexcept {
+				mix(static_cast<std::uint64_t>(text.size()));
+				for (auto c : text) {
+					m_value = (m_value ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+				}
+			}
+
+			void mix(Value const & value) noexcept {
+				mix(static_cast<std::uint64_t>(value.type()));
+				switch (value.type()) {
+					case Value::Type::Void:
+						break;
+					case Value::Type::Number:
+						mix(value.as_number());
+						break;
+					case Value::Type::Boolean:
+						mix(static_cast<std::uint64_t>(value.as_boolean()));
+						break;
+					case Value::Type::Vector:
+						mix(value.as_vector().x);
+						mix(value.as_vector().y);
+						break;
+					case Value::Type::Function:
+						mix(static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(value.as_function())));
+						break;
+				}
+			}
+
+			auto value() const noexcept -> std::uint64_t {
+				return m_value;
+			}
+
+		private:
+			std::uint64_t m_value;
+		};
+
+		/** \brief Hashes a statement, without spans, and finds the variables it reads and assigns.
+		 **
+		 ** Slots are listed in the order they first appear in the tree, and the temporaries of the optimizer,
+		 ** named after their slot, are hashed by that order too, so that the key of a statement does not
+		 ** depend on the numbering of the rest of the program.
+		 */
+		class Fingerprint : public Walker {
+		public:
+			std::vector<std::uint32_t> reads, writes;
+			/// Whether the statement reads a property such as `rand`, whose value depends on the context.
+			bool random = false;
+
+			virtual void visit(Variable const & node) override {
+				kind(1);
+				name(node.id());
+				auto symbol = node.symbol();
+				if (symbol != nullptr) {
+					add(reads, m_read, symbol->slot);
+					random = random || (symbol->builtin != nullptr && symbol->builtin->kind == Builtin::Kind::Property);
+				}
+			}
+
+			virtual void visit(Constant const & node) override {
+				kind(2);
+				hash.mix(node.id());
+			}
+
+			virtual void visit(Numeric const & node) override {
+				kind(3);
+				hash.mix(node.value());
+			}
+
+			virtual void visit(Boolean const & node) override {
+				kind(4);
+				hash.mix(static_cast<std::uint64_t>(node.value()));
+			}
+
+			virtual void visit(Vector const & node) override {
+				kind(5);
+				Walker::visit(node);
+			}
+
+			virtual void visit(FunctionCall const & node) override {
+				kind(6);
+				hash.mix(static_cast<std::uint64_t>(node.args().size()));
+				Walker::visit(node);
+			}
+
+			virtual void visit(ArrayAccess const & node) override {
+				kind(7);
+				Walker::visit(node);
+			}
+
+			virtual void visit(UnaryOperation const & node) override {
+				kind(8);
+				hash.mix(static_cast<std::uint64_t>(node.op()));
+				Walker::visit(node);
+			}
+
+			virtual void visit(BinaryOperation const & node) override {
+				kind(9);
+				hash.mix(static_cast<std::uint64_t>(node.op()));
+				Walker::visit(node);
+			}
+
+			virtual void visit(EmptyStatement const & node) override {
+				kind(10);
+			}
+
+			virtual void visit(CompoundStatement const & node) override {
+				kind(11);
+				hash.mix(static_cast<std::uint64_t>(node.stmts().size()));
+				Walker::visit(node);
+			}
+
+			virtual void visit(ConditionalStatement const & node) override {
+				kind(12);
+				Walker::visit(node);
+			}
+
+			virtual void visit(WhileStatement const & node) override {
+				kind(13);
+				Walker::visit(node);
+			}
+
+			virtual void visit(UntilStatement const & node) override {
+				kind(14);
+				Walker::visit(node);
+			}
+
+			virtual void visit(ForStatement const & node) override {
+				kind(15);
+				name(node.id());
+				add(writes, m_written, node.slot());
+				Walker::visit(node);
+			}
+
+			virtual void visit(AssignStatement const & node) override {
+				kind(16);
+				name(node.id());
+				add(writes, m_written, node.slot());
+				Walker::visit(node);
+			}
+
+			virtual void visit(ExpressionStatement const & node) override {
+				kind(17);
+				Walker::visit(node);
+			}
+
+			/// The key of the statement when it starts in \a context.
+			auto key(Context const & context) const noexcept -> std::uint64_t {
+				auto key = hash;
+				auto mix = [&](std::uint32_t slot) {
+					auto value = context.variable(slot);
+					key.mix(static_cast<std::uint64_t>(value != nullptr));
+					if (value != nullptr) {
+						key.mix(*value);
+					}
+				};
+				// Points are drawn through the transform.
+				mix(origin_slot);
+				mix(scale_slot);
+				mix(rot_slot);
+				for (auto slot : reads) {
+					mix(slot);
+				}
+				if (random) {
+					key.mix(context.seed());
+					key.mix(context.randoms());
+				}
+				return key.value();
+			}
+
+		private:
+			void kind(std::uint64_t kind) noexcept {
+				hash.mix(kind);
+			}
+
+			void name(std::string const & id) {
+				if (id.empty() || id[0] != '$') {
+					hash.mix(id);
+					return;
+				}
+				auto index = m_temporaries.emplace(id, m_temporaries.size()).first->second;
+				hash.mix(std::string("$"));
+				hash.mix(static_cast<std::uint64_t>(index));
+			}
+
+			static void add(std::vector<std::uint32_t> & slots, std::unordered_set<std::uint32_t> & seen, std::uint32_t slot) {
+				if (slot != no_slot && seen.insert(slot).second) {
+					slots.push_back(slot);
+				}
+			}
+
+			Hash hash;
+			std::unordered_set<std::uint32_t> m_read, m_written;
+			/// Temporaries by name, numbered in the order they first appear.
+			std::unordered_map<std::string, std::uint64_t> m_temporaries;
+		};
+
+	} // namespace
+
+	constexpr std::size_t Tape::max_events;
+
+	constexpr std::size_t RenderCache::max_bytes;
+
+	Tape::Tape(Device & device) noexcept : m_device(device), m_events(nullptr), m_complete(true) {
+	}
+
+	Tape::~Tape() noexcept {
+	}
+
+	void Tape::clear(std::size_t width, std::size_t height) {
+		m_device.clear(width, height);
+		m_copy(Recorder::Event{Recorder::Event::Kind::Clear, static_cast<double>(width), static_cast<double>(height)});
+	}
+
+	void Tape::draw(double x, double y) {
+		m_device.draw(x, y);
+		m_copy(Recorder::Event{Recorder::Event::Kind::Draw, x, y});
+	}
+
+	void Tape::draw(double const * xs, double const * ys, std::size_t count) {
+		m_device.draw(xs, ys, count);
+		if (m_events != nullptr && m_events->size() + count > max_events) {
+			m_events = nullptr;
+			m_complete = false;
+		}
+		if (m_events != nullptr) {
+			for (std::size_t i = 0; i < count; ++i) {
+				m_events->push_back(Recorder::Event{Recorder::Event::Kind::Draw, xs[i], ys[i]});
+			}
+		}
+	}
+
+	void Tape::save() {
+		m_device.save();
+		m_copy(Recorder::Event{Recorder::Event::Kind::Save, 0.0, 0.0});
+	}
+
+	void Tape::record(std::vector<Recorder::Event> & events) noexcept {
+		m_events = &events;
+		m_complete = true;
+	}
+
+	auto Tape::stop() noexcept -> bool {
+		m_events = nullptr;
+		return m_complete;
+	}
+
+	void Tape::replay(std::vector<Recorder::Event> const & events) {
+		std::vector<double> xs, ys;
+		auto flush = [&]() {
+			m_device.draw(xs.data(), ys.data(), xs.size());
+			xs.clear();
+			ys.clear();
+		};
+		for (auto const & event : events) {
+			switch (event.kind) {
+				case Recorder::Event::Kind::Clear:
+					flush();
+					m_device.clear(static_cast<std::size_t>(event.x), static_cast<std::size_t>(event.y));
+					break;
+				case Recorder::Event::Kind::Draw:
+					xs.push_back(event.x);
+					ys.push_back(event.y);
+					break;
+				case Recorder::Event::Kind::Save:
+					flush();
+					m_device.save();
+					break;
+			}
+		}
+		flush();
+	}
+
+	void Tape::m_copy(Recorder::Event const & event) {
+		if (m_events == nullptr) {
+			return;
+		}
+		if (m_events->size() == max_events) {
+			m_events = nullptr;
+			m_complete = false;
+			return;
+		}
+		m_events->push_back(event);
+	}
+
+	auto RenderCache::run(Program const & program, Context & context, Tape & tape) -> Statistics {
+		Statistics statistics{0, 0};
+		std::unordered_map<std::uint64_t, Entry> used;
+		// What the entries in used take.
+		std::size_t bytes = 0;
+		context.flush();
+		try {
+			for (auto stmt : program.stmts()) {
+				Fingerprint fingerprint;
+				stmt->accept(fingerprint);
+				auto key = fingerprint.key(context);
+
+				auto entry = used.find(key);
+				if (entry == used.end()) {
+					auto found = m_entries.find(key);
+					if (found != m_entries.end()) {
+						bytes += found->second.bytes();
+						entry = used.emplace(key, std::move(found->second)).first;
+						m_entries.erase(found);
+					}
+				}
+				if (entry != used.end()) {
+					tape.replay(entry->second.events);
+					// Statements of the same key assign the same variables in the same order, up to renumbering.
+					auto const & writes = entry->second.writes;
+					for (std::size_t i = 0; i < writes.size(); ++i) {
+						auto const & write = writes[i];
+						auto slot = fingerprint.writes[i];
+						if (write.assigned) {
+							context.restore(slot, write.value);
+						} else {
+							context.unassign(slot);
+						}
+					}
+					context.randoms(context.randoms() + entry->second.randoms);
+					++statistics.replayed;
+					continue;
+				}
+
+				Entry recorded;
+				auto randoms = context.randoms();
+				tape.record(recorded.events);
+				stmt->invoke(context);
+				context.flush();
+				++statistics.run;
+				if (!tape.stop()) {
+					continue;
+				}
+				recorded.randoms = context.randoms() - randoms;
+				for (auto slot : fingerprint.writes) {
+					auto value = context.variable(slot);
+					recorded.writes.push_back(Write{value != nullptr, value != nullptr ? *value : Value()});
+				}
+				recorded.events.shrink_to_fit();
+				auto size = recorded.bytes();
+				if (bytes + size <= max_bytes && used.emplace(key, std::move(recorded)).second) {
+					bytes += size;
+				}
+			}
+		} catch (...) {
+			// The entries of the statements not reached are kept along with those of the statements before the
+			// error, so that the version after a fix runs no more than it would have without the error.
+			tape.stop();
+			for (auto & entry : m_entries) {
+				auto size = entry.second.bytes();
+				if (bytes + size <= max_bytes && used.emplace(entry.first, std::move(entry.second)).second) {
+					bytes += size;
+				}
+			}
+			m_entries.swap(used);
+			throw;
+		}
+		m_entries.swap(used);
+		return statistics;
+	}
+
+#if RAPH_INOTIFY
+
+	Watcher::Watcher(std::string const & path) : m_path(path), m_descriptor(inotify_init1(IN_CLOEXEC)) {
+		// The directory is watched rather than the file, which editors often replace instead of writing to.
+		auto slash = path.rfind('/');
+		auto directory = slash == std::string::npos ? std::string(".") : path.substr(0, slash + 1);
+		if (m_descriptor >= 0 && inotify_add_watch(m_descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+			close(m_descriptor);
+			m_descriptor = -1;
+		}
+	}
+
+	Watcher::~Watcher() noexcept {
+		if (m_descriptor >= 0) {
+			close(m_descriptor);
+		}
+	}
+
+	auto Watcher::wait() -> bool {
+		if (m_descriptor < 0) {
+			std::cerr << "cannot watch " << m_path << ": " << std::strerror(errno) << std::endl;
+			return false;
+		}
+		auto slash = m_path.rfind('/');
+		auto name = slash == std::string::npos ? m_path : m_path.substr(slash + 1);
+		alignas(inotify_event) char buffer[4096];
+		auto changed = false;
+		// Once the file has changed, wait for the writes to settle.
+		for (;;) {
+			pollfd descriptor{m_descriptor, POLLIN, 0};
+			auto ready = poll(&descriptor, 1, changed ? settle_milliseconds : -1);
+			if (ready == 0) {
+				return true;
+			}
+			if (ready < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				std::cerr << "cannot watch " << m_path << ": " << std::strerror(errno) << std::endl;
+				return false;
+			}
+			auto length = read(m_descriptor, buffer, sizeof(buffer));
+			if (length < 0) {
+				std::cerr << "cannot watch " << m_path << ": " << std::strerror(errno) << std::endl;
+				return false;
+			}
+			for (auto at = buffer; at < buffer + length; ) {
+				auto event = reinterpret_cast<inotify_event const *>(at);
+				changed = changed || (event->len > 0 && name == event->name);
+				at += sizeof(inotify_event) + event->len;
+			}
+		}
+	}
+
+#else
+
+	namespace {
+
+		/// How often a file is read again where it cannot be watched.
+		constexpr int poll_milliseconds = 200;
+
+		auto contents(std::string const & path) -> std::string {
+			std::ifstream stream(path, std::ios::binary);
+			return std::string((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+		}
+
+	} // namespace
+
+	Watcher::Watcher(std::string const & path) : m_path(path), m_descriptor(-1), m_contents(contents(path)) {
+	}
+
+	Watcher::~Watcher() noexcept {
+	}
+
+	auto Watcher::wait() -> bool {
+		for (;;) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(poll_milliseconds));
+			auto now = contents(m_path);
+			if (now != m_contents) {
+				m_contents = std::move(now);
+				std::this_thread::sleep_for(std::chrono::milliseconds(settle_milliseconds));
+				return true;
+			}
+		}
+	}
+
+#endif
+
+} // namespace br
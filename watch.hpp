@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.hpp"
+#include "context.hpp"
+#include "device.hpp"
+
+namespace br {
+
+	/// Hands every call on to another device, copying them while recording so that they can be replayed.
+	class Tape : public Device {
+	public:
+		/// Calls copied at most by one recording; a statement drawing more is run again rather than kept.
+		static constexpr std::size_t max_events = 1 << 22;
+
+		explicit Tape(Device & device) noexcept;
+
+		virtual ~Tape() noexcept;
+
+		virtual void clear(std::size_t width, std::size_t height) override;
+
+		virtual void draw(double x, double y) override;
+
+		virtual void draw(double const * xs, double const * ys, std::size_t count) override;
+
+		virtual void save() override;
+
+		/// Start copying calls into \a events.
+		void record(std::vector<Recorder::Event> & events) noexcept;
+
+		/// Stop recording. \return whether every call since record() was copied
+		auto stop() noexcept -> bool;
+
+		/// Hand \a events on to the device again.
+		void replay(std::vector<Recorder::Event> const & events);
+
+	private:
+		void m_copy(Recorder::Event const & event);
+
+		Device & m_device;
+		std::vector<Recorder::Event> * m_events;
+		bool m_complete;
+	}; // class Tape
+
+	/** \brief What each top-level statement of a program did in the last run, to replay in the next one.
+	 **
+	 ** A statement is known by a hash of its syntax tree, without spans, and of what it could depend on
+	 ** when it starts: the values of the variables it reads, the drawing transform and, if it reads
+	 ** `rand`, the position in the random stream. For each, the cache keeps what it handed to the device,
+	 ** the variables it assigns as they were after it and how many random numbers it took. A statement
+	 ** with the same key in the next run, however the rest of the script changed, is replayed from that
+	 ** instead of being run. Only the entries used by the last run are kept, or after a run that raised an
+	 ** error, those of the run before as well, as long as they fit in max_bytes. A statement recorded once
+	 ** the entries of a run take max_bytes is not kept, and runs again next time.
+	 */
+	class RenderCache {
+	public:
+		/// Bytes the entries take at most, in all.
+		static constexpr std::size_t max_bytes = std::size_t(1) << 29;
+
+		struct Statistics {
+			/// Statements run, and replayed from the cache.
+			std::size_t run, replayed;
+		};
+
+		/** \brief Run the statements of \a program in \a context, replaying those run before with the same inputs.
+		 **
+		 ** \param tape the device of \a context
+		 ** \throw RuntimeError as Program::invoke(); the statements before it are kept
+		 */
+		auto run(Program const & program, Context & context, Tape & tape) -> Statistics;
+
+	private:
+		/// A variable as a statement left it, in the order the statement first assigns them.
+		struct Write {
+			bool assigned;
+			Value value;
+		};
+
+		struct Entry {
+			std::vector<Recorder::Event> events;
+			std::vector<Write> writes;
+			/// Random numbers taken.
+			std::uint64_t randoms;
+
+			auto bytes() const noexcept -> std::size_t {
+				return sizeof(Entry) + events.capacity() * sizeof(Recorder::Event) + writes.capacity() * sizeof(Write);
+			}
+		};
+
+		std::unordered_map<std::uint64_t, Entry> m_entries;
+	}; // class RenderCache
+
+	/// Waits for a file to be written: with inotify on Linux, by reading it again now and then elsewhere.
+	class Watcher {
+	public:
+		explicit Watcher(std::string const & path);
+
+		Watcher(Watcher const &) = delete;
+
+		auto operator=(Watcher const &) -> Watcher & = delete;
+
+		~Watcher() noexcept;
+
+		/** \brief Block until the file has been written, or replaced as editors save, and the writes have settled.
+		 ** \return false if it cannot be watched, having said why on std::cerr
+		 */
+		auto wait() -> bool;
+
+	private:
+		std::string m_path;
+		/// The inotify instance, or -1 where there is none.
+		int m_descriptor;
+		/// The contents last seen, where the file is polled.
+		std::string m_contents;
+	}; // class Watcher
+
+} // namespace br